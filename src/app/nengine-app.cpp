@@ -1,5 +1,19 @@
 #include "../core/include/nengine.h"
+#include "../core/include/nengine-async-io.h"
+#include "../core/include/nengine-descriptor-slots.h"
+#include "../core/include/nengine-file-watcher.h"
+#include "../core/include/nengine-frame-fences.h"
+#include "../core/include/nengine-frustum.h"
+#include "../core/include/nengine-image-file.h"
+#include "../core/include/nengine-mesh-file.h"
+#include "../core/include/nengine-pak-file.h"
+#include "../core/include/nengine-pipeline-cache.h"
+#include "../core/include/nengine-profiler.h"
+#include "../core/include/nengine-render-graph.h"
+#include "../core/include/nengine-render-queue.h"
 #include "../core/include/nengine-shader-compiler.h"
+#include "../core/include/nengine-staging-ring.h"
+#include "../core/include/nengine-tlsf-allocator.h"
 #include "../utils/helpers.h"
 
 #ifdef __LINUX__
@@ -15,18 +29,30 @@
 #include <glm/glm.hpp>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <bitset>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <iostream>
+#include <iterator>
 #include <fstream>
 #include <filesystem>
+#include <future>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <queue>
+#include <semaphore>
 #include <set>
 #include <sstream>
 #include <string>
 #include <string.h>
+#include <thread>
+#include <utility>
 #include <vector>
 
 const nengine_utils::version nengine_app_version = { 0, 0, 1, 0};
@@ -36,13 +62,61 @@ const std::string applicationName = "NeNgine-app";
 const std::string engineName = "NeNgine";
 
 // Application State
-const int MAX_FRAMES_IN_FLIGHT = 2;
-const int FRAMES_BETWEEN_FPS_CALCULATIONS = 100;
-
-uint64_t application_last_fps_calculation_frame = 0;
-double application_last_measurement_time = 0.0;
-double application_current_fps = 0.0;
-double application_current_frame_time = 0.0;
+const int FRAMES_BETWEEN_FRAME_STATISTICS = 100;
+const uint32_t RENDER_COMMAND_QUEUE_CAPACITY = 4096;
+// How many frames the simulation may run ahead of the frame the render thread is drawing.
+const int SIMULATION_FRAMES_AHEAD = 1;
+// How often the shader reload thread looks for saved shaders.
+const std::chrono::milliseconds SHADER_RELOAD_POLL_INTERVAL(50);
+
+// The profiler's Chrome trace is written here on exit when set.
+std::filesystem::path application_trace_output_path;
+// Mesh files loaded at startup, one object per submesh.
+std::vector<std::filesystem::path> application_mesh_paths;
+// When the simulation of the next frame may start, from nengine_config.
+nengine_frame_wait application_frame_wait = NENGINE_FRAME_WAIT_PIPELINED;
+// Simulation state of the frame the main thread is preparing, interpolation_alpha blends the last two fixed ticks.
+nengine_frame_timing application_frame_timing;
+// Set when the window's framebuffer changed size, the swap chain is recreated before the next frame.
+std::atomic<bool> application_framebuffer_resized = false;
+// Last framebuffer size reported by GLFW. GLFW may only be queried on the main thread, the render thread reads these.
+std::atomic<int> application_framebuffer_width = 0;
+std::atomic<int> application_framebuffer_height = 0;
+
+// The main thread simulates and writes render commands, the render thread owns every Vulkan object after startup and
+// turns the commands into frames. Each END_FRAME pushed releases one queued frame, and the render thread releases a
+// frame slot once it starts drawing it, which bounds how far the simulation runs ahead.
+render_command_queue application_render_commands(RENDER_COMMAND_QUEUE_CAPACITY);
+std::counting_semaphore<> application_queued_frames{0};
+std::counting_semaphore<> application_frame_slots{SIMULATION_FRAMES_AHEAD};
+std::atomic<bool> application_render_thread_failed = false;
+std::exception_ptr application_render_thread_error;
+// Owned by the main thread, sent to the renderer every frame.
+glm::mat4 application_view_projection = glm::mat4(1.0f);
+
+// Shaders are watched for edits and rebuilt on their own thread, unless --no-shader-reload is passed.
+bool application_shader_reload_enabled = true;
+std::atomic<bool> application_shader_reload_stop = false;
+
+// Reads asset files in the background. Created right after the arguments are parsed, so the startup reads overlap
+// device initialization, and destroyed once no thread submits to it anymore.
+std::unique_ptr<async_io_service> application_io;
+
+// Headless runs render offscreen with no window, for batch renders and CI on software drivers such as lavapipe.
+bool application_headless = false;
+// Number of frames a headless run renders before exiting, 0 runs until killed.
+uint64_t application_headless_frame_limit = 0;
+// The last headless frame is written here as a binary PPM when set.
+std::filesystem::path application_headless_output_path;
+const VkFormat HEADLESS_IMAGE_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+
+const std::chrono::steady_clock::time_point application_start_time = std::chrono::steady_clock::now();
+
+// Seconds since startup. Independent of GLFW so the headless path, which never initializes it, has a clock too.
+double application_get_time()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - application_start_time).count();
+}
 
 // GLFW callbacks
 
@@ -57,6 +131,14 @@ void glfw_window_resize_callback(GLFWwindow* window, int width, int height)
     std::cout << applicationName << ": GLFW: glfwWindowSize: " << width << " x " << height << std::endl;
 }
 
+void glfw_framebuffer_resize_callback(GLFWwindow* window, int width, int height)
+{
+    UNUSED(window);
+    application_framebuffer_width = width;
+    application_framebuffer_height = height;
+    application_framebuffer_resized = true;
+}
+
 GLFWwindow* glfw_create_window(nengine_config& config)
 {
     // Create a window that we can manually setup a rendering surface on.
@@ -65,6 +147,13 @@ GLFWwindow* glfw_create_window(nengine_config& config)
 
     // Set window callbacks
     glfwSetWindowSizeCallback(window, glfw_window_resize_callback);
+    glfwSetFramebufferSizeCallback(window, glfw_framebuffer_resize_callback);
+
+    int width = 0;
+    int height = 0;
+    glfwGetFramebufferSize(window, &width, &height);
+    application_framebuffer_width = width;
+    application_framebuffer_height = height;
     return window;
 }
 
@@ -96,6 +185,10 @@ VkPhysicalDevice                        vulkan_physical_device          = VK_NUL
 VkDevice                                vulkan_device                   = VK_NULL_HANDLE;
 VkQueue                                 vulkan_graphics_queue           = VK_NULL_HANDLE;
 VkQueue                                 vulkan_present_queue            = VK_NULL_HANDLE;
+// A transfer only queue when the device has one, the graphics queue otherwise.
+VkQueue                                 vulkan_transfer_queue           = VK_NULL_HANDLE;
+uint32_t                                vulkan_graphics_queue_family    = 0;
+uint32_t                                vulkan_transfer_queue_family    = 0;
 VkSurfaceKHR                            vulkan_surface                  = VK_NULL_HANDLE;
 VkSwapchainKHR                          vulkan_swap_chain               = VK_NULL_HANDLE;
 VkFormat                                vulkan_swap_chain_image_format  = VK_FORMAT_UNDEFINED;
@@ -108,16 +201,352 @@ std::vector
 VkPipelineLayout                        vulkan_pipeline_layout          = VK_NULL_HANDLE;
 VkRenderPass                            vulkan_render_pass              = VK_NULL_HANDLE;
 VkPipeline                              vulkan_graphics_pipeline        = {};
+// Persisted between runs so pipelines compiled once are not compiled again.
+VkPipelineCache                         vulkan_pipeline_cache           = VK_NULL_HANDLE;
+std::unique_ptr<pipeline_cache_file>    vulkan_pipeline_cache_file      = {};
 std::vector<VkFramebuffer>              vulkan_swap_chain_framebuffers  = {};
-VkCommandPool                           vulkan_command_pool             = VK_NULL_HANDLE;
 std::vector<VkCommandBuffer>            vulkan_command_buffers          = {VK_NULL_HANDLE};
 VkClearValue                            vulkan_clear_color              = {.color = {.float32 = { 0.0f, 0.0f, 0.0f, 1.0f}}};
 std::vector<VkSemaphore>                vulkan_image_available_semaphores = {VK_NULL_HANDLE};
 std::vector<VkSemaphore>                vulkan_render_finished_semaphores = {VK_NULL_HANDLE};
 std::vector<VkFence>                    vulkan_in_flight_fences         = {VK_NULL_HANDLE};
+// Completed frames as seen through vulkan_in_flight_fences, retired resources are destroyed from it.
+std::unique_ptr<frame_fence_tracker>    vulkan_frame_fences             = {};
+// Frame pacing from nengine_config, with its latency mode applied.
+uint32_t                                vulkan_frames_in_flight         = 2;
+uint32_t                                vulkan_requested_swap_chain_image_count = 0;
+nengine_present_mode                    vulkan_requested_present_mode   = NENGINE_PRESENT_MODE_MAILBOX;
+
+// Input to present latency. Every present is tagged with an id (VK_KHR_present_id) and the render thread polls which
+// have reached the display (VK_KHR_present_wait), so a latency is measured up to a frame after the fact. Devices
+// without both extensions, and headless runs, measure nothing.
+struct VulkanPendingPresent
+{
+    uint64_t present_id;
+    // profiler::now() when the frame's input was sampled.
+    uint64_t input_time_ns;
+};
+
+bool                                    vulkan_present_latency_supported = false;
+PFN_vkWaitForPresentKHR                 vulkan_wait_for_present         = nullptr;
+uint64_t                                vulkan_last_present_id          = 0;
+std::deque<VulkanPendingPresent>        vulkan_pending_presents         = {};
+// Input time of the frame the render thread is drawing.
+uint64_t                                vulkan_frame_input_time_ns      = 0;
+
+// Device memory is allocated in large blocks per memory type and sub-allocated with TLSF. vkAllocateMemory costs
+// milliseconds and drivers cap the number of live allocations (maxMemoryAllocationCount, often 4096).
+const VkDeviceSize VULKAN_MEMORY_BLOCK_SIZE = 256 * 1024 * 1024;
+// Resources at least this large get a VkDeviceMemory of their own rather than most of a block.
+const VkDeviceSize VULKAN_DEDICATED_ALLOCATION_THRESHOLD = VULKAN_MEMORY_BLOCK_SIZE / 2;
+const uint32_t VULKAN_DEDICATED_ALLOCATION = UINT32_MAX;
+
+// Buffers and linear images must not share a bufferImageGranularity page with optimal tiling images, so the two
+// kinds are sub-allocated from separate blocks.
+enum VulkanResourceKind
+{
+    VULKAN_RESOURCE_LINEAR = 0,
+    VULKAN_RESOURCE_OPTIMAL = 1,
+    VULKAN_RESOURCE_KIND_COUNT = 2
+};
+
+struct VulkanMemoryBlock
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    std::unique_ptr<tlsf_allocator> allocator;
+    // Mapped for the block's whole lifetime when its memory type is host visible.
+    void* mapped = nullptr;
+};
+
+// Blocks of one memory type holding one resource kind. Released blocks leave an empty slot, so block indices
+// held by live allocations stay valid.
+struct VulkanMemoryPool
+{
+    std::vector<VulkanMemoryBlock> blocks;
+    VkDeviceSize block_size = 0;
+};
+
+struct VulkanAllocation
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    // Host pointer to offset, null unless the memory type is host visible.
+    void* mapped = nullptr;
+    uint32_t memory_type_index = 0;
+    VulkanResourceKind kind = VULKAN_RESOURCE_LINEAR;
+    uint32_t block_index = VULKAN_DEDICATED_ALLOCATION;
+    tlsf_allocation range = {};
+};
+
+VkPhysicalDeviceMemoryProperties        vulkan_memory_properties        = {};
+VkDeviceSize                            vulkan_buffer_image_granularity = 1;
+VkDeviceSize                            vulkan_non_coherent_atom_size   = 1;
+// One pool per memory type and resource kind, indexed memory_type_index * VULKAN_RESOURCE_KIND_COUNT + kind.
+std::vector<VulkanMemoryPool>           vulkan_memory_pools             = {};
+uint32_t                                vulkan_dedicated_allocation_count = 0;
+VkDeviceSize                            vulkan_dedicated_allocation_bytes = 0;
+
+// Draws recorded per secondary command buffer. Each one is a job, so scenes with fewer draws record on one thread.
+const uint32_t VULKAN_DRAWS_PER_RECORDING_JOB = 256;
+
+// Command pool of one recording thread for one frame in flight. Pools are reset as a whole once their frame has
+// retired, and the command buffers allocated from them are recycled rather than freed.
+struct VulkanThreadCommandPool
+{
+    VkCommandPool pool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> secondary_command_buffers;
+    uint32_t used_secondary_command_buffers = 0;
+};
+
+// One per frame in flight, each with a pool per job system thread and one for the render thread, which is not one of
+// them. Pools are never shared between threads, so recording needs no locks.
+std::vector<job_thread_storage<VulkanThreadCommandPool>> vulkan_thread_command_pools = {};
+
+// Mesh uploads. Copies are recorded on the transfer queue out of a persistently mapped staging ring and signal the
+// upload timeline semaphore, the render thread only ever polls it, so streaming never stalls a frame.
+const VkDeviceSize VULKAN_STAGING_RING_SIZE = 32 * 1024 * 1024;
+// Staging bytes copied per frame at most, larger uploads are spread over several frames.
+const VkDeviceSize VULKAN_UPLOAD_BYTES_PER_FRAME = 8 * 1024 * 1024;
+
+struct VulkanVertex
+{
+    glm::vec2 position;
+    glm::vec3 color;
+};
+
+// Part of a mesh drawn as one object, relative to the mesh's ranges.
+struct VulkanSubmesh
+{
+    uint32_t first_index = 0;
+    uint32_t index_count = 0;
+    int32_t vertex_offset = 0;
+    // Bounding sphere in object space, xyz center and w radius.
+    glm::vec4 bounds = glm::vec4(0.0f);
+};
+
+// All meshes share one vertex and one index buffer, so any number of them can be drawn with a single indirect call.
+struct VulkanMesh
+{
+    // Ranges of the shared buffers, in vertices and in indices.
+    tlsf_allocation vertex_range;
+    tlsf_allocation index_range;
+    std::vector<VulkanSubmesh> submeshes;
+    // Complete once no upload is pending and the upload timeline reached ready_timeline_value.
+    uint32_t pending_uploads = 0;
+    uint64_t ready_timeline_value = 0;
+};
+
+// Layout of one object in the object storage buffer, matches ObjectData in the shaders (std430).
+struct VulkanObjectData
+{
+    glm::mat4 transform;
+    glm::vec4 bounds;
+    uint32_t index_count;
+    uint32_t first_index;
+    int32_t vertex_offset;
+    uint32_t padding;
+};
+
+// An instance of a mesh in the scene. Drawable once its record reached the object buffer.
+struct VulkanObject
+{
+    VulkanObjectData data;
+    uint32_t pending_uploads = 0;
+    uint64_t ready_timeline_value = 0;
+};
+
+enum VulkanUploadTarget
+{
+    VULKAN_UPLOAD_MESH = 0,
+    VULKAN_UPLOAD_OBJECT = 1
+};
+
+// Data waiting for staging space, copied to destination in chunks as space frees up.
+struct VulkanPendingUpload
+{
+    // Either a copy held in data, or memory kept alive by source_owner such as a mapped mesh file, which is then
+    // copied straight into the staging ring.
+    const uint8_t* source = nullptr;
+    size_t size = 0;
+    std::vector<uint8_t> data;
+    std::shared_ptr<const void> source_owner;
+    VkBuffer destination = VK_NULL_HANDLE;
+    VkDeviceSize destination_offset = 0;
+    VkDeviceSize uploaded_bytes = 0;
+    // The mesh or object whose pending_uploads the upload counts towards.
+    VulkanUploadTarget target = VULKAN_UPLOAD_MESH;
+    uint32_t target_index = 0;
+};
+
+struct VulkanUploadCommandBuffer
+{
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    // Reusable once the upload timeline reached this value.
+    uint64_t timeline_value = 0;
+};
+
+VkCommandPool                           vulkan_transfer_command_pool    = VK_NULL_HANDLE;
+std::vector<VulkanUploadCommandBuffer>  vulkan_upload_command_buffers   = {};
+VkSemaphore                             vulkan_upload_timeline          = VK_NULL_HANDLE;
+// Value signaled by the most recently submitted upload batch.
+uint64_t                                vulkan_upload_timeline_submitted = 0;
+// Value observed at the start of the current frame, everything up to it has been copied.
+uint64_t                                vulkan_upload_timeline_completed = 0;
+VkBuffer                                vulkan_staging_buffer           = VK_NULL_HANDLE;
+VulkanAllocation                        vulkan_staging_allocation       = {};
+std::unique_ptr<staging_ring>           vulkan_staging_ring             = {};
+std::deque<VulkanPendingUpload>         vulkan_pending_uploads          = {};
+std::vector<VulkanMesh>                 vulkan_meshes                   = {};
+
+// Scene drawing. Objects live in a storage buffer. When the device supports indirect count draws, a compute pass
+// frustum culls them and writes one indexed indirect draw per visible object, and the frame issues a single
+// vkCmdDrawIndexedIndirectCount, so the CPU does no per object work. Otherwise the CPU culls them with the same test
+// and records one draw per visible object.
+const uint32_t VULKAN_MAX_OBJECTS = 64 * 1024;
+const uint32_t VULKAN_MAX_VERTICES = 1024 * 1024;
+const uint32_t VULKAN_MAX_INDICES = 4 * 1024 * 1024;
+// local_size_x of cull-objects.comp.
+const uint32_t VULKAN_CULL_GROUP_SIZE = 64;
+// Sizes of the bindless descriptor arrays, lowered to the device's update after bind limits.
+const uint32_t VULKAN_BINDLESS_BUFFER_COUNT = 16 * 1024;
+const uint32_t VULKAN_BINDLESS_TEXTURE_COUNT = 16 * 1024;
+const uint32_t VULKAN_BINDLESS_BUFFER_BINDING = 0;
+const uint32_t VULKAN_BINDLESS_TEXTURE_BINDING = 1;
+
+// Push constants of the cull pass and the vertex shader, which only declares the members up to object_buffer.
+// The buffers are slots in the bindless storage buffer array.
+struct VulkanSceneConstants
+{
+    glm::mat4 view_projection;
+    uint32_t object_count;
+    uint32_t object_buffer;
+    uint32_t draw_buffer;
+    uint32_t draw_count_buffer;
+};
+
+bool                                    vulkan_gpu_driven_draws         = false;
+glm::mat4                               vulkan_view_projection          = glm::mat4(1.0f);
+VkBuffer                                vulkan_vertex_buffer            = VK_NULL_HANDLE;
+VulkanAllocation                        vulkan_vertex_allocation        = {};
+std::unique_ptr<tlsf_allocator>         vulkan_vertex_ranges            = {};
+VkBuffer                                vulkan_index_buffer             = VK_NULL_HANDLE;
+VulkanAllocation                        vulkan_index_allocation         = {};
+std::unique_ptr<tlsf_allocator>         vulkan_index_ranges             = {};
+VkBuffer                                vulkan_object_buffer            = VK_NULL_HANDLE;
+VulkanAllocation                        vulkan_object_allocation        = {};
+std::vector<VulkanObject>               vulkan_objects                  = {};
+// Objects complete their uploads in creation order, [0, vulkan_ready_object_count) are drawable.
+uint32_t                                vulkan_ready_object_count       = 0;
+// One update after bind set holding every buffer and texture, bound once per command buffer.
+VkDescriptorSetLayout                   vulkan_descriptor_set_layout    = VK_NULL_HANDLE;
+VkDescriptorPool                        vulkan_descriptor_pool          = VK_NULL_HANDLE;
+VkDescriptorSet                         vulkan_bindless_descriptor_set  = VK_NULL_HANDLE;
+std::unique_ptr<descriptor_slot_allocator> vulkan_bindless_buffer_slots = {};
+uint32_t                                vulkan_object_buffer_slot       = 0;
+// Slots of the indirect draw and count buffers, one of each per frame in flight.
+std::vector<uint32_t>                   vulkan_indirect_draw_slots      = {};
+std::vector<uint32_t>                   vulkan_indirect_count_slots     = {};
+VkPipeline                              vulkan_cull_pipeline            = VK_NULL_HANDLE;
+// Written by the cull pass, one of each per frame in flight.
+std::vector<VkBuffer>                   vulkan_indirect_draw_buffers    = {};
+std::vector<VulkanAllocation>           vulkan_indirect_draw_allocations = {};
+std::vector<VkBuffer>                   vulkan_indirect_count_buffers   = {};
+std::vector<VulkanAllocation>           vulkan_indirect_count_allocations = {};
+
+// Headless render targets, one per frame in flight. They stand in for the swap chain images, so image views,
+// framebuffers and command recording are shared with the windowed path.
+std::vector<VkImage>                    vulkan_offscreen_images         = {};
+std::vector<VulkanAllocation>           vulkan_offscreen_image_allocations = {};
+// Host visible copies of each offscreen image, valid once the frame's fence has signaled.
+std::vector<VkBuffer>                   vulkan_readback_buffers         = {};
+std::vector<VulkanAllocation>           vulkan_readback_allocations     = {};
+
+// GPU timestamps bracketing the render pass, one query pool per frame in flight. Only created in profiling builds,
+// and only when the graphics queue supports timestamps.
+const uint32_t VULKAN_TIMESTAMP_QUERY_COUNT = 2;
+std::vector<VkQueryPool>                vulkan_timestamp_query_pools    = {};
+// profiler::now() when each slot's frame was submitted, 0 once its timestamps have been resolved.
+std::vector<uint64_t>                   vulkan_timestamp_submit_times   = {};
+double                                  vulkan_timestamp_period_ns      = 0.0;
+uint64_t                                vulkan_timestamp_valid_mask     = 0;
 
 uint64_t                                current_render_frame            = 0;
 
+// Fixed function variants of the graphics pipeline. All of them are created before the first frame, so switching
+// between them while rendering never compiles a pipeline.
+enum VulkanPipelinePermutation
+{
+    VULKAN_PIPELINE_OPAQUE = 0,
+    VULKAN_PIPELINE_ALPHA_BLENDED = 1,
+    VULKAN_PIPELINE_PERMUTATION_COUNT = 2
+};
+
+std::vector<VkPipeline>                 vulkan_graphics_pipelines       = {};
+
+// A swap chain replaced by vulkan_recreate_swap_chain, with everything that referenced its images. Frames recorded
+// before the replacement may still use them, so they are destroyed once those frames have retired.
+struct VulkanRetiredSwapChain
+{
+    VkSwapchainKHR swap_chain = VK_NULL_HANDLE;
+    std::vector<VkImageView> image_views;
+    std::vector<VkFramebuffer> framebuffers;
+    // Transient attachments of the frame graph built for the replaced swap chain.
+    std::vector<VkImage> transient_images;
+    std::vector<VulkanAllocation> transient_memory;
+    // First frame rendered to the replacement swap chain, every frame before it may use the old one.
+    uint64_t retire_frame = 0;
+};
+
+std::vector<VulkanRetiredSwapChain>     vulkan_retired_swap_chains      = {};
+
+// Pipelines built from edited shaders. An empty graphics_pipelines or a null cull_pipeline leaves the current one.
+struct VulkanPipelineSet
+{
+    std::vector<VkPipeline> graphics_pipelines;
+    VkPipeline cull_pipeline = VK_NULL_HANDLE;
+};
+
+// Pipelines replaced by a shader reload, destroyed once the frames recorded with them have retired.
+struct VulkanRetiredPipelines
+{
+    VulkanPipelineSet pipelines;
+    uint64_t retire_frame = 0;
+};
+
+// Written by the shader reload thread, taken by the render thread at the start of a frame.
+std::mutex                              vulkan_reloaded_pipelines_mutex;
+std::optional<VulkanPipelineSet>        vulkan_reloaded_pipelines       = {};
+std::vector<VulkanRetiredPipelines>     vulkan_retired_pipelines        = {};
+
+// Frame graph
+
+// What a pass needs to record its commands, handed to the graph's callbacks while recording a frame.
+struct VulkanRenderGraphContext
+{
+    nengine* engine = nullptr;
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    uint32_t image_index = 0;
+    uint32_t frame_index = 0;
+    const VkCommandBuffer* secondary_command_buffers = nullptr;
+    uint32_t secondary_command_buffer_count = 0;
+};
+
+struct VulkanRenderGraphAccess
+{
+    VkPipelineStageFlags stage;
+    VkAccessFlags access;
+    VkImageLayout layout;
+};
+
+render_graph                            vulkan_render_graph             = {};
+// The swap chain image, or headless offscreen image, being rendered to. It is resolved per frame from image_index.
+render_graph_resource                   vulkan_render_graph_backbuffer  = 0;
+// Indexed by graph resource, VK_NULL_HANDLE for imported resources.
+std::vector<VkImage>                    vulkan_render_graph_transient_images = {};
+// One allocation per memory slot, shared by the transient images aliased into it.
+std::vector<VulkanAllocation>           vulkan_render_graph_transient_memory = {};
+
 // Vulkan callbacks
 
 #ifndef NDEBUG
@@ -128,12 +557,26 @@ const std::vector<const char*> vulkan_required_validation_layers = {
 };
 #endif
 
-// Required extensions for vulkan devices
+// Required extensions for vulkan devices, the swap chain is only required when rendering to a window.
 const std::vector<const char*> vulkan_required_device_extensions = {
-    "VK_KHR_portability_subset",
     VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 };
 
+// Enabled when the device exposes them. The portability subset must be enabled on devices that report it (MoltenVK),
+// but does not exist on most others, lavapipe included.
+const std::vector<const char*> vulkan_optional_device_extensions = {
+    "VK_KHR_portability_subset",
+};
+
+std::vector<const char*> vulkan_get_required_device_extensions()
+{
+    if (application_headless)
+    {
+        return {};
+    }
+    return vulkan_required_device_extensions;
+}
+
 VkResult vulkan_CreateDebugUtilsMessengerEXT(const VkInstance& instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger) {
     auto func = (PFN_vkCreateDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
     if (func != nullptr) {
@@ -194,13 +637,17 @@ VkResult vulkan_initialize(VkInstance& instance)
     vulkan_create_info.pApplicationInfo = &vulkan_app_info;
 
     // Make sure our Vulkan instance supports all required GLFW extensions
-    unsigned int vulkan_enabled_extension_count;
+    unsigned int vulkan_enabled_extension_count = 0;
     std::vector<const char*> vulkan_enabled_extensions;
 
-    auto requiredInstanceExtensions = glfwGetRequiredInstanceExtensions(&vulkan_enabled_extension_count); 
-    for (unsigned int i = 0; i < static_cast<unsigned int>(vulkan_enabled_extension_count); ++i)
+    // headless rendering needs no surface extensions, and GLFW is never initialized to ask for them.
+    if (!application_headless)
     {
-        vulkan_enabled_extensions.push_back(requiredInstanceExtensions[i]);
+        auto requiredInstanceExtensions = glfwGetRequiredInstanceExtensions(&vulkan_enabled_extension_count); 
+        for (unsigned int i = 0; i < static_cast<unsigned int>(vulkan_enabled_extension_count); ++i)
+        {
+            vulkan_enabled_extensions.push_back(requiredInstanceExtensions[i]);
+        }
     }
 
     #ifndef NDEBUG
@@ -284,6 +731,8 @@ struct VulkanQueueFamilyIndices
 {
     std::optional<uint32_t> graphics_family;
     std::optional<uint32_t> present_family;
+    // Falls back to the graphics family, transfer is never what makes a device unusable.
+    std::optional<uint32_t> transfer_family;
 
     bool is_complete() {
         return graphics_family.has_value()
@@ -335,16 +784,35 @@ bool vulkan_find_queue_families(const VkPhysicalDevice& device, VulkanQueueFamil
             indices.graphics_family = i;
         }
 
+        // without a surface nothing is presented, the graphics queue stands in for the present queue.
         VkBool32 present_support = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_support);
+        if (surface != VK_NULL_HANDLE)
+        {
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_support);
+        }
+        else
+        {
+            present_support = (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+        }
         if (present_support)
         {
             indices.present_family = i;
         }
 
+        // a family without graphics or compute is the DMA engine, copies there run alongside rendering.
+        if ((queue_family.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queue_family.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+        {
+            indices.transfer_family = i;
+        }
+
         ++i;
     }
 
+    if (!indices.transfer_family.has_value())
+    {
+        indices.transfer_family = indices.graphics_family;
+    }
+
     if (!indices.is_complete())
     {
         std::ostringstream oss;
@@ -363,7 +831,8 @@ bool vulkan_check_device_extension_support(VkPhysicalDevice physical_device)
     std::vector<VkExtensionProperties> available_extensions(extension_count);
     vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, available_extensions.data());
 
-    std::set<std::string> required_device_extensions(vulkan_required_device_extensions.begin(), vulkan_required_device_extensions.end());
+    const std::vector<const char*> device_extensions = vulkan_get_required_device_extensions();
+    std::set<std::string> required_device_extensions(device_extensions.begin(), device_extensions.end());
     for (const auto& extension : available_extensions)
     {
         required_device_extensions.erase(extension.extensionName);
@@ -371,7 +840,7 @@ bool vulkan_check_device_extension_support(VkPhysicalDevice physical_device)
 
     std::cout << "\t\tDoes Device support required extensions? " << (required_device_extensions.empty() ? "YES" : "NO") << std::endl;
     std::cout << "\t\tRequired extensions:" << std::endl;
-    for(const auto& extension : vulkan_required_device_extensions)
+    for(const auto& extension : device_extensions)
     {
         std::cout << "\t\t\t" << extension << std::endl;
     }
@@ -433,23 +902,33 @@ VkSurfaceFormatKHR vulkan_choose_swap_surface_format(const std::vector<VkSurface
     return available_formats[0];
 }
 
-VkPresentModeKHR vulkan_choose_swap_present_mode(const std::vector<VkPresentModeKHR>& available_present_modes)
+// Picks the requested mode when the surface supports it. Mailbox and immediate fall back on each other before FIFO,
+// which every surface supports, so a request to not wait for vertical blank is honoured wherever possible.
+VkPresentModeKHR vulkan_choose_swap_present_mode(const std::vector<VkPresentModeKHR>& available_present_modes, nengine_present_mode requested_mode)
 {
-    VkPresentModeKHR best_mode = VK_PRESENT_MODE_FIFO_KHR;
+    std::vector<VkPresentModeKHR> preferred_modes;
+    switch (requested_mode)
+    {
+        case NENGINE_PRESENT_MODE_FIFO:
+            preferred_modes = {VK_PRESENT_MODE_FIFO_KHR};
+            break;
+        case NENGINE_PRESENT_MODE_MAILBOX:
+            preferred_modes = {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR};
+            break;
+        case NENGINE_PRESENT_MODE_IMMEDIATE:
+            preferred_modes = {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR};
+            break;
+    }
 
-    for (const auto& available_present_mode : available_present_modes)
+    for (VkPresentModeKHR preferred_mode : preferred_modes)
     {
-        if (available_present_mode == VK_PRESENT_MODE_MAILBOX_KHR)
-        {
-            return available_present_mode;
-        }
-        else if (available_present_mode == VK_PRESENT_MODE_IMMEDIATE_KHR)
+        if (std::find(available_present_modes.begin(), available_present_modes.end(), preferred_mode) != available_present_modes.end())
         {
-            best_mode = available_present_mode;
+            return preferred_mode;
         }
     }
 
-    return best_mode;
+    return VK_PRESENT_MODE_FIFO_KHR;
 }
 
 VkExtent2D vulkan_choose_swap_extent(const VkSurfaceCapabilitiesKHR& capabilities, const GLFWwindow* window)
@@ -460,9 +939,10 @@ VkExtent2D vulkan_choose_swap_extent(const VkSurfaceCapabilitiesKHR& capabilitie
     }
     else
     {
-        int width, height;
-        // due to GLFW api, we need to remove const here, even though the expectation is that this function does not modify the window pointer
-        glfwGetFramebufferSize((GLFWwindow*)window, &width, &height);
+        UNUSED(window);
+        // recreation runs on the render thread, where GLFW can not be queried.
+        const int width = application_framebuffer_width;
+        const int height = application_framebuffer_height;
 
         VkExtent2D actualExtent = 
         {
@@ -496,8 +976,32 @@ bool vulkan_is_physical_device_suitable(const VkPhysicalDevice& physical_device,
 
     bool extensions_supported = vulkan_check_device_extension_support(physical_device);
 
+    // uploads are synchronized with timeline semaphores, core since Vulkan 1.2.
+    VkPhysicalDeviceVulkan12Features vulkan_12_features{};
+    vulkan_12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 features_2{};
+    features_2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features_2.pNext = &vulkan_12_features;
+    vkGetPhysicalDeviceFeatures2(physical_device, &features_2);
+    std::cout << "\t\tSupports timeline semaphores? " << (vulkan_12_features.timelineSemaphore ? "YES" : "NO") << std::endl;
+    std::cout << "\t\tSupports indirect count draws? " << (vulkan_12_features.drawIndirectCount ? "YES" : "NO") << std::endl;
+
+    // every resource is reached through one bindless descriptor set that is updated while frames using it are in flight.
+    const bool bindless_supported = vulkan_12_features.runtimeDescriptorArray
+                                    && vulkan_12_features.descriptorBindingPartiallyBound
+                                    && vulkan_12_features.descriptorBindingUpdateUnusedWhilePending
+                                    && vulkan_12_features.descriptorBindingStorageBufferUpdateAfterBind
+                                    && vulkan_12_features.descriptorBindingSampledImageUpdateAfterBind
+                                    && vulkan_12_features.shaderSampledImageArrayNonUniformIndexing;
+    std::cout << "\t\tSupports bindless descriptors? " << (bindless_supported ? "YES" : "NO") << std::endl;
+
     bool swap_chain_is_adequate = false;
-    if (extensions_supported)
+    if (extensions_supported && surface == VK_NULL_HANDLE)
+    {
+        // headless, rendering goes to plain images and nothing is presented.
+        swap_chain_is_adequate = true;
+    }
+    else if (extensions_supported)
     {
         VulkanSwapChainSupportDetails swap_chain_support = vulkan_query_swap_chain_support_details(physical_device, surface);
         swap_chain_is_adequate = !swap_chain_support.formats.empty() && !swap_chain_support.present_modes.empty();
@@ -510,6 +1014,8 @@ bool vulkan_is_physical_device_suitable(const VkPhysicalDevice& physical_device,
     }
 
     return  device_queue_family_indices.is_complete()
+                && vulkan_12_features.timelineSemaphore
+                && bindless_supported
                 && extensions_supported
                 && swap_chain_is_adequate;
 }
@@ -639,7 +1145,7 @@ VkResult vulkan_initialize_debug_utils(const VkInstance& instance, VkDebugUtilsM
     return result;
 }
 
-void vulkan_create_logical_device(VkPhysicalDevice& physical_device, VkDevice& device, VkQueue& graphics_queue, VkQueue& present_queue, VkSurfaceKHR& surface)
+void vulkan_create_logical_device(VkPhysicalDevice& physical_device, VkDevice& device, VkQueue& graphics_queue, VkQueue& present_queue, VkQueue& transfer_queue, VkSurfaceKHR& surface)
 {
     std::cout << applicationName << ": Creating Vulkan logical device." << std::endl;
     
@@ -655,7 +1161,23 @@ void vulkan_create_logical_device(VkPhysicalDevice& physical_device, VkDevice& d
         std::cout << "\t" << extension.extensionName << std::endl;
     }
 
-    std::vector<const char*> device_extensions(vulkan_required_device_extensions); 
+    std::vector<const char*> device_extensions = vulkan_get_required_device_extensions();
+
+    uint32_t available_extension_count = 0;
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &available_extension_count, nullptr);
+    std::vector<VkExtensionProperties> available_extensions(available_extension_count);
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &available_extension_count, available_extensions.data());
+    for (const char* optional_extension : vulkan_optional_device_extensions)
+    {
+        for (const auto& extension : available_extensions)
+        {
+            if (strcmp(optional_extension, extension.extensionName) == 0)
+            {
+                device_extensions.push_back(optional_extension);
+                break;
+            }
+        }
+    }
 
     VulkanQueueFamilyIndices queue_family_indices;
     vulkan_find_queue_families(physical_device, queue_family_indices, surface);
@@ -663,8 +1185,11 @@ void vulkan_create_logical_device(VkPhysicalDevice& physical_device, VkDevice& d
 
     std::cout << "\t" << "Using Graphics Queue: " << queue_family_indices.graphics_family.value() << std::endl;
     std::cout << "\t" << "Using Present Queue: " << queue_family_indices.present_family.value() << std::endl;
+    std::cout << "\t" << "Using Transfer Queue: " << queue_family_indices.transfer_family.value() << std::endl;
 
-    std::set<uint32_t> unique_queue_families = {queue_family_indices.graphics_family.value(), queue_family_indices.present_family.value()};
+    std::set<uint32_t> unique_queue_families = {queue_family_indices.graphics_family.value(),
+                                                queue_family_indices.present_family.value(),
+                                                queue_family_indices.transfer_family.value()};
     std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
     float queuePriority = 1.0f;
     for (uint32_t queue_family : unique_queue_families) 
@@ -677,10 +1202,71 @@ void vulkan_create_logical_device(VkPhysicalDevice& physical_device, VkDevice& d
         queue_create_infos.push_back(queue_create_info);
     }
 
+    // GPU driven draws need indirect count draws, multi draw indirect, and object indices passed as firstInstance.
+    VkPhysicalDevicePresentWaitFeaturesKHR supported_present_wait_features{};
+    supported_present_wait_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    VkPhysicalDevicePresentIdFeaturesKHR supported_present_id_features{};
+    supported_present_id_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    supported_present_id_features.pNext = &supported_present_wait_features;
+    VkPhysicalDeviceVulkan12Features supported_vulkan_12_features{};
+    supported_vulkan_12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    supported_vulkan_12_features.pNext = &supported_present_id_features;
+    VkPhysicalDeviceFeatures2 supported_features{};
+    supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported_features.pNext = &supported_vulkan_12_features;
+    vkGetPhysicalDeviceFeatures2(physical_device, &supported_features);
+    vulkan_gpu_driven_draws =   supported_vulkan_12_features.drawIndirectCount
+                                && supported_features.features.multiDrawIndirect
+                                && supported_features.features.drawIndirectFirstInstance;
+    std::cout << "\t" << "GPU driven draws: " << (vulkan_gpu_driven_draws ? "YES" : "NO") << std::endl;
+
+    // both extensions depend on VK_KHR_swapchain, which headless devices do not enable.
+    auto is_extension_available = [&](const char* extension_name)
+    {
+        return std::any_of(available_extensions.begin(), available_extensions.end(), [&](const VkExtensionProperties& extension)
+        {
+            return strcmp(extension.extensionName, extension_name) == 0;
+        });
+    };
+    vulkan_present_latency_supported =  !application_headless
+                                        && is_extension_available("VK_KHR_present_id")
+                                        && is_extension_available("VK_KHR_present_wait")
+                                        && supported_present_id_features.presentId
+                                        && supported_present_wait_features.presentWait;
+    if (vulkan_present_latency_supported)
+    {
+        device_extensions.push_back("VK_KHR_present_id");
+        device_extensions.push_back("VK_KHR_present_wait");
+    }
+    std::cout << "\t" << "Input to present latency: " << (vulkan_present_latency_supported ? "YES" : "NO") << std::endl;
+
+    VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features{};
+    present_wait_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    present_wait_features.presentWait = VK_TRUE;
+    VkPhysicalDevicePresentIdFeaturesKHR present_id_features{};
+    present_id_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    present_id_features.pNext = &present_wait_features;
+    present_id_features.presentId = VK_TRUE;
+
     VkPhysicalDeviceFeatures physical_device_features = {};
+    physical_device_features.multiDrawIndirect = vulkan_gpu_driven_draws ? VK_TRUE : VK_FALSE;
+    physical_device_features.drawIndirectFirstInstance = vulkan_gpu_driven_draws ? VK_TRUE : VK_FALSE;
+
+    VkPhysicalDeviceVulkan12Features vulkan_12_features = {};
+    vulkan_12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan_12_features.timelineSemaphore = VK_TRUE;
+    vulkan_12_features.drawIndirectCount = vulkan_gpu_driven_draws ? VK_TRUE : VK_FALSE;
+    vulkan_12_features.runtimeDescriptorArray = VK_TRUE;
+    vulkan_12_features.descriptorBindingPartiallyBound = VK_TRUE;
+    vulkan_12_features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    vulkan_12_features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+    vulkan_12_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    vulkan_12_features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    vulkan_12_features.pNext = vulkan_present_latency_supported ? &present_id_features : nullptr;
 
     VkDeviceCreateInfo logical_device_create_info = {};
     logical_device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    logical_device_create_info.pNext = &vulkan_12_features;
     logical_device_create_info.pEnabledFeatures = &physical_device_features;
     logical_device_create_info.enabledExtensionCount = device_extensions.size();
     logical_device_create_info.ppEnabledExtensionNames = device_extensions.data();
@@ -707,8 +1293,17 @@ void vulkan_create_logical_device(VkPhysicalDevice& physical_device, VkDevice& d
         std::cout << "\t" << extensionName << std::endl;
     }
 
+    if (vulkan_present_latency_supported)
+    {
+        vulkan_wait_for_present = reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(device, "vkWaitForPresentKHR"));
+        vulkan_present_latency_supported = vulkan_wait_for_present != nullptr;
+    }
+
     vkGetDeviceQueue(device, queue_family_indices.graphics_family.value(), 0, &graphics_queue);
     vkGetDeviceQueue(device, queue_family_indices.present_family.value(), 0, &present_queue);
+    vkGetDeviceQueue(device, queue_family_indices.transfer_family.value(), 0, &transfer_queue);
+    vulkan_graphics_queue_family = queue_family_indices.graphics_family.value();
+    vulkan_transfer_queue_family = queue_family_indices.transfer_family.value();
 
     std::cout << applicationName << ": Using Graphics VkQueue: " << &graphics_queue << std::endl;
     std::cout << applicationName << ": Using Present VkQueue: " << &present_queue << std::endl;
@@ -722,17 +1317,19 @@ void vulkan_create_swap_chain(  const VkPhysicalDevice& physical_device,
                                 VkSwapchainKHR& swap_chain,
                                 VkFormat& swap_chain_image_format,
                                 VkExtent2D& swap_chain_extent,
-                                std::vector<VkImage> &swap_chain_images)
+                                std::vector<VkImage> &swap_chain_images,
+                                VkSwapchainKHR old_swap_chain = VK_NULL_HANDLE)
 {
     std::cout << applicationName << ": Creating Vulkan swap chain." << std::endl;
 
     VulkanSwapChainSupportDetails swap_chain_support = vulkan_query_swap_chain_support_details(physical_device, surface);
     VkSurfaceFormatKHR surface_format = vulkan_choose_swap_surface_format(swap_chain_support.formats);
-    VkPresentModeKHR present_mode = vulkan_choose_swap_present_mode(swap_chain_support.present_modes);
+    VkPresentModeKHR present_mode = vulkan_choose_swap_present_mode(swap_chain_support.present_modes, vulkan_requested_present_mode);
     VkExtent2D extent = vulkan_choose_swap_extent(swap_chain_support.capabilities, window);
     swap_chain_extent = extent;
 
-    uint32_t image_count = swap_chain_support.capabilities.minImageCount + 1;
+    uint32_t image_count = vulkan_requested_swap_chain_image_count > 0 ? vulkan_requested_swap_chain_image_count : swap_chain_support.capabilities.minImageCount + 1;
+    image_count = std::max(image_count, swap_chain_support.capabilities.minImageCount);
     if (swap_chain_support.capabilities.maxImageCount > 0 && image_count > swap_chain_support.capabilities.maxImageCount)
     {
         image_count = swap_chain_support.capabilities.maxImageCount;
@@ -771,7 +1368,8 @@ void vulkan_create_swap_chain(  const VkPhysicalDevice& physical_device,
     swap_chain_create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     swap_chain_create_info.presentMode = present_mode;
     swap_chain_create_info.clipped = VK_TRUE;
-    swap_chain_create_info.oldSwapchain = VK_NULL_HANDLE;
+    // lets the driver hand resources of the replaced swap chain over to the new one.
+    swap_chain_create_info.oldSwapchain = old_swap_chain;
 
     std::cout << applicationName << ": Creating Vulkan swap chain with the following properties:" << std::endl;
     std::cout << "\tVulkan Surface: " << swap_chain_create_info.surface << std::endl;
@@ -855,128 +1453,1067 @@ void vulkan_create_image_views( const VkDevice& device,
     std::cout << applicationName << ": Created Vulkan image views." << std::endl;
 }
 
-VkShaderModule vulkan_create_shader_module(const VkDevice& device, const std::vector<uint32_t>& shader_bytecode)
+std::optional<uint32_t> vulkan_find_memory_type(const VkPhysicalDevice& physical_device, uint32_t type_filter, VkMemoryPropertyFlags properties)
 {
-    VkShaderModuleCreateInfo create_info = {};
-    create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    create_info.codeSize = shader_bytecode.size() * sizeof(uint32_t);
-    create_info.pCode = shader_bytecode.data();
-    VkShaderModule shader_module;
-    if(vkCreateShaderModule(device, &create_info, nullptr, &shader_module) != VK_SUCCESS)
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i)
     {
-        std::ostringstream error_stream;
-        error_stream << applicationName << ": Vulkan - Failed to create shader module using bytecode: " << &shader_bytecode << std::endl;
-        throw std::runtime_error(error_stream.str());
+        if ((type_filter & (1u << i)) && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties)
+        {
+            return i;
+        }
     }
-    return shader_module;
+    return std::nullopt;
 }
 
-void vulkan_create_graphics_pipeline(VkPipelineLayout& pipeline_layout)
+void vulkan_initialize_memory_allocator()
 {
-    std::cout << applicationName << ": Creating Vulkan graphics pipeline." << std::endl;
-    
-        std::vector<VkDynamicState> dynamic_states = 
+    VkPhysicalDeviceProperties physical_device_properties;
+    vkGetPhysicalDeviceProperties(vulkan_physical_device, &physical_device_properties);
+    vkGetPhysicalDeviceMemoryProperties(vulkan_physical_device, &vulkan_memory_properties);
+    vulkan_buffer_image_granularity = std::max<VkDeviceSize>(physical_device_properties.limits.bufferImageGranularity, 1);
+    vulkan_non_coherent_atom_size = std::max<VkDeviceSize>(physical_device_properties.limits.nonCoherentAtomSize, 1);
+
+    vulkan_memory_pools.clear();
+    vulkan_memory_pools.resize(vulkan_memory_properties.memoryTypeCount * VULKAN_RESOURCE_KIND_COUNT);
+    for (uint32_t i = 0; i < vulkan_memory_properties.memoryTypeCount; ++i)
     {
-        VK_DYNAMIC_STATE_VIEWPORT,
-        VK_DYNAMIC_STATE_SCISSOR
-    };
+        // small heaps (e.g. the 256MB host visible device local window) would be exhausted by a single block.
+        const VkDeviceSize heap_size = vulkan_memory_properties.memoryHeaps[vulkan_memory_properties.memoryTypes[i].heapIndex].size;
+        for (uint32_t kind = 0; kind < VULKAN_RESOURCE_KIND_COUNT; ++kind)
+        {
+            vulkan_memory_pools[i * VULKAN_RESOURCE_KIND_COUNT + kind].block_size = std::min(VULKAN_MEMORY_BLOCK_SIZE, heap_size / 8);
+        }
+    }
 
-    VkPipelineDynamicStateCreateInfo dynamic_state_create_info{};
-    dynamic_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamic_state_create_info.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
-    dynamic_state_create_info.pDynamicStates = dynamic_states.data();
+    std::cout   << applicationName << ": Initialized Vulkan memory allocator for " << vulkan_memory_properties.memoryTypeCount
+                << " memory types, bufferImageGranularity " << vulkan_buffer_image_granularity
+                << ", maxMemoryAllocationCount " << physical_device_properties.limits.maxMemoryAllocationCount << "." << std::endl;
+}
 
-    VkPipelineVertexInputStateCreateInfo vertex_input_create_info{};
-    vertex_input_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertex_input_create_info.vertexBindingDescriptionCount = 0;
-    vertex_input_create_info.pVertexBindingDescriptions = nullptr;
-    vertex_input_create_info.vertexAttributeDescriptionCount = 0;
-    vertex_input_create_info.pVertexAttributeDescriptions = nullptr;
+std::optional<uint32_t> vulkan_find_allocation_memory_type(uint32_t type_filter, VkMemoryPropertyFlags required_properties, VkMemoryPropertyFlags preferred_properties)
+{
+    std::optional<uint32_t> memory_type = vulkan_find_memory_type(vulkan_physical_device, type_filter, required_properties | preferred_properties);
+    return memory_type.has_value() ? memory_type : vulkan_find_memory_type(vulkan_physical_device, type_filter, required_properties);
+}
 
-    VkPipelineInputAssemblyStateCreateInfo input_assembly_state_create_info{};
-    input_assembly_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    input_assembly_state_create_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    input_assembly_state_create_info.primitiveRestartEnable = VK_FALSE;
+VkDeviceMemory vulkan_allocate_device_memory(VkDeviceSize size, uint32_t memory_type_index, void** mapped)
+{
+    VkMemoryAllocateInfo allocate_info{};
+    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocate_info.allocationSize = size;
+    allocate_info.memoryTypeIndex = memory_type_index;
 
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;  
-    viewport.width = (float)vulkan_swap_chain_extent.width;
-    viewport.height = (float)vulkan_swap_chain_extent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    if (vkAllocateMemory(vulkan_device, &allocate_info, nullptr, &memory) != VK_SUCCESS)
+    {
+        return VK_NULL_HANDLE;
+    }
 
-    VkRect2D scissor{};
-    scissor.offset = {0, 0};
-    scissor.extent = vulkan_swap_chain_extent;
+    *mapped = nullptr;
+    if ((vulkan_memory_properties.memoryTypes[memory_type_index].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        && vkMapMemory(vulkan_device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS)
+    {
+        vkFreeMemory(vulkan_device, memory, nullptr);
+        return VK_NULL_HANDLE;
+    }
+    return memory;
+}
 
-    VkPipelineViewportStateCreateInfo viewport_state_create_info{};
-    viewport_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewport_state_create_info.viewportCount = 1;
-    viewport_state_create_info.pViewports = &viewport;
-    viewport_state_create_info.scissorCount = 1;
-    viewport_state_create_info.pScissors = &scissor;
+// Sub-allocates from an existing block of the pool, or allocates a new block when none has room.
+bool vulkan_allocate_from_pool(VulkanAllocation& allocation, const VkMemoryRequirements& requirements, VkDeviceSize alignment)
+{
+    VulkanMemoryPool& pool = vulkan_memory_pools[allocation.memory_type_index * VULKAN_RESOURCE_KIND_COUNT + allocation.kind];
 
-    VkPipelineRasterizationStateCreateInfo rasterization_state_create_info{};
-    rasterization_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterization_state_create_info.depthClampEnable = VK_FALSE;
-    rasterization_state_create_info.rasterizerDiscardEnable = VK_FALSE;
-    rasterization_state_create_info.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterization_state_create_info.lineWidth = 1.0f;
-    rasterization_state_create_info.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterization_state_create_info.frontFace = VK_FRONT_FACE_CLOCKWISE;
-    rasterization_state_create_info.depthBiasEnable = VK_FALSE;
-    rasterization_state_create_info.depthBiasConstantFactor = 0.0f;
-    rasterization_state_create_info.depthBiasClamp = 0.0f;
-    rasterization_state_create_info.depthBiasSlopeFactor = 0.0f;
+    auto allocate_from_block = [&](uint32_t block_index)
+    {
+        VulkanMemoryBlock& block = pool.blocks[block_index];
+        std::optional<tlsf_allocation> range = block.allocator->allocate(requirements.size, alignment);
+        if (!range.has_value())
+        {
+            return false;
+        }
+        allocation.memory = block.memory;
+        allocation.offset = range->offset;
+        allocation.mapped = block.mapped != nullptr ? static_cast<std::byte*>(block.mapped) + range->offset : nullptr;
+        allocation.block_index = block_index;
+        allocation.range = *range;
+        return true;
+    };
 
-    VkPipelineMultisampleStateCreateInfo multisample_state_create_info{};
-    multisample_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisample_state_create_info.sampleShadingEnable = VK_FALSE;
-    multisample_state_create_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-    multisample_state_create_info.minSampleShading = 1.0f;
-    multisample_state_create_info.pSampleMask = nullptr;
-    multisample_state_create_info.alphaToCoverageEnable = VK_FALSE;
-    multisample_state_create_info.alphaToOneEnable = VK_FALSE;
+    uint32_t empty_slot = VULKAN_DEDICATED_ALLOCATION;
+    for (uint32_t i = 0; i < pool.blocks.size(); ++i)
+    {
+        if (pool.blocks[i].memory == VK_NULL_HANDLE)
+        {
+            empty_slot = std::min(empty_slot, i);
+        }
+        else if (allocate_from_block(i))
+        {
+            return true;
+        }
+    }
 
-    VkPipelineDepthStencilStateCreateInfo depth_stencil_state_create_info {};
-    depth_stencil_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    depth_stencil_state_create_info.depthTestEnable = VK_FALSE;
-    depth_stencil_state_create_info.depthWriteEnable = VK_FALSE;
-    depth_stencil_state_create_info.depthCompareOp = VK_COMPARE_OP_LESS;
-    depth_stencil_state_create_info.depthBoundsTestEnable = VK_FALSE;
-    depth_stencil_state_create_info.stencilTestEnable = VK_FALSE;
+    VulkanMemoryBlock block;
+    block.memory = vulkan_allocate_device_memory(pool.block_size, allocation.memory_type_index, &block.mapped);
+    if (block.memory == VK_NULL_HANDLE)
+    {
+        return false;
+    }
+    block.allocator = std::make_unique<tlsf_allocator>(pool.block_size);
 
-    VkPipelineColorBlendAttachmentState color_blend_attachment_state_no_blending{};
-    color_blend_attachment_state_no_blending.colorWriteMask =     VK_COLOR_COMPONENT_R_BIT 
-                                                                | VK_COLOR_COMPONENT_G_BIT 
-                                                                | VK_COLOR_COMPONENT_B_BIT 
-                                                                | VK_COLOR_COMPONENT_A_BIT;
-    color_blend_attachment_state_no_blending.blendEnable = VK_FALSE;
-    color_blend_attachment_state_no_blending.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-    color_blend_attachment_state_no_blending.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
-    color_blend_attachment_state_no_blending.colorBlendOp = VK_BLEND_OP_ADD;
-    color_blend_attachment_state_no_blending.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    color_blend_attachment_state_no_blending.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    color_blend_attachment_state_no_blending.alphaBlendOp = VK_BLEND_OP_ADD;
-    
-    VkPipelineColorBlendAttachmentState color_blend_attachment_state_alpha_blending{};
-    color_blend_attachment_state_alpha_blending.colorWriteMask =     VK_COLOR_COMPONENT_R_BIT 
-                                                                | VK_COLOR_COMPONENT_G_BIT 
-                                                                | VK_COLOR_COMPONENT_B_BIT 
-                                                                | VK_COLOR_COMPONENT_A_BIT;
-    color_blend_attachment_state_alpha_blending.blendEnable = VK_TRUE;
-    color_blend_attachment_state_alpha_blending.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-    color_blend_attachment_state_alpha_blending.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-    color_blend_attachment_state_alpha_blending.colorBlendOp = VK_BLEND_OP_ADD;
-    color_blend_attachment_state_alpha_blending.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    color_blend_attachment_state_alpha_blending.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    color_blend_attachment_state_alpha_blending.alphaBlendOp = VK_BLEND_OP_ADD;
+    if (empty_slot == VULKAN_DEDICATED_ALLOCATION)
+    {
+        empty_slot = static_cast<uint32_t>(pool.blocks.size());
+        pool.blocks.push_back(std::move(block));
+    }
+    else
+    {
+        pool.blocks[empty_slot] = std::move(block);
+    }
+    return allocate_from_block(empty_slot);
+}
 
-    VkPipelineColorBlendStateCreateInfo color_blending_state_create_info{};
-    color_blending_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    color_blending_state_create_info.logicOpEnable = VK_FALSE;
-    color_blending_state_create_info.logicOp = VK_LOGIC_OP_COPY;
+// Picks the memory type, preferring required | preferred properties, and returns a range of it that satisfies
+// the requirements. Throws when the device is out of memory.
+VulkanAllocation vulkan_allocate_memory(const VkMemoryRequirements& requirements,
+                                        VkMemoryPropertyFlags required_properties,
+                                        VkMemoryPropertyFlags preferred_properties,
+                                        VulkanResourceKind kind)
+{
+    std::optional<uint32_t> memory_type = vulkan_find_allocation_memory_type(requirements.memoryTypeBits, required_properties, preferred_properties);
+    if (!memory_type.has_value())
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - No memory type with properties " << string_VkMemoryPropertyFlags(required_properties);
+        throw std::runtime_error(oss.str());
+    }
+
+    VulkanAllocation allocation;
+    allocation.memory_type_index = *memory_type;
+    allocation.size = requirements.size;
+    // a single resource kind per block makes bufferImageGranularity irrelevant, except when one kind ends up in
+    // both (granularity 1 devices do not care either way).
+    allocation.kind = vulkan_buffer_image_granularity > 1 ? kind : VULKAN_RESOURCE_LINEAR;
+
+    // ranges of non coherent memory are flushed in whole atoms, neighbours must not share one.
+    VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+    if (!(vulkan_memory_properties.memoryTypes[*memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+        && (vulkan_memory_properties.memoryTypes[*memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+    {
+        alignment = std::max(alignment, vulkan_non_coherent_atom_size);
+    }
+
+    const VulkanMemoryPool& pool = vulkan_memory_pools[allocation.memory_type_index * VULKAN_RESOURCE_KIND_COUNT + allocation.kind];
+    if (requirements.size < std::min(VULKAN_DEDICATED_ALLOCATION_THRESHOLD, pool.block_size)
+        && vulkan_allocate_from_pool(allocation, requirements, alignment))
+    {
+        return allocation;
+    }
+
+    allocation.memory = vulkan_allocate_device_memory(requirements.size, allocation.memory_type_index, &allocation.mapped);
+    if (allocation.memory == VK_NULL_HANDLE)
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Failed to allocate " << requirements.size << " bytes of memory type " << *memory_type;
+        throw std::runtime_error(oss.str());
+    }
+    vulkan_dedicated_allocation_count++;
+    vulkan_dedicated_allocation_bytes += requirements.size;
+    return allocation;
+}
+
+// The GPU must be done with the resource bound to the allocation.
+void vulkan_free_memory(VulkanAllocation& allocation)
+{
+    if (allocation.memory == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    if (allocation.block_index == VULKAN_DEDICATED_ALLOCATION)
+    {
+        vkFreeMemory(vulkan_device, allocation.memory, nullptr);
+        vulkan_dedicated_allocation_count--;
+        vulkan_dedicated_allocation_bytes -= allocation.size;
+    }
+    else
+    {
+        VulkanMemoryPool& pool = vulkan_memory_pools[allocation.memory_type_index * VULKAN_RESOURCE_KIND_COUNT + allocation.kind];
+        VulkanMemoryBlock& block = pool.blocks[allocation.block_index];
+        block.allocator->release(allocation.range);
+
+        // keep one block per pool around, so a resource created and destroyed every frame does not hit
+        // vkAllocateMemory each time.
+        const auto live_blocks = std::count_if(pool.blocks.begin(), pool.blocks.end(), [](const VulkanMemoryBlock& other) { return other.memory != VK_NULL_HANDLE; });
+        if (block.allocator->is_empty() && live_blocks > 1)
+        {
+            vkFreeMemory(vulkan_device, block.memory, nullptr);
+            block = VulkanMemoryBlock();
+        }
+    }
+    allocation = VulkanAllocation();
+}
+
+void vulkan_create_buffer(  VkDeviceSize size,
+                            VkBufferUsageFlags usage,
+                            VkMemoryPropertyFlags required_properties,
+                            VkMemoryPropertyFlags preferred_properties,
+                            VkBuffer& buffer,
+                            VulkanAllocation& allocation)
+{
+    VkBufferCreateInfo buffer_create_info{};
+    buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_create_info.size = size;
+    buffer_create_info.usage = usage;
+    buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    // buffers the transfer queue writes are shared with the graphics queue, rather than handed over with queue
+    // family ownership transfers on every upload.
+    const uint32_t queue_families[] = {vulkan_graphics_queue_family, vulkan_transfer_queue_family};
+    if ((usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT) && vulkan_graphics_queue_family != vulkan_transfer_queue_family)
+    {
+        buffer_create_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        buffer_create_info.queueFamilyIndexCount = 2;
+        buffer_create_info.pQueueFamilyIndices = queue_families;
+    }
+
+    if (vkCreateBuffer(vulkan_device, &buffer_create_info, nullptr, &buffer) != VK_SUCCESS)
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Failed to create buffer of " << size << " bytes.";
+        throw std::runtime_error(oss.str());
+    }
+
+    VkMemoryRequirements memory_requirements;
+    vkGetBufferMemoryRequirements(vulkan_device, buffer, &memory_requirements);
+    allocation = vulkan_allocate_memory(memory_requirements, required_properties, preferred_properties, VULKAN_RESOURCE_LINEAR);
+
+    if (vkBindBufferMemory(vulkan_device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS)
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Failed to bind buffer memory.";
+        throw std::runtime_error(oss.str());
+    }
+}
+
+void vulkan_create_image(   const VkImageCreateInfo& image_create_info,
+                            VkMemoryPropertyFlags required_properties,
+                            VkImage& image,
+                            VulkanAllocation& allocation)
+{
+    if (vkCreateImage(vulkan_device, &image_create_info, nullptr, &image) != VK_SUCCESS)
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Failed to create image.";
+        throw std::runtime_error(oss.str());
+    }
+
+    VkMemoryRequirements memory_requirements;
+    vkGetImageMemoryRequirements(vulkan_device, image, &memory_requirements);
+    allocation = vulkan_allocate_memory(memory_requirements,
+                                        required_properties,
+                                        0,
+                                        image_create_info.tiling == VK_IMAGE_TILING_OPTIMAL ? VULKAN_RESOURCE_OPTIMAL : VULKAN_RESOURCE_LINEAR);
+
+    if (vkBindImageMemory(vulkan_device, image, allocation.memory, allocation.offset) != VK_SUCCESS)
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Failed to bind image memory.";
+        throw std::runtime_error(oss.str());
+    }
+}
+
+void vulkan_destroy_buffer(VkBuffer& buffer, VulkanAllocation& allocation)
+{
+    vkDestroyBuffer(vulkan_device, buffer, nullptr);
+    vulkan_free_memory(allocation);
+    buffer = VK_NULL_HANDLE;
+}
+
+void vulkan_destroy_image(VkImage& image, VulkanAllocation& allocation)
+{
+    vkDestroyImage(vulkan_device, image, nullptr);
+    vulkan_free_memory(allocation);
+    image = VK_NULL_HANDLE;
+}
+
+void vulkan_print_memory_statistics()
+{
+    std::cout << applicationName << ": Vulkan memory" << std::endl;
+    for (uint32_t i = 0; i < vulkan_memory_pools.size(); ++i)
+    {
+        tlsf_statistics totals;
+        uint32_t block_count = 0;
+        for (const VulkanMemoryBlock& block : vulkan_memory_pools[i].blocks)
+        {
+            if (block.memory == VK_NULL_HANDLE)
+            {
+                continue;
+            }
+            const tlsf_statistics statistics = block.allocator->get_statistics();
+            totals.capacity += statistics.capacity;
+            totals.used_bytes += statistics.used_bytes;
+            totals.free_bytes += statistics.free_bytes;
+            totals.largest_free_range = std::max(totals.largest_free_range, statistics.largest_free_range);
+            totals.allocation_count += statistics.allocation_count;
+            totals.free_range_count += statistics.free_range_count;
+            block_count++;
+        }
+
+        if (block_count > 0)
+        {
+            std::cout   << "\tMemory type " << i / VULKAN_RESOURCE_KIND_COUNT
+                        << (i % VULKAN_RESOURCE_KIND_COUNT == VULKAN_RESOURCE_OPTIMAL ? " (optimal images)" : " (buffers)")
+                        << ": " << block_count << " blocks, " << totals.allocation_count << " allocations, "
+                        << totals.used_bytes << " / " << totals.capacity << " bytes used, "
+                        << totals.free_range_count << " free ranges, fragmentation " << totals.get_fragmentation() << std::endl;
+        }
+    }
+    std::cout   << "\tDedicated: " << vulkan_dedicated_allocation_count << " allocations, "
+                << vulkan_dedicated_allocation_bytes << " bytes" << std::endl;
+}
+
+void vulkan_destroy_memory_allocator()
+{
+    vulkan_print_memory_statistics();
+    for (VulkanMemoryPool& pool : vulkan_memory_pools)
+    {
+        for (VulkanMemoryBlock& block : pool.blocks)
+        {
+            if (block.memory != VK_NULL_HANDLE)
+            {
+                if (!block.allocator->is_empty())
+                {
+                    std::cerr << applicationName << ": Vulkan - Leaked " << block.allocator->get_used_bytes() << " bytes of device memory." << std::endl;
+                }
+                vkFreeMemory(vulkan_device, block.memory, nullptr);
+            }
+        }
+    }
+    vulkan_memory_pools.clear();
+}
+
+void vulkan_create_offscreen_targets(   const nengine_config& config,
+                                        VkFormat& image_format,
+                                        VkExtent2D& image_extent,
+                                        std::vector<VkImage>& images)
+{
+    std::cout << applicationName << ": Creating Vulkan offscreen render targets." << std::endl;
+
+    image_format = HEADLESS_IMAGE_FORMAT;
+    image_extent = {static_cast<uint32_t>(config.resolution[0]), static_cast<uint32_t>(config.resolution[1])};
+    const VkDeviceSize readback_size = static_cast<VkDeviceSize>(image_extent.width) * image_extent.height * 4;
+
+    vulkan_offscreen_images.resize(vulkan_frames_in_flight);
+    vulkan_offscreen_image_allocations.resize(vulkan_frames_in_flight);
+    vulkan_readback_buffers.resize(vulkan_frames_in_flight);
+    vulkan_readback_allocations.resize(vulkan_frames_in_flight);
+
+    for (size_t i = 0; i < vulkan_frames_in_flight; ++i)
+    {
+        VkImageCreateInfo image_create_info{};
+        image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_create_info.imageType = VK_IMAGE_TYPE_2D;
+        image_create_info.format = image_format;
+        image_create_info.extent = {image_extent.width, image_extent.height, 1};
+        image_create_info.mipLevels = 1;
+        image_create_info.arrayLayers = 1;
+        image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_create_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        vulkan_create_image(image_create_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vulkan_offscreen_images[i], vulkan_offscreen_image_allocations[i]);
+
+        // cached memory keeps CPU reads of the readback fast, fall back to whatever host visible memory exists.
+        vulkan_create_buffer(   readback_size,
+                                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+                                vulkan_readback_buffers[i],
+                                vulkan_readback_allocations[i]);
+    }
+
+    images = vulkan_offscreen_images;
+
+    std::cout << "\tImage Format: " << string_VkFormat(image_format) << std::endl;
+    std::cout << "\tImage Extent: " << image_extent.width << " x " << image_extent.height << std::endl;
+    std::cout << "\tImage Count: " << images.size() << std::endl;
+    std::cout << applicationName << ": Created Vulkan offscreen render targets." << std::endl;
+}
+
+void vulkan_create_upload_resources()
+{
+    std::cout << applicationName << ": Creating Vulkan upload resources." << std::endl;
+
+    VkCommandPoolCreateInfo command_pool_create_info{};
+    command_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    command_pool_create_info.queueFamilyIndex = vulkan_transfer_queue_family;
+
+    VkSemaphoreTypeCreateInfo semaphore_type_create_info{};
+    semaphore_type_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    semaphore_type_create_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    semaphore_type_create_info.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphore_create_info{};
+    semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_create_info.pNext = &semaphore_type_create_info;
+
+    if (vkCreateCommandPool(vulkan_device, &command_pool_create_info, nullptr, &vulkan_transfer_command_pool) != VK_SUCCESS
+        || vkCreateSemaphore(vulkan_device, &semaphore_create_info, nullptr, &vulkan_upload_timeline) != VK_SUCCESS)
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Failed to create upload command pool and timeline semaphore.";
+        throw std::runtime_error(oss.str());
+    }
+
+    vulkan_create_buffer(   VULKAN_STAGING_RING_SIZE,
+                            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                            0,
+                            vulkan_staging_buffer,
+                            vulkan_staging_allocation);
+    vulkan_staging_ring = std::make_unique<staging_ring>(VULKAN_STAGING_RING_SIZE);
+
+    std::cout   << applicationName << ": Created Vulkan upload resources, " << VULKAN_STAGING_RING_SIZE << " byte staging ring on queue family "
+                << vulkan_transfer_queue_family << "." << std::endl;
+}
+
+// Creates the bindless descriptor set: an array of storage buffers at binding 0 and of sampled textures at binding 1.
+// Unused elements may stay unwritten and elements no pending command buffer reads may be rewritten while the set is
+// bound, so resources are added without allocating or rebinding sets.
+void vulkan_create_bindless_descriptors()
+{
+    VkPhysicalDeviceVulkan12Properties vulkan_12_properties{};
+    vulkan_12_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+    VkPhysicalDeviceProperties2 device_properties{};
+    device_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    device_properties.pNext = &vulkan_12_properties;
+    vkGetPhysicalDeviceProperties2(vulkan_physical_device, &device_properties);
+
+    const uint32_t buffer_count = std::min({VULKAN_BINDLESS_BUFFER_COUNT,
+                                            vulkan_12_properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+                                            vulkan_12_properties.maxDescriptorSetUpdateAfterBindStorageBuffers});
+    const uint32_t texture_count = std::min({VULKAN_BINDLESS_TEXTURE_COUNT,
+                                            vulkan_12_properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                                            vulkan_12_properties.maxDescriptorSetUpdateAfterBindSampledImages});
+
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+    bindings[0].binding = VULKAN_BINDLESS_BUFFER_BINDING;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[0].descriptorCount = buffer_count;
+    bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+    bindings[1].binding = VULKAN_BINDLESS_TEXTURE_BINDING;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[1].descriptorCount = texture_count;
+    bindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+
+    const VkDescriptorBindingFlags binding_flag = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+                                                  | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT
+                                                  | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+    const std::array<VkDescriptorBindingFlags, 2> binding_flags{binding_flag, binding_flag};
+    VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_create_info{};
+    binding_flags_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    binding_flags_create_info.bindingCount = static_cast<uint32_t>(binding_flags.size());
+    binding_flags_create_info.pBindingFlags = binding_flags.data();
+
+    VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info{};
+    descriptor_set_layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptor_set_layout_create_info.pNext = &binding_flags_create_info;
+    descriptor_set_layout_create_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    descriptor_set_layout_create_info.bindingCount = static_cast<uint32_t>(bindings.size());
+    descriptor_set_layout_create_info.pBindings = bindings.data();
+
+    const std::array<VkDescriptorPoolSize, 2> pool_sizes{{
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, buffer_count},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, texture_count},
+    }};
+
+    VkDescriptorPoolCreateInfo descriptor_pool_create_info{};
+    descriptor_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptor_pool_create_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    descriptor_pool_create_info.maxSets = 1;
+    descriptor_pool_create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+    descriptor_pool_create_info.pPoolSizes = pool_sizes.data();
+
+    if (vkCreateDescriptorSetLayout(vulkan_device, &descriptor_set_layout_create_info, nullptr, &vulkan_descriptor_set_layout) != VK_SUCCESS
+        || vkCreateDescriptorPool(vulkan_device, &descriptor_pool_create_info, nullptr, &vulkan_descriptor_pool) != VK_SUCCESS)
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Failed to create bindless descriptor set layout and pool.";
+        throw std::runtime_error(oss.str());
+    }
+
+    VkDescriptorSetAllocateInfo descriptor_set_allocate_info{};
+    descriptor_set_allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptor_set_allocate_info.descriptorPool = vulkan_descriptor_pool;
+    descriptor_set_allocate_info.descriptorSetCount = 1;
+    descriptor_set_allocate_info.pSetLayouts = &vulkan_descriptor_set_layout;
+
+    if (vkAllocateDescriptorSets(vulkan_device, &descriptor_set_allocate_info, &vulkan_bindless_descriptor_set) != VK_SUCCESS)
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Failed to allocate bindless descriptor set.";
+        throw std::runtime_error(oss.str());
+    }
+
+    vulkan_bindless_buffer_slots = std::make_unique<descriptor_slot_allocator>(buffer_count);
+
+    std::cout   << applicationName << ": Created bindless descriptor set with " << buffer_count << " buffer and "
+                << texture_count << " texture slots." << std::endl;
+}
+
+// Writes the buffer into a free slot of the bindless buffer array and returns the slot shaders index it with.
+uint32_t vulkan_register_bindless_buffer(VkBuffer buffer)
+{
+    const std::optional<uint32_t> slot = vulkan_bindless_buffer_slots->allocate();
+    if (!slot)
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Out of bindless buffer slots, all " << vulkan_bindless_buffer_slots->get_capacity() << " are in use.";
+        throw std::runtime_error(oss.str());
+    }
+
+    const VkDescriptorBufferInfo buffer_info{buffer, 0, VK_WHOLE_SIZE};
+    VkWriteDescriptorSet descriptor_write{};
+    descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptor_write.dstSet = vulkan_bindless_descriptor_set;
+    descriptor_write.dstBinding = VULKAN_BINDLESS_BUFFER_BINDING;
+    descriptor_write.dstArrayElement = *slot;
+    descriptor_write.descriptorCount = 1;
+    descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptor_write.pBufferInfo = &buffer_info;
+    vkUpdateDescriptorSets(vulkan_device, 1, &descriptor_write, 0, nullptr);
+    return *slot;
+}
+
+// Creates the shared geometry and object buffers, the per frame indirect draw buffers the cull pass writes, and
+// registers them in the bindless descriptor set.
+void vulkan_create_scene_resources()
+{
+    std::cout << applicationName << ": Creating Vulkan scene resources." << std::endl;
+
+    vulkan_create_buffer(   static_cast<VkDeviceSize>(VULKAN_MAX_VERTICES) * sizeof(VulkanVertex),
+                            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                            0,
+                            vulkan_vertex_buffer,
+                            vulkan_vertex_allocation);
+    vulkan_create_buffer(   static_cast<VkDeviceSize>(VULKAN_MAX_INDICES) * sizeof(uint32_t),
+                            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                            0,
+                            vulkan_index_buffer,
+                            vulkan_index_allocation);
+    vulkan_create_buffer(   static_cast<VkDeviceSize>(VULKAN_MAX_OBJECTS) * sizeof(VulkanObjectData),
+                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                            0,
+                            vulkan_object_buffer,
+                            vulkan_object_allocation);
+    vulkan_vertex_ranges = std::make_unique<tlsf_allocator>(VULKAN_MAX_VERTICES);
+    vulkan_index_ranges = std::make_unique<tlsf_allocator>(VULKAN_MAX_INDICES);
+
+    vulkan_indirect_draw_buffers.resize(vulkan_frames_in_flight);
+    vulkan_indirect_draw_allocations.resize(vulkan_frames_in_flight);
+    vulkan_indirect_count_buffers.resize(vulkan_frames_in_flight);
+    vulkan_indirect_count_allocations.resize(vulkan_frames_in_flight);
+    for (size_t i = 0; i < vulkan_frames_in_flight; ++i)
+    {
+        vulkan_create_buffer(   static_cast<VkDeviceSize>(VULKAN_MAX_OBJECTS) * sizeof(VkDrawIndexedIndirectCommand),
+                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                0,
+                                vulkan_indirect_draw_buffers[i],
+                                vulkan_indirect_draw_allocations[i]);
+        vulkan_create_buffer(   sizeof(uint32_t),
+                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                0,
+                                vulkan_indirect_count_buffers[i],
+                                vulkan_indirect_count_allocations[i]);
+    }
+
+    vulkan_create_bindless_descriptors();
+    vulkan_object_buffer_slot = vulkan_register_bindless_buffer(vulkan_object_buffer);
+    vulkan_indirect_draw_slots.resize(vulkan_frames_in_flight);
+    vulkan_indirect_count_slots.resize(vulkan_frames_in_flight);
+    for (size_t i = 0; i < vulkan_frames_in_flight; ++i)
+    {
+        vulkan_indirect_draw_slots[i] = vulkan_register_bindless_buffer(vulkan_indirect_draw_buffers[i]);
+        vulkan_indirect_count_slots[i] = vulkan_register_bindless_buffer(vulkan_indirect_count_buffers[i]);
+    }
+
+    std::cout   << applicationName << ": Created Vulkan scene resources for " << VULKAN_MAX_OBJECTS << " objects, "
+                << VULKAN_MAX_VERTICES << " vertices and " << VULKAN_MAX_INDICES << " indices." << std::endl;
+}
+
+void vulkan_destroy_scene_resources()
+{
+    vkDestroyPipeline(vulkan_device, vulkan_cull_pipeline, nullptr);
+    vkDestroyDescriptorPool(vulkan_device, vulkan_descriptor_pool, nullptr);
+    vkDestroyDescriptorSetLayout(vulkan_device, vulkan_descriptor_set_layout, nullptr);
+    vulkan_bindless_descriptor_set = VK_NULL_HANDLE;
+    vulkan_bindless_buffer_slots.reset();
+    vulkan_indirect_draw_slots.clear();
+    vulkan_indirect_count_slots.clear();
+
+    for (size_t i = 0; i < vulkan_indirect_draw_buffers.size(); ++i)
+    {
+        vulkan_destroy_buffer(vulkan_indirect_draw_buffers[i], vulkan_indirect_draw_allocations[i]);
+        vulkan_destroy_buffer(vulkan_indirect_count_buffers[i], vulkan_indirect_count_allocations[i]);
+    }
+
+    if (vulkan_object_buffer != VK_NULL_HANDLE)
+    {
+        vulkan_destroy_buffer(vulkan_object_buffer, vulkan_object_allocation);
+        vulkan_destroy_buffer(vulkan_index_buffer, vulkan_index_allocation);
+        vulkan_destroy_buffer(vulkan_vertex_buffer, vulkan_vertex_allocation);
+    }
+    vulkan_objects.clear();
+    vulkan_meshes.clear();
+}
+
+// Queues size bytes at source for upload. Without a source_owner they are copied right away, otherwise the owner
+// keeps them alive and unchanged until they reached the staging ring.
+void vulkan_queue_upload(   const void* source,
+                            size_t size,
+                            VkBuffer destination,
+                            VkDeviceSize destination_offset,
+                            VulkanUploadTarget target,
+                            uint32_t target_index,
+                            std::shared_ptr<const void> source_owner = {})
+{
+    VulkanPendingUpload upload;
+    if (source_owner)
+    {
+        upload.source = static_cast<const uint8_t*>(source);
+        upload.source_owner = std::move(source_owner);
+    }
+    else
+    {
+        upload.data.assign(static_cast<const uint8_t*>(source), static_cast<const uint8_t*>(source) + size);
+        upload.source = upload.data.data();
+    }
+    upload.size = size;
+    upload.destination = destination;
+    upload.destination_offset = destination_offset;
+    upload.target = target;
+    upload.target_index = target_index;
+    vulkan_pending_uploads.push_back(std::move(upload));
+
+    if (target == VULKAN_UPLOAD_MESH)
+    {
+        vulkan_meshes[target_index].pending_uploads++;
+    }
+    else
+    {
+        vulkan_objects[target_index].pending_uploads++;
+    }
+}
+
+// Appends a mesh with room for its vertices and indices in the shared buffers. Throws without touching either buffer
+// when the mesh is empty or does not fit.
+VulkanMesh& vulkan_allocate_mesh(uint64_t vertex_count, uint64_t index_count)
+{
+    if (vertex_count == 0 || index_count == 0)
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Can not create a mesh with " << vertex_count << " vertices and " << index_count << " indices.";
+        throw std::invalid_argument(oss.str());
+    }
+
+    std::optional<tlsf_allocation> vertex_range = vulkan_vertex_ranges->allocate(vertex_count);
+    std::optional<tlsf_allocation> index_range = vulkan_index_ranges->allocate(index_count);
+    if (!vertex_range.has_value() || !index_range.has_value())
+    {
+        if (vertex_range.has_value())
+        {
+            vulkan_vertex_ranges->release(*vertex_range);
+        }
+        if (index_range.has_value())
+        {
+            vulkan_index_ranges->release(*index_range);
+        }
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Out of mesh space for " << vertex_count << " vertices and " << index_count << " indices.";
+        throw std::runtime_error(oss.str());
+    }
+
+    vulkan_meshes.emplace_back();
+    VulkanMesh& mesh = vulkan_meshes.back();
+    mesh.vertex_range = *vertex_range;
+    mesh.index_range = *index_range;
+    return mesh;
+}
+
+// Places the mesh in the shared vertex and index buffers and queues its contents for upload. Returns the mesh index.
+uint32_t vulkan_create_mesh(const std::vector<VulkanVertex>& vertices, const std::vector<uint32_t>& indices)
+{
+    const uint32_t mesh_index = static_cast<uint32_t>(vulkan_meshes.size());
+    VulkanMesh& mesh = vulkan_allocate_mesh(vertices.size(), indices.size());
+
+    // a sphere around the bounding box, loose but cheap to test.
+    glm::vec2 minimum(std::numeric_limits<float>::max());
+    glm::vec2 maximum(std::numeric_limits<float>::lowest());
+    for (const VulkanVertex& vertex : vertices)
+    {
+        minimum = glm::min(minimum, vertex.position);
+        maximum = glm::max(maximum, vertex.position);
+    }
+    VulkanSubmesh submesh;
+    submesh.index_count = static_cast<uint32_t>(indices.size());
+    submesh.bounds = glm::vec4((minimum + maximum) * 0.5f, 0.0f, glm::length(maximum - minimum) * 0.5f);
+    mesh.submeshes.push_back(submesh);
+
+    vulkan_queue_upload(vertices.data(), vertices.size() * sizeof(VulkanVertex), vulkan_vertex_buffer, mesh.vertex_range.offset * sizeof(VulkanVertex), VULKAN_UPLOAD_MESH, mesh_index);
+    vulkan_queue_upload(indices.data(), indices.size() * sizeof(uint32_t), vulkan_index_buffer, mesh.index_range.offset * sizeof(uint32_t), VULKAN_UPLOAD_MESH, mesh_index);
+    return mesh_index;
+}
+
+// Places a mapped mesh file in the shared vertex and index buffers. Its streams are copied from the mapping into the
+// staging ring as uploads proceed, the mesh file stays mapped until then. Returns the mesh index.
+uint32_t vulkan_create_mesh(std::shared_ptr<const mesh_file> file)
+{
+    const mesh_file_header& header = file->get_header();
+    if (header.vertex_stride != sizeof(VulkanVertex))
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Mesh file vertices are " << header.vertex_stride << " bytes, expected " << sizeof(VulkanVertex) << ".";
+        throw std::runtime_error(oss.str());
+    }
+
+    const uint32_t mesh_index = static_cast<uint32_t>(vulkan_meshes.size());
+    VulkanMesh& mesh = vulkan_allocate_mesh(header.vertex_count, header.index_count);
+    for (uint32_t i = 0; i < header.submesh_count; ++i)
+    {
+        const mesh_file_submesh& file_submesh = file->get_submeshes()[i];
+        VulkanSubmesh submesh;
+        submesh.first_index = file_submesh.first_index;
+        submesh.index_count = file_submesh.index_count;
+        submesh.vertex_offset = file_submesh.vertex_offset;
+        submesh.bounds = glm::vec4(file_submesh.bounds[0], file_submesh.bounds[1], file_submesh.bounds[2], file_submesh.bounds[3]);
+        mesh.submeshes.push_back(submesh);
+    }
+
+    vulkan_queue_upload(file->get_vertex_data(), file->get_vertex_data_size(), vulkan_vertex_buffer, mesh.vertex_range.offset * sizeof(VulkanVertex), VULKAN_UPLOAD_MESH, mesh_index, file);
+    vulkan_queue_upload(file->get_indices(), header.index_count * sizeof(uint32_t), vulkan_index_buffer, mesh.index_range.offset * sizeof(uint32_t), VULKAN_UPLOAD_MESH, mesh_index, file);
+    return mesh_index;
+}
+
+// Adds an instance of one of the mesh's submeshes to the scene and queues its record for upload. The object is drawn
+// from the first frame after the upload completed, its mesh was queued earlier and is complete by then.
+uint32_t vulkan_create_object(uint32_t mesh_index, const glm::mat4& transform, uint32_t submesh_index = 0)
+{
+    if (vulkan_objects.size() == VULKAN_MAX_OBJECTS)
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Scene is full, at most " << VULKAN_MAX_OBJECTS << " objects are supported.";
+        throw std::runtime_error(oss.str());
+    }
+
+    const VulkanMesh& mesh = vulkan_meshes[mesh_index];
+    const VulkanSubmesh& submesh = mesh.submeshes[submesh_index];
+    const uint32_t object_index = static_cast<uint32_t>(vulkan_objects.size());
+    vulkan_objects.emplace_back();
+    VulkanObject& object = vulkan_objects.back();
+    object.data.transform = transform;
+    object.data.bounds = submesh.bounds;
+    object.data.index_count = submesh.index_count;
+    object.data.first_index = static_cast<uint32_t>(mesh.index_range.offset) + submesh.first_index;
+    object.data.vertex_offset = static_cast<int32_t>(mesh.vertex_range.offset) + submesh.vertex_offset;
+    object.data.padding = 0;
+
+    vulkan_queue_upload(&object.data, sizeof(VulkanObjectData), vulkan_object_buffer, object_index * sizeof(VulkanObjectData), VULKAN_UPLOAD_OBJECT, object_index);
+    return object_index;
+}
+
+// Retires finished upload batches and submits the next one. Pending data is copied into the staging ring until the
+// ring is full or the per frame budget is spent, the rest waits for a later frame. Never waits on the GPU.
+void vulkan_process_uploads()
+{
+    PROFILE_ZONE("Process uploads");
+
+    vkGetSemaphoreCounterValue(vulkan_device, vulkan_upload_timeline, &vulkan_upload_timeline_completed);
+    vulkan_staging_ring->retire(vulkan_upload_timeline_completed);
+    while ( vulkan_ready_object_count < vulkan_objects.size()
+            && vulkan_objects[vulkan_ready_object_count].pending_uploads == 0
+            && vulkan_objects[vulkan_ready_object_count].ready_timeline_value <= vulkan_upload_timeline_completed)
+    {
+        vulkan_ready_object_count++;
+    }
+
+    if (vulkan_pending_uploads.empty())
+    {
+        return;
+    }
+
+    VulkanUploadCommandBuffer* upload_command_buffer = nullptr;
+    for (auto& candidate : vulkan_upload_command_buffers)
+    {
+        if (candidate.timeline_value <= vulkan_upload_timeline_completed)
+        {
+            upload_command_buffer = &candidate;
+            break;
+        }
+    }
+    if (upload_command_buffer == nullptr)
+    {
+        VkCommandBufferAllocateInfo command_buffer_allocate_info{};
+        command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        command_buffer_allocate_info.commandPool = vulkan_transfer_command_pool;
+        command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        command_buffer_allocate_info.commandBufferCount = 1;
+
+        VulkanUploadCommandBuffer new_command_buffer;
+        if (vkAllocateCommandBuffers(vulkan_device, &command_buffer_allocate_info, &new_command_buffer.command_buffer) != VK_SUCCESS)
+        {
+            std::ostringstream oss;
+            oss << applicationName << ": Vulkan - Failed to allocate upload command buffer.";
+            throw std::runtime_error(oss.str());
+        }
+        vulkan_upload_command_buffers.push_back(new_command_buffer);
+        upload_command_buffer = &vulkan_upload_command_buffers.back();
+    }
+
+    bool recording = false;
+    std::vector<std::pair<VulkanUploadTarget, uint32_t>> completed_targets;
+    VkDeviceSize budget = VULKAN_UPLOAD_BYTES_PER_FRAME;
+    while (!vulkan_pending_uploads.empty() && budget > 0)
+    {
+        VulkanPendingUpload& upload = vulkan_pending_uploads.front();
+        const VkDeviceSize chunk_size = std::min({static_cast<VkDeviceSize>(upload.size) - upload.uploaded_bytes,
+                                                  budget,
+                                                  VULKAN_STAGING_RING_SIZE / 4});
+        std::optional<uint64_t> staging_offset = vulkan_staging_ring->allocate(chunk_size, 16);
+        if (!staging_offset.has_value())
+        {
+            break;
+        }
+
+        if (!recording)
+        {
+            VkCommandBufferBeginInfo command_buffer_begin_info{};
+            command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            vkResetCommandBuffer(upload_command_buffer->command_buffer, 0);
+            vkBeginCommandBuffer(upload_command_buffer->command_buffer, &command_buffer_begin_info);
+            recording = true;
+        }
+
+        std::memcpy(static_cast<std::byte*>(vulkan_staging_allocation.mapped) + *staging_offset,
+                    upload.source + upload.uploaded_bytes,
+                    static_cast<size_t>(chunk_size));
+
+        VkBufferCopy copy_region{};
+        copy_region.srcOffset = *staging_offset;
+        copy_region.dstOffset = upload.destination_offset + upload.uploaded_bytes;
+        copy_region.size = chunk_size;
+        vkCmdCopyBuffer(upload_command_buffer->command_buffer, vulkan_staging_buffer, upload.destination, 1, &copy_region);
+
+        upload.uploaded_bytes += chunk_size;
+        budget -= chunk_size;
+        if (upload.uploaded_bytes == upload.size)
+        {
+            completed_targets.emplace_back(upload.target, upload.target_index);
+            vulkan_pending_uploads.pop_front();
+        }
+    }
+
+    if (!recording)
+    {
+        return;
+    }
+
+    if (vkEndCommandBuffer(upload_command_buffer->command_buffer) != VK_SUCCESS)
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Failed to record upload command buffer.";
+        throw std::runtime_error(oss.str());
+    }
+
+    const uint64_t signal_value = vulkan_upload_timeline_submitted + 1;
+    VkTimelineSemaphoreSubmitInfo timeline_submit_info{};
+    timeline_submit_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_submit_info.signalSemaphoreValueCount = 1;
+    timeline_submit_info.pSignalSemaphoreValues = &signal_value;
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_submit_info;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &upload_command_buffer->command_buffer;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &vulkan_upload_timeline;
+
+    if (vkQueueSubmit(vulkan_transfer_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS)
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Failed to submit upload command buffer.";
+        throw std::runtime_error(oss.str());
+    }
+
+    vulkan_upload_timeline_submitted = signal_value;
+    upload_command_buffer->timeline_value = signal_value;
+    vulkan_staging_ring->close_batch(signal_value);
+    for (const auto& [target, target_index] : completed_targets)
+    {
+        if (target == VULKAN_UPLOAD_MESH)
+        {
+            vulkan_meshes[target_index].pending_uploads--;
+            vulkan_meshes[target_index].ready_timeline_value = signal_value;
+        }
+        else
+        {
+            vulkan_objects[target_index].pending_uploads--;
+            vulkan_objects[target_index].ready_timeline_value = signal_value;
+        }
+    }
+}
+
+void vulkan_destroy_upload_resources()
+{
+    vulkan_pending_uploads.clear();
+
+    if (vulkan_staging_buffer != VK_NULL_HANDLE)
+    {
+        vulkan_destroy_buffer(vulkan_staging_buffer, vulkan_staging_allocation);
+    }
+    vulkan_upload_command_buffers.clear();
+    vkDestroyCommandPool(vulkan_device, vulkan_transfer_command_pool, nullptr);
+    vkDestroySemaphore(vulkan_device, vulkan_upload_timeline, nullptr);
+}
+
+VkShaderModule vulkan_create_shader_module(const VkDevice& device, const std::vector<uint32_t>& shader_bytecode)
+{
+    VkShaderModuleCreateInfo create_info = {};
+    create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    create_info.codeSize = shader_bytecode.size() * sizeof(uint32_t);
+    create_info.pCode = shader_bytecode.data();
+    VkShaderModule shader_module;
+    if(vkCreateShaderModule(device, &create_info, nullptr, &shader_module) != VK_SUCCESS)
+    {
+        std::ostringstream error_stream;
+        error_stream << applicationName << ": Vulkan - Failed to create shader module using bytecode: " << &shader_bytecode << std::endl;
+        throw std::runtime_error(error_stream.str());
+    }
+    return shader_module;
+}
+
+// Creates every graphics pipeline permutation from the vertex and fragment stages. Only reads objects that stay fixed
+// after startup, so shader hot reload calls it from its own thread.
+void vulkan_create_graphics_pipeline_permutations(  const std::vector<VkPipelineShaderStageCreateInfo>& shader_stages,
+                                                    VkPipelineLayout pipeline_layout,
+                                                    std::vector<VkPipeline>& out_pipelines)
+{
+        std::vector<VkDynamicState> dynamic_states = 
+    {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+
+    VkPipelineDynamicStateCreateInfo dynamic_state_create_info{};
+    dynamic_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state_create_info.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
+    dynamic_state_create_info.pDynamicStates = dynamic_states.data();
+
+    VkVertexInputBindingDescription vertex_binding_description{};
+    vertex_binding_description.binding = 0;
+    vertex_binding_description.stride = sizeof(VulkanVertex);
+    vertex_binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    std::array<VkVertexInputAttributeDescription, 2> vertex_attribute_descriptions{};
+    vertex_attribute_descriptions[0].binding = 0;
+    vertex_attribute_descriptions[0].location = 0;
+    vertex_attribute_descriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
+    vertex_attribute_descriptions[0].offset = offsetof(VulkanVertex, position);
+    vertex_attribute_descriptions[1].binding = 0;
+    vertex_attribute_descriptions[1].location = 1;
+    vertex_attribute_descriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+    vertex_attribute_descriptions[1].offset = offsetof(VulkanVertex, color);
+
+    VkPipelineVertexInputStateCreateInfo vertex_input_create_info{};
+    vertex_input_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertex_input_create_info.vertexBindingDescriptionCount = 1;
+    vertex_input_create_info.pVertexBindingDescriptions = &vertex_binding_description;
+    vertex_input_create_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertex_attribute_descriptions.size());
+    vertex_input_create_info.pVertexAttributeDescriptions = vertex_attribute_descriptions.data();
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly_state_create_info{};
+    input_assembly_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly_state_create_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    input_assembly_state_create_info.primitiveRestartEnable = VK_FALSE;
+
+    // viewport and scissor are dynamic state, set while recording, so the pipelines do not depend on the swap chain.
+    VkPipelineViewportStateCreateInfo viewport_state_create_info{};
+    viewport_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state_create_info.viewportCount = 1;
+    viewport_state_create_info.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterization_state_create_info{};
+    rasterization_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterization_state_create_info.depthClampEnable = VK_FALSE;
+    rasterization_state_create_info.rasterizerDiscardEnable = VK_FALSE;
+    rasterization_state_create_info.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterization_state_create_info.lineWidth = 1.0f;
+    rasterization_state_create_info.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterization_state_create_info.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    rasterization_state_create_info.depthBiasEnable = VK_FALSE;
+    rasterization_state_create_info.depthBiasConstantFactor = 0.0f;
+    rasterization_state_create_info.depthBiasClamp = 0.0f;
+    rasterization_state_create_info.depthBiasSlopeFactor = 0.0f;
+
+    VkPipelineMultisampleStateCreateInfo multisample_state_create_info{};
+    multisample_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisample_state_create_info.sampleShadingEnable = VK_FALSE;
+    multisample_state_create_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisample_state_create_info.minSampleShading = 1.0f;
+    multisample_state_create_info.pSampleMask = nullptr;
+    multisample_state_create_info.alphaToCoverageEnable = VK_FALSE;
+    multisample_state_create_info.alphaToOneEnable = VK_FALSE;
+
+    VkPipelineDepthStencilStateCreateInfo depth_stencil_state_create_info {};
+    depth_stencil_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil_state_create_info.depthTestEnable = VK_FALSE;
+    depth_stencil_state_create_info.depthWriteEnable = VK_FALSE;
+    depth_stencil_state_create_info.depthCompareOp = VK_COMPARE_OP_LESS;
+    depth_stencil_state_create_info.depthBoundsTestEnable = VK_FALSE;
+    depth_stencil_state_create_info.stencilTestEnable = VK_FALSE;
+
+    VkPipelineColorBlendAttachmentState color_blend_attachment_state_no_blending{};
+    color_blend_attachment_state_no_blending.colorWriteMask =     VK_COLOR_COMPONENT_R_BIT 
+                                                                | VK_COLOR_COMPONENT_G_BIT 
+                                                                | VK_COLOR_COMPONENT_B_BIT 
+                                                                | VK_COLOR_COMPONENT_A_BIT;
+    color_blend_attachment_state_no_blending.blendEnable = VK_FALSE;
+    color_blend_attachment_state_no_blending.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    color_blend_attachment_state_no_blending.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+    color_blend_attachment_state_no_blending.colorBlendOp = VK_BLEND_OP_ADD;
+    color_blend_attachment_state_no_blending.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    color_blend_attachment_state_no_blending.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    color_blend_attachment_state_no_blending.alphaBlendOp = VK_BLEND_OP_ADD;
+    
+    VkPipelineColorBlendAttachmentState color_blend_attachment_state_alpha_blending{};
+    color_blend_attachment_state_alpha_blending.colorWriteMask =     VK_COLOR_COMPONENT_R_BIT 
+                                                                | VK_COLOR_COMPONENT_G_BIT 
+                                                                | VK_COLOR_COMPONENT_B_BIT 
+                                                                | VK_COLOR_COMPONENT_A_BIT;
+    color_blend_attachment_state_alpha_blending.blendEnable = VK_TRUE;
+    color_blend_attachment_state_alpha_blending.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    color_blend_attachment_state_alpha_blending.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    color_blend_attachment_state_alpha_blending.colorBlendOp = VK_BLEND_OP_ADD;
+    color_blend_attachment_state_alpha_blending.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    color_blend_attachment_state_alpha_blending.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    color_blend_attachment_state_alpha_blending.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo color_blending_state_create_info{};
+    color_blending_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blending_state_create_info.logicOpEnable = VK_FALSE;
+    color_blending_state_create_info.logicOp = VK_LOGIC_OP_COPY;
     color_blending_state_create_info.attachmentCount = 1;
     color_blending_state_create_info.pAttachments = &color_blend_attachment_state_no_blending;
     color_blending_state_create_info.blendConstants[0] = 0.0f;
@@ -984,25 +2521,14 @@ void vulkan_create_graphics_pipeline(VkPipelineLayout& pipeline_layout)
     color_blending_state_create_info.blendConstants[2] = 0.0f;
     color_blending_state_create_info.blendConstants[3] = 0.0f;
 
-    VkPipelineLayoutCreateInfo pipeline_layout_create_info{};
-    pipeline_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipeline_layout_create_info.setLayoutCount = 0;
-    pipeline_layout_create_info.pSetLayouts = nullptr;
-    pipeline_layout_create_info.pushConstantRangeCount = 0;
-    pipeline_layout_create_info.pPushConstantRanges = nullptr;
-
-    if (vkCreatePipelineLayout(vulkan_device, &pipeline_layout_create_info, nullptr, &pipeline_layout) != VK_SUCCESS)
-    {
-        std::ostringstream oss;
-        oss << applicationName << ": Vulkan - Failed to create pipeline layout.";
-        throw std::runtime_error(oss.str());
-    }
+    VkPipelineColorBlendStateCreateInfo alpha_blending_state_create_info = color_blending_state_create_info;
+    alpha_blending_state_create_info.pAttachments = &color_blend_attachment_state_alpha_blending;
 
     VkGraphicsPipelineCreateInfo pipeline_create_info{};
     pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipeline_create_info.stageCount = 2;
     pipeline_create_info.pDynamicState = &dynamic_state_create_info;
-    pipeline_create_info.pStages = vulkan_shader_stages.data();
+    pipeline_create_info.stageCount = static_cast<uint32_t>(shader_stages.size());
+    pipeline_create_info.pStages = shader_stages.data();
     pipeline_create_info.pVertexInputState = &vertex_input_create_info;
     pipeline_create_info.pInputAssemblyState = &input_assembly_state_create_info;
     pipeline_create_info.pViewportState = &viewport_state_create_info;
@@ -1017,14 +2543,156 @@ void vulkan_create_graphics_pipeline(VkPipelineLayout& pipeline_layout)
     pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
     pipeline_create_info.basePipelineIndex = -1;
 
-    if (vkCreateGraphicsPipelines(vulkan_device, VK_NULL_HANDLE, 1, &pipeline_create_info, nullptr, &vulkan_graphics_pipeline) != VK_SUCCESS)
+    // warm up: every permutation is created here in one batch, through the pipeline cache, instead of on first use.
+    std::vector<VkGraphicsPipelineCreateInfo> permutation_create_infos(VULKAN_PIPELINE_PERMUTATION_COUNT, pipeline_create_info);
+    permutation_create_infos[VULKAN_PIPELINE_ALPHA_BLENDED].pColorBlendState = &alpha_blending_state_create_info;
+
+    out_pipelines.resize(VULKAN_PIPELINE_PERMUTATION_COUNT);
+    if (vkCreateGraphicsPipelines(  vulkan_device,
+                                    vulkan_pipeline_cache,
+                                    static_cast<uint32_t>(permutation_create_infos.size()),
+                                    permutation_create_infos.data(),
+                                    nullptr,
+                                    out_pipelines.data()) != VK_SUCCESS)
     {
         std::ostringstream oss;
         oss << applicationName << ": Vulkan - Failed to create graphics pipeline.";
         throw std::runtime_error(oss.str());
     }
+}
+
+void vulkan_create_graphics_pipeline(VkPipelineLayout& pipeline_layout)
+{
+    std::cout << applicationName << ": Creating Vulkan graphics pipeline." << std::endl;
+
+    // shared with the cull pipeline, so the scene descriptor set and constants are laid out the same for both.
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(VulkanSceneConstants);
+
+    VkPipelineLayoutCreateInfo pipeline_layout_create_info{};
+    pipeline_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_create_info.setLayoutCount = 1;
+    pipeline_layout_create_info.pSetLayouts = &vulkan_descriptor_set_layout;
+    pipeline_layout_create_info.pushConstantRangeCount = 1;
+    pipeline_layout_create_info.pPushConstantRanges = &push_constant_range;
+
+    if (vkCreatePipelineLayout(vulkan_device, &pipeline_layout_create_info, nullptr, &pipeline_layout) != VK_SUCCESS)
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Failed to create pipeline layout.";
+        throw std::runtime_error(oss.str());
+    }
+
+    const uint64_t warm_up_start_ns = profiler::now();
+    vulkan_create_graphics_pipeline_permutations(vulkan_shader_stages, pipeline_layout, vulkan_graphics_pipelines);
+    profiler::get().record_zone("Pipeline warm-up", warm_up_start_ns, profiler::now());
+    vulkan_graphics_pipeline = vulkan_graphics_pipelines[VULKAN_PIPELINE_OPAQUE];
+
+    std::cout   << applicationName << ": Created " << vulkan_graphics_pipelines.size() << " Vulkan graphics pipeline permutations in "
+                << static_cast<double>(profiler::now() - warm_up_start_ns) / 1e6 << " ms." << std::endl;
+}
+
+VkPipeline vulkan_create_cull_pipeline(const VkPipelineShaderStageCreateInfo& compute_shader_stage_info)
+{
+    VkComputePipelineCreateInfo pipeline_create_info{};
+    pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_create_info.stage = compute_shader_stage_info;
+    pipeline_create_info.layout = vulkan_pipeline_layout;
+    pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
+    pipeline_create_info.basePipelineIndex = -1;
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if (vkCreateComputePipelines(vulkan_device, vulkan_pipeline_cache, 1, &pipeline_create_info, nullptr, &pipeline) != VK_SUCCESS)
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Failed to create cull pipeline.";
+        throw std::runtime_error(oss.str());
+    }
+    return pipeline;
+}
+
+pipeline_cache_device_identity vulkan_get_pipeline_cache_identity(const VkPhysicalDevice& physical_device)
+{
+    VkPhysicalDeviceProperties physical_device_properties;
+    vkGetPhysicalDeviceProperties(physical_device, &physical_device_properties);
+
+    pipeline_cache_device_identity identity;
+    identity.vendor_id = physical_device_properties.vendorID;
+    identity.device_id = physical_device_properties.deviceID;
+    identity.driver_version = physical_device_properties.driverVersion;
+    std::copy(  std::begin(physical_device_properties.pipelineCacheUUID),
+                std::end(physical_device_properties.pipelineCacheUUID),
+                identity.pipeline_cache_uuid.begin());
+    return identity;
+}
+
+// The blob starts with VkPipelineCacheHeaderVersionOne. pipeline_cache_file already matched the device it was saved
+// for, this guards against drivers that disagree with their own reported properties.
+bool vulkan_is_pipeline_cache_data_compatible(const std::vector<uint8_t>& data, const pipeline_cache_device_identity& identity)
+{
+    const size_t header_size = 4 * sizeof(uint32_t) + PIPELINE_CACHE_UUID_SIZE;
+    if (data.size() < header_size)
+    {
+        return false;
+    }
+
+    uint32_t header_fields[4];
+    std::memcpy(header_fields, data.data(), sizeof(header_fields));
+    return header_fields[0] >= header_size
+        && header_fields[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && header_fields[2] == identity.vendor_id
+        && header_fields[3] == identity.device_id
+        && std::memcmp(data.data() + sizeof(header_fields), identity.pipeline_cache_uuid.data(), PIPELINE_CACHE_UUID_SIZE) == 0;
+}
+
+void vulkan_create_pipeline_cache(const std::filesystem::path& path)
+{
+    vulkan_pipeline_cache_file = std::make_unique<pipeline_cache_file>(path);
+    const pipeline_cache_device_identity identity = vulkan_get_pipeline_cache_identity(vulkan_physical_device);
+
+    std::optional<std::vector<uint8_t>> initial_data = vulkan_pipeline_cache_file->load(identity);
+    if (initial_data.has_value() && !vulkan_is_pipeline_cache_data_compatible(*initial_data, identity))
+    {
+        std::cout << applicationName << ": Vulkan - Pipeline cache header does not match the device, starting empty." << std::endl;
+        initial_data.reset();
+    }
+
+    VkPipelineCacheCreateInfo pipeline_cache_create_info{};
+    pipeline_cache_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    pipeline_cache_create_info.initialDataSize = initial_data.has_value() ? initial_data->size() : 0;
+    pipeline_cache_create_info.pInitialData = initial_data.has_value() ? initial_data->data() : nullptr;
+
+    if (vkCreatePipelineCache(vulkan_device, &pipeline_cache_create_info, nullptr, &vulkan_pipeline_cache) != VK_SUCCESS)
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Failed to create pipeline cache.";
+        throw std::runtime_error(oss.str());
+    }
+
+    std::cout   << applicationName << ": Created Vulkan pipeline cache from " << path << " ("
+                << pipeline_cache_create_info.initialDataSize << " bytes)." << std::endl;
+}
+
+void vulkan_save_pipeline_cache()
+{
+    if (vulkan_pipeline_cache == VK_NULL_HANDLE)
+    {
+        return;
+    }
 
-    std::cout << applicationName << ": Created Vulkan graphics pipeline." << std::endl;
+    size_t data_size = 0;
+    std::vector<uint8_t> data;
+    if (vkGetPipelineCacheData(vulkan_device, vulkan_pipeline_cache, &data_size, nullptr) == VK_SUCCESS)
+    {
+        data.resize(data_size);
+        if (vkGetPipelineCacheData(vulkan_device, vulkan_pipeline_cache, &data_size, data.data()) == VK_SUCCESS)
+        {
+            data.resize(data_size);
+            vulkan_pipeline_cache_file->save(vulkan_get_pipeline_cache_identity(vulkan_physical_device), data);
+        }
+    }
 }
 
 void vulkan_create_render_pass(VkRenderPass& render_pass)
@@ -1038,8 +2706,9 @@ void vulkan_create_render_pass(VkRenderPass& render_pass)
     color_attachment_description.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     color_attachment_description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     color_attachment_description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    color_attachment_description.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    color_attachment_description.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    // the frame graph transitions the attachment around the pass, so the pass itself never changes its layout.
+    color_attachment_description.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    color_attachment_description.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
     VkAttachmentReference color_attachment_reference{};
     color_attachment_reference.attachment = 0;
@@ -1056,20 +2725,7 @@ void vulkan_create_render_pass(VkRenderPass& render_pass)
     render_pass_create_info.pAttachments = &color_attachment_description;
     render_pass_create_info.subpassCount = 1;
     render_pass_create_info.pSubpasses = &subpass_description;
-
-    // Subpass dependencies
-    // Ensure the color buffer is propagated through the color subpass;
-    VkSubpassDependency subpass_dependency{};
-    subpass_dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    subpass_dependency.dstSubpass = 0;
-
-    subpass_dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    subpass_dependency.srcAccessMask = 0;
-    subpass_dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    subpass_dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-    render_pass_create_info.dependencyCount = 1;
-    render_pass_create_info.pDependencies = &subpass_dependency;
+    // no external subpass dependencies, the frame graph's barriers order everything before and after the pass.
 
     if(vkCreateRenderPass(vulkan_device, &render_pass_create_info, nullptr, &render_pass) != VK_SUCCESS)
     {
@@ -1085,98 +2741,421 @@ void vulkan_create_framebuffers(std::vector<VkFramebuffer>& framebuffers)
 {
     std::cout << applicationName << ": Creating Vulkan framebuffers." << std::endl;
 
-    framebuffers.resize(vulkan_swap_chain_image_views.size());
-    for (size_t i = 0; i < vulkan_swap_chain_image_views.size(); ++i)
+    framebuffers.resize(vulkan_swap_chain_image_views.size());
+    for (size_t i = 0; i < vulkan_swap_chain_image_views.size(); ++i)
+    {
+        VkImageView attachments[] = {vulkan_swap_chain_image_views[i]};
+        VkFramebufferCreateInfo framebuffer_create_info{};
+        framebuffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebuffer_create_info.renderPass = vulkan_render_pass;
+        framebuffer_create_info.attachmentCount = 1;
+        framebuffer_create_info.pAttachments = attachments;
+        framebuffer_create_info.width = vulkan_swap_chain_extent.width;
+        framebuffer_create_info.height = vulkan_swap_chain_extent.height;
+        framebuffer_create_info.layers = 1;
+
+        if (vkCreateFramebuffer(vulkan_device, &framebuffer_create_info, nullptr, &framebuffers[i]) != VK_SUCCESS)
+        {
+            std::ostringstream oss;
+            oss << applicationName << ": Vulkan - Failed to create framebuffer.";
+            throw std::runtime_error(oss.str());
+        }
+    }
+
+    std::cout << applicationName << ": Created Vulkan framebuffers." << std::endl;
+}
+
+VulkanRenderGraphAccess vulkan_get_render_graph_access(render_graph_access access)
+{
+    switch (access)
+    {
+        case RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT_WRITE:
+            return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+        case RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT_WRITE:
+            return {VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+        case RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT_READ:
+            return {VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+        case RENDER_GRAPH_ACCESS_SHADER_READ:
+            return {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        case RENDER_GRAPH_ACCESS_STORAGE_WRITE:
+            return {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL};
+        case RENDER_GRAPH_ACCESS_TRANSFER_READ:
+            return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL};
+        case RENDER_GRAPH_ACCESS_TRANSFER_WRITE:
+            return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL};
+        case RENDER_GRAPH_ACCESS_PRESENT:
+            // acquire and present are ordered by semaphores, the acquire semaphore is waited on at color output.
+            return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+        case RENDER_GRAPH_ACCESS_NONE:
+            break;
+    }
+    return {VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED};
+}
+
+VkImageUsageFlags vulkan_get_render_graph_image_usage(uint32_t access_mask)
+{
+    VkImageUsageFlags usage = 0;
+    if ((access_mask & RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT_WRITE) != 0)
+    {
+        usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    }
+    if ((access_mask & (RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT_WRITE | RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT_READ)) != 0)
+    {
+        usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    }
+    if ((access_mask & RENDER_GRAPH_ACCESS_SHADER_READ) != 0)
+    {
+        usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+    }
+    if ((access_mask & RENDER_GRAPH_ACCESS_STORAGE_WRITE) != 0)
+    {
+        usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+    }
+    if ((access_mask & RENDER_GRAPH_ACCESS_TRANSFER_READ) != 0)
+    {
+        usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    }
+    if ((access_mask & RENDER_GRAPH_ACCESS_TRANSFER_WRITE) != 0)
+    {
+        usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+    return usage;
+}
+
+// Records one batch of the graph's barriers as a single vkCmdPipelineBarrier.
+void vulkan_record_render_graph_barriers(void* context, const render_graph_barrier* barriers, size_t barrier_count)
+{
+    VulkanRenderGraphContext& graph_context = *static_cast<VulkanRenderGraphContext*>(context);
+
+    frame_vector<VkImageMemoryBarrier> image_barriers{frame_stl_allocator<VkImageMemoryBarrier>(graph_context.engine->get_frame_allocator())};
+    image_barriers.reserve(barrier_count);
+    VkPipelineStageFlags source_stages = 0;
+    VkPipelineStageFlags destination_stages = 0;
+
+    for (size_t i = 0; i < barrier_count; ++i)
+    {
+        const render_graph_barrier& barrier = barriers[i];
+        const VulkanRenderGraphAccess before = vulkan_get_render_graph_access(barrier.before);
+        const VulkanRenderGraphAccess after = vulkan_get_render_graph_access(barrier.after);
+        source_stages |= before.stage;
+        destination_stages |= after.stage;
+
+        const bool depth = (barrier.after & (RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT_WRITE | RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT_READ)) != 0;
+
+        VkImageMemoryBarrier image_barrier{};
+        image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        image_barrier.srcAccessMask = before.access;
+        image_barrier.dstAccessMask = after.access;
+        // discarded contents skip the layout transition, which also covers memory another aliased image used last.
+        image_barrier.oldLayout = barrier.discard ? VK_IMAGE_LAYOUT_UNDEFINED : before.layout;
+        image_barrier.newLayout = after.layout;
+        image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        image_barrier.image = barrier.resource == vulkan_render_graph_backbuffer ? vulkan_swap_chain_images[graph_context.image_index]
+                                                                                 : vulkan_render_graph_transient_images[barrier.resource];
+        image_barrier.subresourceRange.aspectMask = depth ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+        image_barrier.subresourceRange.baseMipLevel = 0;
+        image_barrier.subresourceRange.levelCount = 1;
+        image_barrier.subresourceRange.baseArrayLayer = 0;
+        image_barrier.subresourceRange.layerCount = 1;
+        image_barriers.push_back(image_barrier);
+    }
+
+    vkCmdPipelineBarrier(   graph_context.command_buffer,
+                            source_stages,
+                            destination_stages,
+                            0,
+                            0, nullptr,
+                            0, nullptr,
+                            static_cast<uint32_t>(image_barriers.size()), image_barriers.data());
+}
+
+void vulkan_destroy_render_graph_resources(std::vector<VkImage>& images, std::vector<VulkanAllocation>& memory)
+{
+    for (VkImage image : images)
+    {
+        vkDestroyImage(vulkan_device, image, nullptr);
+    }
+    for (VulkanAllocation& allocation : memory)
+    {
+        vulkan_free_memory(allocation);
+    }
+    images.clear();
+    memory.clear();
+}
+
+// Declares the frame's passes and realizes the transient attachments of the compiled graph. The swap chain's
+// format and extent are part of the graph, so it is rebuilt whenever the swap chain is replaced.
+void vulkan_build_render_graph()
+{
+    PROFILE_ZONE("Build render graph");
+    std::cout << applicationName << ": Building Vulkan frame graph." << std::endl;
+
+    vulkan_render_graph.clear();
+
+    const render_graph_texture_description backbuffer_description{  vulkan_swap_chain_extent.width,
+                                                                    vulkan_swap_chain_extent.height,
+                                                                    static_cast<uint32_t>(vulkan_swap_chain_image_format)};
+    // headless frames are left ready for the readback copy instead of being handed to the presentation engine.
+    const render_graph_access backbuffer_access = application_headless ? RENDER_GRAPH_ACCESS_TRANSFER_READ : RENDER_GRAPH_ACCESS_PRESENT;
+    vulkan_render_graph_backbuffer = vulkan_render_graph.import_texture("Backbuffer", backbuffer_description, backbuffer_access, backbuffer_access);
+
+    render_graph_pass scene_pass = vulkan_render_graph.add_pass("Scene", [](void* context)
+    {
+        const VulkanRenderGraphContext& graph_context = *static_cast<const VulkanRenderGraphContext*>(context);
+
+        VkRenderPassBeginInfo render_pass_begin_info{};
+        render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        render_pass_begin_info.renderPass = vulkan_render_pass;
+        render_pass_begin_info.framebuffer = vulkan_swap_chain_framebuffers[graph_context.image_index];
+        render_pass_begin_info.renderArea.offset = {0, 0};
+        render_pass_begin_info.renderArea.extent = vulkan_swap_chain_extent;
+        render_pass_begin_info.clearValueCount = 1;
+        render_pass_begin_info.pClearValues = &vulkan_clear_color;
+
+        vkCmdBeginRenderPass(graph_context.command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        if (graph_context.secondary_command_buffer_count > 0)
+        {
+            vkCmdExecuteCommands(graph_context.command_buffer, graph_context.secondary_command_buffer_count, graph_context.secondary_command_buffers);
+        }
+        vkCmdEndRenderPass(graph_context.command_buffer);
+    });
+    vulkan_render_graph.write(scene_pass, vulkan_render_graph_backbuffer, RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT_WRITE);
+
+    if (application_headless)
     {
-        VkImageView attachments[] = {vulkan_swap_chain_image_views[i]};
-        VkFramebufferCreateInfo framebuffer_create_info{};
-        framebuffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebuffer_create_info.renderPass = vulkan_render_pass;
-        framebuffer_create_info.attachmentCount = 1;
-        framebuffer_create_info.pAttachments = attachments;
-        framebuffer_create_info.width = vulkan_swap_chain_extent.width;
-        framebuffer_create_info.height = vulkan_swap_chain_extent.height;
-        framebuffer_create_info.layers = 1;
+        // nothing in the graph consumes the copy, the host does.
+        render_graph_pass readback_pass = vulkan_render_graph.add_pass("Readback", [](void* context)
+        {
+            const VulkanRenderGraphContext& graph_context = *static_cast<const VulkanRenderGraphContext*>(context);
+
+            // copy the image out as tightly packed rows.
+            VkBufferImageCopy copy_region{};
+            copy_region.bufferOffset = 0;
+            copy_region.bufferRowLength = 0;
+            copy_region.bufferImageHeight = 0;
+            copy_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            copy_region.imageSubresource.mipLevel = 0;
+            copy_region.imageSubresource.baseArrayLayer = 0;
+            copy_region.imageSubresource.layerCount = 1;
+            copy_region.imageOffset = {0, 0, 0};
+            copy_region.imageExtent = {vulkan_swap_chain_extent.width, vulkan_swap_chain_extent.height, 1};
+            vkCmdCopyImageToBuffer( graph_context.command_buffer,
+                                    vulkan_offscreen_images[graph_context.image_index],
+                                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                    vulkan_readback_buffers[graph_context.image_index],
+                                    1,
+                                    &copy_region);
+
+            // make the copy visible to the host once the frame's fence signals.
+            VkMemoryBarrier host_read_barrier{};
+            host_read_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            host_read_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            host_read_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+            vkCmdPipelineBarrier(graph_context.command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &host_read_barrier, 0, nullptr, 0, nullptr);
+        });
+        vulkan_render_graph.read(readback_pass, vulkan_render_graph_backbuffer, RENDER_GRAPH_ACCESS_TRANSFER_READ);
+        vulkan_render_graph.set_side_effects(readback_pass);
+    }
 
-        if (vkCreateFramebuffer(vulkan_device, &framebuffer_create_info, nullptr, &framebuffers[i]) != VK_SUCCESS)
+    // transient images are created while compiling, the graph needs their memory requirements to alias them.
+    vulkan_render_graph_transient_images.assign(vulkan_render_graph.get_resource_count(), VK_NULL_HANDLE);
+    vulkan_render_graph.compile([](render_graph_resource resource, const render_graph_resource_info& info)
+    {
+        VkImageCreateInfo image_create_info{};
+        image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_create_info.imageType = VK_IMAGE_TYPE_2D;
+        image_create_info.format = static_cast<VkFormat>(info.description.format);
+        image_create_info.extent = {info.description.width, info.description.height, 1};
+        image_create_info.mipLevels = 1;
+        image_create_info.arrayLayers = 1;
+        image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_create_info.usage = vulkan_get_render_graph_image_usage(info.access_mask);
+        image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        if (vkCreateImage(vulkan_device, &image_create_info, nullptr, &vulkan_render_graph_transient_images[resource]) != VK_SUCCESS)
         {
             std::ostringstream oss;
-            oss << applicationName << ": Vulkan - Failed to create framebuffer.";
+            oss << applicationName << ": Vulkan - Failed to create frame graph image " << info.name;
             throw std::runtime_error(oss.str());
         }
+
+        VkMemoryRequirements memory_requirements;
+        vkGetImageMemoryRequirements(vulkan_device, vulkan_render_graph_transient_images[resource], &memory_requirements);
+        return render_graph_memory_requirements{memory_requirements.size, memory_requirements.alignment, memory_requirements.memoryTypeBits};
+    });
+
+    // images sharing a memory slot are bound to the same range, their lifetimes never overlap within a frame.
+    for (const render_graph_memory_slot& slot : vulkan_render_graph.get_memory_slots())
+    {
+        VkMemoryRequirements slot_requirements{slot.requirements.size, slot.requirements.alignment, slot.requirements.memory_type_bits};
+        vulkan_render_graph_transient_memory.push_back(vulkan_allocate_memory(slot_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, VULKAN_RESOURCE_OPTIMAL));
+        const VulkanAllocation& allocation = vulkan_render_graph_transient_memory.back();
+        for (render_graph_resource resource : slot.resources)
+        {
+            if (vkBindImageMemory(vulkan_device, vulkan_render_graph_transient_images[resource], allocation.memory, allocation.offset) != VK_SUCCESS)
+            {
+                std::ostringstream oss;
+                oss << applicationName << ": Vulkan - Failed to bind frame graph image memory.";
+                throw std::runtime_error(oss.str());
+            }
+        }
     }
 
-    std::cout << applicationName << ": Created Vulkan framebuffers." << std::endl;
+    size_t pass_count = 0;
+    for (const auto& level : vulkan_render_graph.get_levels())
+    {
+        pass_count += level.size();
+    }
+    std::cout << "\tPasses: " << pass_count << " in " << vulkan_render_graph.get_levels().size() << " levels" << std::endl;
+    std::cout << "\tBarriers per frame: " << vulkan_render_graph.get_barrier_count() << std::endl;
+    std::cout << "\tTransient memory: " << vulkan_render_graph.get_aliased_memory_bytes() << " bytes, "
+              << vulkan_render_graph.get_unaliased_memory_bytes() << " without aliasing" << std::endl;
+    std::cout << applicationName << ": Built Vulkan frame graph." << std::endl;
 }
 
-void vulkan_create_command_pool(VkCommandPool& command_pool)
+void vulkan_create_command_pools(const job_system& jobs)
 {
-    std::cout << applicationName << ": Creating Vulkan command pool." << std::endl;
+    std::cout << applicationName << ": Creating Vulkan command pools." << std::endl;
 
     VulkanQueueFamilyIndices queue_family_indices; 
     vulkan_find_queue_families(vulkan_physical_device, queue_family_indices, vulkan_surface);
 
     VkCommandPoolCreateInfo command_pool_create_info{};
     command_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
     command_pool_create_info.queueFamilyIndex = queue_family_indices.graphics_family.value();
 
-    if(vkCreateCommandPool(vulkan_device, &command_pool_create_info, nullptr, &command_pool) != VK_SUCCESS)
+    vulkan_thread_command_pools.assign(vulkan_frames_in_flight, job_thread_storage<VulkanThreadCommandPool>(jobs));
+    for (auto& frame_command_pools : vulkan_thread_command_pools)
     {
-        std::ostringstream oss;
-        oss << applicationName << ": Vulkan - Failed to create command pool.";
-        throw std::runtime_error(oss.str());
+        for (auto& thread_command_pool : frame_command_pools)
+        {
+            if(vkCreateCommandPool(vulkan_device, &command_pool_create_info, nullptr, &thread_command_pool.pool) != VK_SUCCESS)
+            {
+                std::ostringstream oss;
+                oss << applicationName << ": Vulkan - Failed to create command pool.";
+                throw std::runtime_error(oss.str());
+            }
+        }
     }
 
-    std::cout << applicationName << ": Created Vulkan command pool." << std::endl;
+    std::cout   << applicationName << ": Created " << vulkan_frames_in_flight << " x " << vulkan_thread_command_pools.front().size()
+                << " Vulkan command pools, one per frame in flight and recording thread." << std::endl;
+}
+
+// Resets every pool of the frame slot in one call each, its previous frame must have retired.
+void vulkan_reset_frame_command_pools(uint32_t frame_index)
+{
+    for (auto& thread_command_pool : vulkan_thread_command_pools[frame_index])
+    {
+        vkResetCommandPool(vulkan_device, thread_command_pool.pool, 0);
+        thread_command_pool.used_secondary_command_buffers = 0;
+    }
+}
+
+void vulkan_destroy_command_pools()
+{
+    for (auto& frame_command_pools : vulkan_thread_command_pools)
+    {
+        for (auto& thread_command_pool : frame_command_pools)
+        {
+            vkDestroyCommandPool(vulkan_device, thread_command_pool.pool, nullptr);
+        }
+    }
+    vulkan_thread_command_pools.clear();
 }
 
 void vulkan_create_command_buffers(std::vector<VkCommandBuffer>& command_buffers)
 {
     std::cout << applicationName << ": Creating Vulkan command buffers." << std::endl;
 
-    command_buffers.resize(MAX_FRAMES_IN_FLIGHT);
+    command_buffers.resize(vulkan_frames_in_flight);
 
-    VkCommandBufferAllocateInfo command_buffer_allocate_info{};
-    command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    command_buffer_allocate_info.commandPool = vulkan_command_pool;
-    command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    command_buffer_allocate_info.commandBufferCount = command_buffers.size();
-
-    if(vkAllocateCommandBuffers(vulkan_device, &command_buffer_allocate_info, command_buffers.data()) != VK_SUCCESS)
+    // each frame's primary comes from the render thread's pool of that frame, and is reset along with it.
+    for (size_t i = 0; i < command_buffers.size(); ++i)
     {
-        std::ostringstream oss;
-        oss << applicationName << ": Vulkan - Failed to allocate command buffers.";
-        throw std::runtime_error(oss.str());
+        VkCommandBufferAllocateInfo command_buffer_allocate_info{};
+        command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        command_buffer_allocate_info.commandPool = vulkan_thread_command_pools[i].get_external().pool;
+        command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        command_buffer_allocate_info.commandBufferCount = 1;
+
+        if(vkAllocateCommandBuffers(vulkan_device, &command_buffer_allocate_info, &command_buffers[i]) != VK_SUCCESS)
+        {
+            std::ostringstream oss;
+            oss << applicationName << ": Vulkan - Failed to allocate command buffers.";
+            throw std::runtime_error(oss.str());
+        }
     }
 
     std::cout << applicationName << ": Created Vulkan command buffers." << std::endl;
 }
 
-void vulkan_record_command_buffer(VkCommandBuffer& command_buffer, uint32_t image_index)
+VulkanSceneConstants vulkan_get_scene_constants(uint32_t frame_index, uint32_t object_count)
 {
+    return {vulkan_view_projection,
+            object_count,
+            vulkan_object_buffer_slot,
+            vulkan_indirect_draw_slots[frame_index],
+            vulkan_indirect_count_slots[frame_index]};
+}
+
+// Records the draws of objects [first_object, first_object + object_count) into a secondary command buffer from
+// the calling thread's pool, or the frame's single indirect draw of the cull pass output when draws are GPU driven.
+// Called from job system threads and the render thread, one call per job.
+VkCommandBuffer vulkan_record_draw_commands(uint32_t image_index,
+                                            uint32_t frame_index,
+                                            uint32_t first_object,
+                                            uint32_t object_count)
+{
+    PROFILE_ZONE("Record draws");
+
+    VulkanThreadCommandPool& thread_command_pool = vulkan_thread_command_pools[frame_index].local();
+    if (thread_command_pool.used_secondary_command_buffers == thread_command_pool.secondary_command_buffers.size())
+    {
+        VkCommandBufferAllocateInfo command_buffer_allocate_info{};
+        command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        command_buffer_allocate_info.commandPool = thread_command_pool.pool;
+        command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        command_buffer_allocate_info.commandBufferCount = 1;
+
+        VkCommandBuffer new_command_buffer = VK_NULL_HANDLE;
+        if (vkAllocateCommandBuffers(vulkan_device, &command_buffer_allocate_info, &new_command_buffer) != VK_SUCCESS)
+        {
+            std::ostringstream oss;
+            oss << applicationName << ": Vulkan - Failed to allocate secondary command buffer.";
+            throw std::runtime_error(oss.str());
+        }
+        thread_command_pool.secondary_command_buffers.push_back(new_command_buffer);
+    }
+    VkCommandBuffer command_buffer = thread_command_pool.secondary_command_buffers[thread_command_pool.used_secondary_command_buffers++];
+
+    VkCommandBufferInheritanceInfo inheritance_info{};
+    inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance_info.renderPass = vulkan_render_pass;
+    inheritance_info.subpass = 0;
+    inheritance_info.framebuffer = vulkan_swap_chain_framebuffers[image_index];
+
     VkCommandBufferBeginInfo command_buffer_begin_info{};
     command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    command_buffer_begin_info.flags = 0;
-    command_buffer_begin_info.pInheritanceInfo = nullptr;
+    command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    command_buffer_begin_info.pInheritanceInfo = &inheritance_info;
 
     if(vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info) != VK_SUCCESS)
     {
         std::ostringstream oss;
-        oss << applicationName << ": Vulkan - Failed to begin recording command buffer.";
+        oss << applicationName << ": Vulkan - Failed to begin recording secondary command buffer.";
         throw std::runtime_error(oss.str());
     }
 
-    VkRenderPassBeginInfo render_pass_begin_info{};
-    render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    render_pass_begin_info.renderPass = vulkan_render_pass;
-    render_pass_begin_info.framebuffer = vulkan_swap_chain_framebuffers[image_index];
-    render_pass_begin_info.renderArea.offset = {0, 0};
-    render_pass_begin_info.renderArea.extent = vulkan_swap_chain_extent;
-    render_pass_begin_info.clearValueCount = 1;
-    render_pass_begin_info.pClearValues = &vulkan_clear_color;
-
-    vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+    // secondary command buffers inherit no state, every one binds its own.
     vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_graphics_pipeline);
 
     VkViewport viewport{}; // TODO: we should populate viewport values dynamically given the current camera settings.
@@ -1191,10 +3170,129 @@ void vulkan_record_command_buffer(VkCommandBuffer& command_buffer, uint32_t imag
     VkRect2D scissor{};
     scissor.offset = {0, 0};
     scissor.extent = vulkan_swap_chain_extent;
-
     vkCmdSetScissor(command_buffer, 0, 1, &scissor);
-    vkCmdDraw(command_buffer, 3, 1, 0, 0); //TODO: we should dynamically set these values given a vertex buffer.
-    vkCmdEndRenderPass(command_buffer);
+
+    const VulkanSceneConstants scene_constants = vulkan_get_scene_constants(frame_index, vulkan_ready_object_count);
+    vkCmdPushConstants(command_buffer, vulkan_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(scene_constants), &scene_constants);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_pipeline_layout, 0, 1, &vulkan_bindless_descriptor_set, 0, nullptr);
+
+    const VkDeviceSize vertex_offset = 0;
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, &vulkan_vertex_buffer, &vertex_offset);
+    vkCmdBindIndexBuffer(command_buffer, vulkan_index_buffer, 0, VK_INDEX_TYPE_UINT32);
+
+    // objects are passed as the first instance, the vertex shader looks their transform up with gl_InstanceIndex.
+    if (vulkan_gpu_driven_draws)
+    {
+        vkCmdDrawIndexedIndirectCount(  command_buffer,
+                                        vulkan_indirect_draw_buffers[frame_index],
+                                        0,
+                                        vulkan_indirect_count_buffers[frame_index],
+                                        0,
+                                        object_count,
+                                        sizeof(VkDrawIndexedIndirectCommand));
+    }
+    else
+    {
+        const view_frustum frustum = view_frustum_from_view_projection(vulkan_view_projection);
+        for (uint32_t object_index = first_object; object_index < first_object + object_count; ++object_index)
+        {
+            const VulkanObjectData& object = vulkan_objects[object_index].data;
+            if (view_frustum_intersects_sphere(frustum, object.transform, object.bounds))
+            {
+                vkCmdDrawIndexed(command_buffer, object.index_count, 1, object.first_index, object.vertex_offset, object_index);
+            }
+        }
+    }
+
+    if(vkEndCommandBuffer(command_buffer) != VK_SUCCESS)
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Failed to record secondary command buffer.";
+        throw std::runtime_error(oss.str());
+    }
+    return command_buffer;
+}
+
+// Resets the frame's draw count and dispatches the cull pass over the first object_count objects. The draws it
+// writes are visible to the indirect draw that follows.
+void vulkan_record_object_culling(VkCommandBuffer command_buffer, uint32_t frame_index, uint32_t object_count)
+{
+    vkCmdFillBuffer(command_buffer, vulkan_indirect_count_buffers[frame_index], 0, sizeof(uint32_t), 0);
+
+    VkMemoryBarrier count_reset_barrier{};
+    count_reset_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    count_reset_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    count_reset_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &count_reset_barrier, 0, nullptr, 0, nullptr);
+
+    const VulkanSceneConstants scene_constants = vulkan_get_scene_constants(frame_index, object_count);
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, vulkan_cull_pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, vulkan_pipeline_layout, 0, 1, &vulkan_bindless_descriptor_set, 0, nullptr);
+    vkCmdPushConstants(command_buffer, vulkan_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(scene_constants), &scene_constants);
+    vkCmdDispatch(command_buffer, (object_count + VULKAN_CULL_GROUP_SIZE - 1) / VULKAN_CULL_GROUP_SIZE, 1, 1);
+
+    VkMemoryBarrier draw_barrier{};
+    draw_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    draw_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    draw_barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &draw_barrier, 0, nullptr, 0, nullptr);
+}
+
+void vulkan_record_command_buffer(nengine& engine, VkCommandBuffer& command_buffer, uint32_t image_index, uint32_t frame_index)
+{
+    PROFILE_ZONE("Record command buffer");
+
+    // objects still uploading are skipped rather than waited for. GPU driven frames record one indirect draw for
+    // all of them, otherwise the draws are split into jobs recorded in parallel, the results stay in draw order.
+    const uint32_t object_count = vulkan_ready_object_count;
+    const uint32_t draws_per_job = vulkan_gpu_driven_draws ? std::max(object_count, 1u) : VULKAN_DRAWS_PER_RECORDING_JOB;
+    const uint32_t recording_job_count = (object_count + draws_per_job - 1) / draws_per_job;
+    frame_vector<VkCommandBuffer> secondary_command_buffers(recording_job_count, VK_NULL_HANDLE, frame_stl_allocator<VkCommandBuffer>(engine.get_frame_allocator()));
+    engine.get_job_system().parallel_for(recording_job_count, 1, [&](uint32_t job_index)
+    {
+        const uint32_t first_object = job_index * draws_per_job;
+        secondary_command_buffers[job_index] = vulkan_record_draw_commands( image_index,
+                                                                            frame_index,
+                                                                            first_object,
+                                                                            std::min(draws_per_job, object_count - first_object));
+    });
+
+    VkCommandBufferBeginInfo command_buffer_begin_info{};
+    command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    command_buffer_begin_info.pInheritanceInfo = nullptr;
+
+    if(vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info) != VK_SUCCESS)
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Failed to begin recording command buffer.";
+        throw std::runtime_error(oss.str());
+    }
+
+    if (!vulkan_timestamp_query_pools.empty())
+    {
+        vkCmdResetQueryPool(command_buffer, vulkan_timestamp_query_pools[frame_index], 0, VULKAN_TIMESTAMP_QUERY_COUNT);
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, vulkan_timestamp_query_pools[frame_index], 0);
+    }
+
+    if (vulkan_gpu_driven_draws && object_count > 0)
+    {
+        vulkan_record_object_culling(command_buffer, frame_index, object_count);
+    }
+
+    VulkanRenderGraphContext graph_context;
+    graph_context.engine = &engine;
+    graph_context.command_buffer = command_buffer;
+    graph_context.image_index = image_index;
+    graph_context.frame_index = frame_index;
+    graph_context.secondary_command_buffers = secondary_command_buffers.data();
+    graph_context.secondary_command_buffer_count = static_cast<uint32_t>(secondary_command_buffers.size());
+    vulkan_render_graph.execute(&graph_context, vulkan_record_render_graph_barriers);
+
+    if (!vulkan_timestamp_query_pools.empty())
+    {
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, vulkan_timestamp_query_pools[frame_index], 1);
+    }
 
     if(vkEndCommandBuffer(command_buffer) != VK_SUCCESS)
     {
@@ -1209,16 +3307,17 @@ void vulkan_create_sync_objects()
     VkSemaphoreCreateInfo semaphore_create_info{};
     semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    vulkan_image_available_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    vulkan_render_finished_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
+    vulkan_image_available_semaphores.resize(vulkan_frames_in_flight);
+    vulkan_render_finished_semaphores.resize(vulkan_frames_in_flight);
     
     VkFenceCreateInfo fence_create_info{};
     fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
     fence_create_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-    vulkan_in_flight_fences.resize(MAX_FRAMES_IN_FLIGHT);
+    vulkan_in_flight_fences.resize(vulkan_frames_in_flight);
+    vulkan_frame_fences = std::make_unique<frame_fence_tracker>(vulkan_frames_in_flight);
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    for (size_t i = 0; i < vulkan_frames_in_flight; ++i)
     {
         if (vkCreateSemaphore(vulkan_device, &semaphore_create_info, nullptr, &vulkan_image_available_semaphores[i]) != VK_SUCCESS ||
             vkCreateSemaphore(vulkan_device, &semaphore_create_info, nullptr, &vulkan_render_finished_semaphores[i]) != VK_SUCCESS ||
@@ -1231,6 +3330,157 @@ void vulkan_create_sync_objects()
     }
 }
 
+// Destroys retired swap chains whose frames have all retired, or every one of them once the device is idle.
+void vulkan_destroy_retired_swap_chains(bool device_idle)
+{
+    auto retired = vulkan_retired_swap_chains.begin();
+    while (retired != vulkan_retired_swap_chains.end())
+    {
+        // the fences only cover rendering, the last present to the old swap chain is only known to be done once the
+        // first frame rendered to the replacement has completed as well.
+        if (!device_idle && !vulkan_frame_fences->is_complete(retired->retire_frame))
+        {
+            ++retired;
+            continue;
+        }
+
+        for (auto framebuffer : retired->framebuffers)
+        {
+            vkDestroyFramebuffer(vulkan_device, framebuffer, nullptr);
+        }
+        for (auto image_view : retired->image_views)
+        {
+            vkDestroyImageView(vulkan_device, image_view, nullptr);
+        }
+        vulkan_destroy_render_graph_resources(retired->transient_images, retired->transient_memory);
+        vkDestroySwapchainKHR(vulkan_device, retired->swap_chain, nullptr);
+        retired = vulkan_retired_swap_chains.erase(retired);
+    }
+}
+
+void vulkan_destroy_pipeline_set(const VulkanPipelineSet& pipelines)
+{
+    for (auto pipeline : pipelines.graphics_pipelines)
+    {
+        vkDestroyPipeline(vulkan_device, pipeline, nullptr);
+    }
+    vkDestroyPipeline(vulkan_device, pipelines.cull_pipeline, nullptr);
+}
+
+// Destroys pipelines replaced by shader reloads once their frames have retired, or all of them once the device is idle.
+void vulkan_destroy_retired_pipelines(bool device_idle)
+{
+    auto retired = vulkan_retired_pipelines.begin();
+    while (retired != vulkan_retired_pipelines.end())
+    {
+        if (!device_idle && vulkan_frame_fences->get_completed_frame_count() < retired->retire_frame)
+        {
+            ++retired;
+            continue;
+        }
+
+        vulkan_destroy_pipeline_set(retired->pipelines);
+        retired = vulkan_retired_pipelines.erase(retired);
+    }
+}
+
+// Starts using pipelines the shader reload thread finished, if any. Never waits for the reload thread, a reload it
+// is still handing over is picked up next frame.
+void vulkan_swap_reloaded_pipelines()
+{
+    std::unique_lock<std::mutex> lock(vulkan_reloaded_pipelines_mutex, std::try_to_lock);
+    if (!lock.owns_lock() || !vulkan_reloaded_pipelines)
+    {
+        return;
+    }
+
+    VulkanRetiredPipelines retired;
+    retired.retire_frame = current_render_frame;
+    if (!vulkan_reloaded_pipelines->graphics_pipelines.empty())
+    {
+        retired.pipelines.graphics_pipelines = std::exchange(vulkan_graphics_pipelines, vulkan_reloaded_pipelines->graphics_pipelines);
+        vulkan_graphics_pipeline = vulkan_graphics_pipelines[VULKAN_PIPELINE_OPAQUE];
+    }
+    if (vulkan_reloaded_pipelines->cull_pipeline != VK_NULL_HANDLE)
+    {
+        retired.pipelines.cull_pipeline = std::exchange(vulkan_cull_pipeline, vulkan_reloaded_pipelines->cull_pipeline);
+    }
+    vulkan_retired_pipelines.push_back(std::move(retired));
+    vulkan_reloaded_pipelines.reset();
+}
+
+void vulkan_create_timestamp_query_pools()
+{
+#if defined(PROFILING_ENABLED)
+    VulkanQueueFamilyIndices queue_family_indices;
+    vulkan_find_queue_families(vulkan_physical_device, queue_family_indices, vulkan_surface);
+
+    uint32_t queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(vulkan_physical_device, &queue_family_count, nullptr);
+    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(vulkan_physical_device, &queue_family_count, queue_families.data());
+    const uint32_t timestamp_valid_bits = queue_families[queue_family_indices.graphics_family.value()].timestampValidBits;
+
+    VkPhysicalDeviceProperties physical_device_properties;
+    vkGetPhysicalDeviceProperties(vulkan_physical_device, &physical_device_properties);
+
+    if (timestamp_valid_bits == 0 || physical_device_properties.limits.timestampPeriod <= 0.0f)
+    {
+        std::cout << applicationName << ": Vulkan - Graphics queue does not support timestamps, GPU profiling disabled." << std::endl;
+        return;
+    }
+
+    vulkan_timestamp_period_ns = static_cast<double>(physical_device_properties.limits.timestampPeriod);
+    vulkan_timestamp_valid_mask = timestamp_valid_bits >= 64 ? std::numeric_limits<uint64_t>::max() : (uint64_t{1} << timestamp_valid_bits) - 1;
+
+    VkQueryPoolCreateInfo query_pool_create_info{};
+    query_pool_create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_pool_create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_pool_create_info.queryCount = VULKAN_TIMESTAMP_QUERY_COUNT;
+
+    vulkan_timestamp_query_pools.resize(vulkan_frames_in_flight);
+    vulkan_timestamp_submit_times.assign(vulkan_frames_in_flight, 0);
+    for (size_t i = 0; i < vulkan_frames_in_flight; ++i)
+    {
+        if (vkCreateQueryPool(vulkan_device, &query_pool_create_info, nullptr, &vulkan_timestamp_query_pools[i]) != VK_SUCCESS)
+        {
+            std::ostringstream oss;
+            oss << applicationName << ": Vulkan - Failed to create timestamp query pool for frame " << i;
+            throw std::runtime_error(oss.str());
+        }
+    }
+#endif // PROFILING_ENABLED
+}
+
+// Turns the timestamps of the frame that last used this slot into a GPU zone. Call once the slot's fence signaled.
+void vulkan_resolve_gpu_timestamps(uint32_t frame_index)
+{
+    if (vulkan_timestamp_query_pools.empty() || vulkan_timestamp_submit_times[frame_index] == 0)
+    {
+        return;
+    }
+
+    uint64_t timestamps[VULKAN_TIMESTAMP_QUERY_COUNT] = {};
+    if (vkGetQueryPoolResults(  vulkan_device,
+                                vulkan_timestamp_query_pools[frame_index],
+                                0,
+                                VULKAN_TIMESTAMP_QUERY_COUNT,
+                                sizeof(timestamps),
+                                timestamps,
+                                sizeof(uint64_t),
+                                VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+    {
+        const uint64_t elapsed_ticks = (timestamps[1] - timestamps[0]) & vulkan_timestamp_valid_mask;
+        const uint64_t duration_ns = static_cast<uint64_t>(static_cast<double>(elapsed_ticks) * vulkan_timestamp_period_ns);
+
+        // the GPU clock is not calibrated against the CPU one, so the zone is placed at submission, the earliest the
+        // GPU could have started. Its duration is exact.
+        const uint64_t submit_time_ns = vulkan_timestamp_submit_times[frame_index];
+        profiler::get().record_gpu_zone("Render pass", submit_time_ns, submit_time_ns + duration_ns);
+    }
+    vulkan_timestamp_submit_times[frame_index] = 0;
+}
+
 void vulkan_cleanup()
 {
     std::cout << std::endl;
@@ -1250,15 +3500,33 @@ void vulkan_cleanup()
     {
         vkDestroyFence(vulkan_device, fence, nullptr);
     }
+    vulkan_frame_fences.reset();
+
+    for (auto query_pool : vulkan_timestamp_query_pools)
+    {
+        vkDestroyQueryPool(vulkan_device, query_pool, nullptr);
+    }
 
-    vkDestroyCommandPool(vulkan_device, vulkan_command_pool, nullptr);
+    vulkan_destroy_command_pools();
     
     for (auto framebuffer : vulkan_swap_chain_framebuffers)
     {
         vkDestroyFramebuffer(vulkan_device, framebuffer, nullptr);
     }
 
-    vkDestroyPipeline(vulkan_device, vulkan_graphics_pipeline, nullptr);
+    for (auto pipeline : vulkan_graphics_pipelines)
+    {
+        vkDestroyPipeline(vulkan_device, pipeline, nullptr);
+    }
+    vulkan_destroy_retired_pipelines(true);
+    if (vulkan_reloaded_pipelines)
+    {
+        vulkan_destroy_pipeline_set(*vulkan_reloaded_pipelines);
+        vulkan_reloaded_pipelines.reset();
+    }
+
+    vulkan_save_pipeline_cache();
+    vkDestroyPipelineCache(vulkan_device, vulkan_pipeline_cache, nullptr);
     vkDestroyPipelineLayout(vulkan_device, vulkan_pipeline_layout, nullptr);
     vkDestroyRenderPass(vulkan_device, vulkan_render_pass, nullptr);
     
@@ -1271,7 +3539,21 @@ void vulkan_cleanup()
     {
         vkDestroyImageView(vulkan_device, image_view, nullptr);
     }
+
+    vulkan_destroy_retired_swap_chains(true);
     
+    vulkan_destroy_upload_resources();
+    vulkan_destroy_scene_resources();
+    vulkan_destroy_render_graph_resources(vulkan_render_graph_transient_images, vulkan_render_graph_transient_memory);
+
+    for (size_t i = 0; i < vulkan_offscreen_images.size(); ++i)
+    {
+        vulkan_destroy_buffer(vulkan_readback_buffers[i], vulkan_readback_allocations[i]);
+        vulkan_destroy_image(vulkan_offscreen_images[i], vulkan_offscreen_image_allocations[i]);
+    }
+
+    vulkan_destroy_memory_allocator();
+
     vkDestroySwapchainKHR(vulkan_device, vulkan_swap_chain, nullptr);
     vkDestroySurfaceKHR(vulkan_instance, vulkan_surface, nullptr);
     vkDestroyDevice(vulkan_device, nullptr);
@@ -1281,45 +3563,201 @@ void vulkan_cleanup()
     std::cout << applicationName << ": Successfully cleaned up Vulkan resources." << std::endl;
 }
 
-void draw_frame()
+// Copies the readback of a retired headless frame out as tightly packed RGBA8 rows.
+void vulkan_copy_readback(uint32_t frame_index, void* destination)
 {
-    uint32_t current_frame_index = current_render_frame % MAX_FRAMES_IN_FLIGHT;
-    vkWaitForFences(vulkan_device, 1, &vulkan_in_flight_fences[current_frame_index], VK_TRUE, std::numeric_limits<uint64_t>::max());
-    vkResetFences(vulkan_device, 1, &vulkan_in_flight_fences[current_frame_index]);
+    std::memcpy(destination, vulkan_readback_allocations[frame_index].mapped, static_cast<size_t>(vulkan_swap_chain_extent.width) * vulkan_swap_chain_extent.height * 4);
+}
+
+// Records the latency of every present that reached the display since the last call, oldest first. Never waits.
+void vulkan_collect_present_latencies()
+{
+    while (!vulkan_pending_presents.empty())
+    {
+        const VulkanPendingPresent& pending = vulkan_pending_presents.front();
+        const VkResult wait_result = vulkan_wait_for_present(vulkan_device, vulkan_swap_chain, pending.present_id, 0);
+        if (wait_result == VK_TIMEOUT)
+        {
+            break;
+        }
+        // presents the swap chain went out of date on are dropped.
+        if (wait_result == VK_SUCCESS)
+        {
+            profiler::get().record_latency(pending.input_time_ns, profiler::now());
+        }
+        vulkan_pending_presents.pop_front();
+    }
+}
+
+// Replaces the swap chain after a resize or display change. Only the image views, framebuffers and frame graph depend
+// on the swap chain images, the render pass, pipeline and per-frame objects are kept. The old swap chain is retired rather
+// than destroyed, so recreation never waits on the device.
+// Returns false while the window has no area (minimized), the frame should be skipped and recreation retried.
+bool vulkan_recreate_swap_chain(GLFWwindow* window)
+{
+    PROFILE_ZONE("Recreate swap chain");
+
+    // cleared before the new size is read, a resize arriving while the swap chain is rebuilt sets it again and is
+    // picked up next frame instead of being lost.
+    application_framebuffer_resized = false;
+    if (application_framebuffer_width == 0 || application_framebuffer_height == 0)
+    {
+        application_framebuffer_resized = true;
+        return false;
+    }
+
+    // present ids belong to the old swap chain, its outstanding presents are no longer waited on.
+    vulkan_pending_presents.clear();
+
+    VulkanRetiredSwapChain retired;
+    retired.swap_chain = vulkan_swap_chain;
+    retired.image_views = std::move(vulkan_swap_chain_image_views);
+    retired.framebuffers = std::move(vulkan_swap_chain_framebuffers);
+    retired.transient_images = std::move(vulkan_render_graph_transient_images);
+    retired.transient_memory = std::move(vulkan_render_graph_transient_memory);
+    retired.retire_frame = current_render_frame;
+    vulkan_retired_swap_chains.push_back(std::move(retired));
+
+    const VkFormat previous_image_format = vulkan_swap_chain_image_format;
+    vulkan_swap_chain_images = {};
+    vulkan_create_swap_chain(   vulkan_physical_device,
+                                vulkan_device,
+                                window,
+                                vulkan_surface,
+                                vulkan_swap_chain,
+                                vulkan_swap_chain_image_format,
+                                vulkan_swap_chain_extent,
+                                vulkan_swap_chain_images,
+                                vulkan_retired_swap_chains.back().swap_chain);
+
+    if (vulkan_swap_chain_image_format != previous_image_format)
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": Vulkan - Swap chain format changed from " << string_VkFormat(previous_image_format)
+            << " to " << string_VkFormat(vulkan_swap_chain_image_format) << ", the render pass does not support it.";
+        throw std::runtime_error(oss.str());
+    }
+
+    vulkan_swap_chain_image_views = {};
+    vulkan_create_image_views(vulkan_device, vulkan_swap_chain_images, vulkan_swap_chain_image_format, vulkan_swap_chain_image_views);
+    vulkan_swap_chain_framebuffers = {};
+    vulkan_create_framebuffers(vulkan_swap_chain_framebuffers);
+    vulkan_render_graph_transient_memory = {};
+    vulkan_build_render_graph();
+    return true;
+}
+
+void draw_frame(nengine& engine, GLFWwindow* window)
+{
+    PROFILE_ZONE("Draw frame");
 
-    uint32_t image_index;
-    vkAcquireNextImageKHR(  vulkan_device,
-                            vulkan_swap_chain,
-                            std::numeric_limits<uint64_t>::max(),
-                            vulkan_image_available_semaphores[current_frame_index],
-                            VK_NULL_HANDLE,
-                            &image_index);
+    if (!application_headless && application_framebuffer_resized && !vulkan_recreate_swap_chain(window))
+    {
+        return;
+    }
+
+    uint32_t current_frame_index = current_render_frame % vulkan_frames_in_flight;
+    {
+        PROFILE_ZONE("Wait for frame fence");
+        vkWaitForFences(vulkan_device, 1, &vulkan_in_flight_fences[current_frame_index], VK_TRUE, std::numeric_limits<uint64_t>::max());
+    }
+    vulkan_frame_fences->fence_signaled(current_frame_index);
+    vulkan_resolve_gpu_timestamps(current_frame_index);
+    vulkan_destroy_retired_swap_chains(false);
+    vulkan_destroy_retired_pipelines(false);
+    vulkan_swap_reloaded_pipelines();
+    // every frame before the one that last used this slot has had its fence waited on.
+    if (current_render_frame >= vulkan_frames_in_flight)
+    {
+        vulkan_bindless_buffer_slots->retire(current_render_frame - vulkan_frames_in_flight);
+    }
+
+    // the frame that last used this slot has retired, so its transient allocations and command buffers can be recycled.
+    engine.get_frame_allocator().begin_frame(current_frame_index);
+    vulkan_reset_frame_command_pools(current_frame_index);
+    vulkan_process_uploads();
+
+    uint32_t image_index = current_frame_index;
+    if (application_headless)
+    {
+        // each slot owns its offscreen image. The frame that rendered it last has retired, hand its pixels over
+        // before they are overwritten, so out_texture trails rendering by vulkan_frames_in_flight frames.
+        if (engine.get_config().out_texture != nullptr && current_render_frame >= vulkan_frames_in_flight)
+        {
+            vulkan_copy_readback(current_frame_index, engine.get_config().out_texture);
+        }
+    }
+    else
+    {
+        VkResult acquire_result = vkAcquireNextImageKHR(vulkan_device,
+                                                        vulkan_swap_chain,
+                                                        std::numeric_limits<uint64_t>::max(),
+                                                        vulkan_image_available_semaphores[current_frame_index],
+                                                        VK_NULL_HANDLE,
+                                                        &image_index);
+        if (acquire_result == VK_ERROR_OUT_OF_DATE_KHR)
+        {
+            // nothing was acquired and the fence is still signaled, so the frame can simply be retried.
+            application_framebuffer_resized = true;
+            return;
+        }
+        else if (acquire_result != VK_SUCCESS && acquire_result != VK_SUBOPTIMAL_KHR)
+        {
+            std::ostringstream oss;
+            oss << applicationName << ": Vulkan - Failed to acquire swap chain image: " << string_VkResult(acquire_result);
+            throw std::runtime_error(oss.str());
+        }
+    }
+
+    // only reset once work is certain to be submitted, an early return must leave the fence signaled.
+    vkResetFences(vulkan_device, 1, &vulkan_in_flight_fences[current_frame_index]);
     
-    vkResetCommandBuffer(vulkan_command_buffers[current_frame_index], 0);
-    vulkan_record_command_buffer(vulkan_command_buffers[current_frame_index], image_index);
+    vulkan_record_command_buffer(engine, vulkan_command_buffers[current_frame_index], image_index, current_frame_index);
 
     VkSubmitInfo submit_info{};
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     
-    VkSemaphore wait_semaphores[] = {vulkan_image_available_semaphores[current_frame_index]};
-    VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    
-    submit_info.waitSemaphoreCount = 1;
+    // the upload timeline already reached the waited value, the wait never stalls and only makes the uploaded
+    // meshes and objects visible to the cull pass and vertex processing. Headless frames have no image to acquire or present, the fence orders them.
+    VkSemaphore wait_semaphores[] = {vulkan_upload_timeline, vulkan_image_available_semaphores[current_frame_index]};
+    VkPipelineStageFlags wait_stages[] = {  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                                            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+    const uint64_t wait_values[] = {vulkan_upload_timeline_completed, 0};
+
+    VkTimelineSemaphoreSubmitInfo timeline_submit_info{};
+    timeline_submit_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_submit_info.waitSemaphoreValueCount = application_headless ? 1 : 2;
+    timeline_submit_info.pWaitSemaphoreValues = wait_values;
+
+    submit_info.pNext = &timeline_submit_info;
+    submit_info.waitSemaphoreCount = application_headless ? 1 : 2;
     submit_info.pWaitSemaphores = wait_semaphores;
     submit_info.pWaitDstStageMask = wait_stages;
     submit_info.commandBufferCount = 1;
     submit_info.pCommandBuffers = &vulkan_command_buffers[current_frame_index];
     
     VkSemaphore signal_semaphores[] = {vulkan_render_finished_semaphores[current_frame_index]};
-    submit_info.signalSemaphoreCount = 1;
+    submit_info.signalSemaphoreCount = application_headless ? 0 : 1;
     submit_info.pSignalSemaphores = signal_semaphores;
 
+    if (!vulkan_timestamp_submit_times.empty())
+    {
+        vulkan_timestamp_submit_times[current_frame_index] = profiler::now();
+    }
+
     if(vkQueueSubmit(vulkan_graphics_queue, 1, &submit_info, vulkan_in_flight_fences[current_frame_index]) != VK_SUCCESS)
     {
         std::ostringstream oss;
         oss << applicationName << ": Vulkan - Failed to submit draw command buffer.";
         throw std::runtime_error(oss.str());
     }
+    vulkan_frame_fences->submitted(current_render_frame);
+
+    if (application_headless)
+    {
+        current_render_frame++;
+        return;
+    }
 
     VkPresentInfoKHR present_info{};
     present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1332,138 +3770,615 @@ void draw_frame()
     present_info.pImageIndices = &image_index;
     present_info.pResults = nullptr;
 
-    if (vkQueuePresentKHR(vulkan_present_queue, &present_info) != VK_SUCCESS)
+    const uint64_t present_id = vulkan_last_present_id + 1;
+    VkPresentIdKHR present_id_info{};
+    present_id_info.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    present_id_info.swapchainCount = 1;
+    present_id_info.pPresentIds = &present_id;
+    if (vulkan_present_latency_supported)
+    {
+        present_info.pNext = &present_id_info;
+    }
+
+    PROFILE_ZONE("Present");
+    VkResult present_result = vkQueuePresentKHR(vulkan_present_queue, &present_info);
+    // ids must increase even across failed presents.
+    vulkan_last_present_id = present_id;
+    if (vulkan_present_latency_supported && (present_result == VK_SUCCESS || present_result == VK_SUBOPTIMAL_KHR))
+    {
+        vulkan_pending_presents.push_back({present_id, vulkan_frame_input_time_ns});
+        vulkan_collect_present_latencies();
+    }
+    if (present_result == VK_ERROR_OUT_OF_DATE_KHR || present_result == VK_SUBOPTIMAL_KHR)
+    {
+        // the frame was still submitted, recreate before the next one.
+        application_framebuffer_resized = true;
+    }
+    else if (present_result != VK_SUCCESS)
     {
         std::ostringstream oss;
-        oss << applicationName << ": Vulkan - Failed to present swap chain image.";
+        oss << applicationName << ": Vulkan - Failed to present swap chain image: " << string_VkResult(present_result);
         throw std::runtime_error(oss.str());
     }
 
     current_render_frame++;
 }
 
-void compute_fps(double& last_frame_time, const double& current_frame_time, const uint64_t& frame_count_since_last_time, double& average_frame_time, double& average_fps)
+// Applies render commands until the end of the frame they describe, then draws it. Runs on the render thread.
+void application_execute_render_frame(nengine& engine, GLFWwindow* window, bool& stop)
+{
+    for (;;)
+    {
+        // sleeps while the simulation has nothing queued. Every command of the frame was pushed before the frame
+        // was queued, but a command another producer claimed a place for ahead of END_FRAME may still be being written.
+        render_command command;
+        application_render_commands.pop(command);
+
+        switch (command.type)
+        {
+            case RENDER_COMMAND_NONE:
+                break;
+            case RENDER_COMMAND_SET_VIEW_PROJECTION:
+                vulkan_view_projection = command.matrix;
+                break;
+            case RENDER_COMMAND_STOP:
+                stop = true;
+                return;
+            case RENDER_COMMAND_END_FRAME:
+                vulkan_frame_input_time_ns = command.timestamp_ns;
+                if (application_frame_wait == NENGINE_FRAME_WAIT_PIPELINED)
+                {
+                    // the simulation prepares the next frame while this one is drawn.
+                    application_frame_slots.release();
+                    draw_frame(engine, window);
+                }
+                else
+                {
+                    // the next frame samples its input only once the GPU is done with this one.
+                    const uint64_t submitted_frame = current_render_frame;
+                    draw_frame(engine, window);
+                    if (current_render_frame != submitted_frame)
+                    {
+                        PROFILE_ZONE("Wait for GPU idle");
+                        const uint32_t submitted_slot = static_cast<uint32_t>(submitted_frame % vulkan_frames_in_flight);
+                        vkWaitForFences(vulkan_device, 1, &vulkan_in_flight_fences[submitted_slot], VK_TRUE, std::numeric_limits<uint64_t>::max());
+                        vulkan_frame_fences->fence_signaled(submitted_slot);
+                    }
+                    application_frame_slots.release();
+                }
+                profiler::get().end_frame();
+                return;
+        }
+    }
+}
+
+void application_print_frame_statistics()
+{
+    // percentiles rather than an average, single long frames are what the player notices.
+    const profiler_frame_statistics frame_statistics = profiler::get().get_frame_statistics();
+    std::cout   << "\r" << "Frame Number: " << current_render_frame
+                << " Frame time p50: " << frame_statistics.p50_ms << " ms"
+                << " p95: " << frame_statistics.p95_ms << " ms"
+                << " p99: " << frame_statistics.p99_ms << " ms"
+                << " max: " << frame_statistics.maximum_ms << " ms";
+
+    const profiler_frame_statistics latency_statistics = profiler::get().get_latency_statistics();
+    if (latency_statistics.frame_count > 0)
+    {
+        std::cout   << " Input to present p50: " << latency_statistics.p50_ms << " ms"
+                    << " p99: " << latency_statistics.p99_ms << " ms";
+    }
+    std::cout << std::flush;
+}
+
+void application_render_thread_main(nengine* engine, GLFWwindow* window)
 {
-    double elapsed_time = current_frame_time - last_frame_time;
+    profiler::get().set_thread_name("Render");
 
-    if (elapsed_time > 1.0)
+    try
     {
-        average_fps = static_cast<double>(frame_count_since_last_time) / elapsed_time;
-        average_frame_time = (elapsed_time * 1000.0) / static_cast<double>(frame_count_since_last_time); // convert seconds to miliseconds
-        last_frame_time = current_frame_time;
-        application_last_fps_calculation_frame = current_render_frame;
+        bool stop = false;
+        while (!stop)
+        {
+            application_queued_frames.acquire();
+            application_execute_render_frame(*engine, window, stop);
+
+            if (!stop && current_render_frame % FRAMES_BETWEEN_FRAME_STATISTICS == 0)
+            {
+                application_print_frame_statistics();
+            }
+        }
+    }
+    catch (...)
+    {
+        // handed to the main thread, which stops simulating and rethrows it once the render thread has exited.
+        application_render_thread_error = std::current_exception();
+        application_render_thread_failed = true;
+        application_frame_slots.release();
     }
 }
 
-int main(int argc, char** argv)
+// Writes the render commands of the frame the main thread just simulated and queues it for the render thread.
+void application_submit_render_frame(uint64_t input_time_ns)
 {
-    UNUSED(argc);
-    UNUSED(argv);
+    render_command view_projection;
+    view_projection.type = RENDER_COMMAND_SET_VIEW_PROJECTION;
+    view_projection.matrix = application_view_projection;
+    application_render_commands.push(view_projection);
+
+    render_command end_frame;
+    end_frame.type = RENDER_COMMAND_END_FRAME;
+    end_frame.timestamp_ns = input_time_ns;
+    application_render_commands.push(end_frame);
+    application_queued_frames.release();
+}
+// Shaders the reload thread rebuilds, in the order main() compiles them.
+enum ApplicationShader
+{
+    APPLICATION_SHADER_VERTEX = 0,
+    APPLICATION_SHADER_FRAGMENT = 1,
+    APPLICATION_SHADER_CULL = 2,
+    APPLICATION_SHADER_COUNT = 3
+};
+
+// Builds the pipelines using the shaders that were recompiled, from each shader's latest good module.
+VulkanPipelineSet application_build_reloaded_pipelines( const std::vector<shader_compile_config>& shader_configs,
+                                                        const std::vector<spirv_module>& shader_modules,
+                                                        bool graphics_changed,
+                                                        bool cull_changed)
+{
+    std::vector<VkShaderModule> modules(APPLICATION_SHADER_COUNT, VK_NULL_HANDLE);
+    VulkanPipelineSet pipelines;
+    std::exception_ptr error;
+    try
+    {
+        if (graphics_changed)
+        {
+            modules[APPLICATION_SHADER_VERTEX] = vulkan_create_shader_module(vulkan_device, shader_modules[APPLICATION_SHADER_VERTEX]);
+            modules[APPLICATION_SHADER_FRAGMENT] = vulkan_create_shader_module(vulkan_device, shader_modules[APPLICATION_SHADER_FRAGMENT]);
+
+            std::vector<VkPipelineShaderStageCreateInfo> shader_stages(2);
+            shader_stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            shader_stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+            shader_stages[0].module = modules[APPLICATION_SHADER_VERTEX];
+            shader_stages[0].pName = shader_configs[APPLICATION_SHADER_VERTEX].entry_point.c_str();
+            shader_stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            shader_stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+            shader_stages[1].module = modules[APPLICATION_SHADER_FRAGMENT];
+            shader_stages[1].pName = shader_configs[APPLICATION_SHADER_FRAGMENT].entry_point.c_str();
+            vulkan_create_graphics_pipeline_permutations(shader_stages, vulkan_pipeline_layout, pipelines.graphics_pipelines);
+        }
+        if (cull_changed)
+        {
+            modules[APPLICATION_SHADER_CULL] = vulkan_create_shader_module(vulkan_device, shader_modules[APPLICATION_SHADER_CULL]);
+
+            VkPipelineShaderStageCreateInfo cull_shader_stage{};
+            cull_shader_stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            cull_shader_stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+            cull_shader_stage.module = modules[APPLICATION_SHADER_CULL];
+            cull_shader_stage.pName = shader_configs[APPLICATION_SHADER_CULL].entry_point.c_str();
+            pipelines.cull_pipeline = vulkan_create_cull_pipeline(cull_shader_stage);
+        }
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+        vulkan_destroy_pipeline_set(pipelines);
+    }
+
+    // pipelines do not reference their shader modules once created.
+    for (auto module : modules)
+    {
+        vkDestroyShaderModule(vulkan_device, module, nullptr);
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+    return pipelines;
+}
+
+// Watches the shader sources and every file they include, recompiles the shaders built from a saved file and builds
+// the pipelines using them, while the render thread keeps drawing with the current ones. A shader that fails to
+// compile keeps its last good version. Only reads Vulkan objects that stay fixed after startup, the render thread
+// swaps the result in.
+void application_shader_reload_thread_main( std::vector<std::filesystem::path> shader_paths,
+                                            std::vector<shader_compile_config> shader_configs,
+                                            std::vector<spirv_module> shader_modules)
+{
+    profiler::get().set_thread_name("Shader Reload");
+
+    // the files each shader is built from, itself first, absolute and normalized the way the watcher compares them.
+    file_watcher watcher;
+    std::vector<std::vector<std::filesystem::path>> shader_files(shader_paths.size());
+    auto watch_shader_files = [&](size_t shader)
+    {
+        const shader_compile_config& config = shader_configs[shader];
+        shader_files[shader] = {std::filesystem::absolute(shader_paths[shader]).lexically_normal()};
+        for (const auto& include : shader_compiler::get_include_cache()->find_includes(config.shader_code, config.input_file_name, config.include_directories))
+        {
+            shader_files[shader].push_back(std::filesystem::absolute(include->path).lexically_normal());
+        }
+        for (const auto& file : shader_files[shader])
+        {
+            watcher.watch(file);
+        }
+    };
+    for (size_t shader = 0; shader < shader_paths.size(); ++shader)
+    {
+        watch_shader_files(shader);
+    }
+
+    while (!application_shader_reload_stop)
+    {
+        const std::vector<std::filesystem::path> changed_paths = watcher.poll();
+        if (changed_paths.empty())
+        {
+            std::this_thread::sleep_for(SHADER_RELOAD_POLL_INTERVAL);
+            continue;
+        }
+
+        const uint64_t reload_start_ns = profiler::now();
+        std::vector<size_t> changed_shaders;
+        std::vector<shader_compile_config> changed_configs;
+        for (size_t shader = 0; shader < shader_paths.size(); ++shader)
+        {
+            const std::vector<std::filesystem::path>& files = shader_files[shader];
+            const bool source_changed = std::find(changed_paths.begin(), changed_paths.end(), files.front()) != changed_paths.end();
+            const bool include_changed = std::find_first_of(files.begin() + 1, files.end(), changed_paths.begin(), changed_paths.end()) != files.end();
+            if (!source_changed && !include_changed)
+            {
+                continue;
+            }
+            if (source_changed)
+            {
+                // an editor waits on this read, it does not queue behind bulk loads.
+                async_io_result shader_code = application_io->read(shader_paths[shader], ASYNC_IO_PRIORITY_STREAMING).get();
+                if (!shader_code.succeeded())
+                {
+                    std::cerr << applicationName << ": Failed to reload " << shader_paths[shader] << ": " << shader_code.error << std::endl;
+                    continue;
+                }
+                shader_configs[shader].shader_code.assign(shader_code.data.begin(), shader_code.data.end());
+            }
+            // the edit may have added includes.
+            watch_shader_files(shader);
+            changed_shaders.push_back(shader);
+            changed_configs.push_back(shader_configs[shader]);
+        }
+
+        std::vector<shader_compile_result> results = shader_compiler::compile_batch(changed_configs);
+        bool graphics_changed = false;
+        bool cull_changed = false;
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            if (!results[i].succeeded())
+            {
+                std::cerr << applicationName << ": Failed to reload " << changed_configs[i].input_file_name << ": " << results[i].error << std::endl;
+                continue;
+            }
+            shader_modules[changed_shaders[i]] = std::move(results[i].module);
+            if (changed_shaders[i] == APPLICATION_SHADER_CULL)
+            {
+                cull_changed = vulkan_gpu_driven_draws;
+            }
+            else
+            {
+                graphics_changed = true;
+            }
+        }
+        if (!graphics_changed && !cull_changed)
+        {
+            continue;
+        }
+
+        VulkanPipelineSet pipelines;
+        try
+        {
+            pipelines = application_build_reloaded_pipelines(shader_configs, shader_modules, graphics_changed, cull_changed);
+        }
+        catch (const std::exception& exception)
+        {
+            std::cerr << applicationName << ": Failed to rebuild pipelines: " << exception.what() << std::endl;
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(vulkan_reloaded_pipelines_mutex);
+            if (vulkan_reloaded_pipelines)
+            {
+                // the render thread has not started using the previous reload yet. Whatever this one replaces was
+                // never used and is destroyed right away, the rest is carried over.
+                VulkanPipelineSet unused;
+                if (pipelines.graphics_pipelines.empty())
+                {
+                    pipelines.graphics_pipelines = std::move(vulkan_reloaded_pipelines->graphics_pipelines);
+                }
+                else
+                {
+                    unused.graphics_pipelines = std::move(vulkan_reloaded_pipelines->graphics_pipelines);
+                }
+                if (pipelines.cull_pipeline == VK_NULL_HANDLE)
+                {
+                    pipelines.cull_pipeline = vulkan_reloaded_pipelines->cull_pipeline;
+                }
+                else
+                {
+                    unused.cull_pipeline = vulkan_reloaded_pipelines->cull_pipeline;
+                }
+                vulkan_destroy_pipeline_set(unused);
+            }
+            vulkan_reloaded_pipelines = std::move(pipelines);
+        }
 
+        std::cout   << applicationName << ": Reloaded " << changed_shaders.size() << " shaders in "
+                    << static_cast<double>(profiler::now() - reload_start_ns) / 1e6 << " ms." << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
     nengine_config config;
 
-    glfw_initialize();
+    profiler::get().set_thread_name("Main");
+
+    // --headless [--frames=<count>] [--output=<file.ppm>] renders offscreen, as fast as the device allows.
+    // --trace=<file.json> writes the profiler's zones as a Chrome trace on exit.
+    // --latency=<low|throughput> picks a latency mode, overriding --frames-in-flight=<count>,
+    // --swap-chain-images=<count>, --present-mode=<fifo|mailbox|immediate> and --wait-for-gpu.
+    // --no-shader-reload stops watching the shaders for edits.
+    // --mesh=<file.nmesh> adds every submesh of a mesh file to the scene, may be repeated.
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+        if (argument == "--headless")
+        {
+            application_headless = true;
+        }
+        else if (argument.rfind("--frames=", 0) == 0)
+        {
+            application_headless_frame_limit = std::stoull(argument.substr(strlen("--frames=")));
+        }
+        else if (argument.rfind("--output=", 0) == 0)
+        {
+            application_headless_output_path = argument.substr(strlen("--output="));
+        }
+        else if (argument.rfind("--trace=", 0) == 0)
+        {
+            application_trace_output_path = argument.substr(strlen("--trace="));
+        }
+        else if (argument == "--latency=low")
+        {
+            config.latency_mode = NENGINE_LATENCY_MODE_LOW_LATENCY;
+        }
+        else if (argument == "--latency=throughput")
+        {
+            config.latency_mode = NENGINE_LATENCY_MODE_MAX_THROUGHPUT;
+        }
+        else if (argument.rfind("--frames-in-flight=", 0) == 0)
+        {
+            config.frames_in_flight = static_cast<unsigned int>(std::stoul(argument.substr(strlen("--frames-in-flight="))));
+        }
+        else if (argument.rfind("--swap-chain-images=", 0) == 0)
+        {
+            config.swap_chain_image_count = static_cast<unsigned int>(std::stoul(argument.substr(strlen("--swap-chain-images="))));
+        }
+        else if (argument == "--present-mode=fifo")
+        {
+            config.present_mode = NENGINE_PRESENT_MODE_FIFO;
+        }
+        else if (argument == "--present-mode=mailbox")
+        {
+            config.present_mode = NENGINE_PRESENT_MODE_MAILBOX;
+        }
+        else if (argument == "--present-mode=immediate")
+        {
+            config.present_mode = NENGINE_PRESENT_MODE_IMMEDIATE;
+        }
+        else if (argument == "--wait-for-gpu")
+        {
+            config.frame_wait = NENGINE_FRAME_WAIT_GPU_IDLE;
+        }
+        else if (argument.rfind("--mesh=", 0) == 0)
+        {
+            application_mesh_paths.push_back(argument.substr(strlen("--mesh=")));
+        }
+        else if (argument == "--no-shader-reload")
+        {
+            application_shader_reload_enabled = false;
+        }
+        else
+        {
+            std::cerr << applicationName << ": Ignoring unknown argument " << argument << std::endl;
+        }
+    }
+
+    nengine_apply_latency_mode(config);
+    if (config.frames_in_flight == 0)
+    {
+        std::ostringstream oss;
+        oss << applicationName << ": At least one frame must be in flight.";
+        throw std::invalid_argument(oss.str());
+    }
+    vulkan_frames_in_flight = config.frames_in_flight;
+    vulkan_requested_swap_chain_image_count = config.swap_chain_image_count;
+    vulkan_requested_present_mode = config.present_mode;
+    application_frame_wait = config.frame_wait;
+    config.headless = application_headless;
+
+    // receives the pixels of every retired headless frame when an output file was requested.
+    std::vector<uint8_t> headless_output_pixels;
+    if (application_headless && !application_headless_output_path.empty())
+    {
+        headless_output_pixels.resize(static_cast<size_t>(config.resolution[0]) * config.resolution[1] * 4);
+        config.out_texture = headless_output_pixels.data();
+    }
+
+    const std::filesystem::path current_path = std::filesystem::current_path();
+    const std::filesystem::path executable_relative_path(argv[0]);
+    const std::filesystem::path executable_relative_directory = executable_relative_path.parent_path();
+
+    const std::filesystem::path vertex_shader_relative_path("shaders/basic-shader-triangle.vert");
+    const std::filesystem::path fragment_shader_relative_path("shaders/basic-shader-triangle.frag");
+    const std::filesystem::path cull_shader_relative_path("shaders/cull-objects.comp");
+    std::vector<std::filesystem::path> shader_paths = { current_path / executable_relative_directory / vertex_shader_relative_path,
+                                                        current_path / executable_relative_directory / fragment_shader_relative_path,
+                                                        current_path / executable_relative_directory / cull_shader_relative_path};
+
+    // the build packs the shaders into an archive next to the executable. Without one, every loose shader source is
+    // read in one batch while the window and the device are created.
+    application_io = std::make_unique<async_io_service>();
+    std::unique_ptr<pak_file> shader_archive;
+    std::vector<std::future<async_io_result>> shader_code_reads;
+    const std::filesystem::path shader_archive_path = current_path / executable_relative_directory / "shaders.pak";
+    if (std::filesystem::exists(shader_archive_path))
+    {
+        shader_archive = std::make_unique<pak_file>(shader_archive_path);
+        std::cout << applicationName << ": Reading shaders from " << shader_archive_path << std::endl;
+    }
+    else
+    {
+        shader_code_reads = application_io->read_batch(shader_paths);
+        std::cout   << applicationName << ": Reading loose shaders with " << (application_io->is_using_io_uring() ? "io_uring." : "a thread pool.")
+                    << std::endl;
+    }
+
+    if (!application_headless)
+    {
+        glfw_initialize();
+    }
     vulkan_initialize(vulkan_instance);
 
     #ifndef NDEBUG
     vulkan_initialize_debug_utils(vulkan_instance, vulkan_debug_messenger);
     #endif // NDEBUG
 
-    // Create the window and rendering surface with GLFW.
-    GLFWwindow* window = glfw_create_window(config);
-
-    if (glfwCreateWindowSurface(vulkan_instance, window, nullptr, &vulkan_surface) != VK_SUCCESS)
+    // Create the window and rendering surface with GLFW. Headless runs have neither.
+    GLFWwindow* window = nullptr;
+    if (!application_headless)
     {
-        std::ostringstream oss;
-        oss << applicationName << ": failed to create window surface." << std::endl;
-        throw std::runtime_error(oss.str());
+        window = glfw_create_window(config);
+        if (glfwCreateWindowSurface(vulkan_instance, window, nullptr, &vulkan_surface) != VK_SUCCESS)
+        {
+            std::ostringstream oss;
+            oss << applicationName << ": failed to create window surface." << std::endl;
+            throw std::runtime_error(oss.str());
+        }
+        std::cout << applicationName << ": Created window surface.";
     }
 
     // pick a physical device
     vulkan_pick_physical_device(vulkan_instance, vulkan_physical_device, vulkan_surface);
 
-    std::cout << applicationName << ": Created window surface.";
-
     // create the logical vulkan device
-    vulkan_create_logical_device(vulkan_physical_device, vulkan_device, vulkan_graphics_queue, vulkan_present_queue, vulkan_surface);
-
-    // initialize the swapchain
-    std::vector<VkImage> swap_chain_images;
-    vulkan_create_swap_chain(   vulkan_physical_device, 
-                                vulkan_device, 
-                                window, 
-                                vulkan_surface, 
-                                vulkan_swap_chain,
-                                vulkan_swap_chain_image_format,
-                                vulkan_swap_chain_extent,
-                                swap_chain_images);
+    vulkan_create_logical_device(vulkan_physical_device, vulkan_device, vulkan_graphics_queue, vulkan_present_queue, vulkan_transfer_queue, vulkan_surface);
+    vulkan_initialize_memory_allocator();
+
+    // initialize the swapchain, or the offscreen images that replace it
+    if (application_headless)
+    {
+        vulkan_create_offscreen_targets(config,
+                                        vulkan_swap_chain_image_format,
+                                        vulkan_swap_chain_extent,
+                                        vulkan_swap_chain_images);
+    }
+    else
+    {
+        vulkan_create_swap_chain(   vulkan_physical_device, 
+                                    vulkan_device, 
+                                    window, 
+                                    vulkan_surface, 
+                                    vulkan_swap_chain,
+                                    vulkan_swap_chain_image_format,
+                                    vulkan_swap_chain_extent,
+                                    vulkan_swap_chain_images);
+    }
 
     // create image views
-    vulkan_swap_chain_image_views.resize(swap_chain_images.size());
-    vulkan_create_image_views(vulkan_device, swap_chain_images, vulkan_swap_chain_image_format, vulkan_swap_chain_image_views);
+    vulkan_swap_chain_image_views.resize(vulkan_swap_chain_images.size());
+    vulkan_create_image_views(vulkan_device, vulkan_swap_chain_images, vulkan_swap_chain_image_format, vulkan_swap_chain_image_views);
 
 
     // compile shaders
     std::cout << applicationName << ": Compiling shaders." << std::endl;
     
-    // vertex shader
-    const std::filesystem::path current_path = std::filesystem::current_path();
-    const std::filesystem::path executable_relative_path(argv[0]);
-    const std::filesystem::path executable_relative_directory = executable_relative_path.parent_path();
-    const std::filesystem::path vertex_shader_relative_path ("shaders/basic-shader-triangle.vert");
-    
-    std::cout << "\t" << applicationName << ": Compiling vertex shader: " << current_path / executable_relative_directory / vertex_shader_relative_path << std::endl;
-    
+    // reuse SPIR-V from previous runs, only shaders whose source or compile settings changed reach shaderc.
+    shader_compiler::set_cache(std::make_shared<shader_cache>(current_path / executable_relative_directory / "shader-cache"));
+
     shader_compile_config vertex_shader_config;
     vertex_shader_config.entry_point = "main";
-
-    // read the vertex shader code from file
-    std::ifstream vertex_shader_code_in(current_path / executable_relative_directory / vertex_shader_relative_path);
-    assert(!vertex_shader_code_in.fail());
-    vertex_shader_code_in.seekg(0, std::ios::end);
-    assert(!vertex_shader_code_in.fail());
-    uint32_t vertex_shader_code_size = vertex_shader_code_in.tellg();
-    assert(!vertex_shader_code_in.fail());
-    vertex_shader_config.shader_code.resize(vertex_shader_code_size);
-    vertex_shader_code_in.seekg(0);
-    assert(!vertex_shader_code_in.fail());
-    vertex_shader_code_in.read(&(vertex_shader_config.shader_code[0]), vertex_shader_code_size);
-    assert(!vertex_shader_code_in.fail());
-    
     vertex_shader_config.shader_kind = shaderc_shader_kind::shaderc_glsl_vertex_shader;
+    vertex_shader_config.input_file_name = vertex_shader_relative_path.string();
 
-    std::cout << "\t\t" << "Vertex shader source: \n" << vertex_shader_config.shader_code << std::endl;
-    spirv_module vertex_shader_bytecode = shader_compiler::compile(vertex_shader_config);
-
-    // fragment shader
-    const std::filesystem::path fragment_shader_relative_path("shaders/basic-shader-triangle.frag");
-    
-    std::cout << "\t" << applicationName << ": Compiling fragment shader: " << current_path / executable_relative_directory / fragment_shader_relative_path << std::endl;
-
-    // read the vertex shader code from file
     shader_compile_config fragment_shader_config;
     fragment_shader_config.entry_point = "main";
-    std::ifstream fragment_shader_code_in(current_path / executable_relative_directory / fragment_shader_relative_path);
-    assert(!fragment_shader_code_in.fail());
-    fragment_shader_code_in.seekg(0, std::ios::end);
-    assert(!fragment_shader_code_in.fail());
-    uint32_t fragment_shader_code_size = fragment_shader_code_in.tellg();
-    assert(!fragment_shader_code_in.fail());
-    fragment_shader_config.shader_code.resize(fragment_shader_code_size);
-    fragment_shader_code_in.seekg(0);
-    assert(!fragment_shader_code_in.fail());
-    fragment_shader_code_in.read(&fragment_shader_config.shader_code[0], fragment_shader_code_size);
-    assert(!fragment_shader_code_in.fail());
-
     fragment_shader_config.shader_kind = shaderc_shader_kind::shaderc_glsl_fragment_shader;
+    fragment_shader_config.input_file_name = fragment_shader_relative_path.string();
+
+    // object culling compute shader
+    shader_compile_config cull_shader_config;
+    cull_shader_config.entry_point = "main";
+    cull_shader_config.shader_kind = shaderc_shader_kind::shaderc_glsl_compute_shader;
+    cull_shader_config.input_file_name = cull_shader_relative_path.string();
+
+    // compile every stage concurrently, once its source arrived.
+    std::vector<shader_compile_config> shader_configs = {vertex_shader_config, fragment_shader_config, cull_shader_config};
+    for (size_t i = 0; i < shader_configs.size(); ++i)
+    {
+        std::vector<uint8_t> shader_code;
+        if (shader_archive)
+        {
+            // archive names are relative to the executable, with / separators.
+            const pak_file_entry* entry = shader_archive->find(shader_configs[i].input_file_name);
+            if (entry == nullptr)
+            {
+                std::ostringstream oss;
+                oss << applicationName << ": " << shader_archive_path << " has no " << shader_configs[i].input_file_name;
+                throw std::runtime_error(oss.str());
+            }
+            shader_code = shader_archive->read(*entry);
+        }
+        else
+        {
+            async_io_result shader_code_read = shader_code_reads[i].get();
+            if (!shader_code_read.succeeded())
+            {
+                std::ostringstream oss;
+                oss << applicationName << ": Failed to read " << shader_configs[i].input_file_name << ": " << shader_code_read.error;
+                throw std::runtime_error(oss.str());
+            }
+            shader_code = std::move(shader_code_read.data);
+        }
+        std::cout << "\t" << applicationName << ": Compiling shader: " << shader_paths[i] << std::endl;
+        shader_configs[i].shader_code.assign(shader_code.begin(), shader_code.end());
+        shader_configs[i].include_directories = {current_path / executable_relative_directory / "shaders"};
+#if defined(RELEASE)
+        shader_configs[i].optimize = true;
+#endif
+    }
+    std::vector<shader_compile_result> shader_results = shader_compiler::compile_batch(shader_configs);
+    for (size_t i = 0; i < shader_results.size(); ++i)
+    {
+        if (!shader_results[i].succeeded())
+        {
+            std::ostringstream oss;
+            oss << applicationName << ": Failed to compile " << shader_configs[i].input_file_name << ": " << shader_results[i].error;
+            throw std::runtime_error(oss.str());
+        }
+    }
+
+    spirv_module vertex_shader_bytecode = std::move(shader_results[0].module);
+    spirv_module fragment_shader_bytecode = std::move(shader_results[1].module);
+    spirv_module cull_shader_bytecode = std::move(shader_results[2].module);
 
-    std::cout << "\t\t" << fragment_shader_config.shader_code << std::endl; 
-    spirv_module fragment_shader_bytecode = shader_compiler::compile(fragment_shader_config);
+    std::cout   << "\t" << applicationName << ": Shader cache hits: " << shader_compiler::get_cache()->get_hit_count()
+                << " misses: " << shader_compiler::get_cache()->get_miss_count() << std::endl;
 
     VkShaderModule vertex_shader_module = vulkan_create_shader_module(vulkan_device, vertex_shader_bytecode);
     VkShaderModule fragment_shader_module = vulkan_create_shader_module(vulkan_device, fragment_shader_bytecode);
+    VkShaderModule cull_shader_module = vulkan_create_shader_module(vulkan_device, cull_shader_bytecode);
 
-    vulkan_shader_modules = {vertex_shader_module, fragment_shader_module};
+    vulkan_shader_modules = {vertex_shader_module, fragment_shader_module, cull_shader_module};
 
     VkPipelineShaderStageCreateInfo vertex_shader_stage_info = {};
     vertex_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -1479,16 +4394,51 @@ int main(int argc, char** argv)
 
     vulkan_shader_stages.insert( vulkan_shader_stages.end(), {vertex_shader_stage_info, fragment_shader_stage_info} );
 
-    // setup graphics pipeline
+    VkPipelineShaderStageCreateInfo cull_shader_stage_info = {};
+    cull_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    cull_shader_stage_info.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    cull_shader_stage_info.module = cull_shader_module;
+    cull_shader_stage_info.pName = cull_shader_config.entry_point.c_str();
+
+    // setup graphics pipeline, every permutation is built here so none compiles during the first frames
+    vulkan_create_pipeline_cache(current_path / executable_relative_directory / "pipeline-cache.bin");
     vulkan_create_render_pass(vulkan_render_pass);
+    vulkan_create_scene_resources();
     vulkan_create_graphics_pipeline(vulkan_pipeline_layout);
+    if (vulkan_gpu_driven_draws)
+    {
+        vulkan_cull_pipeline = vulkan_create_cull_pipeline(cull_shader_stage_info);
+        std::cout << applicationName << ": Created Vulkan cull pipeline." << std::endl;
+    }
     vulkan_create_framebuffers(vulkan_swap_chain_framebuffers);
-    vulkan_create_command_pool(vulkan_command_pool);
-    vulkan_create_command_buffers(vulkan_command_buffers);
+    vulkan_build_render_graph();
     vulkan_create_sync_objects();
+    vulkan_create_timestamp_query_pools();
+    vulkan_create_upload_resources();
+
+    // uploaded through the staging ring like any streamed mesh, it appears once its copy completed.
+    const std::vector<VulkanVertex> triangle_vertices = {
+        {glm::vec2(0.0f, -0.5f), glm::vec3(1.0f, 0.0f, 0.0f)},
+        {glm::vec2(0.5f, 0.5f), glm::vec3(0.0f, 1.0f, 0.0f)},
+        {glm::vec2(-0.5f, 0.5f), glm::vec3(0.0f, 0.0f, 1.0f)},
+    };
+    vulkan_create_object(vulkan_create_mesh(triangle_vertices, {0, 1, 2}), glm::mat4(1.0f));
+
+    for (const auto& mesh_path : application_mesh_paths)
+    {
+        const uint64_t load_start_ns = profiler::now();
+        auto file = std::make_shared<const mesh_file>(mesh_path);
+        const uint32_t mesh_index = vulkan_create_mesh(file);
+        for (uint32_t submesh_index = 0; submesh_index < file->get_header().submesh_count; ++submesh_index)
+        {
+            vulkan_create_object(mesh_index, glm::mat4(1.0f), submesh_index);
+        }
+        std::cout   << applicationName << ": Mapped " << mesh_path << ", " << file->get_header().submesh_count << " submeshes in "
+                    << static_cast<double>(profiler::now() - load_start_ns) / 1e6 << " ms." << std::endl;
+    }
 
     // More application initialization
-    auto engine_instance = std::make_unique<nengine>();
+    auto engine_instance = std::make_unique<nengine>(config);
     std::cout << applicationName    << ": Initialized NeNgine v"
                                     << nengine::nengine_version.variant << "."
                                     << nengine::nengine_version.major << "."
@@ -1498,31 +4448,106 @@ int main(int argc, char** argv)
 
     // Application main loop, pump OS events, calling handler callbacks via GLFW.
     engine_instance->initialize();
+
+    // command pools are per job system thread, so they can only be created once its workers exist.
+    vulkan_create_command_pools(engine_instance->get_job_system());
+    vulkan_create_command_buffers(vulkan_command_buffers);
     
     
-    while (!glfwWindowShouldClose(window))
+    // from here on only the render thread touches Vulkan, until it is joined. The shader reload thread only creates
+    // pipelines and hands them over.
+    std::thread render_thread(application_render_thread_main, engine_instance.get(), window);
+    std::thread shader_reload_thread;
+    if (application_shader_reload_enabled && !application_headless)
     {
-        glfwPollEvents();
-        draw_frame();
+        shader_reload_thread = std::thread(application_shader_reload_thread_main,
+                                           std::move(shader_paths),
+                                           std::move(shader_configs),
+                                           std::vector<spirv_module>{vertex_shader_bytecode, fragment_shader_bytecode, cull_shader_bytecode});
+    }
 
-        if (current_render_frame % FRAMES_BETWEEN_FPS_CALCULATIONS == 0)
+    uint64_t simulated_frame_count = 0;
+    while (application_headless ? (application_headless_frame_limit == 0 || simulated_frame_count < application_headless_frame_limit)
+                                : !glfwWindowShouldClose(window))
+    {
+        // input is sampled once the frame may start, as late as the frame wait strategy allows.
+        application_frame_slots.acquire();
+        if (application_render_thread_failed)
         {
-            compute_fps(application_last_measurement_time, glfwGetTime(), current_render_frame - application_last_fps_calculation_frame, application_current_frame_time, application_current_fps);
-            std::cout << "\r" << "Frame Number: " << current_render_frame << " FPS: " << application_current_fps << " Frame time: " << application_current_frame_time << " ms" << std::flush;
+            break;
+        }
+        if (!application_headless)
+        {
+            glfwPollEvents();
         }
+        const uint64_t input_time_ns = profiler::now();
+
+        application_frame_timing = engine_instance->update(application_get_time());
+        application_submit_render_frame(input_time_ns);
+        simulated_frame_count++;
+    }
+
+    application_shader_reload_stop = true;
+    if (shader_reload_thread.joinable())
+    {
+        shader_reload_thread.join();
+    }
+    application_io.reset();
 
+    if (!application_render_thread_failed)
+    {
+        render_command stop;
+        stop.type = RENDER_COMMAND_STOP;
+        application_render_commands.push(stop);
+        application_queued_frames.release();
+    }
+    render_thread.join();
+    if (application_render_thread_error)
+    {
+        std::rethrow_exception(application_render_thread_error);
     }
 
     // wait for device to finish all pending work before shutting down
     vkDeviceWaitIdle(vulkan_device);
 
+    if (vulkan_present_latency_supported)
+    {
+        vulkan_collect_present_latencies();
+    }
+    application_print_frame_statistics();
+
+    if (!application_trace_output_path.empty())
+    {
+        for (uint32_t i = 0; i < vulkan_timestamp_submit_times.size(); ++i)
+        {
+            vulkan_resolve_gpu_timestamps(i);
+        }
+        profiler::get().save_chrome_trace(application_trace_output_path);
+    }
+
+    // every frame has retired now, the last one is the final image of the run.
+    if (application_headless && config.out_texture != nullptr && current_render_frame > 0)
+    {
+        vulkan_copy_readback(static_cast<uint32_t>((current_render_frame - 1) % vulkan_frames_in_flight), config.out_texture);
+        if (!image_file::write_ppm(application_headless_output_path, headless_output_pixels.data(), vulkan_swap_chain_extent.width, vulkan_swap_chain_extent.height))
+        {
+            std::ostringstream oss;
+            oss << applicationName << ": Failed to write headless output to " << application_headless_output_path;
+            throw std::runtime_error(oss.str());
+        }
+        std::cout << applicationName << ": Wrote headless output to " << application_headless_output_path << std::endl;
+    }
+
     engine_instance->shutdown();
 
     // cleanup Vulkan instance and dependencies
     vulkan_cleanup();
 
     // cleanup GLFW window and instance
-    glfw_cleanup(window);
+    if (window != nullptr)
+    {
+        glfw_cleanup(window);
+    }
 
     // Pass any engine error state as an exit code.
     std::cout << applicationName << ": " << "Engine exiting with code: " << engine_instance->get_status() << std::endl;
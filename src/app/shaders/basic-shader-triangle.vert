@@ -1,12 +1,37 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
-// make a triangle and statically pass it as the vertex position.
-vec2 positions[3] = vec2[] (
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
+// Matches VulkanObjectData in nengine-app.cpp.
+struct ObjectData
+{
+    mat4 transform;
+    vec4 bounds;
+    uint index_count;
+    uint first_index;
+    int vertex_offset;
+    uint padding;
+};
+
+// Slot constants.object_buffer of the bindless storage buffer array.
+layout(std430, set = 0, binding = 0) readonly buffer Objects
+{
+    ObjectData objects[];
+} object_buffers[];
+
+layout(push_constant) uniform SceneConstants
+{
+    mat4 view_projection;
+    uint object_count;
+    uint object_buffer;
+} constants;
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+layout(location = 0) out vec3 fragColor;
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+    // every draw, direct or indirect, passes its object index as the first instance.
+    gl_Position = constants.view_projection * object_buffers[constants.object_buffer].objects[gl_InstanceIndex].transform * vec4(inPosition, 0.0, 1.0);
+    fragColor = inColor;
 }
\ No newline at end of file
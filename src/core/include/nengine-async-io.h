@@ -0,0 +1,135 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Reads up to this size go through a buffer registered with the io_uring, larger ones read straight into their result.
+const uint64_t ASYNC_IO_REGISTERED_BUFFER_SIZE = 64 * 1024;
+
+enum async_io_priority : uint32_t
+{
+    // Reads the running game waits for, such as streamed textures. Always taken before bulk reads, and bulk reads
+    // never fill the queue slots kept for them.
+    ASYNC_IO_PRIORITY_STREAMING = 0,
+    // Level loads and prefetching.
+    ASYNC_IO_PRIORITY_BULK = 1,
+    ASYNC_IO_PRIORITY_COUNT = 2
+};
+
+struct async_io_result
+{
+    std::filesystem::path path;
+    std::vector<uint8_t> data;
+    std::string error;
+
+    inline bool succeeded() const { return error.empty(); }
+};
+
+struct async_io_request
+{
+    std::filesystem::path path;
+    uint64_t offset = 0;
+    // 0 reads from offset to the end of the file.
+    uint64_t size = 0;
+    async_io_priority priority = ASYNC_IO_PRIORITY_BULK;
+    // Called on an I/O thread once the read finished or failed. Must not block or throw, the next completions wait.
+    std::function<void(async_io_result&)> on_complete;
+};
+
+// Reads files in the background. On Linux one thread drives an io_uring: a whole batch of requests goes to the kernel
+// in a single system call, and small reads land in buffers registered with the ring once, instead of having their
+// pages pinned on every read. Where io_uring or its read opcodes are not available a pool of threads does blocking
+// reads instead.
+class async_io_service
+{
+public:
+    // At most queue_depth reads are in flight at once.
+    async_io_service(uint32_t in_queue_depth = 64, bool use_io_uring = true, uint32_t fallback_thread_count = 4);
+    // Finishes every read submitted before it.
+    ~async_io_service();
+
+    async_io_service(const async_io_service&) = delete;
+    async_io_service& operator=(const async_io_service&) = delete;
+
+    static std::string name;
+
+    void submit(std::vector<async_io_request> requests);
+    std::future<async_io_result> read(const std::filesystem::path& path, async_io_priority priority = ASYNC_IO_PRIORITY_BULK);
+    std::vector<std::future<async_io_result>> read_batch(const std::vector<std::filesystem::path>& paths, async_io_priority priority = ASYNC_IO_PRIORITY_BULK);
+
+    bool is_using_io_uring() const;
+    // Reads served from registered buffers.
+    inline uint64_t get_registered_buffer_read_count() const { return registered_buffer_read_count.load(std::memory_order_relaxed); }
+
+private:
+    void fallback_thread_main();
+    bool take_request(async_io_request& out_request, size_t reserved_slots, size_t free_slots);
+
+    uint32_t queue_depth;
+    std::mutex mutex;
+    std::condition_variable work_available;
+    std::array<std::deque<async_io_request>, ASYNC_IO_PRIORITY_COUNT> pending_requests;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+    std::atomic<uint64_t> registered_buffer_read_count = 0;
+
+#if defined(__LINUX__)
+    // A read in flight on the ring, one per queue slot.
+    struct ring_operation
+    {
+        async_io_request request;
+        async_io_result result;
+        int file = -1;
+        uint64_t size = 0;
+        uint64_t completed = 0;
+        bool registered_buffer = false;
+    };
+
+    bool create_ring();
+    void destroy_ring();
+    void ring_thread_main();
+    void* get_submission_entry();
+    void queue_read(uint32_t operation_index);
+    void queue_wake_read();
+    void finish_operation(uint32_t operation_index, const std::string& error);
+    void open_operation(uint32_t operation_index);
+
+    int ring_descriptor = -1;
+    // eventfd that submit() and the destructor write, a read of it is always in flight on the ring.
+    int wake_descriptor = -1;
+    // Set by the ring thread when the eventfd read fails. It finishes the reads in flight and does blocking reads from
+    // then on.
+    std::atomic<bool> ring_failed = false;
+    uint64_t wake_value = 0;
+    void* submission_ring = nullptr;
+    size_t submission_ring_size = 0;
+    void* completion_ring = nullptr;
+    size_t completion_ring_size = 0;
+    void* submission_entries = nullptr;
+    size_t submission_entries_size = 0;
+    uint32_t* submission_head = nullptr;
+    uint32_t* submission_tail = nullptr;
+    uint32_t submission_mask = 0;
+    uint32_t* submission_array = nullptr;
+    uint32_t* completion_head = nullptr;
+    uint32_t* completion_tail = nullptr;
+    uint32_t completion_mask = 0;
+    void* completion_entries = nullptr;
+    // queue_depth buffers of ASYNC_IO_REGISTERED_BUFFER_SIZE, null when registering them failed.
+    uint8_t* registered_buffers = nullptr;
+    std::vector<ring_operation> operations;
+    std::vector<uint32_t> free_operations;
+#endif
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <cstddef>
+#include <filesystem>
+#include <initializer_list>
+#include <string>
+
+struct atomic_file_part
+{
+    const void* data;
+    size_t size;
+};
+
+// Writes parts back to back into a temporary file next to path, then renames it over path. Readers, in this process
+// or another, see either the previous file or the complete new one. Concurrent writers never share a temporary file,
+// the last rename wins. Failures are logged on behalf of owner_name and return false.
+bool atomic_file_write(const std::filesystem::path& path, std::initializer_list<atomic_file_part> parts, const std::string& owner_name);
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+class job_system;
+
+typedef uint32_t bvh_object_id;
+const bvh_object_id BVH_NONE = UINT32_MAX;
+// Objects per leaf, a leaf with more is split whenever the SAH finds a split.
+const uint32_t BVH_MAX_LEAF_SIZE = 4;
+// Subtrees with more objects than this are built as jobs of their own.
+const uint32_t BVH_PARALLEL_BUILD_SIZE = 8192;
+// Queries per job of the batched query functions.
+const uint32_t BVH_QUERY_BATCH_SIZE = 64;
+
+struct bvh_aabb
+{
+    glm::vec3 minimum;
+    glm::vec3 maximum;
+};
+
+struct bvh_ray
+{
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float max_distance;
+};
+
+struct bvh_ray_hit
+{
+    // BVH_NONE when the ray hit nothing.
+    bvh_object_id object = BVH_NONE;
+    // Along direction, in units of its length, to where the ray enters the object's bounds. 0 when it starts inside.
+    float distance = 0.0f;
+};
+
+// Six planes with xyz pointing into the frustum, a point p is inside a plane when dot(xyz, p) + w >= 0.
+struct bvh_frustum
+{
+    glm::vec4 planes[6];
+};
+
+// The objects every query of a batch found, query i's are objects[offsets[i]] up to objects[offsets[i + 1]].
+struct bvh_query_results
+{
+    std::vector<bvh_object_id> objects;
+    std::vector<uint32_t> offsets;
+};
+
+// Bounding volume hierarchy over object bounds, built with the surface area heuristic.
+// Moving an object only refits the boxes above it at the next update(), which keeps the tree correct but lets it
+// grow looser as objects travel, so update() rebuilds it every rebuild_interval updates. Objects inserted since the
+// last build are tested one by one until the next one, which comes early once they, or removed objects, make up an
+// eighth of the tree.
+class bvh
+{
+public:
+    bvh(uint32_t in_rebuild_interval = 120);
+
+    static std::string name;
+
+    bvh_object_id insert(const bvh_aabb& bounds);
+    void remove(bvh_object_id id);
+    void move(bvh_object_id id, const bvh_aabb& bounds);
+    inline uint32_t get_object_count() const { return object_count; }
+    const bvh_aabb& get_bounds(bvh_object_id id) const;
+
+    // Refits the boxes above moved objects, or rebuilds when due. Call once per frame.
+    void update();
+    // Same as update(), a rebuild builds large subtrees in parallel.
+    void update(job_system& jobs);
+    void rebuild();
+    void rebuild(job_system& jobs);
+
+    // Batched queries, the overloads taking a job system spread the batch over its threads.
+    void overlap(const std::vector<bvh_aabb>& boxes, bvh_query_results& out_results) const;
+    void overlap(const std::vector<bvh_aabb>& boxes, bvh_query_results& out_results, job_system& jobs) const;
+    void cull(const std::vector<bvh_frustum>& frustums, bvh_query_results& out_results) const;
+    void cull(const std::vector<bvh_frustum>& frustums, bvh_query_results& out_results, job_system& jobs) const;
+    // Nearest object whose bounds each ray hits.
+    void raycast(const std::vector<bvh_ray>& rays, std::vector<bvh_ray_hit>& out_hits) const;
+    void raycast(const std::vector<bvh_ray>& rays, std::vector<bvh_ray_hit>& out_hits, job_system& jobs) const;
+
+    inline uint32_t get_node_count() const { return static_cast<uint32_t>(nodes.size()); }
+    inline uint32_t get_build_count() const { return build_count; }
+
+private:
+    // Leaves hold count objects starting at first in leaf_objects, inner nodes have count 0 and their children at
+    // first and first + 1. Children always come after their parent.
+    struct node
+    {
+        bvh_aabb bounds;
+        uint32_t first;
+        uint32_t count;
+    };
+
+    enum object_state : uint8_t
+    {
+        BVH_OBJECT_FREE = 0,
+        // Inserted since the last build, not in the tree yet.
+        BVH_OBJECT_PENDING = 1,
+        BVH_OBJECT_IN_TREE = 2,
+        // Removed since the last build, its leaf still lists it and its id is not reused until the next build.
+        BVH_OBJECT_REMOVED = 3
+    };
+
+    struct build_task;
+
+    // Counts the update and tells whether it should rebuild instead of refitting.
+    bool needs_rebuild();
+    void build(job_system* jobs);
+    void build_node(uint32_t node_index, uint32_t first, uint32_t count, uint32_t depth, job_system* jobs);
+    static void build_node_job(void* data);
+    void refit();
+    template<typename visit_type>
+    void visit(const visit_type& overlaps, std::vector<bvh_object_id>& out_objects) const;
+    void ray_query(const bvh_ray& ray, bvh_ray_hit& out_hit) const;
+    template<typename query_type, typename function_type>
+    static void query_batch(const std::vector<query_type>& queries, bvh_query_results& out_results, job_system* jobs, const function_type& function);
+    void check_object(bvh_object_id id) const;
+
+    uint32_t rebuild_interval;
+    uint32_t updates_since_build = 0;
+    uint32_t build_count = 0;
+    uint32_t object_count = 0;
+
+    std::vector<node> nodes;
+    std::vector<bvh_object_id> leaf_objects;
+    std::vector<uint32_t> node_parents;
+    std::atomic<uint32_t> allocated_node_count = 0;
+
+    // Indexed by object id.
+    std::vector<bvh_aabb> object_bounds;
+    std::vector<object_state> object_states;
+    std::vector<uint32_t> object_leaves;
+
+    std::vector<bvh_object_id> pending_objects;
+    std::vector<bvh_object_id> moved_objects;
+    std::vector<bvh_object_id> free_ids;
+    std::vector<bvh_object_id> removed_ids;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Free list of slots in a bindless descriptor array. Resources are addressed by their slot index, which shaders get
+// through push constants or other buffers, so nothing is allocated or bound per draw.
+// A freed slot may still be read by frames the GPU has not finished, it only returns to the free list once the
+// frame value it was freed at has been retired. Lower slots are handed out first, keeping the used range compact.
+// Not thread safe.
+class descriptor_slot_allocator
+{
+public:
+    descriptor_slot_allocator(uint32_t in_capacity);
+
+    static std::string name;
+
+    // Fails when every slot is in use or waiting to be retired.
+    std::optional<uint32_t> allocate();
+    // The slot is reused once retire() is called with a value of at least retire_value. Values must not decrease
+    // from one call to the next.
+    void free(uint32_t slot, uint64_t retire_value);
+    void retire(uint64_t completed_value);
+
+    inline uint32_t get_capacity() const { return capacity; }
+    // Includes slots waiting to be retired.
+    inline uint32_t get_used_count() const { return capacity - static_cast<uint32_t>(free_slots.size()); }
+
+private:
+    struct retiring_slot
+    {
+        uint32_t slot;
+        uint64_t retire_value;
+    };
+
+    uint32_t capacity;
+    // min-heap, so allocate hands out the lowest free slot and retire only pushes what it returns.
+    std::vector<uint32_t> free_slots;
+    std::deque<retiring_slot> retiring_slots;
+    std::vector<bool> allocated;
+};
@@ -0,0 +1,284 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include "nengine-job-system.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Stable handle to an entity. The generation changes every time an index is recycled, so handles to destroyed
+// entities are detected instead of aliasing whatever reuses their slot.
+struct entity
+{
+    static constexpr uint32_t INVALID_INDEX = std::numeric_limits<uint32_t>::max();
+
+    uint32_t index = INVALID_INDEX;
+    uint32_t generation = 0;
+
+    inline bool is_valid() const { return index != INVALID_INDEX; }
+    inline bool operator==(const entity& other) const { return index == other.index && generation == other.generation; }
+    inline bool operator!=(const entity& other) const { return !(*this == other); }
+};
+
+typedef uint32_t component_type_id;
+typedef uint64_t component_mask;
+
+const uint32_t ECS_MAX_COMPONENT_TYPES = 64;
+const size_t ECS_CHUNK_SIZE = 16 * 1024;
+const size_t ECS_CHUNK_ALIGNMENT = 64;
+
+struct ecs_component_type_info
+{
+    size_t size;
+    size_t alignment;
+};
+
+// Assigns a dense id to each component type the first time it is used.
+class ecs_component_registry
+{
+public:
+    // const qualified types share the id of the mutable type, queries use them to mark read-only access.
+    template<typename component_type>
+    static component_type_id get_id()
+    {
+        if constexpr (std::is_const_v<component_type> || std::is_volatile_v<component_type>)
+        {
+            return get_id<std::remove_cv_t<component_type>>();
+        }
+        else
+        {
+            return register_id<component_type>();
+        }
+    }
+
+    template<typename... component_types>
+    static component_mask get_mask()
+    {
+        return (component_mask{0} | ... | (component_mask{1} << get_id<component_types>()));
+    }
+
+    static ecs_component_type_info get_info(component_type_id id);
+
+private:
+    template<typename component_type>
+    static component_type_id register_id()
+    {
+        // Components are moved between chunks with memcpy and never destroyed, so they must be plain data.
+        static_assert(std::is_trivially_copyable_v<component_type>, "ECS components must be trivially copyable.");
+        static_assert(std::is_trivially_destructible_v<component_type>, "ECS components must be trivially destructible.");
+        static_assert(alignof(component_type) <= ECS_CHUNK_ALIGNMENT, "ECS component alignment exceeds chunk alignment.");
+        static const component_type_id id = register_type(sizeof(component_type), alignof(component_type));
+        return id;
+    }
+
+    static component_type_id register_type(size_t size, size_t alignment);
+};
+
+// Fixed size block holding up to the archetype's chunk_capacity entities, laid out as structure of arrays:
+// the entity handles, then one tightly packed array per component type.
+struct ecs_chunk
+{
+    struct deleter
+    {
+        void operator()(std::byte* data) const { ::operator delete(data, std::align_val_t(ECS_CHUNK_ALIGNMENT)); }
+    };
+
+    std::unique_ptr<std::byte, deleter> data;
+    uint32_t count = 0;
+};
+
+// Storage for every entity with exactly the same set of component types.
+class ecs_archetype
+{
+public:
+    static constexpr uint32_t INVALID_ARCHETYPE = std::numeric_limits<uint32_t>::max();
+
+    ecs_archetype(component_mask in_mask);
+
+    inline component_mask get_mask() const { return mask; }
+    inline bool has_component(component_type_id id) const { return (mask >> id) & 1u; }
+    inline uint32_t get_chunk_capacity() const { return chunk_capacity; }
+    inline size_t get_chunk_count() const { return chunks.size(); }
+    inline ecs_chunk& get_chunk(size_t chunk_index) { return chunks[chunk_index]; }
+
+    inline entity* get_entities(ecs_chunk& chunk) const { return reinterpret_cast<entity*>(chunk.data.get()); }
+    inline void* get_column(ecs_chunk& chunk, component_type_id id) const { return chunk.data.get() + column_offsets[id]; }
+    inline size_t get_component_size(component_type_id id) const { return component_sizes[id]; }
+    template<typename component_type>
+    inline component_type* get_column(ecs_chunk& chunk) const
+    {
+        return static_cast<component_type*>(get_column(chunk, ecs_component_registry::get_id<component_type>()));
+    }
+
+    // Appends a row for in_entity, component values are left uninitialized.
+    void allocate_row(entity in_entity, uint32_t& out_chunk, uint32_t& out_row);
+    // Fills the hole with the archetype's last row to keep chunks dense. Returns the entity that moved into
+    // (chunk, row), or an invalid entity when the removed row was the last one.
+    entity remove_row(uint32_t chunk_index, uint32_t row);
+
+    // Cached archetype transitions when adding or removing one component type.
+    std::array<uint32_t, ECS_MAX_COMPONENT_TYPES> add_edges;
+    std::array<uint32_t, ECS_MAX_COMPONENT_TYPES> remove_edges;
+
+private:
+    component_mask mask;
+    uint32_t chunk_capacity = 0;
+    std::array<size_t, ECS_MAX_COMPONENT_TYPES> column_offsets = {};
+    std::array<size_t, ECS_MAX_COMPONENT_TYPES> component_sizes = {};
+    std::vector<component_type_id> component_types;
+    std::vector<ecs_chunk> chunks;
+};
+
+// Archetype based entity-component store. Entities with the same component set share chunks, so iterating a
+// query walks contiguous component arrays instead of chasing per-entity pointers.
+class ecs_world
+{
+public:
+    ecs_world();
+
+    static std::string name;
+
+    entity create();
+    void destroy(entity in_entity);
+    bool is_alive(entity in_entity) const;
+    inline size_t get_entity_count() const { return entity_records.size() - free_indices.size(); }
+
+    template<typename component_type>
+    void add(entity in_entity, const component_type& value);
+    template<typename component_type>
+    void remove(entity in_entity);
+    template<typename component_type>
+    bool has(entity in_entity) const;
+    // Returns nullptr when the entity is dead or lacks the component. Invalidated by any structural change.
+    template<typename component_type>
+    component_type* get(entity in_entity);
+
+    // Calls function(entity, component_types&...) for every entity that has all of component_types.
+    // Entities must not be created, destroyed or change components while iterating.
+    template<typename... component_types, typename function_type>
+    void each(function_type&& function);
+
+    // Same as each(), with chunks spread across the job system's threads. function must be safe to call concurrently.
+    template<typename... component_types, typename function_type>
+    void parallel_each(job_system& jobs, function_type&& function);
+
+private:
+    struct entity_record
+    {
+        uint32_t archetype;
+        uint32_t chunk;
+        uint32_t row;
+        uint32_t generation;
+    };
+
+    struct chunk_reference
+    {
+        ecs_archetype* archetype;
+        ecs_chunk* chunk;
+    };
+
+    uint32_t get_or_create_archetype(component_mask mask);
+    uint32_t get_archetype_with(uint32_t archetype_index, component_type_id id, bool with_component);
+    void move_entity(entity in_entity, uint32_t target_archetype);
+    void* get_component(entity in_entity, component_type_id id);
+    void check_alive(entity in_entity) const;
+    void gather_chunks(component_mask mask, std::vector<chunk_reference>& out_chunks);
+
+    template<typename... component_types, typename function_type>
+    static void each_in_chunk(ecs_archetype& archetype, ecs_chunk& chunk, function_type& function);
+
+    std::vector<entity_record> entity_records;
+    std::vector<uint32_t> free_indices;
+    std::vector<std::unique_ptr<ecs_archetype>> archetypes;
+    std::unordered_map<component_mask, uint32_t> archetype_lookup;
+    std::vector<chunk_reference> parallel_chunks;
+};
+
+template<typename component_type>
+void ecs_world::add(entity in_entity, const component_type& value)
+{
+    check_alive(in_entity);
+    const component_type_id id = ecs_component_registry::get_id<component_type>();
+    const entity_record& record = entity_records[in_entity.index];
+    if (!archetypes[record.archetype]->has_component(id))
+    {
+        move_entity(in_entity, get_archetype_with(record.archetype, id, true));
+    }
+    *static_cast<component_type*>(get_component(in_entity, id)) = value;
+}
+
+template<typename component_type>
+void ecs_world::remove(entity in_entity)
+{
+    check_alive(in_entity);
+    const component_type_id id = ecs_component_registry::get_id<component_type>();
+    const entity_record& record = entity_records[in_entity.index];
+    if (archetypes[record.archetype]->has_component(id))
+    {
+        move_entity(in_entity, get_archetype_with(record.archetype, id, false));
+    }
+}
+
+template<typename component_type>
+bool ecs_world::has(entity in_entity) const
+{
+    return is_alive(in_entity)
+        && archetypes[entity_records[in_entity.index].archetype]->has_component(ecs_component_registry::get_id<component_type>());
+}
+
+template<typename component_type>
+component_type* ecs_world::get(entity in_entity)
+{
+    if (!is_alive(in_entity))
+    {
+        return nullptr;
+    }
+    return static_cast<component_type*>(get_component(in_entity, ecs_component_registry::get_id<component_type>()));
+}
+
+template<typename... component_types, typename function_type>
+void ecs_world::each_in_chunk(ecs_archetype& archetype, ecs_chunk& chunk, function_type& function)
+{
+    entity* entities = archetype.get_entities(chunk);
+    std::tuple<component_types*...> columns(archetype.get_column<component_types>(chunk)...);
+    for (uint32_t row = 0; row < chunk.count; ++row)
+    {
+        function(entities[row], std::get<component_types*>(columns)[row]...);
+    }
+}
+
+template<typename... component_types, typename function_type>
+void ecs_world::each(function_type&& function)
+{
+    const component_mask mask = ecs_component_registry::get_mask<component_types...>();
+    for (auto& archetype : archetypes)
+    {
+        if ((archetype->get_mask() & mask) != mask)
+        {
+            continue;
+        }
+        for (size_t chunk_index = 0; chunk_index < archetype->get_chunk_count(); ++chunk_index)
+        {
+            each_in_chunk<component_types...>(*archetype, archetype->get_chunk(chunk_index), function);
+        }
+    }
+}
+
+template<typename... component_types, typename function_type>
+void ecs_world::parallel_each(job_system& jobs, function_type&& function)
+{
+    // a chunk is the unit of work, it is big enough to amortize scheduling and never shared between threads.
+    gather_chunks(ecs_component_registry::get_mask<component_types...>(), parallel_chunks);
+    jobs.parallel_for(static_cast<uint32_t>(parallel_chunks.size()), 1, [&](uint32_t chunk_index)
+    {
+        each_in_chunk<component_types...>(*parallel_chunks[chunk_index].archetype, *parallel_chunks[chunk_index].chunk, function);
+    });
+}
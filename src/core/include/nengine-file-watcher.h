@@ -0,0 +1,40 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Reports watched files whose contents changed since the last poll. On Linux the directories of the watched files
+// are watched with inotify, so a poll is one non-blocking read. Elsewhere every poll compares modification times.
+// Editors often save by renaming a new file over the old one, so files are matched by path rather than by inode.
+// Not thread safe.
+class file_watcher
+{
+public:
+    file_watcher();
+    ~file_watcher();
+
+    file_watcher(const file_watcher&) = delete;
+    file_watcher& operator=(const file_watcher&) = delete;
+
+    static std::string name;
+
+    void watch(const std::filesystem::path& file);
+    // Never blocks. Changed files are reported once each, in the order they were watched.
+    std::vector<std::filesystem::path> poll();
+
+private:
+    // absolute and normalized, poll() reports them as they were passed to watch().
+    std::vector<std::filesystem::path> files;
+    std::vector<std::filesystem::path> watched_paths;
+
+#if defined(__LINUX__)
+    int inotify_descriptor = -1;
+    // inotify watch descriptor to the directory it watches.
+    std::unordered_map<int, std::filesystem::path> directories;
+#else
+    std::vector<std::filesystem::file_time_type> write_times;
+#endif
+};
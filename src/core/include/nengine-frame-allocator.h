@@ -0,0 +1,110 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+const size_t FRAME_ALLOCATOR_ALIGNMENT = 64;
+
+struct frame_allocator_block_deleter
+{
+    void operator()(std::byte* data) const { ::operator delete(data, std::align_val_t(FRAME_ALLOCATOR_ALIGNMENT)); }
+};
+typedef std::unique_ptr<std::byte, frame_allocator_block_deleter> frame_allocator_block;
+
+// Ring of bump arenas, one per frame in flight.
+// Everything allocated during a frame is released together when its slot comes around again, which must only happen
+// once the CPU and GPU work of that frame has retired (i.e. after the slot's in-flight fence signaled).
+// Threads carve private blocks out of the current slot and bump allocate inside them, so concurrent allocation only
+// touches shared state once per block. Nothing is ever freed individually and no destructors are run.
+class frame_allocator
+{
+public:
+    frame_allocator(uint32_t in_frame_count, size_t in_bytes_per_frame, size_t in_thread_block_size = 64 * 1024);
+
+    static std::string name;
+
+    // Releases everything previously allocated from frame_index and makes it the current slot.
+    // No other thread may allocate from this allocator while begin_frame runs.
+    void begin_frame(uint32_t frame_index);
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    template<typename object_type, typename... argument_types>
+    object_type* create(argument_types&&... arguments)
+    {
+        return new (allocate(sizeof(object_type), alignof(object_type))) object_type(std::forward<argument_types>(arguments)...);
+    }
+
+    inline uint32_t get_frame_count() const { return static_cast<uint32_t>(slots.size()); }
+    inline uint32_t get_current_frame() const { return current_frame; }
+    inline size_t get_bytes_per_frame() const { return bytes_per_frame; }
+    // Bytes used by the current frame, including thread blocks that are not full yet.
+    size_t get_used_bytes() const;
+    // Bytes that did not fit in the arena and fell back to the general heap. Non zero means bytes_per_frame is too small.
+    inline size_t get_overflow_bytes() const { return slots[current_frame]->overflow_bytes.load(std::memory_order_relaxed); }
+    inline size_t get_peak_bytes() const { return peak_bytes; }
+
+private:
+    struct frame_slot
+    {
+        frame_allocator_block memory;
+        std::atomic<size_t> offset = 0;
+        std::atomic<size_t> overflow_bytes = 0;
+        std::mutex overflow_mutex;
+        std::vector<frame_allocator_block> overflow_blocks;
+    };
+
+    void* allocate_shared(frame_slot& slot, size_t size, size_t alignment);
+    void* allocate_overflow(frame_slot& slot, size_t size, size_t alignment);
+
+    std::vector<std::unique_ptr<frame_slot>> slots;
+    size_t bytes_per_frame;
+    size_t thread_block_size;
+    uint32_t current_frame = 0;
+    // Unique across every frame_allocator in the process, thread blocks claimed under another generation are stale,
+    // even when another allocator now lives at this one's address.
+    uint64_t current_generation = 0;
+    size_t peak_bytes = 0;
+};
+
+// Adapts frame_allocator for standard containers. deallocate is a no-op, memory comes back at the frame reset.
+template<typename value_type_in>
+class frame_stl_allocator
+{
+public:
+    typedef value_type_in value_type;
+
+    frame_stl_allocator(frame_allocator& in_allocator) noexcept : allocator(&in_allocator) {}
+    template<typename other_type>
+    frame_stl_allocator(const frame_stl_allocator<other_type>& other) noexcept : allocator(other.allocator) {}
+
+    value_type* allocate(size_t count)
+    {
+        return static_cast<value_type*>(allocator->allocate(count * sizeof(value_type), alignof(value_type)));
+    }
+    void deallocate(value_type* pointer, size_t count) noexcept
+    {
+        UNUSED(pointer);
+        UNUSED(count);
+    }
+
+    template<typename other_type>
+    bool operator==(const frame_stl_allocator<other_type>& other) const noexcept { return allocator == other.allocator; }
+    template<typename other_type>
+    bool operator!=(const frame_stl_allocator<other_type>& other) const noexcept { return allocator != other.allocator; }
+
+    frame_allocator* allocator;
+};
+
+template<typename value_type>
+using frame_vector = std::vector<value_type, frame_stl_allocator<value_type>>;
+typedef std::basic_string<char, std::char_traits<char>, frame_stl_allocator<char>> frame_string;
+typedef std::basic_ostringstream<char, std::char_traits<char>, frame_stl_allocator<char>> frame_ostringstream;
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Which submitted frames the GPU has finished, learned from the fence of each frame in flight slot. Frames are
+// submitted to one queue and complete in order, so a signaled fence also completes every frame submitted before the
+// one it was signaled for. Whatever a frame referenced can be destroyed once that frame is complete.
+// Not thread safe.
+class frame_fence_tracker
+{
+public:
+    frame_fence_tracker(uint32_t in_frames_in_flight);
+
+    static std::string name;
+
+    // The frame was submitted with the fence of slot frame % frames_in_flight. Frames must be submitted in order.
+    void submitted(uint64_t frame);
+    // The fence of the slot was waited on, or found signaled.
+    void fence_signaled(uint32_t slot);
+
+    // Every frame before this one has completed.
+    inline uint64_t get_completed_frame_count() const { return completed_frame_count; }
+    inline bool is_complete(uint64_t frame) const { return frame < completed_frame_count; }
+
+private:
+    // one past the frame last submitted with each slot's fence, 0 while the fence was never submitted.
+    std::vector<uint64_t> slot_frame_counts;
+    uint64_t completed_frame_count = 0;
+};
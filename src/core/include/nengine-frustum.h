@@ -0,0 +1,17 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <glm/glm.hpp>
+
+// The clip volume of a view projection, -w <= x, y <= w and 0 <= z <= w, as six planes taken from its rows. xyz points
+// into the volume and is not normalized. cull-objects.comp culls objects on the GPU with the same test.
+struct view_frustum
+{
+    glm::vec4 planes[6];
+};
+
+view_frustum view_frustum_from_view_projection(const glm::mat4& view_projection);
+
+// Whether an object may be visible. bounds is its bounding sphere in object space, xyz center and w radius. The radius
+// grows with the largest axis scale of transform, so the test stays conservative under non uniform scale.
+bool view_frustum_intersects_sphere(const view_frustum& frustum, const glm::mat4& transform, const glm::vec4& bounds);
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// Image files written from rendered frames, such as the headless frames copied to nengine_config::out_texture.
+class image_file
+{
+public:
+    static std::string name;
+
+    // Writes tightly packed RGBA8 rows, top row first, as a binary PPM. Alpha is dropped. Failures are logged and
+    // return false.
+    static bool write_ppm(const std::filesystem::path& path, const void* rgba_pixels, uint32_t width, uint32_t height);
+};
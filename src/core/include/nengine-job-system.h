@@ -0,0 +1,213 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef void (*job_function)(void* data);
+
+// Number of jobs still outstanding. Every job submitted with a counter increments it, and decrements it once it
+// has finished, so a counter shared by a batch of jobs reaches zero when the whole batch is done.
+struct job_counter
+{
+    std::atomic<uint32_t> pending = 0;
+
+    inline bool is_done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+struct job
+{
+    job_function function = nullptr;
+    void* data = nullptr;
+    job_counter* counter = nullptr;
+};
+
+// Chase-Lev work stealing deque with a fixed capacity.
+// Only the owning thread may push and pop (LIFO, at the bottom); any thread may steal (FIFO, from the top).
+class job_deque
+{
+public:
+    job_deque(uint32_t in_capacity);
+
+    bool push(const job& in_job);
+    bool pop(job& out_job);
+    bool steal(job& out_job);
+
+private:
+    // fields are individually atomic so a thief racing the owner never reads a torn job.
+    struct slot
+    {
+        std::atomic<job_function> function = nullptr;
+        std::atomic<void*> data = nullptr;
+        std::atomic<job_counter*> counter = nullptr;
+    };
+
+    void write_slot(int64_t index, const job& in_job);
+    job read_slot(int64_t index) const;
+
+    std::unique_ptr<slot[]> slots;
+    int64_t capacity;
+    int64_t mask;
+    alignas(64) std::atomic<int64_t> top = 0;
+    alignas(64) std::atomic<int64_t> bottom = 0;
+};
+
+// Work stealing job scheduler.
+// The thread that calls start() becomes the main thread: it owns the first deque, helps execute jobs while it waits,
+// and is the only thread that runs jobs submitted through run_on_main_thread().
+// Threads that are neither the main thread nor a worker submit through a shared, mutex protected queue.
+class job_system
+{
+public:
+    job_system();
+    ~job_system();
+
+    static std::string name;
+    static constexpr uint32_t DEQUE_CAPACITY = 4096;
+
+    // worker_count of 0 starts one worker per hardware thread, minus the main thread.
+    void start(unsigned int worker_count = 0);
+    void stop();
+
+    void run(job_function function, void* data, job_counter* counter = nullptr);
+    // Runs the job once dependency reaches zero.
+    void run_after(job_counter& dependency, job_function function, void* data, job_counter* counter = nullptr);
+    // Queues the job for the next pump_main_thread_jobs(), used for work that must stay on the main thread.
+    void run_on_main_thread(job_function function, void* data, job_counter* counter = nullptr);
+
+    // Executes other jobs until counter reaches zero, rather than blocking the calling thread.
+    void wait(job_counter& counter);
+    void pump_main_thread_jobs();
+
+    // Calls function(index) for every index in [0, count), in batches of batch_size indices per job, and returns
+    // once all of them have run.
+    template<typename function_type>
+    void parallel_for(uint32_t count, uint32_t batch_size, const function_type& function);
+
+    inline bool is_running() const { return running.load(std::memory_order_acquire); }
+    inline unsigned int get_worker_count() const { return static_cast<unsigned int>(workers.size()); }
+    // Workers plus the main thread.
+    inline unsigned int get_thread_count() const { return static_cast<unsigned int>(deques.size()); }
+    bool is_main_thread() const;
+    // Index of the calling thread's deque, 0 for the main thread. Returns -1 for threads unknown to this system.
+    int get_thread_index() const;
+
+private:
+    void submit(const job& in_job);
+    void execute(const job& in_job);
+    void complete(job_counter* counter);
+    bool find_job(int thread_index, job& out_job);
+    void worker_main(int thread_index);
+    void wake_workers();
+
+    std::vector<std::unique_ptr<job_deque>> deques;
+    std::vector<std::thread> workers;
+    std::atomic<bool> running = false;
+    // the thread that called start(), reset by stop().
+    std::atomic<std::thread::id> main_thread_id;
+
+    // bumped on every submission, idle workers sleep until it changes.
+    std::atomic<uint32_t> work_epoch = 0;
+    std::atomic<uint32_t> sleeping_worker_count = 0;
+
+    std::mutex external_jobs_mutex;
+    std::deque<job> external_jobs;
+    std::atomic<bool> has_external_jobs = false;
+
+    std::mutex main_thread_jobs_mutex;
+    std::vector<job> main_thread_jobs;
+    std::vector<job> main_thread_jobs_executing;
+
+    struct deferred_job
+    {
+        job_counter* dependency;
+        job deferred;
+    };
+    std::mutex deferred_jobs_mutex;
+    std::vector<deferred_job> deferred_jobs;
+};
+
+template<typename function_type>
+void job_system::parallel_for(uint32_t count, uint32_t batch_size, const function_type& function)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    batch_size = std::max(1u, batch_size);
+    const uint32_t batch_count = (count + batch_size - 1) / batch_size;
+
+    // Every job pulls batches from a shared cursor until none remain. The state lives on this stack frame, which
+    // outlives the jobs because we wait on them below, so nothing is allocated per call.
+    struct parallel_for_state
+    {
+        const function_type* function;
+        uint32_t count;
+        uint32_t batch_size;
+        uint32_t batch_count;
+        std::atomic<uint32_t> next_batch;
+    };
+    parallel_for_state state{&function, count, batch_size, batch_count, {0}};
+
+    auto run_batches = [](void* data)
+    {
+        parallel_for_state& shared_state = *static_cast<parallel_for_state*>(data);
+        for (uint32_t batch = shared_state.next_batch.fetch_add(1, std::memory_order_relaxed);
+             batch < shared_state.batch_count;
+             batch = shared_state.next_batch.fetch_add(1, std::memory_order_relaxed))
+        {
+            const uint32_t begin = batch * shared_state.batch_size;
+            const uint32_t end = std::min(begin + shared_state.batch_size, shared_state.count);
+            for (uint32_t index = begin; index < end; ++index)
+            {
+                (*shared_state.function)(index);
+            }
+        }
+    };
+
+    const uint32_t job_count = std::min(batch_count, std::max(1u, get_thread_count()));
+    job_counter counter;
+    for (uint32_t i = 1; i < job_count; ++i)
+    {
+        run(run_batches, &state, &counter);
+    }
+
+    // the caller takes a share of the batches itself before helping with anything else.
+    run_batches(&state);
+    wait(counter);
+}
+
+// One value for every thread of a started job system, plus one for the thread outside it that drives it, such as a
+// render thread. Each thread reaches its own value without a lock, so per thread resources like command pools need no
+// synchronization. At most one thread outside the job system may use it at a time.
+template<typename value_type>
+class job_thread_storage
+{
+public:
+    job_thread_storage(const job_system& in_jobs) : jobs(&in_jobs), values(in_jobs.get_thread_count() + 1) {}
+
+    // The calling thread's value.
+    inline value_type& local()
+    {
+        const int thread_index = jobs->get_thread_index();
+        return thread_index >= 0 ? values[static_cast<size_t>(thread_index)] : values.back();
+    }
+    // The value of the thread outside the job system.
+    inline value_type& get_external() { return values.back(); }
+
+    inline size_t size() const { return values.size(); }
+    inline typename std::vector<value_type>::iterator begin() { return values.begin(); }
+    inline typename std::vector<value_type>::iterator end() { return values.end(); }
+
+private:
+    const job_system* jobs;
+    std::vector<value_type> values;
+};
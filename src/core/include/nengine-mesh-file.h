@@ -0,0 +1,101 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+const uint32_t MESH_FILE_MAGIC = 0x48534d4e; // "NMSH"
+const uint32_t MESH_FILE_FORMAT_VERSION = 1;
+// Every table and stream starts at a multiple of this, so they can be read in place and copied as whole cache lines.
+const uint64_t MESH_FILE_ALIGNMENT = 64;
+
+// Engine native mesh container, stored little endian exactly as laid out in memory:
+// header, submesh table, vertex stream and 32 bit index stream, each starting at an aligned offset.
+struct mesh_file_header
+{
+    uint32_t magic;
+    uint32_t format_version;
+    // Bytes per vertex, the layout of a vertex is up to the renderer reading the file.
+    uint32_t vertex_stride;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t submesh_count;
+    uint64_t submesh_offset;
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint64_t file_size;
+};
+
+// A range of the index stream drawn on its own, like the arguments of an indexed draw.
+struct mesh_file_submesh
+{
+    uint32_t first_index;
+    uint32_t index_count;
+    // Added to every index of the submesh.
+    int32_t vertex_offset;
+    uint32_t padding;
+    // Bounding sphere in mesh space, xyz center and w radius.
+    float bounds[4];
+};
+
+static_assert(sizeof(mesh_file_header) == 56, "mesh_file_header is part of the file format");
+static_assert(sizeof(mesh_file_submesh) == 32, "mesh_file_submesh is part of the file format");
+
+// Read only view of a whole file. Mapped into memory on Linux, so pages are only read when touched, elsewhere the
+// file is read into memory up front.
+class mapped_file
+{
+public:
+    mapped_file(const std::filesystem::path& path);
+    ~mapped_file();
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    static std::string name;
+
+    inline const uint8_t* get_data() const { return data; }
+    inline size_t get_size() const { return size; }
+
+private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+#if !defined(__LINUX__)
+    std::vector<uint8_t> contents;
+#endif
+};
+
+// A mesh file mapped into memory. Opening it validates the header, the submesh table and that every index a submesh
+// draws stays inside the vertex stream. The streams are never copied, they are handed out as pointers into the
+// mapping and stay valid as long as the mesh_file.
+class mesh_file
+{
+public:
+    // Throws when the file can not be mapped or is not a valid mesh file.
+    mesh_file(const std::filesystem::path& path);
+
+    static std::string name;
+
+    // Replaces path atomically, mesh_files mapping the previous file keep seeing it. Failures are logged and return
+    // false.
+    static bool write(  const std::filesystem::path& path,
+                        uint32_t vertex_stride,
+                        const void* vertices,
+                        uint32_t vertex_count,
+                        const uint32_t* indices,
+                        uint32_t index_count,
+                        const std::vector<mesh_file_submesh>& submeshes);
+
+    inline const mesh_file_header& get_header() const { return *header; }
+    inline const void* get_vertex_data() const { return mapping.get_data() + header->vertex_offset; }
+    inline size_t get_vertex_data_size() const { return static_cast<size_t>(header->vertex_count) * header->vertex_stride; }
+    inline const uint32_t* get_indices() const { return reinterpret_cast<const uint32_t*>(mapping.get_data() + header->index_offset); }
+    inline const mesh_file_submesh* get_submeshes() const { return reinterpret_cast<const mesh_file_submesh*>(mapping.get_data() + header->submesh_offset); }
+
+private:
+    mapped_file mapping;
+    const mesh_file_header* header = nullptr;
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "nengine-mesh-file.h"
+
+class job_system;
+
+const uint32_t PAK_FILE_MAGIC = 0x4b41504e; // "NPAK"
+const uint32_t PAK_FILE_FORMAT_VERSION = 1;
+// The packed files are one stream cut into blocks of this size, each compressed on its own, so reading a file only
+// decompresses the blocks it overlaps.
+const uint32_t PAK_FILE_BLOCK_SIZE = 64 * 1024;
+const uint64_t PAK_FILE_ALIGNMENT = 64;
+
+// Engine asset archive, stored little endian exactly as laid out in memory: header, entry table, block table, names
+// and the compressed blocks, the tables starting at aligned offsets.
+struct pak_file_header
+{
+    uint32_t magic;
+    uint32_t format_version;
+    uint32_t entry_count;
+    uint32_t block_count;
+    uint64_t entry_offset;
+    uint64_t block_offset;
+    uint64_t name_offset;
+    uint64_t name_size;
+    // Size of the uncompressed stream, the sum of every entry's size.
+    uint64_t data_size;
+    uint64_t file_size;
+};
+
+// Sorted by path_hash, then name, so a lookup is a binary search that compares names only on equal hashes.
+struct pak_file_entry
+{
+    // hash_fnv1a_64 of the name.
+    uint64_t path_hash;
+    // Where the file starts in the uncompressed stream.
+    uint64_t data_offset;
+    uint64_t size;
+    // Relative path with / separators, in the name section and not null terminated.
+    uint32_t name_offset;
+    uint32_t name_size;
+};
+
+struct pak_file_block
+{
+    uint64_t offset;
+    // A block that did not get smaller is stored as is, compressed_size equals uncompressed_size then.
+    uint32_t compressed_size;
+    uint32_t uncompressed_size;
+};
+
+static_assert(sizeof(pak_file_header) == 64, "pak_file_header is part of the file format");
+static_assert(sizeof(pak_file_entry) == 32, "pak_file_entry is part of the file format");
+static_assert(sizeof(pak_file_block) == 16, "pak_file_block is part of the file format");
+
+struct pak_file_input
+{
+    // Path inside the archive, normalized to / separators when written.
+    std::string name;
+    std::vector<uint8_t> data;
+};
+
+// A pak archive mapped into memory. Opening it validates the tables, blocks are decompressed on read. Many small
+// files come from one mapping with sequential reads instead of an open and a seek each.
+class pak_file
+{
+public:
+    // Throws when the file can not be mapped or is not a valid pak archive.
+    pak_file(const std::filesystem::path& path);
+
+    static std::string name;
+
+    // Replaces path atomically, pak_files mapping the previous file keep seeing it. Fails on duplicate names. The
+    // overload taking a job system compresses the blocks in parallel.
+    static bool write(const std::filesystem::path& path, const std::vector<pak_file_input>& files);
+    static bool write(const std::filesystem::path& path, const std::vector<pak_file_input>& files, job_system& jobs);
+
+    // nullptr when the archive has no file of that name.
+    const pak_file_entry* find(std::string_view file_name) const;
+    // Decompresses the blocks the entry overlaps, in parallel with the overload taking a job system. Throws when a
+    // block is damaged.
+    std::vector<uint8_t> read(const pak_file_entry& entry) const;
+    std::vector<uint8_t> read(const pak_file_entry& entry, job_system& jobs) const;
+    std::string_view get_name(const pak_file_entry& entry) const;
+
+    inline const pak_file_header& get_header() const { return *header; }
+    inline const pak_file_entry* get_entries() const { return reinterpret_cast<const pak_file_entry*>(mapping.get_data() + header->entry_offset); }
+    inline const pak_file_block* get_blocks() const { return reinterpret_cast<const pak_file_block*>(mapping.get_data() + header->block_offset); }
+
+private:
+    static bool write_blocks(const std::filesystem::path& path, const std::vector<pak_file_input>& files, job_system* jobs);
+    std::vector<uint8_t> read_blocks(const pak_file_entry& entry, job_system* jobs) const;
+
+    mapped_file mapping;
+    const pak_file_header* header = nullptr;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+const size_t PIPELINE_CACHE_UUID_SIZE = 16;
+
+// The driver a pipeline cache blob was produced by. Blobs are only usable by the exact same device and driver build,
+// anything else must start from an empty cache.
+struct pipeline_cache_device_identity
+{
+    uint32_t vendor_id = 0;
+    uint32_t device_id = 0;
+    uint32_t driver_version = 0;
+    std::array<uint8_t, PIPELINE_CACHE_UUID_SIZE> pipeline_cache_uuid = {};
+
+    bool operator==(const pipeline_cache_device_identity& other) const = default;
+};
+
+// Persists the opaque blob of a graphics API pipeline cache between runs.
+// The blob is stored along with the identity of the device that produced it and a checksum, so data from another
+// driver, a driver update or a torn write is rejected instead of being handed to the driver. Saves write a temporary
+// file and rename it into place.
+class pipeline_cache_file
+{
+public:
+    pipeline_cache_file(const std::filesystem::path& in_path);
+
+    static std::string name;
+
+    std::optional<std::vector<uint8_t>> load(const pipeline_cache_device_identity& identity) const;
+    bool save(const pipeline_cache_device_identity& identity, const std::vector<uint8_t>& data) const;
+
+    inline const std::filesystem::path& get_path() const { return path; }
+
+private:
+    std::filesystem::path path;
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Zones retained per thread. Older zones are overwritten once a thread's buffer is full.
+const size_t PROFILER_ZONES_PER_THREAD = 64 * 1024;
+// Frame times, and latencies, retained for the statistics.
+const size_t PROFILER_FRAME_HISTORY = 1024;
+
+struct profiler_zone_event
+{
+    // Must outlive the profiler, zones are named with string literals.
+    const char* name;
+    uint64_t start_ns;
+    uint64_t end_ns;
+};
+
+// Frame time or latency distribution over the retained history, in milliseconds. Percentiles use the nearest rank.
+struct profiler_frame_statistics
+{
+    size_t frame_count = 0;
+    double average_ms = 0.0;
+    double minimum_ms = 0.0;
+    double maximum_ms = 0.0;
+    double p50_ms = 0.0;
+    double p95_ms = 0.0;
+    double p99_ms = 0.0;
+};
+
+// Zones recorded by one thread, or by the GPU. The owner appends under its own uncontended mutex, so readers only
+// ever contend with a single writer.
+struct profiler_timeline
+{
+    uint32_t id = 0;
+    std::string name;
+    std::mutex mutex;
+    std::vector<profiler_zone_event> zones;
+    size_t next_zone = 0;
+};
+
+// Process wide frame profiler.
+// CPU zones are timed with profiler_zone, usually through PROFILE_ZONE, and land in a per-thread timeline. GPU zones
+// are resolved by the renderer from timestamp queries and recorded on a dedicated timeline. end_frame() feeds the
+// frame time history behind get_frame_statistics(), and everything retained can be exported as a Chrome trace
+// (chrome://tracing, Perfetto).
+class profiler
+{
+public:
+    static std::string name;
+
+    static profiler& get();
+    // Nanoseconds on a monotonic clock, relative to process start. Every zone uses this time base.
+    static uint64_t now();
+
+    // Zones are dropped while disabled, frame times are still recorded.
+    inline void set_enabled(bool in_enabled) { enabled.store(in_enabled, std::memory_order_relaxed); }
+    inline bool is_enabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    // Names the calling thread's timeline in exported traces.
+    void set_thread_name(const std::string& thread_name);
+
+    void record_zone(const char* zone_name, uint64_t start_ns, uint64_t end_ns);
+    void record_gpu_zone(const char* zone_name, uint64_t start_ns, uint64_t end_ns);
+
+    // Closes the frame that started at the previous end_frame() call and adds its duration to the history.
+    void end_frame(uint64_t end_ns = now());
+    profiler_frame_statistics get_frame_statistics() const;
+    // Time from sampling the input a frame was simulated with to the frame reaching the display, one call per frame.
+    void record_latency(uint64_t input_ns, uint64_t present_ns);
+    profiler_frame_statistics get_latency_statistics() const;
+
+    void write_chrome_trace(std::ostream& out) const;
+    void save_chrome_trace(const std::filesystem::path& path) const;
+
+    // Drops every retained zone and frame time. Thread names are kept.
+    void clear();
+
+private:
+    profiler();
+
+    friend struct profiler_thread_timeline_handle;
+
+    profiler_timeline& get_thread_timeline();
+    void release_thread_timeline(profiler_timeline* timeline);
+    static void append_zone(profiler_timeline& timeline, const profiler_zone_event& zone);
+
+    std::atomic<bool> enabled = true;
+
+    mutable std::mutex timelines_mutex;
+    // one per running thread that recorded a zone or was named.
+    std::vector<std::unique_ptr<profiler_timeline>> thread_timelines;
+    uint32_t last_thread_timeline_id = 0;
+    mutable profiler_timeline gpu_timeline;
+
+    mutable std::mutex frames_mutex;
+    std::vector<uint64_t> frame_durations_ns;
+    size_t next_frame = 0;
+    uint64_t last_frame_end_ns = 0;
+    bool frame_open = false;
+    std::vector<uint64_t> latencies_ns;
+    size_t next_latency = 0;
+};
+
+// Records the time between its construction and destruction as a zone of the calling thread.
+class profiler_zone
+{
+public:
+    explicit profiler_zone(const char* in_zone_name) : zone_name(in_zone_name), start_ns(profiler::now()) {}
+    ~profiler_zone() { profiler::get().record_zone(zone_name, start_ns, profiler::now()); }
+
+    profiler_zone(const profiler_zone&) = delete;
+    profiler_zone& operator=(const profiler_zone&) = delete;
+
+private:
+    const char* zone_name;
+    uint64_t start_ns;
+};
+
+#define PROFILER_CONCATENATE_INNER(a, b) a##b
+#define PROFILER_CONCATENATE(a, b) PROFILER_CONCATENATE_INNER(a, b)
+
+// Zones compile away entirely in builds without PROFILING_ENABLED.
+#if defined(PROFILING_ENABLED)
+#define PROFILE_ZONE(zone_name) profiler_zone PROFILER_CONCATENATE(profiler_zone_, __LINE__)(zone_name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#else
+#define PROFILE_ZONE(zone_name) static_cast<void>(0)
+#define PROFILE_FUNCTION() static_cast<void>(0)
+#endif
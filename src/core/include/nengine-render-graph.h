@@ -0,0 +1,180 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+typedef uint32_t render_graph_resource;
+typedef uint32_t render_graph_pass;
+
+// How a pass uses a resource. Values are bits, so every way a resource is used over the frame fits one mask.
+enum render_graph_access : uint32_t
+{
+    RENDER_GRAPH_ACCESS_NONE = 0,
+    RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT_WRITE = 1u << 0,
+    RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT_WRITE = 1u << 1,
+    RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT_READ = 1u << 2,
+    RENDER_GRAPH_ACCESS_SHADER_READ = 1u << 3,
+    RENDER_GRAPH_ACCESS_STORAGE_WRITE = 1u << 4,
+    RENDER_GRAPH_ACCESS_TRANSFER_READ = 1u << 5,
+    RENDER_GRAPH_ACCESS_TRANSFER_WRITE = 1u << 6,
+    // Owned by the presentation engine, before acquire and after present.
+    RENDER_GRAPH_ACCESS_PRESENT = 1u << 7
+};
+
+inline bool render_graph_is_read(render_graph_access access)
+{
+    return (access & (  RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT_READ
+                        | RENDER_GRAPH_ACCESS_SHADER_READ
+                        | RENDER_GRAPH_ACCESS_TRANSFER_READ)) != 0;
+}
+
+inline bool render_graph_is_write(render_graph_access access)
+{
+    return (access & (  RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT_WRITE
+                        | RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT_WRITE
+                        | RENDER_GRAPH_ACCESS_STORAGE_WRITE
+                        | RENDER_GRAPH_ACCESS_TRANSFER_WRITE)) != 0;
+}
+
+struct render_graph_texture_description
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // Graphics API format, opaque to the graph.
+    uint32_t format = 0;
+};
+
+struct render_graph_memory_requirements
+{
+    uint64_t size = 0;
+    uint64_t alignment = 1;
+    // Memory types the resource can be bound to, resources sharing memory must have one in common.
+    uint32_t memory_type_bits = ~0u;
+};
+
+// Synchronization and layout change of one resource between two accesses.
+struct render_graph_barrier
+{
+    render_graph_resource resource;
+    render_graph_access before;
+    render_graph_access after;
+    // The previous contents are not needed and may be dropped, e.g. on the first use of a transient resource whose
+    // memory was last used by another resource.
+    bool discard;
+};
+
+struct render_graph_resource_info
+{
+    std::string name;
+    render_graph_texture_description description;
+    bool imported = false;
+    // State of imported resources entering and leaving the frame.
+    render_graph_access initial_access = RENDER_GRAPH_ACCESS_NONE;
+    render_graph_access final_access = RENDER_GRAPH_ACCESS_NONE;
+    bool preserve_contents = false;
+
+    // Filled by compile().
+    bool live = false;
+    // Union of the accesses of every live pass, backends derive usage flags from it.
+    uint32_t access_mask = 0;
+    // Dependency levels of the first and last live pass using the resource.
+    uint32_t first_level = 0;
+    uint32_t last_level = 0;
+    render_graph_access last_access = RENDER_GRAPH_ACCESS_NONE;
+    // Transient resources only. Resources with disjoint lifetimes share a memory slot.
+    uint32_t memory_slot = UINT32_MAX;
+    render_graph_memory_requirements memory_requirements;
+};
+
+struct render_graph_memory_slot
+{
+    render_graph_memory_requirements requirements;
+    // Resources bound to the slot, in the order they use it during the frame.
+    std::vector<render_graph_resource> resources;
+};
+
+typedef std::function<void(void* context)> render_graph_execute_function;
+typedef std::function<void(void* context, const render_graph_barrier* barriers, size_t barrier_count)> render_graph_barrier_function;
+typedef std::function<render_graph_memory_requirements(render_graph_resource resource, const render_graph_resource_info& info)> render_graph_memory_function;
+
+// Declarative frame graph.
+// Passes declare the resources they read and write, and compile() turns that into an execution plan:
+//  - passes that contribute to no imported resource and have no side effects are culled,
+//  - the rest are grouped into dependency levels, passes of one level never depend on each other,
+//  - the barriers of a level are batched and only emitted where an access actually changes state or a write is
+//    involved, so reads of the same kind never synchronize,
+//  - transient resources whose lifetimes do not overlap share memory.
+// The graph is API agnostic: backends turn accesses and barriers into API calls through the callbacks.
+class render_graph
+{
+public:
+    static std::string name;
+
+    render_graph_resource create_texture(const std::string& resource_name, const render_graph_texture_description& description);
+    // Resources owned outside the graph, such as swap chain images. They are never culled or aliased.
+    render_graph_resource import_texture(   const std::string& resource_name,
+                                            const render_graph_texture_description& description,
+                                            render_graph_access initial_access,
+                                            render_graph_access final_access,
+                                            bool preserve_contents = false);
+
+    render_graph_pass add_pass(const std::string& pass_name, render_graph_execute_function execute);
+    // A pass accesses each resource once, passes that read and write a resource declare the write. read() takes one
+    // read access and write() one write access, anything else throws.
+    void read(render_graph_pass pass, render_graph_resource resource, render_graph_access access);
+    void write(render_graph_pass pass, render_graph_resource resource, render_graph_access access);
+    // Passes with effects outside the graph (readback, queries) are never culled.
+    void set_side_effects(render_graph_pass pass);
+
+    // memory_requirements is called once per live transient resource, before memory is aliased.
+    void compile(const render_graph_memory_function& memory_requirements);
+    // Runs the barriers of each dependency level, then the level's passes, then the transitions of imported
+    // resources to their final access.
+    void execute(void* context, const render_graph_barrier_function& barriers) const;
+    void clear();
+
+    inline const render_graph_resource_info& get_resource(render_graph_resource resource) const { return resources[resource]; }
+    inline size_t get_resource_count() const { return resources.size(); }
+    inline const std::string& get_pass_name(render_graph_pass pass) const { return passes[pass].name; }
+    inline bool is_pass_culled(render_graph_pass pass) const { return !passes[pass].live; }
+    inline const std::vector<std::vector<render_graph_pass>>& get_levels() const { return levels; }
+    inline const std::vector<render_graph_memory_slot>& get_memory_slots() const { return memory_slots; }
+    size_t get_barrier_count() const;
+    uint64_t get_aliased_memory_bytes() const;
+    uint64_t get_unaliased_memory_bytes() const;
+
+private:
+    struct pass_access
+    {
+        render_graph_resource resource;
+        render_graph_access access;
+    };
+
+    struct pass_info
+    {
+        std::string name;
+        render_graph_execute_function execute;
+        std::vector<pass_access> accesses;
+        bool side_effects = false;
+        bool live = false;
+        uint32_t level = 0;
+    };
+
+    void add_access(render_graph_pass pass, render_graph_resource resource, render_graph_access access, bool write);
+    void cull_passes();
+    void assign_levels();
+    void alias_memory(const render_graph_memory_function& memory_requirements);
+    void plan_barriers();
+
+    std::vector<render_graph_resource_info> resources;
+    std::vector<pass_info> passes;
+
+    std::vector<std::vector<render_graph_pass>> levels;
+    std::vector<std::vector<render_graph_barrier>> level_barriers;
+    std::vector<render_graph_barrier> final_barriers;
+    std::vector<render_graph_memory_slot> memory_slots;
+};
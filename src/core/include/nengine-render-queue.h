@@ -0,0 +1,66 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <glm/glm.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+enum render_command_type : uint32_t
+{
+    RENDER_COMMAND_NONE = 0,
+    // Everything pushed before it belongs to one frame, the renderer draws it once this arrives.
+    RENDER_COMMAND_END_FRAME = 1,
+    // No further commands follow, the render thread exits.
+    RENDER_COMMAND_STOP = 2,
+    RENDER_COMMAND_SET_VIEW_PROJECTION = 3
+};
+
+// Plain data the simulation hands to the renderer. It never refers to graphics API objects, only to indices the
+// renderer resolves on its own thread.
+struct render_command
+{
+    render_command_type type = RENDER_COMMAND_NONE;
+    glm::mat4 matrix = glm::mat4(1.0f);
+    // END_FRAME: profiler::now() when the input the frame was simulated with was sampled.
+    uint64_t timestamp_ns = 0;
+};
+
+// Bounded lock-free queue of render commands, any number of producer threads and one consumer thread.
+// Every cell carries a sequence number telling producers and the consumer whose turn it is, so a push is one compare
+// and swap on the write position and a pop touches no shared position at all. Commands of one producer are popped in
+// the order they were pushed, commands of different producers interleave. The blocking push() and pop() sleep on the
+// sequence of the cell they wait for, so an idle consumer or a producer facing a full queue burns no CPU.
+class render_command_queue
+{
+public:
+    // capacity is rounded up to a power of two.
+    render_command_queue(uint32_t in_capacity);
+
+    static std::string name;
+
+    // Fails when the queue is full.
+    bool try_push(const render_command& command);
+    // Sleeps until the consumer made room.
+    void push(const render_command& command);
+    // Consumer thread only.
+    bool try_pop(render_command& out_command);
+    // Consumer thread only, sleeps until a command arrives.
+    void pop(render_command& out_command);
+
+    inline uint32_t get_capacity() const { return static_cast<uint32_t>(mask + 1); }
+
+private:
+    struct cell
+    {
+        std::atomic<uint64_t> sequence = 0;
+        render_command command;
+    };
+
+    std::unique_ptr<cell[]> cells;
+    uint64_t mask;
+    alignas(64) std::atomic<uint64_t> write_position = 0;
+    // only the consumer reads or writes it, kept off the producers' cache line.
+    alignas(64) uint64_t read_position = 0;
+};
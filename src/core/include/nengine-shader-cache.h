@@ -0,0 +1,51 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+typedef  std::vector<uint32_t> spirv_module;
+
+// Everything that can change the SPIR-V produced for a shader. Two configs with equal keys must compile to
+// identical bytecode, so any new compile option has to be folded into compile_options.
+struct shader_cache_key
+{
+    uint64_t source_hash = 0;
+    // Contents of every included file, see shader_include_cache::hash_includes.
+    uint64_t include_hash = 0;
+    uint32_t shader_kind = 0;
+    std::string entry_point;
+    std::string compile_options;
+    // Versions of the shaderc, glslang and SPIRV-Tools builds linked in, any of them can change the output.
+    std::string compiler_build;
+
+    uint64_t hash() const;
+};
+
+// Content addressed, on-disk store of compiled SPIR-V modules.
+// Entries are written to a temporary file and renamed into place, so concurrent writers and readers
+// (other threads or other processes sharing the directory) only ever observe complete entries.
+class shader_cache
+{
+public:
+    shader_cache(const std::filesystem::path& in_directory);
+
+    static std::string name;
+
+    std::optional<spirv_module> load(const shader_cache_key& key);
+    bool store(const shader_cache_key& key, const spirv_module& module);
+
+    std::filesystem::path get_entry_path(const shader_cache_key& key) const;
+    inline const std::filesystem::path& get_directory() const { return directory; }
+    inline uint64_t get_hit_count() const { return hit_count.load(std::memory_order_relaxed); }
+    inline uint64_t get_miss_count() const { return miss_count.load(std::memory_order_relaxed); }
+
+private:
+    std::filesystem::path directory;
+    std::atomic<uint64_t> hit_count = 0;
+    std::atomic<uint64_t> miss_count = 0;
+};
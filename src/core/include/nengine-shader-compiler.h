@@ -1,18 +1,51 @@
 #pragma once
 
 #include "../../utils/helpers.h"
+#include "nengine-shader-cache.h"
+#include "nengine-shader-includes.h"
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include "shaderc/shaderc.hpp"
 
-typedef  std::vector<uint32_t> spirv_module;
-
 struct shader_compile_config
 {
     std::string shader_code;
     shaderc_shader_kind shader_kind;
     std::string entry_point = "main";
     std::string input_file_name = "unnamed_shader";
+    // Defined before the first line of shader_code, name to value.
+    std::map<std::string, std::string> definitions;
+    // Searched for #include <...>, and for #include "..." when it is not next to the including file.
+    std::vector<std::filesystem::path> include_directories;
+    // Runs the SPIR-V optimizer for performance, meant for release builds. Makes compiles noticeably slower.
+    bool optimize = false;
+};
+
+struct shader_compile_result
+{
+    spirv_module module;
+    std::string error;
+
+    inline bool succeeded() const { return error.empty(); }
+};
+
+// Variants of one shader, selected by a bitmask of features. Permutations that compile to identical SPIR-V, because
+// the features they differ in do not affect the shader's code, share one module.
+struct shader_permutation_result
+{
+    // Unique modules, in the order they were first produced.
+    std::vector<spirv_module> modules;
+    // For every requested feature mask, the index of its module.
+    std::vector<uint32_t> module_indices;
+    // First compile error, nothing is returned when any permutation fails.
+    std::string error;
+
+    inline bool succeeded() const { return error.empty(); }
+    inline const spirv_module& get_module(size_t permutation) const { return modules[module_indices[permutation]]; }
 };
 
 class shader_compiler
@@ -24,4 +57,32 @@ private:
 public:
     static std::string name;
     static spirv_module compile(shader_compile_config& config);
+
+    // Compiles every config concurrently, one shaderc::Compiler per worker thread. Failures do not throw,
+    // they are reported through the result at the same index as their config.
+    // thread_count of 0 uses all hardware threads.
+    static std::vector<shader_compile_result> compile_batch(std::vector<shader_compile_config>& configs, unsigned int thread_count = 0);
+
+    // Compiles base once per feature mask, defining feature_macros[i] as 1 when bit i of the mask is set, all of
+    // them concurrently.
+    static shader_permutation_result compile_permutations(  const shader_compile_config& base,
+                                                            const std::vector<std::string>& feature_macros,
+                                                            const std::vector<uint32_t>& feature_masks,
+                                                            unsigned int thread_count = 0);
+
+    // Compiled modules are looked up in, and written back to, this cache. Pass nullptr to disable caching.
+    static void set_cache(std::shared_ptr<shader_cache> in_cache);
+    static inline std::shared_ptr<shader_cache> get_cache() { return cache; }
+    static shader_cache_key make_cache_key(const shader_compile_config& config);
+
+    // Included files are served from this cache, it is never disabled.
+    static inline std::shared_ptr<shader_include_cache> get_include_cache() { return include_cache; }
+
+private:
+    static spirv_module compile(const shaderc::Compiler& compiler, shader_compile_config& config);
+    static shaderc::CompileOptions make_compile_options(const shader_compile_config& config);
+    static std::string get_compile_options_signature(const shader_compile_config& config);
+
+    static std::shared_ptr<shader_cache> cache;
+    static std::shared_ptr<shader_include_cache> include_cache;
 };
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "shaderc/shaderc.hpp"
+
+struct shader_include_file
+{
+    std::filesystem::path path;
+    std::string contents;
+    uint64_t contents_hash = 0;
+};
+
+// In-memory copies of the files shaders include, shared by every compile. A file is read from disk the first time it
+// is included and again only once its size or modification time changed, so compiling many permutations of shaders
+// that share headers reads each header once. Thread safe.
+class shader_include_cache
+{
+public:
+    static std::string name;
+
+    // nullptr when the file can not be read.
+    std::shared_ptr<const shader_include_file> load(const std::filesystem::path& path);
+
+    // Finds an included file the way the compiler does. Relative includes, #include "...", are looked up next to the
+    // including file before the include directories, standard includes, #include <...>, only in the directories.
+    std::shared_ptr<const shader_include_file> resolve( const std::string& requested_source,
+                                                        const std::filesystem::path& requesting_source,
+                                                        bool relative,
+                                                        const std::vector<std::filesystem::path>& include_directories);
+
+    // Every file source includes, directly or through other includes, each once. Includes are found by scanning for
+    // #include lines without preprocessing, so ones the preprocessor would skip count too. Files that can not be
+    // found are left out.
+    std::vector<std::shared_ptr<const shader_include_file>> find_includes(  const std::string& source,
+                                                                            const std::filesystem::path& source_path,
+                                                                            const std::vector<std::filesystem::path>& include_directories);
+    // Hash of the contents of every file find_includes() returns, 0 when source includes nothing.
+    uint64_t hash_includes( const std::string& source,
+                            const std::filesystem::path& source_path,
+                            const std::vector<std::filesystem::path>& include_directories);
+
+    inline uint64_t get_read_count() const { return read_count.load(std::memory_order_relaxed); }
+
+private:
+    struct cache_entry
+    {
+        std::filesystem::file_time_type write_time;
+        uintmax_t size = 0;
+        // Set once the file was read, compiles that need it meanwhile wait instead of reading it again.
+        std::shared_future<std::shared_ptr<const shader_include_file>> file;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<std::string, cache_entry> entries;
+    std::atomic<uint64_t> read_count = 0;
+};
+
+// Serves the #include directives of one compile from a shader_include_cache.
+class shader_includer : public shaderc::CompileOptions::IncluderInterface
+{
+public:
+    shader_includer(std::shared_ptr<shader_include_cache> in_cache, const std::vector<std::filesystem::path>& in_include_directories);
+
+    shaderc_include_result* GetInclude(const char* requested_source, shaderc_include_type type, const char* requesting_source, size_t include_depth) override;
+    void ReleaseInclude(shaderc_include_result* data) override;
+
+private:
+    // Handed to shaderc, which keeps it until ReleaseInclude. The file keeps the content alive.
+    struct include_result
+    {
+        shaderc_include_result result;
+        std::shared_ptr<const shader_include_file> file;
+        std::string source_name;
+        std::string error;
+    };
+
+    std::shared_ptr<shader_include_cache> cache;
+    std::vector<std::filesystem::path> include_directories;
+};
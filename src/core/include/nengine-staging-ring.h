@@ -0,0 +1,45 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+
+// Ring of staging space for CPU to GPU uploads, as offsets into a buffer the caller owns.
+// Allocations are grouped into batches, each closed with the value a GPU timeline signals once the batch's copies
+// have executed. retire() hands back the space of every batch the GPU is done with, oldest first. allocate() never
+// waits: when the ring is full it fails and the caller retries after a later retire().
+// Not thread safe.
+class staging_ring
+{
+public:
+    staging_ring(uint64_t in_capacity);
+
+    static std::string name;
+
+    // alignment must be a power of two.
+    std::optional<uint64_t> allocate(uint64_t size, uint64_t alignment = 1);
+    // Everything allocated since the previous close_batch is free once the timeline reaches timeline_value.
+    // Values must increase from one batch to the next.
+    void close_batch(uint64_t timeline_value);
+    void retire(uint64_t completed_timeline_value);
+
+    inline uint64_t get_capacity() const { return capacity; }
+    // Includes bytes skipped at the end of the ring when an allocation wrapped around.
+    inline uint64_t get_used_bytes() const { return used_bytes; }
+    inline bool has_open_batch() const { return open_batch_bytes > 0; }
+
+private:
+    struct staging_batch
+    {
+        uint64_t timeline_value;
+        uint64_t bytes;
+    };
+
+    std::deque<staging_batch> batches;
+    uint64_t capacity;
+    uint64_t head = 0;
+    uint64_t used_bytes = 0;
+    uint64_t open_batch_bytes = 0;
+};
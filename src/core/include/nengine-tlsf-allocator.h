@@ -0,0 +1,90 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Each power of two size class is split into 2^TLSF_SECOND_LEVEL_LOG2 linear buckets.
+const uint32_t TLSF_SECOND_LEVEL_LOG2 = 5;
+const uint32_t TLSF_SECOND_LEVEL_COUNT = 1u << TLSF_SECOND_LEVEL_LOG2;
+const uint32_t TLSF_FIRST_LEVEL_COUNT = 64 - TLSF_SECOND_LEVEL_LOG2 + 1;
+
+struct tlsf_allocation
+{
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    // Handle of the range inside its allocator, only meaningful to the allocator that returned it.
+    uint32_t node = 0;
+};
+
+struct tlsf_statistics
+{
+    uint64_t capacity = 0;
+    uint64_t used_bytes = 0;
+    uint64_t free_bytes = 0;
+    uint64_t largest_free_range = 0;
+    uint32_t allocation_count = 0;
+    uint32_t free_range_count = 0;
+
+    // 0 when all free space is one contiguous range, approaching 1 as it is split into many small ranges.
+    inline double get_fragmentation() const
+    {
+        return free_bytes == 0 ? 0.0 : 1.0 - static_cast<double>(largest_free_range) / static_cast<double>(free_bytes);
+    }
+};
+
+// Two level segregated fit allocator over an abstract range of [0, capacity).
+// It never touches the memory it manages, bookkeeping lives on the CPU side, so it can sub-allocate GPU memory,
+// buffers or files. Allocation and release are O(1), and neighbouring free ranges are merged on release.
+// Not thread safe.
+class tlsf_allocator
+{
+public:
+    tlsf_allocator(uint64_t in_capacity);
+
+    static std::string name;
+
+    // alignment must be a power of two. Returns nullopt when no free range is large enough.
+    std::optional<tlsf_allocation> allocate(uint64_t size, uint64_t alignment = 1);
+    void release(const tlsf_allocation& allocation);
+
+    inline uint64_t get_capacity() const { return capacity; }
+    inline uint64_t get_used_bytes() const { return used_bytes; }
+    inline bool is_empty() const { return allocation_count == 0; }
+    // Walks every range, meant for diagnostics rather than per frame use.
+    tlsf_statistics get_statistics() const;
+
+private:
+    static constexpr uint32_t invalid_node = UINT32_MAX;
+
+    struct range_node
+    {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        // Neighbours in address order.
+        uint32_t previous_physical = invalid_node;
+        uint32_t next_physical = invalid_node;
+        // Neighbours in the free list of the node's bucket, only while free.
+        uint32_t previous_free = invalid_node;
+        uint32_t next_free = invalid_node;
+        bool free = false;
+    };
+
+    uint32_t create_node(uint64_t offset, uint64_t size);
+    void destroy_node(uint32_t node);
+    void insert_free(uint32_t node);
+    void remove_free(uint32_t node);
+    uint32_t find_free(uint64_t size) const;
+
+    std::vector<range_node> nodes;
+    std::vector<uint32_t> unused_nodes;
+    uint64_t first_level_bitmap = 0;
+    uint32_t second_level_bitmaps[TLSF_FIRST_LEVEL_COUNT] = {};
+    uint32_t free_heads[TLSF_FIRST_LEVEL_COUNT][TLSF_SECOND_LEVEL_COUNT];
+    uint64_t capacity;
+    uint64_t used_bytes = 0;
+    uint32_t allocation_count = 0;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "../../utils/helpers.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+class job_system;
+
+typedef uint32_t transform_id;
+const transform_id TRANSFORM_NONE = UINT32_MAX;
+// Levels with fewer transforms than this are updated on the calling thread, larger ones in chunks of this size.
+const uint32_t TRANSFORM_PARALLEL_CHUNK_SIZE = 4096;
+
+// Parent relative transforms and their local to world matrices. Every field lives in its own array, sorted by depth,
+// so parents always come before their children and each depth level is one contiguous range. update() is a single
+// linear pass over those arrays: a world matrix is only recomputed when its local transform or its parent's world
+// matrix changed since the last update, so unchanged subtrees cost a flag test per transform.
+class transform_hierarchy
+{
+public:
+    static std::string name;
+
+    transform_id create(transform_id parent = TRANSFORM_NONE, const glm::mat4& local = glm::mat4(1.0f));
+    // Destroys the transform and everything below it. Walks the transforms after it, O(count).
+    void destroy(transform_id id);
+    bool is_alive(transform_id id) const;
+
+    void set_local(transform_id id, const glm::mat4& local);
+    const glm::mat4& get_local(transform_id id) const;
+    // As of the last update().
+    const glm::mat4& get_world(transform_id id) const;
+    transform_id get_parent(transform_id id) const;
+
+    void update();
+    // Same as update(), with the levels that are large enough split into chunks across the job system's threads.
+    void update(job_system& jobs);
+
+    inline size_t get_count() const { return ids.size() - removed_count; }
+    // World matrices recomputed by the last update(), the others were unchanged.
+    inline uint32_t get_updated_count() const { return updated_count.load(std::memory_order_relaxed); }
+
+private:
+    void sort_by_depth();
+    uint32_t update_range(uint32_t begin, uint32_t end);
+    uint32_t get_position(transform_id id) const;
+
+    // Indexed by position, in depth order once sorted. Creating a transform appends it after its parent, destroying
+    // one leaves a hole, both are sorted out before the next update.
+    std::vector<glm::mat4> local_matrices;
+    std::vector<glm::mat4> world_matrices;
+    std::vector<uint32_t> parents;
+    // The local matrix changed since the last update.
+    std::vector<uint8_t> dirty;
+    // The world matrix was recomputed by the current update, children of these are recomputed too.
+    std::vector<uint8_t> changed;
+    // TRANSFORM_NONE for destroyed transforms.
+    std::vector<transform_id> ids;
+    // First position of every depth level, followed by the end of the last one.
+    std::vector<uint32_t> level_starts;
+    bool sorted = true;
+    size_t removed_count = 0;
+
+    // Indexed by id, UINT32_MAX for free ids.
+    std::vector<uint32_t> positions;
+    std::vector<transform_id> free_ids;
+
+    std::atomic<uint32_t> updated_count = 0;
+};
@@ -1,18 +1,94 @@
 #pragma once
 #include "../../utils/helpers.h"
+#include "nengine-ecs.h"
+#include "nengine-frame-allocator.h"
+#include "nengine-job-system.h"
+#include "nengine-profiler.h"
 
 #include <glm/glm.hpp>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <semaphore>
 #include <string>
+#include <thread>
+
+enum nengine_present_mode
+{
+    // Waits for vertical blank and never tears. Always supported.
+    NENGINE_PRESENT_MODE_FIFO = 0,
+    // Waits for vertical blank, but a newer frame replaces one still queued, so the latest frame is shown.
+    NENGINE_PRESENT_MODE_MAILBOX = 1,
+    // Presents at once and may tear.
+    NENGINE_PRESENT_MODE_IMMEDIATE = 2
+};
+
+// When the simulation of the next frame may start.
+enum nengine_frame_wait
+{
+    // As soon as the renderer picked up the previous frame, simulation and rendering overlap.
+    NENGINE_FRAME_WAIT_PIPELINED = 0,
+    // Once the GPU finished the previous frame. Input is sampled as late as possible, CPU and GPU take turns.
+    NENGINE_FRAME_WAIT_GPU_IDLE = 1
+};
+
+// Presets choosing the present mode, queue depth and CPU wait strategy together.
+enum nengine_latency_mode
+{
+    // The settings are used as set.
+    NENGINE_LATENCY_MODE_CUSTOM = 0,
+    // Shortest path from input to display: one frame in flight, mailbox presentation, the simulation waits for the GPU.
+    NENGINE_LATENCY_MODE_LOW_LATENCY = 1,
+    // Most frames per second: three frames in flight, a spare swap chain image, presentation that never waits.
+    NENGINE_LATENCY_MODE_MAX_THROUGHPUT = 2
+};
 
 struct nengine_config
 {
     int resolution[2] = {800, 600};
+    // Headless renderers copy every completed frame here as tightly packed RGBA8 rows,
+    // resolution[0] * resolution[1] * 4 bytes. Left untouched when null.
     void * out_texture = nullptr;
+    // Render into offscreen images without a window, surface or swapchain.
+    bool headless = false;
+    // 0 starts one job worker per hardware thread, minus the main thread.
+    unsigned int job_worker_count = 0;
+    // Overwrites frames_in_flight, swap_chain_image_count, present_mode and frame_wait unless custom.
+    nengine_latency_mode latency_mode = NENGINE_LATENCY_MODE_CUSTOM;
+    // Frames the renderer records ahead of the GPU. One frame arena per frame in flight.
+    unsigned int frames_in_flight = 2;
+    // 0 asks for one image more than the surface's minimum. Clamped to what the surface supports.
+    unsigned int swap_chain_image_count = 0;
+    // Preferred mode, renderers fall back to another one when the surface does not support it.
+    nengine_present_mode present_mode = NENGINE_PRESENT_MODE_MAILBOX;
+    nengine_frame_wait frame_wait = NENGINE_FRAME_WAIT_PIPELINED;
+    size_t frame_allocator_bytes = 16 * 1024 * 1024;
+    // Simulation advances in fixed steps of 1 / simulation_tick_rate seconds, independent of the render rate.
+    double simulation_tick_rate = 60.0;
+    // Upper bound on catch-up ticks per frame, so a long stall can not snowball into ever longer frames.
+    unsigned int max_simulation_ticks_per_frame = 8;
+    // Runs the simulation on its own thread, one frame ahead of rendering.
+    bool threaded_simulation = false;
 };
 
-struct scene
+// Fills in the settings latency_mode stands for. Applied by the nengine constructor, renderers created before the
+// engine call it themselves.
+void nengine_apply_latency_mode(nengine_config& config);
+
+// What the simulation did for one rendered frame.
+struct nengine_frame_timing
 {
+    // Fixed ticks completed since initialize().
+    uint64_t simulation_tick = 0;
+    uint32_t ticks_this_frame = 0;
+    // How far real time has progressed past the last completed tick, in [0, 1). Rendering blends the previous and
+    // current simulation states by this amount so motion stays smooth at any frame rate.
+    double interpolation_alpha = 0.0;
+};
 
+struct scene
+{
+    ecs_world world;
 };
 
 enum nengine_status
@@ -29,18 +105,50 @@ class nengine
 public:
     nengine();
     nengine(nengine_config in_config);
+    ~nengine();
     static nengine_utils::version nengine_version;
     static std::string name;
 
 public:
     void initialize();
     inline int get_status(){ return status; }
+    inline const nengine_config& get_config() const { return config; }
+    inline job_system& get_job_system() { return *jobs; }
+    inline frame_allocator& get_frame_allocator() { return *frame_memory; }
+    inline double get_fixed_timestep() const { return 1.0 / config.simulation_tick_rate; }
     void shutdown();
 
+    // Called once per fixed tick with the tick length in seconds, on the simulation thread when threaded_simulation is set.
+    void set_simulation_callback(std::function<void(double)> in_simulation_callback);
+
+    // Advances the simulation to current_time (seconds, monotonic) and returns the timing rendering should use.
+    // Call once per rendered frame from the main thread. With threaded_simulation the ticks for this frame run
+    // concurrently on the simulation thread and the returned timing is that of the previous frame's ticks.
+    nengine_frame_timing update(double current_time);
+
 protected:    
     void tick();
 
 private:
+    nengine_frame_timing advance_simulation(double frame_time);
+    void simulation_thread_main();
+
     nengine_config config;
     nengine_status status = nengine_status::STOPPED;
+    std::unique_ptr<job_system> jobs = std::make_unique<job_system>();
+    std::unique_ptr<frame_allocator> frame_memory;
+
+    std::function<void(double)> simulation_callback;
+    double simulation_accumulator = 0.0;
+    uint64_t simulation_tick_count = 0;
+    double last_update_time = -1.0;
+
+    // Hand off between the main thread and the simulation thread, which alternate ownership of the fields below.
+    std::thread simulation_thread;
+    std::binary_semaphore simulation_start{0};
+    std::binary_semaphore simulation_done{0};
+    std::atomic<bool> simulation_thread_running = false;
+    bool simulation_in_flight = false;
+    double pending_frame_time = 0.0;
+    nengine_frame_timing completed_frame_timing;
 };
@@ -0,0 +1,634 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include "include/nengine-async-io.h"
+#include "include/nengine.h"
+
+#if defined(__LINUX__)
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+std::string async_io_service::name = "AsyncIOService";
+
+static std::string async_io_format_error(const std::filesystem::path& path, const std::string& reason)
+{
+    std::ostringstream oss;
+    oss << nengine::name << " - " << async_io_service::name << ": Failed to read " << path << ": " << reason;
+    return oss.str();
+}
+
+#if defined(__LINUX__)
+
+// user_data of the eventfd read, every other completion carries the index of its operation.
+const uint64_t ASYNC_IO_WAKE_USER_DATA = UINT64_MAX;
+// A single read returns at most 2 GiB minus a page, larger reads come back short and are continued.
+const uint64_t ASYNC_IO_MAX_READ_SIZE = 1ull << 30;
+
+// liburing is not a dependency, the ring is driven through the raw system calls.
+static int async_io_ring_setup(uint32_t entries, io_uring_params* params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int async_io_ring_enter(int ring, uint32_t to_submit, uint32_t min_complete, uint32_t flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int async_io_ring_register(int ring, uint32_t opcode, const void* arguments, uint32_t count)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, ring, opcode, arguments, count));
+}
+
+// Reads need IORING_OP_READ and IORING_OP_READ_FIXED. Kernels too old to probe predate IORING_OP_READ as well.
+static bool async_io_ring_supports_reads(int ring)
+{
+    std::vector<uint8_t> probe_storage(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(probe_storage.data());
+    if (async_io_ring_register(ring, IORING_REGISTER_PROBE, probe, 256) != 0)
+    {
+        return false;
+    }
+
+    for (const uint32_t opcode : {static_cast<uint32_t>(IORING_OP_READ), static_cast<uint32_t>(IORING_OP_READ_FIXED)})
+    {
+        if (opcode > probe->last_op || (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void async_io_signal(int event_descriptor)
+{
+    const uint64_t value = 1;
+    while (write(event_descriptor, &value, sizeof(value)) < 0 && errno == EINTR)
+    {
+    }
+}
+
+// Opens the file of a request and works out how many bytes to read. Returns why it failed, empty on success.
+static std::string async_io_open(const async_io_request& request, int& out_file, uint64_t& out_size)
+{
+    out_file = open(request.path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat file_status{};
+    if (out_file < 0 || fstat(out_file, &file_status) != 0)
+    {
+        const std::string error = std::strerror(errno);
+        if (out_file >= 0)
+        {
+            close(out_file);
+            out_file = -1;
+        }
+        return error;
+    }
+
+    const uint64_t file_size = static_cast<uint64_t>(file_status.st_size);
+    if (request.offset > file_size || (request.size != 0 && request.size > file_size - request.offset))
+    {
+        close(out_file);
+        out_file = -1;
+        return "the range is past the end of the file";
+    }
+    out_size = request.size != 0 ? request.size : file_size - request.offset;
+    return {};
+}
+
+static void async_io_read_blocking(const async_io_request& request, async_io_result& result)
+{
+    int file = -1;
+    uint64_t size = 0;
+    std::string error = async_io_open(request, file, size);
+    if (error.empty())
+    {
+        result.data.resize(size);
+        for (uint64_t completed = 0; completed < size;)
+        {
+            const ssize_t count = pread(file, result.data.data() + completed, size - completed, static_cast<off_t>(request.offset + completed));
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (count <= 0)
+            {
+                error = count < 0 ? std::strerror(errno) : "unexpected end of file";
+                break;
+            }
+            completed += static_cast<uint64_t>(count);
+        }
+        close(file);
+    }
+
+    if (!error.empty())
+    {
+        result.data.clear();
+        result.error = async_io_format_error(request.path, error);
+    }
+}
+
+#else
+
+static void async_io_read_blocking(const async_io_request& request, async_io_result& result)
+{
+    std::ifstream file_in(request.path, std::ios::binary | std::ios::ate);
+    if (!file_in.is_open())
+    {
+        result.error = async_io_format_error(request.path, "the file can not be opened");
+        return;
+    }
+
+    const uint64_t file_size = static_cast<uint64_t>(file_in.tellg());
+    if (request.offset > file_size || (request.size != 0 && request.size > file_size - request.offset))
+    {
+        result.error = async_io_format_error(request.path, "the range is past the end of the file");
+        return;
+    }
+    result.data.resize(request.size != 0 ? request.size : file_size - request.offset);
+    file_in.seekg(static_cast<std::streamoff>(request.offset));
+    file_in.read(reinterpret_cast<char*>(result.data.data()), static_cast<std::streamsize>(result.data.size()));
+    if (file_in.fail())
+    {
+        result.data.clear();
+        result.error = async_io_format_error(request.path, "unexpected end of file");
+    }
+}
+
+#endif
+
+async_io_service::async_io_service(uint32_t in_queue_depth, bool use_io_uring, uint32_t fallback_thread_count)
+    : queue_depth(std::max(in_queue_depth, 1u))
+{
+#if defined(__LINUX__)
+    if (use_io_uring && create_ring())
+    {
+        threads.emplace_back(&async_io_service::ring_thread_main, this);
+        return;
+    }
+#else
+    UNUSED(use_io_uring);
+#endif
+
+    for (uint32_t i = 0; i < std::max(fallback_thread_count, 1u); ++i)
+    {
+        threads.emplace_back(&async_io_service::fallback_thread_main, this);
+    }
+}
+
+async_io_service::~async_io_service()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+#if defined(__LINUX__)
+    if (wake_descriptor >= 0)
+    {
+        async_io_signal(wake_descriptor);
+    }
+#endif
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+#if defined(__LINUX__)
+    destroy_ring();
+#endif
+}
+
+void async_io_service::submit(std::vector<async_io_request> requests)
+{
+    if (requests.empty())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& request : requests)
+        {
+            const async_io_priority priority = request.priority < ASYNC_IO_PRIORITY_COUNT ? request.priority : ASYNC_IO_PRIORITY_BULK;
+            pending_requests[priority].push_back(std::move(request));
+        }
+    }
+
+    // one wake up for the whole batch, the ring thread then hands it to the kernel in one io_uring_enter.
+    work_available.notify_all();
+#if defined(__LINUX__)
+    if (wake_descriptor >= 0)
+    {
+        async_io_signal(wake_descriptor);
+    }
+#endif
+}
+
+std::future<async_io_result> async_io_service::read(const std::filesystem::path& path, async_io_priority priority)
+{
+    std::vector<std::future<async_io_result>> futures = read_batch({path}, priority);
+    return std::move(futures.front());
+}
+
+std::vector<std::future<async_io_result>> async_io_service::read_batch(const std::vector<std::filesystem::path>& paths, async_io_priority priority)
+{
+    std::vector<std::future<async_io_result>> futures;
+    std::vector<async_io_request> requests;
+    futures.reserve(paths.size());
+    requests.reserve(paths.size());
+    for (const auto& path : paths)
+    {
+        // std::function needs a copyable callback, the promise is shared with it.
+        auto promise = std::make_shared<std::promise<async_io_result>>();
+        futures.push_back(promise->get_future());
+
+        async_io_request request;
+        request.path = path;
+        request.priority = priority;
+        request.on_complete = [promise](async_io_result& result) { promise->set_value(std::move(result)); };
+        requests.push_back(std::move(request));
+    }
+    submit(std::move(requests));
+    return futures;
+}
+
+bool async_io_service::is_using_io_uring() const
+{
+#if defined(__LINUX__)
+    return ring_descriptor >= 0 && !ring_failed.load(std::memory_order_relaxed);
+#else
+    return false;
+#endif
+}
+
+// Takes the oldest request of the most urgent priority, bulk requests only while more than reserved_slots of the
+// free_slots are left. Called with the mutex held.
+bool async_io_service::take_request(async_io_request& out_request, size_t reserved_slots, size_t free_slots)
+{
+    for (uint32_t priority = 0; priority < ASYNC_IO_PRIORITY_COUNT; ++priority)
+    {
+        std::deque<async_io_request>& requests = pending_requests[priority];
+        if (requests.empty())
+        {
+            continue;
+        }
+        if (priority != ASYNC_IO_PRIORITY_STREAMING && free_slots <= reserved_slots)
+        {
+            return false;
+        }
+        out_request = std::move(requests.front());
+        requests.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void async_io_service::fallback_thread_main()
+{
+    for (;;)
+    {
+        async_io_request request;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            bool taken = false;
+            work_available.wait(lock, [this, &request, &taken]
+            {
+                taken = take_request(request, 0, 1);
+                return taken || stopping;
+            });
+            if (!taken)
+            {
+                return;
+            }
+        }
+
+        async_io_result result;
+        result.path = request.path;
+        async_io_read_blocking(request, result);
+        if (request.on_complete)
+        {
+            request.on_complete(result);
+        }
+    }
+}
+
+#if defined(__LINUX__)
+
+bool async_io_service::create_ring()
+{
+    // a slot per read in flight plus the eventfd read, the completion queue gets twice as many entries.
+    io_uring_params params{};
+    ring_descriptor = async_io_ring_setup(queue_depth + 1, &params);
+    if (ring_descriptor < 0)
+    {
+        ring_descriptor = -1;
+        return false;
+    }
+    if (!async_io_ring_supports_reads(ring_descriptor))
+    {
+        destroy_ring();
+        return false;
+    }
+
+    submission_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    completion_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    submission_entries_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* mapped_submission_ring = mmap(nullptr, submission_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_descriptor, IORING_OFF_SQ_RING);
+    void* mapped_completion_ring = mmap(nullptr, completion_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_descriptor, IORING_OFF_CQ_RING);
+    void* mapped_submission_entries = mmap(nullptr, submission_entries_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_descriptor, IORING_OFF_SQES);
+    submission_ring = mapped_submission_ring != MAP_FAILED ? mapped_submission_ring : nullptr;
+    completion_ring = mapped_completion_ring != MAP_FAILED ? mapped_completion_ring : nullptr;
+    submission_entries = mapped_submission_entries != MAP_FAILED ? mapped_submission_entries : nullptr;
+    wake_descriptor = eventfd(0, EFD_CLOEXEC);
+    if (submission_ring == nullptr || completion_ring == nullptr || submission_entries == nullptr || wake_descriptor < 0)
+    {
+        destroy_ring();
+        return false;
+    }
+
+    uint8_t* submission_bytes = static_cast<uint8_t*>(submission_ring);
+    uint8_t* completion_bytes = static_cast<uint8_t*>(completion_ring);
+    submission_head = reinterpret_cast<uint32_t*>(submission_bytes + params.sq_off.head);
+    submission_tail = reinterpret_cast<uint32_t*>(submission_bytes + params.sq_off.tail);
+    submission_mask = *reinterpret_cast<uint32_t*>(submission_bytes + params.sq_off.ring_mask);
+    submission_array = reinterpret_cast<uint32_t*>(submission_bytes + params.sq_off.array);
+    completion_head = reinterpret_cast<uint32_t*>(completion_bytes + params.cq_off.head);
+    completion_tail = reinterpret_cast<uint32_t*>(completion_bytes + params.cq_off.tail);
+    completion_mask = *reinterpret_cast<uint32_t*>(completion_bytes + params.cq_off.ring_mask);
+    completion_entries = completion_bytes + params.cq_off.cqes;
+
+    operations.resize(queue_depth);
+    free_operations.reserve(queue_depth);
+    for (uint32_t i = queue_depth; i > 0; --i)
+    {
+        free_operations.push_back(i - 1);
+    }
+
+    // registering fails when it would lock more memory than RLIMIT_MEMLOCK allows, every read is a plain one then.
+    const size_t registered_buffers_size = queue_depth * ASYNC_IO_REGISTERED_BUFFER_SIZE;
+    registered_buffers = static_cast<uint8_t*>(std::aligned_alloc(4096, registered_buffers_size));
+    if (registered_buffers != nullptr)
+    {
+        std::vector<iovec> buffers(queue_depth);
+        for (uint32_t i = 0; i < queue_depth; ++i)
+        {
+            buffers[i].iov_base = registered_buffers + i * ASYNC_IO_REGISTERED_BUFFER_SIZE;
+            buffers[i].iov_len = ASYNC_IO_REGISTERED_BUFFER_SIZE;
+        }
+        if (async_io_ring_register(ring_descriptor, IORING_REGISTER_BUFFERS, buffers.data(), queue_depth) != 0)
+        {
+            std::free(registered_buffers);
+            registered_buffers = nullptr;
+        }
+    }
+    return true;
+}
+
+void async_io_service::destroy_ring()
+{
+    if (submission_entries != nullptr)
+    {
+        munmap(submission_entries, submission_entries_size);
+        submission_entries = nullptr;
+    }
+    if (completion_ring != nullptr)
+    {
+        munmap(completion_ring, completion_ring_size);
+        completion_ring = nullptr;
+    }
+    if (submission_ring != nullptr)
+    {
+        munmap(submission_ring, submission_ring_size);
+        submission_ring = nullptr;
+    }
+    if (wake_descriptor >= 0)
+    {
+        close(wake_descriptor);
+        wake_descriptor = -1;
+    }
+    // closing the ring unregisters the buffers.
+    if (ring_descriptor >= 0)
+    {
+        close(ring_descriptor);
+        ring_descriptor = -1;
+    }
+    std::free(registered_buffers);
+    registered_buffers = nullptr;
+}
+
+// Next submission queue entry, zeroed and already published. The kernel only looks at the queue inside io_uring_enter
+// on this thread. There is room for a read per slot and the eventfd read, so the queue never runs full.
+void* async_io_service::get_submission_entry()
+{
+    const uint32_t tail = *submission_tail;
+    const uint32_t index = tail & submission_mask;
+    io_uring_sqe* entry = static_cast<io_uring_sqe*>(submission_entries) + index;
+    std::memset(entry, 0, sizeof(io_uring_sqe));
+    submission_array[index] = index;
+    std::atomic_ref<uint32_t>(*submission_tail).store(tail + 1, std::memory_order_release);
+    return entry;
+}
+
+void async_io_service::queue_read(uint32_t operation_index)
+{
+    ring_operation& operation = operations[operation_index];
+    io_uring_sqe* entry = static_cast<io_uring_sqe*>(get_submission_entry());
+    entry->fd = operation.file;
+    entry->off = operation.request.offset + operation.completed;
+    entry->len = static_cast<uint32_t>(std::min(operation.size - operation.completed, ASYNC_IO_MAX_READ_SIZE));
+    entry->user_data = operation_index;
+    if (operation.registered_buffer)
+    {
+        entry->opcode = static_cast<uint8_t>(IORING_OP_READ_FIXED);
+        entry->buf_index = static_cast<uint16_t>(operation_index);
+        entry->addr = reinterpret_cast<uint64_t>(registered_buffers + operation_index * ASYNC_IO_REGISTERED_BUFFER_SIZE + operation.completed);
+    }
+    else
+    {
+        entry->opcode = static_cast<uint8_t>(IORING_OP_READ);
+        entry->addr = reinterpret_cast<uint64_t>(operation.result.data.data() + operation.completed);
+    }
+}
+
+void async_io_service::queue_wake_read()
+{
+    io_uring_sqe* entry = static_cast<io_uring_sqe*>(get_submission_entry());
+    entry->opcode = static_cast<uint8_t>(IORING_OP_READ);
+    entry->fd = wake_descriptor;
+    entry->addr = reinterpret_cast<uint64_t>(&wake_value);
+    entry->len = sizeof(wake_value);
+    entry->user_data = ASYNC_IO_WAKE_USER_DATA;
+}
+
+void async_io_service::open_operation(uint32_t operation_index)
+{
+    ring_operation& operation = operations[operation_index];
+    operation.result.path = operation.request.path;
+    operation.completed = 0;
+
+    const std::string error = async_io_open(operation.request, operation.file, operation.size);
+    if (!error.empty() || operation.size == 0)
+    {
+        finish_operation(operation_index, error);
+        return;
+    }
+
+    operation.registered_buffer = registered_buffers != nullptr && operation.size <= ASYNC_IO_REGISTERED_BUFFER_SIZE;
+    if (!operation.registered_buffer)
+    {
+        operation.result.data.resize(operation.size);
+    }
+    queue_read(operation_index);
+}
+
+void async_io_service::finish_operation(uint32_t operation_index, const std::string& error)
+{
+    ring_operation& operation = operations[operation_index];
+    if (operation.file >= 0)
+    {
+        close(operation.file);
+        operation.file = -1;
+    }
+
+    if (!error.empty())
+    {
+        operation.result.data.clear();
+        operation.result.error = async_io_format_error(operation.request.path, error);
+    }
+    else if (operation.registered_buffer)
+    {
+        const uint8_t* buffer = registered_buffers + operation_index * ASYNC_IO_REGISTERED_BUFFER_SIZE;
+        operation.result.data.assign(buffer, buffer + operation.size);
+        registered_buffer_read_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (operation.request.on_complete)
+    {
+        operation.request.on_complete(operation.result);
+    }
+    operation = {};
+    free_operations.push_back(operation_index);
+}
+
+void async_io_service::ring_thread_main()
+{
+    // slots bulk reads leave free, a streaming read submitted behind a large bulk batch starts right away.
+    const size_t reserved_slots = queue_depth / 4;
+    std::vector<uint32_t> started_operations;
+    started_operations.reserve(queue_depth);
+
+    queue_wake_read();
+    for (;;)
+    {
+        // free_operations belongs to this thread, the mutex only guards the pending requests.
+        started_operations.clear();
+        const bool failed = ring_failed.load(std::memory_order_relaxed);
+        if (failed && free_operations.size() == queue_depth)
+        {
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            async_io_request request;
+            while (!failed && !free_operations.empty() && take_request(request, reserved_slots, free_operations.size()))
+            {
+                const uint32_t operation_index = free_operations.back();
+                free_operations.pop_back();
+                operations[operation_index].request = std::move(request);
+                started_operations.push_back(operation_index);
+            }
+
+            const bool idle = free_operations.size() == queue_depth && pending_requests[ASYNC_IO_PRIORITY_STREAMING].empty() && pending_requests[ASYNC_IO_PRIORITY_BULK].empty();
+            if (stopping && idle)
+            {
+                break;
+            }
+        }
+
+        for (const uint32_t operation_index : started_operations)
+        {
+            open_operation(operation_index);
+        }
+
+        // submits everything queued since the last call. Reads that failed to open finished without a completion, so
+        // it only waits when nothing was started and the next completion or eventfd read is what there is to do.
+        const uint32_t unsubmitted = *submission_tail - std::atomic_ref<uint32_t>(*submission_head).load(std::memory_order_acquire);
+        const uint32_t min_complete = started_operations.empty() ? 1 : 0;
+        if (async_io_ring_enter(ring_descriptor, unsubmitted, min_complete, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            std::cerr << nengine::name << " - " << async_io_service::name << ": io_uring_enter failed: " << std::strerror(errno) << std::endl;
+        }
+
+        uint32_t head = *completion_head;
+        const uint32_t tail = std::atomic_ref<uint32_t>(*completion_tail).load(std::memory_order_acquire);
+        for (; head != tail; ++head)
+        {
+            const io_uring_cqe& completion = static_cast<const io_uring_cqe*>(completion_entries)[head & completion_mask];
+            if (completion.user_data == ASYNC_IO_WAKE_USER_DATA)
+            {
+                // without the eventfd read nothing wakes the ring for new requests.
+                if (completion.res < 0)
+                {
+                    std::cerr   << nengine::name << " - " << async_io_service::name << ": Reading the wake eventfd failed: "
+                                << std::strerror(-completion.res) << ", finishing the reads in flight and reading without the ring." << std::endl;
+                    ring_failed.store(true, std::memory_order_relaxed);
+                }
+                else
+                {
+                    queue_wake_read();
+                }
+                continue;
+            }
+
+            const uint32_t operation_index = static_cast<uint32_t>(completion.user_data);
+            ring_operation& operation = operations[operation_index];
+            if (completion.res == -EINTR || completion.res == -EAGAIN)
+            {
+                queue_read(operation_index);
+            }
+            else if (completion.res < 0)
+            {
+                finish_operation(operation_index, std::strerror(-completion.res));
+            }
+            else if (completion.res == 0)
+            {
+                finish_operation(operation_index, "unexpected end of file");
+            }
+            else
+            {
+                // short reads continue where they stopped.
+                operation.completed += static_cast<uint64_t>(completion.res);
+                if (operation.completed < operation.size)
+                {
+                    queue_read(operation_index);
+                }
+                else
+                {
+                    finish_operation(operation_index, {});
+                }
+            }
+        }
+        std::atomic_ref<uint32_t>(*completion_head).store(head, std::memory_order_release);
+    }
+
+    // submit() still notifies work_available, so this thread carries on like a fallback thread.
+    if (ring_failed.load(std::memory_order_relaxed))
+    {
+        fallback_thread_main();
+    }
+}
+
+#endif
@@ -0,0 +1,52 @@
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "include/nengine-atomic-file.h"
+#include "include/nengine.h"
+
+std::atomic<uint64_t> atomic_file_temp_counter = 0;
+
+bool atomic_file_write(const std::filesystem::path& path, std::initializer_list<atomic_file_part> parts, const std::string& owner_name)
+{
+    // unique across threads and processes writing the same path.
+    std::ostringstream temp_suffix;
+    temp_suffix << ".tmp." << std::hex << std::hash<std::thread::id>{}(std::this_thread::get_id())
+                << "." << std::chrono::steady_clock::now().time_since_epoch().count()
+                << "." << atomic_file_temp_counter.fetch_add(1, std::memory_order_relaxed);
+    std::filesystem::path temp_path = path;
+    temp_path += temp_suffix.str();
+
+    {
+        std::ofstream file_out(temp_path, std::ios::binary | std::ios::trunc);
+        for (const atomic_file_part& part : parts)
+        {
+            file_out.write(static_cast<const char*>(part.data), static_cast<std::streamsize>(part.size));
+        }
+        file_out.close();
+        if (file_out.fail())
+        {
+            std::cerr << nengine::name << " - " << owner_name << ": Failed to write " << temp_path << std::endl;
+            std::error_code remove_error;
+            std::filesystem::remove(temp_path, remove_error);
+            return false;
+        }
+    }
+
+    std::error_code rename_error;
+    std::filesystem::rename(temp_path, path, rename_error);
+    if (rename_error)
+    {
+        std::cerr   << nengine::name << " - " << owner_name
+                    << ": Failed to commit " << path << ": " << rename_error.message() << std::endl;
+        std::error_code remove_error;
+        std::filesystem::remove(temp_path, remove_error);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,655 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "include/nengine-bvh.h"
+#include "include/nengine-job-system.h"
+#include "include/nengine.h"
+
+std::string bvh::name = "BVH";
+
+const uint32_t BVH_SAH_BIN_COUNT = 16;
+// Past this depth splits fall back to the median, which bounds the depth of the tree and so the traversal stack.
+const uint32_t BVH_MAX_SAH_DEPTH = 48;
+const uint32_t BVH_STACK_SIZE = 128;
+
+struct bvh::build_task
+{
+    bvh* tree;
+    uint32_t node_index;
+    uint32_t first;
+    uint32_t count;
+    uint32_t depth;
+    job_system* jobs;
+};
+
+static inline bvh_aabb bvh_empty_bounds()
+{
+    return {glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+}
+
+static inline bool bvh_is_empty(const bvh_aabb& bounds)
+{
+    return bounds.minimum.x > bounds.maximum.x || bounds.minimum.y > bounds.maximum.y || bounds.minimum.z > bounds.maximum.z;
+}
+
+static inline void bvh_grow(bvh_aabb& bounds, const bvh_aabb& other)
+{
+    bounds.minimum = glm::min(bounds.minimum, other.minimum);
+    bounds.maximum = glm::max(bounds.maximum, other.maximum);
+}
+
+static inline glm::vec3 bvh_center(const bvh_aabb& bounds)
+{
+    return (bounds.minimum + bounds.maximum) * 0.5f;
+}
+
+static inline float bvh_surface_area(const bvh_aabb& bounds)
+{
+    if (bvh_is_empty(bounds))
+    {
+        return 0.0f;
+    }
+    const glm::vec3 extent = bounds.maximum - bounds.minimum;
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+static inline bool bvh_overlaps(const bvh_aabb& a, const bvh_aabb& b)
+{
+    return a.minimum.x <= b.maximum.x && a.maximum.x >= b.minimum.x &&
+           a.minimum.y <= b.maximum.y && a.maximum.y >= b.minimum.y &&
+           a.minimum.z <= b.maximum.z && a.maximum.z >= b.minimum.z;
+}
+
+// Outside when the corner furthest along a plane's normal is behind it. Conservative near the frustum's edges.
+static inline bool bvh_in_frustum(const bvh_frustum& frustum, const bvh_aabb& bounds)
+{
+    if (bvh_is_empty(bounds))
+    {
+        return false;
+    }
+    for (const glm::vec4& plane : frustum.planes)
+    {
+        const float x = plane.x >= 0.0f ? bounds.maximum.x : bounds.minimum.x;
+        const float y = plane.y >= 0.0f ? bounds.maximum.y : bounds.minimum.y;
+        const float z = plane.z >= 0.0f ? bounds.maximum.z : bounds.minimum.z;
+        if (plane.x * x + plane.y * y + plane.z * z + plane.w < 0.0f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Slab test, out_distance is where the ray enters the bounds. Axes the ray is parallel to only check the origin.
+static inline bool bvh_ray_enters(const bvh_aabb& bounds, const bvh_ray& ray, const glm::vec3& inverse_direction, float max_distance, float& out_distance)
+{
+    if (bvh_is_empty(bounds))
+    {
+        return false;
+    }
+    float enter = 0.0f;
+    float leave = max_distance;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (!(std::fabs(ray.direction[axis]) > 0.0f))
+        {
+            if (ray.origin[axis] < bounds.minimum[axis] || ray.origin[axis] > bounds.maximum[axis])
+            {
+                return false;
+            }
+            continue;
+        }
+        float slab_enter = (bounds.minimum[axis] - ray.origin[axis]) * inverse_direction[axis];
+        float slab_leave = (bounds.maximum[axis] - ray.origin[axis]) * inverse_direction[axis];
+        if (slab_enter > slab_leave)
+        {
+            std::swap(slab_enter, slab_leave);
+        }
+        enter = std::max(enter, slab_enter);
+        leave = std::min(leave, slab_leave);
+        if (enter > leave)
+        {
+            return false;
+        }
+    }
+    out_distance = enter;
+    return true;
+}
+
+static inline uint32_t bvh_bin(float centroid, float minimum, float scale)
+{
+    return std::min(BVH_SAH_BIN_COUNT - 1, static_cast<uint32_t>((centroid - minimum) * scale));
+}
+
+bvh::bvh(uint32_t in_rebuild_interval) : rebuild_interval(in_rebuild_interval)
+{
+}
+
+bvh_object_id bvh::insert(const bvh_aabb& bounds)
+{
+    bvh_object_id id;
+    if (!free_ids.empty())
+    {
+        id = free_ids.back();
+        free_ids.pop_back();
+    }
+    else
+    {
+        id = static_cast<bvh_object_id>(object_bounds.size());
+        object_bounds.emplace_back();
+        object_states.push_back(BVH_OBJECT_FREE);
+        object_leaves.push_back(UINT32_MAX);
+    }
+
+    object_bounds[id] = bounds;
+    object_states[id] = BVH_OBJECT_PENDING;
+    object_leaves[id] = UINT32_MAX;
+    pending_objects.push_back(id);
+    ++object_count;
+    return id;
+}
+
+void bvh::remove(bvh_object_id id)
+{
+    check_object(id);
+    object_states[id] = BVH_OBJECT_REMOVED;
+    removed_ids.push_back(id);
+    if (object_leaves[id] != UINT32_MAX)
+    {
+        // shrinks its leaf at the next refit.
+        moved_objects.push_back(id);
+    }
+    --object_count;
+}
+
+void bvh::move(bvh_object_id id, const bvh_aabb& bounds)
+{
+    check_object(id);
+    object_bounds[id] = bounds;
+    if (object_leaves[id] != UINT32_MAX)
+    {
+        moved_objects.push_back(id);
+    }
+}
+
+const bvh_aabb& bvh::get_bounds(bvh_object_id id) const
+{
+    check_object(id);
+    return object_bounds[id];
+}
+
+void bvh::update()
+{
+    if (needs_rebuild())
+    {
+        build(nullptr);
+        return;
+    }
+    refit();
+}
+
+void bvh::update(job_system& jobs)
+{
+    if (needs_rebuild())
+    {
+        build(&jobs);
+        return;
+    }
+    refit();
+}
+
+void bvh::rebuild()
+{
+    build(nullptr);
+}
+
+void bvh::rebuild(job_system& jobs)
+{
+    build(&jobs);
+}
+
+bool bvh::needs_rebuild()
+{
+    // only updates that changed something make the tree older, a static scene is never rebuilt.
+    const size_t stale_count = pending_objects.size() + removed_ids.size();
+    if (stale_count > 0 || !moved_objects.empty())
+    {
+        ++updates_since_build;
+    }
+    return updates_since_build >= rebuild_interval || stale_count * 8 > object_count;
+}
+
+void bvh::build(job_system* jobs)
+{
+    for (bvh_object_id id : removed_ids)
+    {
+        object_states[id] = BVH_OBJECT_FREE;
+        free_ids.push_back(id);
+    }
+    removed_ids.clear();
+    pending_objects.clear();
+    moved_objects.clear();
+
+    leaf_objects.clear();
+    object_leaves.assign(object_states.size(), UINT32_MAX);
+    for (bvh_object_id id = 0; id < object_states.size(); ++id)
+    {
+        if (object_states[id] == BVH_OBJECT_PENDING || object_states[id] == BVH_OBJECT_IN_TREE)
+        {
+            object_states[id] = BVH_OBJECT_IN_TREE;
+            leaf_objects.push_back(id);
+        }
+    }
+
+    nodes.clear();
+    node_parents.clear();
+    const uint32_t count = static_cast<uint32_t>(leaf_objects.size());
+    if (count > 0)
+    {
+        // a binary tree with at least one object per leaf never needs more, the nodes don't move while jobs build.
+        nodes.resize(2 * count - 1);
+        node_parents.resize(2 * count - 1);
+        node_parents[0] = UINT32_MAX;
+        allocated_node_count.store(1, std::memory_order_relaxed);
+        build_node(0, 0, count, 0, jobs);
+        nodes.resize(allocated_node_count.load(std::memory_order_relaxed));
+        node_parents.resize(nodes.size());
+    }
+
+    updates_since_build = 0;
+    ++build_count;
+}
+
+void bvh::build_node(uint32_t node_index, uint32_t first, uint32_t count, uint32_t depth, job_system* jobs)
+{
+    bvh_aabb bounds = bvh_empty_bounds();
+    bvh_aabb centroid_bounds = bvh_empty_bounds();
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+        const bvh_aabb& object = object_bounds[leaf_objects[i]];
+        bvh_grow(bounds, object);
+        const glm::vec3 center = bvh_center(object);
+        bvh_grow(centroid_bounds, {center, center});
+    }
+
+    node& current = nodes[node_index];
+    current.bounds = bounds;
+    if (count <= BVH_MAX_LEAF_SIZE)
+    {
+        current.first = first;
+        current.count = count;
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            object_leaves[leaf_objects[i]] = node_index;
+        }
+        return;
+    }
+
+    // binned SAH over the centroids: the split minimising left count * left area + right count * right area.
+    int split_axis = -1;
+    uint32_t split_bin = 0;
+    float best_cost = FLT_MAX;
+    for (int axis = 0; axis < 3 && depth < BVH_MAX_SAH_DEPTH; ++axis)
+    {
+        const float extent = centroid_bounds.maximum[axis] - centroid_bounds.minimum[axis];
+        if (!(extent > 0.0f))
+        {
+            continue;
+        }
+        const float scale = static_cast<float>(BVH_SAH_BIN_COUNT) / extent;
+
+        uint32_t bin_counts[BVH_SAH_BIN_COUNT] = {};
+        bvh_aabb bin_bounds[BVH_SAH_BIN_COUNT];
+        std::fill(bin_bounds, bin_bounds + BVH_SAH_BIN_COUNT, bvh_empty_bounds());
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            const bvh_aabb& object = object_bounds[leaf_objects[i]];
+            const uint32_t bin = bvh_bin(bvh_center(object)[axis], centroid_bounds.minimum[axis], scale);
+            ++bin_counts[bin];
+            bvh_grow(bin_bounds[bin], object);
+        }
+
+        // left_*[b] covers bins [0, b], the right side is swept back from the last bin.
+        float left_areas[BVH_SAH_BIN_COUNT - 1];
+        uint32_t left_counts[BVH_SAH_BIN_COUNT - 1];
+        bvh_aabb left = bvh_empty_bounds();
+        uint32_t left_count = 0;
+        for (uint32_t bin = 0; bin + 1 < BVH_SAH_BIN_COUNT; ++bin)
+        {
+            bvh_grow(left, bin_bounds[bin]);
+            left_count += bin_counts[bin];
+            left_areas[bin] = bvh_surface_area(left);
+            left_counts[bin] = left_count;
+        }
+        bvh_aabb right = bvh_empty_bounds();
+        uint32_t right_count = 0;
+        for (uint32_t bin = BVH_SAH_BIN_COUNT - 1; bin > 0; --bin)
+        {
+            bvh_grow(right, bin_bounds[bin]);
+            right_count += bin_counts[bin];
+            if (left_counts[bin - 1] == 0 || right_count == 0)
+            {
+                continue;
+            }
+            const float cost = static_cast<float>(left_counts[bin - 1]) * left_areas[bin - 1] + static_cast<float>(right_count) * bvh_surface_area(right);
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                split_axis = axis;
+                split_bin = bin;
+            }
+        }
+    }
+
+    uint32_t middle;
+    auto objects_begin = leaf_objects.begin() + static_cast<std::ptrdiff_t>(first);
+    auto objects_end = objects_begin + static_cast<std::ptrdiff_t>(count);
+    if (split_axis >= 0)
+    {
+        const float minimum = centroid_bounds.minimum[split_axis];
+        const float scale = static_cast<float>(BVH_SAH_BIN_COUNT) / (centroid_bounds.maximum[split_axis] - minimum);
+        auto split = std::partition(objects_begin, objects_end, [&](bvh_object_id id)
+        {
+            return bvh_bin(bvh_center(object_bounds[id])[split_axis], minimum, scale) < split_bin;
+        });
+        middle = first + static_cast<uint32_t>(split - objects_begin);
+    }
+    else
+    {
+        // all centroids in one spot, or too deep: split at the median of the longest axis.
+        const glm::vec3 extent = centroid_bounds.maximum - centroid_bounds.minimum;
+        const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+        middle = first + count / 2;
+        std::nth_element(objects_begin, leaf_objects.begin() + static_cast<std::ptrdiff_t>(middle), objects_end, [&](bvh_object_id a, bvh_object_id b)
+        {
+            return bvh_center(object_bounds[a])[axis] < bvh_center(object_bounds[b])[axis];
+        });
+    }
+
+    const uint32_t left = allocated_node_count.fetch_add(2, std::memory_order_relaxed);
+    current.first = left;
+    current.count = 0;
+    node_parents[left] = node_index;
+    node_parents[left + 1] = node_index;
+
+    const uint32_t left_count = middle - first;
+    if (jobs && count > BVH_PARALLEL_BUILD_SIZE)
+    {
+        build_task task{this, left, first, left_count, depth + 1, jobs};
+        job_counter counter;
+        jobs->run(build_node_job, &task, &counter);
+        build_node(left + 1, middle, count - left_count, depth + 1, jobs);
+        jobs->wait(counter);
+        return;
+    }
+    build_node(left, first, left_count, depth + 1, jobs);
+    build_node(left + 1, middle, count - left_count, depth + 1, jobs);
+}
+
+void bvh::build_node_job(void* data)
+{
+    build_task& task = *static_cast<build_task*>(data);
+    task.tree->build_node(task.node_index, task.first, task.count, task.depth, task.jobs);
+}
+
+// Recomputes the boxes on the path from each moved object's leaf to the root, stopping where a box did not change.
+// When many objects moved, one pass over every node backwards, children before parents, is cheaper.
+void bvh::refit()
+{
+    if (moved_objects.empty())
+    {
+        return;
+    }
+
+    auto fit = [this](uint32_t node_index)
+    {
+        const node& current = nodes[node_index];
+        bvh_aabb bounds = bvh_empty_bounds();
+        if (current.count > 0)
+        {
+            for (uint32_t i = current.first; i < current.first + current.count; ++i)
+            {
+                if (object_states[leaf_objects[i]] == BVH_OBJECT_IN_TREE)
+                {
+                    bvh_grow(bounds, object_bounds[leaf_objects[i]]);
+                }
+            }
+        }
+        else
+        {
+            bvh_grow(bounds, nodes[current.first].bounds);
+            bvh_grow(bounds, nodes[current.first + 1].bounds);
+        }
+        return bounds;
+    };
+
+    if (moved_objects.size() * 8 > nodes.size())
+    {
+        for (uint32_t node_index = static_cast<uint32_t>(nodes.size()); node_index-- > 0;)
+        {
+            nodes[node_index].bounds = fit(node_index);
+        }
+    }
+    else
+    {
+        for (bvh_object_id id : moved_objects)
+        {
+            for (uint32_t node_index = object_leaves[id]; node_index != UINT32_MAX; node_index = node_parents[node_index])
+            {
+                const bvh_aabb bounds = fit(node_index);
+                if (std::memcmp(&bounds, &nodes[node_index].bounds, sizeof(bvh_aabb)) == 0)
+                {
+                    break;
+                }
+                nodes[node_index].bounds = bounds;
+            }
+        }
+    }
+    moved_objects.clear();
+}
+
+template<typename visit_type>
+void bvh::visit(const visit_type& overlaps, std::vector<bvh_object_id>& out_objects) const
+{
+    for (bvh_object_id id : pending_objects)
+    {
+        if (object_states[id] == BVH_OBJECT_PENDING && overlaps(object_bounds[id]))
+        {
+            out_objects.push_back(id);
+        }
+    }
+    if (nodes.empty())
+    {
+        return;
+    }
+
+    uint32_t stack[BVH_STACK_SIZE];
+    uint32_t stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0)
+    {
+        const node& current = nodes[stack[--stack_size]];
+        if (!overlaps(current.bounds))
+        {
+            continue;
+        }
+        if (current.count == 0)
+        {
+            stack[stack_size++] = current.first + 1;
+            stack[stack_size++] = current.first;
+            continue;
+        }
+        for (uint32_t i = current.first; i < current.first + current.count; ++i)
+        {
+            const bvh_object_id id = leaf_objects[i];
+            if (object_states[id] == BVH_OBJECT_IN_TREE && overlaps(object_bounds[id]))
+            {
+                out_objects.push_back(id);
+            }
+        }
+    }
+}
+
+// Nearest child first, and nothing that starts further away than the nearest hit so far.
+void bvh::ray_query(const bvh_ray& ray, bvh_ray_hit& out_hit) const
+{
+    out_hit = {};
+    const glm::vec3 inverse_direction(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+    float nearest = ray.max_distance;
+    float distance = 0.0f;
+    for (bvh_object_id id : pending_objects)
+    {
+        if (object_states[id] == BVH_OBJECT_PENDING && bvh_ray_enters(object_bounds[id], ray, inverse_direction, nearest, distance) &&
+            (out_hit.object == BVH_NONE || distance < nearest))
+        {
+            out_hit = {id, distance};
+            nearest = distance;
+        }
+    }
+    if (nodes.empty() || !bvh_ray_enters(nodes[0].bounds, ray, inverse_direction, nearest, distance))
+    {
+        return;
+    }
+
+    uint32_t stack[BVH_STACK_SIZE];
+    float stack_distances[BVH_STACK_SIZE];
+    uint32_t stack_size = 0;
+    stack[stack_size] = 0;
+    stack_distances[stack_size++] = distance;
+    while (stack_size > 0)
+    {
+        --stack_size;
+        if (out_hit.object != BVH_NONE && stack_distances[stack_size] >= nearest)
+        {
+            continue;
+        }
+        const node& current = nodes[stack[stack_size]];
+        if (current.count > 0)
+        {
+            for (uint32_t i = current.first; i < current.first + current.count; ++i)
+            {
+                const bvh_object_id id = leaf_objects[i];
+                if (object_states[id] == BVH_OBJECT_IN_TREE && bvh_ray_enters(object_bounds[id], ray, inverse_direction, nearest, distance) &&
+                    (out_hit.object == BVH_NONE || distance < nearest))
+                {
+                    out_hit = {id, distance};
+                    nearest = distance;
+                }
+            }
+            continue;
+        }
+
+        float left_distance = 0.0f;
+        float right_distance = 0.0f;
+        const bool left_hit = bvh_ray_enters(nodes[current.first].bounds, ray, inverse_direction, nearest, left_distance);
+        const bool right_hit = bvh_ray_enters(nodes[current.first + 1].bounds, ray, inverse_direction, nearest, right_distance);
+        if (left_hit && right_hit)
+        {
+            const bool left_first = left_distance <= right_distance;
+            stack[stack_size] = left_first ? current.first + 1 : current.first;
+            stack_distances[stack_size++] = left_first ? right_distance : left_distance;
+            stack[stack_size] = left_first ? current.first : current.first + 1;
+            stack_distances[stack_size++] = left_first ? left_distance : right_distance;
+        }
+        else if (left_hit || right_hit)
+        {
+            stack[stack_size] = left_hit ? current.first : current.first + 1;
+            stack_distances[stack_size++] = left_hit ? left_distance : right_distance;
+        }
+    }
+}
+
+// Each query collects into its own list, so the lists can be filled in parallel, then they are packed back to back.
+template<typename query_type, typename function_type>
+void bvh::query_batch(const std::vector<query_type>& queries, bvh_query_results& out_results, job_system* jobs, const function_type& function)
+{
+    const uint32_t count = static_cast<uint32_t>(queries.size());
+    std::vector<std::vector<bvh_object_id>> found(count);
+    if (jobs)
+    {
+        jobs->parallel_for(count, BVH_QUERY_BATCH_SIZE, [&](uint32_t i)
+        {
+            function(queries[i], found[i]);
+        });
+    }
+    else
+    {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            function(queries[i], found[i]);
+        }
+    }
+
+    out_results.objects.clear();
+    out_results.offsets.resize(count + 1);
+    out_results.offsets[0] = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        out_results.objects.insert(out_results.objects.end(), found[i].begin(), found[i].end());
+        out_results.offsets[i + 1] = static_cast<uint32_t>(out_results.objects.size());
+    }
+}
+
+void bvh::overlap(const std::vector<bvh_aabb>& boxes, bvh_query_results& out_results) const
+{
+    query_batch(boxes, out_results, nullptr, [this](const bvh_aabb& box, std::vector<bvh_object_id>& out_objects)
+    {
+        visit([&](const bvh_aabb& bounds) { return bvh_overlaps(bounds, box); }, out_objects);
+    });
+}
+
+void bvh::overlap(const std::vector<bvh_aabb>& boxes, bvh_query_results& out_results, job_system& jobs) const
+{
+    query_batch(boxes, out_results, &jobs, [this](const bvh_aabb& box, std::vector<bvh_object_id>& out_objects)
+    {
+        visit([&](const bvh_aabb& bounds) { return bvh_overlaps(bounds, box); }, out_objects);
+    });
+}
+
+void bvh::cull(const std::vector<bvh_frustum>& frustums, bvh_query_results& out_results) const
+{
+    query_batch(frustums, out_results, nullptr, [this](const bvh_frustum& frustum, std::vector<bvh_object_id>& out_objects)
+    {
+        visit([&](const bvh_aabb& bounds) { return bvh_in_frustum(frustum, bounds); }, out_objects);
+    });
+}
+
+void bvh::cull(const std::vector<bvh_frustum>& frustums, bvh_query_results& out_results, job_system& jobs) const
+{
+    query_batch(frustums, out_results, &jobs, [this](const bvh_frustum& frustum, std::vector<bvh_object_id>& out_objects)
+    {
+        visit([&](const bvh_aabb& bounds) { return bvh_in_frustum(frustum, bounds); }, out_objects);
+    });
+}
+
+void bvh::raycast(const std::vector<bvh_ray>& rays, std::vector<bvh_ray_hit>& out_hits) const
+{
+    out_hits.resize(rays.size());
+    for (size_t i = 0; i < rays.size(); ++i)
+    {
+        ray_query(rays[i], out_hits[i]);
+    }
+}
+
+void bvh::raycast(const std::vector<bvh_ray>& rays, std::vector<bvh_ray_hit>& out_hits, job_system& jobs) const
+{
+    out_hits.resize(rays.size());
+    jobs.parallel_for(static_cast<uint32_t>(rays.size()), BVH_QUERY_BATCH_SIZE, [&](uint32_t i)
+    {
+        ray_query(rays[i], out_hits[i]);
+    });
+}
+
+void bvh::check_object(bvh_object_id id) const
+{
+    if (id >= object_states.size() || (object_states[id] != BVH_OBJECT_PENDING && object_states[id] != BVH_OBJECT_IN_TREE))
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << bvh::name << ": Object " << id << " does not exist.";
+        throw std::invalid_argument(oss.str());
+    }
+}
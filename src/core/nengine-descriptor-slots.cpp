@@ -0,0 +1,56 @@
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "include/nengine-descriptor-slots.h"
+#include "include/nengine.h"
+
+std::string descriptor_slot_allocator::name = "DescriptorSlotAllocator";
+
+descriptor_slot_allocator::descriptor_slot_allocator(uint32_t in_capacity) : capacity(in_capacity), allocated(in_capacity, false)
+{
+    // ascending order is already a valid min-heap.
+    free_slots.reserve(capacity);
+    for (uint32_t slot = 0; slot < capacity; ++slot)
+    {
+        free_slots.push_back(slot);
+    }
+}
+
+std::optional<uint32_t> descriptor_slot_allocator::allocate()
+{
+    if (free_slots.empty())
+    {
+        return std::nullopt;
+    }
+
+    std::pop_heap(free_slots.begin(), free_slots.end(), std::greater<uint32_t>());
+    const uint32_t slot = free_slots.back();
+    free_slots.pop_back();
+    allocated[slot] = true;
+    return slot;
+}
+
+void descriptor_slot_allocator::free(uint32_t slot, uint64_t retire_value)
+{
+    if (slot >= capacity || !allocated[slot])
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << descriptor_slot_allocator::name << ": Slot " << slot << " is not allocated.";
+        throw std::invalid_argument(oss.str());
+    }
+
+    allocated[slot] = false;
+    retiring_slots.push_back({slot, retire_value});
+}
+
+void descriptor_slot_allocator::retire(uint64_t completed_value)
+{
+    while (!retiring_slots.empty() && retiring_slots.front().retire_value <= completed_value)
+    {
+        free_slots.push_back(retiring_slots.front().slot);
+        std::push_heap(free_slots.begin(), free_slots.end(), std::greater<uint32_t>());
+        retiring_slots.pop_front();
+    }
+}
@@ -0,0 +1,278 @@
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "include/nengine-ecs.h"
+#include "include/nengine.h"
+
+std::string ecs_world::name = "ECS";
+
+// ecs_component_registry
+//------------------------------------------------------------------------------
+
+std::mutex ecs_component_registry_mutex;
+std::vector<ecs_component_type_info> ecs_component_registry_types;
+
+component_type_id ecs_component_registry::register_type(size_t size, size_t alignment)
+{
+    std::lock_guard<std::mutex> lock(ecs_component_registry_mutex);
+    if (ecs_component_registry_types.size() >= ECS_MAX_COMPONENT_TYPES)
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << ecs_world::name << ": More than " << ECS_MAX_COMPONENT_TYPES << " component types registered.";
+        throw std::runtime_error(oss.str());
+    }
+
+    ecs_component_registry_types.push_back({size, alignment});
+    return static_cast<component_type_id>(ecs_component_registry_types.size() - 1);
+}
+
+ecs_component_type_info ecs_component_registry::get_info(component_type_id id)
+{
+    std::lock_guard<std::mutex> lock(ecs_component_registry_mutex);
+    return ecs_component_registry_types[id];
+}
+
+// ecs_archetype
+//------------------------------------------------------------------------------
+
+ecs_archetype::ecs_archetype(component_mask in_mask) : mask(in_mask)
+{
+    add_edges.fill(INVALID_ARCHETYPE);
+    remove_edges.fill(INVALID_ARCHETYPE);
+
+    size_t row_size = sizeof(entity);
+    std::vector<ecs_component_type_info> infos;
+    for (component_type_id id = 0; id < ECS_MAX_COMPONENT_TYPES; ++id)
+    {
+        if (has_component(id))
+        {
+            component_types.push_back(id);
+            infos.push_back(ecs_component_registry::get_info(id));
+            component_sizes[id] = infos.back().size;
+            row_size += infos.back().size;
+        }
+    }
+
+    // Start from the unpadded estimate and shrink until every column, aligned, fits in the chunk.
+    uint32_t capacity = static_cast<uint32_t>(ECS_CHUNK_SIZE / row_size);
+    for (; capacity > 0; --capacity)
+    {
+        size_t offset = sizeof(entity) * capacity;
+        for (size_t i = 0; i < component_types.size(); ++i)
+        {
+            offset = (offset + infos[i].alignment - 1) & ~(infos[i].alignment - 1);
+            column_offsets[component_types[i]] = offset;
+            offset += infos[i].size * capacity;
+        }
+        if (offset <= ECS_CHUNK_SIZE)
+        {
+            break;
+        }
+    }
+
+    if (capacity == 0)
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << ecs_world::name << ": Archetype components do not fit in a " << ECS_CHUNK_SIZE << " byte chunk.";
+        throw std::runtime_error(oss.str());
+    }
+    chunk_capacity = capacity;
+}
+
+void ecs_archetype::allocate_row(entity in_entity, uint32_t& out_chunk, uint32_t& out_row)
+{
+    if (chunks.empty() || chunks.back().count == chunk_capacity)
+    {
+        ecs_chunk chunk;
+        chunk.data.reset(static_cast<std::byte*>(::operator new(ECS_CHUNK_SIZE, std::align_val_t(ECS_CHUNK_ALIGNMENT))));
+        chunks.push_back(std::move(chunk));
+    }
+
+    ecs_chunk& chunk = chunks.back();
+    out_chunk = static_cast<uint32_t>(chunks.size() - 1);
+    out_row = chunk.count++;
+    get_entities(chunk)[out_row] = in_entity;
+}
+
+entity ecs_archetype::remove_row(uint32_t chunk_index, uint32_t row)
+{
+    ecs_chunk& last_chunk = chunks.back();
+    const uint32_t last_row = last_chunk.count - 1;
+    entity moved_entity;
+
+    if (&chunks[chunk_index] != &last_chunk || row != last_row)
+    {
+        ecs_chunk& chunk = chunks[chunk_index];
+        moved_entity = get_entities(last_chunk)[last_row];
+        get_entities(chunk)[row] = moved_entity;
+        for (component_type_id id : component_types)
+        {
+            const size_t size = component_sizes[id];
+            std::memcpy(static_cast<std::byte*>(get_column(chunk, id)) + size * row,
+                        static_cast<std::byte*>(get_column(last_chunk, id)) + size * last_row,
+                        size);
+        }
+    }
+
+    if (--last_chunk.count == 0)
+    {
+        chunks.pop_back();
+    }
+    return moved_entity;
+}
+
+// ecs_world
+//------------------------------------------------------------------------------
+
+ecs_world::ecs_world()
+{
+    // entities without components live in the empty archetype.
+    get_or_create_archetype(0);
+}
+
+entity ecs_world::create()
+{
+    entity new_entity;
+    if (!free_indices.empty())
+    {
+        new_entity.index = free_indices.back();
+        free_indices.pop_back();
+        new_entity.generation = entity_records[new_entity.index].generation;
+    }
+    else
+    {
+        new_entity.index = static_cast<uint32_t>(entity_records.size());
+        entity_records.push_back({});
+    }
+
+    entity_record& record = entity_records[new_entity.index];
+    record.archetype = archetype_lookup[0];
+    archetypes[record.archetype]->allocate_row(new_entity, record.chunk, record.row);
+    return new_entity;
+}
+
+void ecs_world::destroy(entity in_entity)
+{
+    check_alive(in_entity);
+    entity_record& record = entity_records[in_entity.index];
+    entity moved_entity = archetypes[record.archetype]->remove_row(record.chunk, record.row);
+    if (moved_entity.is_valid())
+    {
+        entity_records[moved_entity.index].chunk = record.chunk;
+        entity_records[moved_entity.index].row = record.row;
+    }
+
+    // bumping the generation invalidates every outstanding handle to this entity.
+    record.archetype = ecs_archetype::INVALID_ARCHETYPE;
+    record.generation++;
+    free_indices.push_back(in_entity.index);
+}
+
+bool ecs_world::is_alive(entity in_entity) const
+{
+    return in_entity.index < entity_records.size()
+        && entity_records[in_entity.index].generation == in_entity.generation
+        && entity_records[in_entity.index].archetype != ecs_archetype::INVALID_ARCHETYPE;
+}
+
+void ecs_world::check_alive(entity in_entity) const
+{
+    if (!is_alive(in_entity))
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << ecs_world::name << ": Entity " << in_entity.index << ":" << in_entity.generation << " is not alive.";
+        throw std::runtime_error(oss.str());
+    }
+}
+
+uint32_t ecs_world::get_or_create_archetype(component_mask mask)
+{
+    auto existing = archetype_lookup.find(mask);
+    if (existing != archetype_lookup.end())
+    {
+        return existing->second;
+    }
+
+    const uint32_t archetype_index = static_cast<uint32_t>(archetypes.size());
+    archetypes.push_back(std::make_unique<ecs_archetype>(mask));
+    archetype_lookup[mask] = archetype_index;
+    return archetype_index;
+}
+
+uint32_t ecs_world::get_archetype_with(uint32_t archetype_index, component_type_id id, bool with_component)
+{
+    ecs_archetype& source = *archetypes[archetype_index];
+    auto& edges = with_component ? source.add_edges : source.remove_edges;
+    if (edges[id] == ecs_archetype::INVALID_ARCHETYPE)
+    {
+        const component_mask component_bit = component_mask{1} << id;
+        edges[id] = get_or_create_archetype(with_component ? (source.get_mask() | component_bit) : (source.get_mask() & ~component_bit));
+    }
+    return edges[id];
+}
+
+void ecs_world::move_entity(entity in_entity, uint32_t target_archetype)
+{
+    entity_record& record = entity_records[in_entity.index];
+    ecs_archetype& source = *archetypes[record.archetype];
+    ecs_archetype& target = *archetypes[target_archetype];
+
+    uint32_t target_chunk = 0;
+    uint32_t target_row = 0;
+    target.allocate_row(in_entity, target_chunk, target_row);
+
+    // copy every component the two archetypes share, the rest is dropped or left for the caller to initialize.
+    const component_mask shared = source.get_mask() & target.get_mask();
+    for (component_type_id id = 0; id < ECS_MAX_COMPONENT_TYPES; ++id)
+    {
+        if ((shared >> id) & 1u)
+        {
+            const size_t size = target.get_component_size(id);
+            std::memcpy(static_cast<std::byte*>(target.get_column(target.get_chunk(target_chunk), id)) + size * target_row,
+                        static_cast<std::byte*>(source.get_column(source.get_chunk(record.chunk), id)) + size * record.row,
+                        size);
+        }
+    }
+
+    entity moved_entity = source.remove_row(record.chunk, record.row);
+    if (moved_entity.is_valid())
+    {
+        entity_records[moved_entity.index].chunk = record.chunk;
+        entity_records[moved_entity.index].row = record.row;
+    }
+
+    record.archetype = target_archetype;
+    record.chunk = target_chunk;
+    record.row = target_row;
+}
+
+void* ecs_world::get_component(entity in_entity, component_type_id id)
+{
+    const entity_record& record = entity_records[in_entity.index];
+    ecs_archetype& archetype = *archetypes[record.archetype];
+    if (!archetype.has_component(id))
+    {
+        return nullptr;
+    }
+    const size_t size = archetype.get_component_size(id);
+    return static_cast<std::byte*>(archetype.get_column(archetype.get_chunk(record.chunk), id)) + size * record.row;
+}
+
+void ecs_world::gather_chunks(component_mask mask, std::vector<chunk_reference>& out_chunks)
+{
+    out_chunks.clear();
+    for (auto& archetype : archetypes)
+    {
+        if ((archetype->get_mask() & mask) != mask)
+        {
+            continue;
+        }
+        for (size_t chunk_index = 0; chunk_index < archetype->get_chunk_count(); ++chunk_index)
+        {
+            out_chunks.push_back({archetype.get(), &archetype->get_chunk(chunk_index)});
+        }
+    }
+}
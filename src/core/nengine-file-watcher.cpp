@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include "include/nengine-file-watcher.h"
+#include "include/nengine.h"
+
+#if defined(__LINUX__)
+#include <cerrno>
+#include <cstring>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+std::string file_watcher::name = "FileWatcher";
+
+#if defined(__LINUX__)
+
+file_watcher::file_watcher()
+{
+    inotify_descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_descriptor < 0)
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << file_watcher::name << ": Failed to initialize inotify: " << std::strerror(errno);
+        throw std::runtime_error(oss.str());
+    }
+}
+
+file_watcher::~file_watcher()
+{
+    close(inotify_descriptor);
+}
+
+void file_watcher::watch(const std::filesystem::path& file)
+{
+    const std::filesystem::path absolute_file = std::filesystem::absolute(file).lexically_normal();
+    if (std::find(files.begin(), files.end(), absolute_file) != files.end())
+    {
+        return;
+    }
+
+    const std::filesystem::path directory = absolute_file.parent_path();
+    const bool directory_watched = std::any_of( directories.begin(),
+                                                directories.end(),
+                                                [&directory](const auto& entry) { return entry.second == directory; });
+    if (!directory_watched)
+    {
+        // a save either closes the file after writing it or moves a finished file over it.
+        const int watch_descriptor = inotify_add_watch(inotify_descriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (watch_descriptor < 0)
+        {
+            std::ostringstream oss;
+            oss << nengine::name << " - " << file_watcher::name << ": Failed to watch " << directory << ": " << std::strerror(errno);
+            throw std::runtime_error(oss.str());
+        }
+        directories[watch_descriptor] = directory;
+    }
+
+    files.push_back(absolute_file);
+    watched_paths.push_back(file);
+}
+
+std::vector<std::filesystem::path> file_watcher::poll()
+{
+    std::vector<bool> changed(files.size(), false);
+
+    alignas(inotify_event) char buffer[4096];
+    for (;;)
+    {
+        const ssize_t length = read(inotify_descriptor, buffer, sizeof(buffer));
+        if (length <= 0)
+        {
+            // EAGAIN, nothing left to read.
+            break;
+        }
+
+        for (ssize_t offset = 0; offset < length;)
+        {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                // events were dropped, any file may have changed.
+                std::fill(changed.begin(), changed.end(), true);
+                continue;
+            }
+
+            const auto directory = directories.find(event->wd);
+            if (directory == directories.end() || event->len == 0)
+            {
+                continue;
+            }
+
+            const std::filesystem::path changed_file = directory->second / event->name;
+            const auto file = std::find(files.begin(), files.end(), changed_file);
+            if (file != files.end())
+            {
+                changed[static_cast<size_t>(file - files.begin())] = true;
+            }
+        }
+    }
+
+    std::vector<std::filesystem::path> changed_files;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        if (changed[i])
+        {
+            changed_files.push_back(watched_paths[i]);
+        }
+    }
+    return changed_files;
+}
+
+#else
+
+file_watcher::file_watcher()
+{
+}
+
+file_watcher::~file_watcher()
+{
+}
+
+void file_watcher::watch(const std::filesystem::path& file)
+{
+    const std::filesystem::path absolute_file = std::filesystem::absolute(file).lexically_normal();
+    if (std::find(files.begin(), files.end(), absolute_file) != files.end())
+    {
+        return;
+    }
+
+    std::error_code error;
+    files.push_back(absolute_file);
+    watched_paths.push_back(file);
+    write_times.push_back(std::filesystem::last_write_time(absolute_file, error));
+}
+
+std::vector<std::filesystem::path> file_watcher::poll()
+{
+    std::vector<std::filesystem::path> changed_files;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        // a file being replaced may briefly not exist, it is picked up on a later poll.
+        std::error_code error;
+        const std::filesystem::file_time_type write_time = std::filesystem::last_write_time(files[i], error);
+        if (!error && write_time != write_times[i])
+        {
+            write_times[i] = write_time;
+            changed_files.push_back(watched_paths[i]);
+        }
+    }
+    return changed_files;
+}
+
+#endif
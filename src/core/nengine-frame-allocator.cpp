@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include "include/nengine-frame-allocator.h"
+#include "include/nengine.h"
+
+std::string frame_allocator::name = "FrameAllocator";
+
+std::atomic<uint64_t> frame_allocator_generation_counter = 1;
+
+// Allocators a thread keeps a block for at once, allocating from more evicts the oldest block.
+const uint32_t FRAME_ALLOCATOR_THREAD_BLOCK_COUNT = 4;
+
+// Private block of the current frame for the calling thread, carved out of owner's current slot.
+struct frame_allocator_thread_block
+{
+    const frame_allocator* owner = nullptr;
+    uint64_t generation = 0;
+    std::byte* cursor = nullptr;
+    std::byte* end = nullptr;
+};
+
+struct frame_allocator_thread_blocks
+{
+    frame_allocator_thread_block blocks[FRAME_ALLOCATOR_THREAD_BLOCK_COUNT];
+    uint32_t next_eviction = 0;
+};
+
+thread_local frame_allocator_thread_blocks frame_allocator_current_thread_blocks;
+
+// The calling thread's block for allocator, so a thread using several allocators never mixes their blocks.
+inline frame_allocator_thread_block& frame_allocator_find_thread_block(const frame_allocator* allocator)
+{
+    frame_allocator_thread_blocks& thread_blocks = frame_allocator_current_thread_blocks;
+    for (frame_allocator_thread_block& block : thread_blocks.blocks)
+    {
+        if (block.owner == allocator)
+        {
+            return block;
+        }
+    }
+
+    frame_allocator_thread_block& block = thread_blocks.blocks[thread_blocks.next_eviction++ % FRAME_ALLOCATOR_THREAD_BLOCK_COUNT];
+    block = {};
+    block.owner = allocator;
+    return block;
+}
+
+inline std::byte* frame_allocator_align_pointer(std::byte* pointer, size_t alignment)
+{
+    const uintptr_t address = reinterpret_cast<uintptr_t>(pointer);
+    return pointer + (((address + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1)) - address);
+}
+
+inline frame_allocator_block frame_allocator_allocate_block(size_t size)
+{
+    return frame_allocator_block(static_cast<std::byte*>(::operator new(size, std::align_val_t(FRAME_ALLOCATOR_ALIGNMENT))));
+}
+
+// frame_allocator
+//------------------------------------------------------------------------------
+
+frame_allocator::frame_allocator(uint32_t in_frame_count, size_t in_bytes_per_frame, size_t in_thread_block_size)
+    : bytes_per_frame(in_bytes_per_frame), thread_block_size(in_thread_block_size)
+{
+    for (uint32_t i = 0; i < std::max(1u, in_frame_count); ++i)
+    {
+        auto slot = std::make_unique<frame_slot>();
+        slot->memory = frame_allocator_allocate_block(bytes_per_frame);
+        slots.push_back(std::move(slot));
+    }
+    current_generation = frame_allocator_generation_counter.fetch_add(1);
+}
+
+void frame_allocator::begin_frame(uint32_t frame_index)
+{
+    peak_bytes = std::max(peak_bytes, get_used_bytes());
+
+    current_frame = frame_index % get_frame_count();
+    frame_slot& slot = *slots[current_frame];
+    slot.offset.store(0, std::memory_order_relaxed);
+
+    if (!slot.overflow_blocks.empty())
+    {
+        std::cerr   << nengine::name << " - " << frame_allocator::name << ": Frame overflowed its "
+                    << bytes_per_frame << " byte arena by " << slot.overflow_bytes.load() << " bytes." << std::endl;
+        slot.overflow_blocks.clear();
+        slot.overflow_bytes.store(0, std::memory_order_relaxed);
+    }
+
+    // every thread block handed out before this point belongs to a retired frame.
+    current_generation = frame_allocator_generation_counter.fetch_add(1);
+}
+
+size_t frame_allocator::get_used_bytes() const
+{
+    return std::min(slots[current_frame]->offset.load(std::memory_order_relaxed), bytes_per_frame);
+}
+
+void* frame_allocator::allocate(size_t size, size_t alignment)
+{
+    frame_slot& slot = *slots[current_frame];
+
+    // large requests would waste most of a thread block, take them straight from the shared arena.
+    if (size + alignment > thread_block_size / 4)
+    {
+        return allocate_shared(slot, size, alignment);
+    }
+
+    frame_allocator_thread_block& block = frame_allocator_find_thread_block(this);
+    if (block.generation == current_generation)
+    {
+        std::byte* aligned = frame_allocator_align_pointer(block.cursor, alignment);
+        if (aligned + size <= block.end)
+        {
+            block.cursor = aligned + size;
+            return aligned;
+        }
+    }
+
+    // claim a fresh block for this thread.
+    const size_t block_offset = slot.offset.fetch_add(thread_block_size, std::memory_order_relaxed);
+    if (block_offset + thread_block_size > bytes_per_frame)
+    {
+        block.generation = 0;
+        return allocate_overflow(slot, size, alignment);
+    }
+
+    block.generation = current_generation;
+    block.cursor = slot.memory.get() + block_offset;
+    block.end = block.cursor + thread_block_size;
+
+    std::byte* aligned = frame_allocator_align_pointer(block.cursor, alignment);
+    block.cursor = aligned + size;
+    return aligned;
+}
+
+void* frame_allocator::allocate_shared(frame_slot& slot, size_t size, size_t alignment)
+{
+    const size_t padded_size = size + alignment - 1;
+    const size_t offset = slot.offset.fetch_add(padded_size, std::memory_order_relaxed);
+    if (offset + padded_size > bytes_per_frame)
+    {
+        return allocate_overflow(slot, size, alignment);
+    }
+    return frame_allocator_align_pointer(slot.memory.get() + offset, alignment);
+}
+
+void* frame_allocator::allocate_overflow(frame_slot& slot, size_t size, size_t alignment)
+{
+    // Keeps the frame running when the arena is undersized, the next begin_frame for this slot reports it.
+    const size_t padded_size = size + alignment - 1;
+    slot.overflow_bytes.fetch_add(padded_size, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(slot.overflow_mutex);
+    slot.overflow_blocks.push_back(frame_allocator_allocate_block(padded_size));
+    return frame_allocator_align_pointer(slot.overflow_blocks.back().get(), alignment);
+}
@@ -0,0 +1,35 @@
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "include/nengine-frame-fences.h"
+#include "include/nengine.h"
+
+std::string frame_fence_tracker::name = "FrameFenceTracker";
+
+frame_fence_tracker::frame_fence_tracker(uint32_t in_frames_in_flight) : slot_frame_counts(std::max(in_frames_in_flight, 1u), 0)
+{
+}
+
+void frame_fence_tracker::submitted(uint64_t frame)
+{
+    uint64_t& slot_frame_count = slot_frame_counts[frame % slot_frame_counts.size()];
+    if (frame < slot_frame_count)
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << frame_fence_tracker::name << ": Frame " << frame << " submitted after frame " << slot_frame_count - 1 << " of the same slot.";
+        throw std::invalid_argument(oss.str());
+    }
+    slot_frame_count = frame + 1;
+}
+
+void frame_fence_tracker::fence_signaled(uint32_t slot)
+{
+    if (slot >= slot_frame_counts.size())
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << frame_fence_tracker::name << ": Slot " << slot << " is out of range.";
+        throw std::invalid_argument(oss.str());
+    }
+    completed_frame_count = std::max(completed_frame_count, slot_frame_counts[slot]);
+}
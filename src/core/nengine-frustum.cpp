@@ -0,0 +1,27 @@
+#include <algorithm>
+#include "include/nengine-frustum.h"
+
+view_frustum view_frustum_from_view_projection(const glm::mat4& view_projection)
+{
+    // glm is column major, row i is element i of every column.
+    auto row = [&](int i) { return glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]); };
+    return {{row(3) + row(0), row(3) - row(0), row(3) + row(1), row(3) - row(1), row(2), row(3) - row(2)}};
+}
+
+bool view_frustum_intersects_sphere(const view_frustum& frustum, const glm::mat4& transform, const glm::vec4& bounds)
+{
+    const glm::vec3 center = glm::vec3(transform * glm::vec4(glm::vec3(bounds), 1.0f));
+    const float scale = std::max(std::max(glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1]))), glm::length(glm::vec3(transform[2])));
+    const float radius = bounds.w * scale;
+
+    // the planes are not normalized, so the distance they give is scaled by the length of their normal.
+    for (const glm::vec4& plane : frustum.planes)
+    {
+        const glm::vec3 normal = glm::vec3(plane);
+        if (glm::dot(normal, center) + plane.w < -radius * glm::length(normal))
+        {
+            return false;
+        }
+    }
+    return true;
+}
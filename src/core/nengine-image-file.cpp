@@ -0,0 +1,24 @@
+#include <string>
+#include <vector>
+#include "include/nengine-atomic-file.h"
+#include "include/nengine-image-file.h"
+#include "include/nengine.h"
+
+std::string image_file::name = "ImageFile";
+
+bool image_file::write_ppm(const std::filesystem::path& path, const void* rgba_pixels, uint32_t width, uint32_t height)
+{
+    const std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+
+    const size_t pixel_count = static_cast<size_t>(width) * height;
+    const uint8_t* rgba = static_cast<const uint8_t*>(rgba_pixels);
+    std::vector<uint8_t> rgb(pixel_count * 3);
+    for (size_t i = 0; i < pixel_count; ++i)
+    {
+        rgb[i * 3] = rgba[i * 4];
+        rgb[i * 3 + 1] = rgba[i * 4 + 1];
+        rgb[i * 3 + 2] = rgba[i * 4 + 2];
+    }
+
+    return atomic_file_write(path, {{header.data(), header.size()}, {rgb.data(), rgb.size()}}, image_file::name);
+}
@@ -0,0 +1,454 @@
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "include/nengine-job-system.h"
+#include "include/nengine.h"
+
+std::string job_system::name = "JobSystem";
+
+// Identifies which job_system, and which of its deques, belongs to a worker thread. Main threads are recorded by the
+// job_system itself, so one thread can be the main thread of several systems.
+struct job_system_thread_state
+{
+    const job_system* owner = nullptr;
+    int thread_index = -1;
+    uint32_t steal_seed = 0;
+};
+
+thread_local job_system_thread_state job_system_current_thread;
+
+// job_deque
+//------------------------------------------------------------------------------
+
+job_deque::job_deque(uint32_t in_capacity)
+{
+    // capacity must be a power of two so indices can wrap with a mask.
+    uint32_t rounded_capacity = 1;
+    while (rounded_capacity < in_capacity)
+    {
+        rounded_capacity <<= 1;
+    }
+    capacity = rounded_capacity;
+    mask = capacity - 1;
+    slots = std::make_unique<slot[]>(rounded_capacity);
+}
+
+void job_deque::write_slot(int64_t index, const job& in_job)
+{
+    slot& target = slots[static_cast<size_t>(index & mask)];
+    target.function.store(in_job.function, std::memory_order_relaxed);
+    target.data.store(in_job.data, std::memory_order_relaxed);
+    target.counter.store(in_job.counter, std::memory_order_relaxed);
+}
+
+job job_deque::read_slot(int64_t index) const
+{
+    const slot& source = slots[static_cast<size_t>(index & mask)];
+    job out_job;
+    out_job.function = source.function.load(std::memory_order_relaxed);
+    out_job.data = source.data.load(std::memory_order_relaxed);
+    out_job.counter = source.counter.load(std::memory_order_relaxed);
+    return out_job;
+}
+
+bool job_deque::push(const job& in_job)
+{
+    const int64_t current_bottom = bottom.load(std::memory_order_relaxed);
+    const int64_t current_top = top.load(std::memory_order_acquire);
+    if (current_bottom - current_top >= capacity)
+    {
+        return false;
+    }
+
+    write_slot(current_bottom, in_job);
+    bottom.store(current_bottom + 1, std::memory_order_release);
+    return true;
+}
+
+bool job_deque::pop(job& out_job)
+{
+    // seq_cst on the bottom store and top load (rather than standalone fences, which thread sanitizer can not
+    // model) keeps a concurrent steal from taking the same last job.
+    const int64_t current_bottom = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(current_bottom, std::memory_order_seq_cst);
+    int64_t current_top = top.load(std::memory_order_seq_cst);
+
+    if (current_top > current_bottom)
+    {
+        // empty
+        bottom.store(current_bottom + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    out_job = read_slot(current_bottom);
+    if (current_top == current_bottom)
+    {
+        // last job, race any thieves for it.
+        const bool won = top.compare_exchange_strong(current_top, current_top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        bottom.store(current_bottom + 1, std::memory_order_relaxed);
+        return won;
+    }
+    return true;
+}
+
+bool job_deque::steal(job& out_job)
+{
+    int64_t current_top = top.load(std::memory_order_seq_cst);
+    const int64_t current_bottom = bottom.load(std::memory_order_seq_cst);
+    if (current_top >= current_bottom)
+    {
+        return false;
+    }
+
+    out_job = read_slot(current_top);
+    return top.compare_exchange_strong(current_top, current_top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+// job_system
+//------------------------------------------------------------------------------
+
+job_system::job_system()
+{
+}
+
+job_system::~job_system()
+{
+    stop();
+}
+
+void job_system::start(unsigned int worker_count)
+{
+    if (is_running())
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << job_system::name << ": start() called on a running job system.";
+        throw std::runtime_error(oss.str());
+    }
+
+    if (worker_count == 0)
+    {
+        const unsigned int hardware_threads = std::thread::hardware_concurrency();
+        worker_count = hardware_threads > 1 ? hardware_threads - 1 : 1;
+    }
+
+    deques.clear();
+    for (unsigned int i = 0; i < worker_count + 1; ++i)
+    {
+        deques.push_back(std::make_unique<job_deque>(DEQUE_CAPACITY));
+    }
+
+    main_thread_id.store(std::this_thread::get_id(), std::memory_order_relaxed);
+
+    running.store(true, std::memory_order_release);
+    workers.reserve(worker_count);
+    for (unsigned int i = 0; i < worker_count; ++i)
+    {
+        workers.emplace_back(&job_system::worker_main, this, static_cast<int>(i + 1));
+    }
+
+    std::cout << nengine::name << " - " << job_system::name << ": Started " << worker_count << " worker threads." << std::endl;
+}
+
+void job_system::stop()
+{
+    if (!is_running())
+    {
+        return;
+    }
+
+    // from here on submissions run inline. Workers finish the job they are running, which can still queue
+    // continuations or release deferred jobs, so the queues are drained only once every worker has exited.
+    running.store(false, std::memory_order_release);
+    work_epoch.fetch_add(1);
+    work_epoch.notify_all();
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    workers.clear();
+
+    // drain until nothing is left, so no counter is left waiting forever. Jobs run here may queue more.
+    bool drained = false;
+    while (!drained)
+    {
+        pump_main_thread_jobs();
+        drained = true;
+        job pending_job;
+        while (find_job(get_thread_index(), pending_job))
+        {
+            execute(pending_job);
+            drained = false;
+        }
+        std::lock_guard<std::mutex> lock(main_thread_jobs_mutex);
+        drained = drained && main_thread_jobs.empty();
+    }
+    deques.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(deferred_jobs_mutex);
+        if (!deferred_jobs.empty())
+        {
+            std::cerr   << nengine::name << " - " << job_system::name << ": Stopped with " << deferred_jobs.size()
+                        << " jobs waiting on dependencies that never completed." << std::endl;
+        }
+    }
+
+    main_thread_id.store(std::thread::id(), std::memory_order_relaxed);
+}
+
+bool job_system::is_main_thread() const
+{
+    return main_thread_id.load(std::memory_order_relaxed) == std::this_thread::get_id();
+}
+
+int job_system::get_thread_index() const
+{
+    if (job_system_current_thread.owner == this)
+    {
+        return job_system_current_thread.thread_index;
+    }
+    return is_main_thread() ? 0 : -1;
+}
+
+void job_system::run(job_function function, void* data, job_counter* counter)
+{
+    if (counter)
+    {
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    submit({function, data, counter});
+}
+
+void job_system::run_after(job_counter& dependency, job_function function, void* data, job_counter* counter)
+{
+    if (counter)
+    {
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    {
+        // complete() releases deferred jobs under the same lock, so the dependency can not finish unnoticed
+        // between the check and the deferral.
+        std::lock_guard<std::mutex> lock(deferred_jobs_mutex);
+        if (!dependency.is_done())
+        {
+            deferred_jobs.push_back({&dependency, {function, data, counter}});
+            return;
+        }
+    }
+
+    submit({function, data, counter});
+}
+
+void job_system::run_on_main_thread(job_function function, void* data, job_counter* counter)
+{
+    if (counter)
+    {
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::lock_guard<std::mutex> lock(main_thread_jobs_mutex);
+    main_thread_jobs.push_back({function, data, counter});
+}
+
+void job_system::pump_main_thread_jobs()
+{
+    if (!is_main_thread() && is_running())
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << job_system::name << ": pump_main_thread_jobs() called off the main thread.";
+        throw std::runtime_error(oss.str());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(main_thread_jobs_mutex);
+        if (main_thread_jobs.empty())
+        {
+            return;
+        }
+        main_thread_jobs_executing.swap(main_thread_jobs);
+    }
+
+    // jobs queued while these run are picked up by the next pump.
+    for (const job& main_thread_job : main_thread_jobs_executing)
+    {
+        execute(main_thread_job);
+    }
+    main_thread_jobs_executing.clear();
+}
+
+void job_system::wait(job_counter& counter)
+{
+    const int thread_index = get_thread_index();
+    const bool on_main_thread = is_main_thread();
+    while (!counter.is_done())
+    {
+        // keeps executing while stop() joins the workers, a worker's job may wait on jobs still queued.
+        job next_job;
+        if (!deques.empty() && find_job(thread_index, next_job))
+        {
+            execute(next_job);
+        }
+        else if (on_main_thread)
+        {
+            pump_main_thread_jobs();
+            std::this_thread::yield();
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void job_system::submit(const job& in_job)
+{
+    if (!is_running())
+    {
+        execute(in_job);
+        return;
+    }
+
+    const int thread_index = get_thread_index();
+    if (thread_index >= 0)
+    {
+        if (!deques[static_cast<size_t>(thread_index)]->push(in_job))
+        {
+            // deque is full, the submitting thread is the best candidate to run it anyway.
+            execute(in_job);
+            return;
+        }
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(external_jobs_mutex);
+        external_jobs.push_back(in_job);
+        has_external_jobs.store(true);
+    }
+
+    wake_workers();
+}
+
+void job_system::wake_workers()
+{
+    work_epoch.fetch_add(1);
+    if (sleeping_worker_count.load() > 0)
+    {
+        work_epoch.notify_one();
+    }
+}
+
+void job_system::execute(const job& in_job)
+{
+    PROFILE_ZONE("Job");
+    in_job.function(in_job.data);
+    complete(in_job.counter);
+}
+
+void job_system::complete(job_counter* counter)
+{
+    if (!counter || counter->pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    {
+        return;
+    }
+
+    // the counter just reached zero, release everything that was waiting on it.
+    std::vector<job> released_jobs;
+    {
+        std::lock_guard<std::mutex> lock(deferred_jobs_mutex);
+        for (size_t i = 0; i < deferred_jobs.size();)
+        {
+            if (deferred_jobs[i].dependency == counter)
+            {
+                released_jobs.push_back(deferred_jobs[i].deferred);
+                deferred_jobs[i] = deferred_jobs.back();
+                deferred_jobs.pop_back();
+            }
+            else
+            {
+                ++i;
+            }
+        }
+    }
+
+    for (const job& released_job : released_jobs)
+    {
+        submit(released_job);
+    }
+}
+
+bool job_system::find_job(int thread_index, job& out_job)
+{
+    if (thread_index >= 0 && deques[static_cast<size_t>(thread_index)]->pop(out_job))
+    {
+        return true;
+    }
+
+    if (has_external_jobs.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(external_jobs_mutex);
+        if (!external_jobs.empty())
+        {
+            out_job = external_jobs.front();
+            external_jobs.pop_front();
+            has_external_jobs.store(!external_jobs.empty());
+            return true;
+        }
+    }
+
+    // steal, starting from a random victim so thieves spread out instead of all hammering the same deque.
+    const size_t deque_count = deques.size();
+    uint32_t& seed = job_system_current_thread.steal_seed;
+    seed = seed == 0 ? 1 : seed;
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    const size_t first_victim = seed % deque_count;
+    for (size_t i = 0; i < deque_count; ++i)
+    {
+        const size_t victim = (first_victim + i) % deque_count;
+        if (static_cast<int>(victim) != thread_index && deques[victim]->steal(out_job))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void job_system::worker_main(int thread_index)
+{
+    job_system_current_thread.owner = this;
+    job_system_current_thread.thread_index = thread_index;
+    job_system_current_thread.steal_seed = 2654435761u * static_cast<uint32_t>(thread_index + 1);
+    profiler::get().set_thread_name("Job worker " + std::to_string(thread_index));
+
+    while (is_running())
+    {
+        job next_job;
+        if (find_job(thread_index, next_job))
+        {
+            execute(next_job);
+            continue;
+        }
+
+        // Announce we are going to sleep, then look once more: a job submitted before we bumped the sleeper count
+        // is found here, and one submitted after it changes the epoch so the wait returns immediately.
+        const uint32_t observed_epoch = work_epoch.load();
+        sleeping_worker_count.fetch_add(1);
+        if (find_job(thread_index, next_job))
+        {
+            sleeping_worker_count.fetch_sub(1);
+            execute(next_job);
+            continue;
+        }
+
+        if (is_running())
+        {
+            work_epoch.wait(observed_epoch);
+        }
+        sleeping_worker_count.fetch_sub(1);
+    }
+}
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "include/nengine-atomic-file.h"
+#include "include/nengine-mesh-file.h"
+#include "include/nengine.h"
+
+#if defined(__LINUX__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::string mapped_file::name = "MappedFile";
+std::string mesh_file::name = "MeshFile";
+
+#if defined(__LINUX__)
+
+mapped_file::mapped_file(const std::filesystem::path& path)
+{
+    const int file_descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat file_status{};
+    if (file_descriptor < 0 || fstat(file_descriptor, &file_status) != 0)
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << mapped_file::name << ": Failed to open " << path << ": " << std::strerror(errno);
+        if (file_descriptor >= 0)
+        {
+            close(file_descriptor);
+        }
+        throw std::runtime_error(oss.str());
+    }
+
+    size = static_cast<size_t>(file_status.st_size);
+    if (size > 0)
+    {
+        // the mapping keeps the file alive, the descriptor is not needed past this point.
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+        if (mapping == MAP_FAILED)
+        {
+            std::ostringstream oss;
+            oss << nengine::name << " - " << mapped_file::name << ": Failed to map " << path << ": " << std::strerror(errno);
+            close(file_descriptor);
+            throw std::runtime_error(oss.str());
+        }
+        // the whole file is usually copied out right away, read ahead instead of faulting page by page.
+        madvise(mapping, size, MADV_WILLNEED);
+        data = static_cast<const uint8_t*>(mapping);
+    }
+    close(file_descriptor);
+}
+
+mapped_file::~mapped_file()
+{
+    if (data != nullptr)
+    {
+        munmap(const_cast<uint8_t*>(data), size);
+    }
+}
+
+#else
+
+mapped_file::mapped_file(const std::filesystem::path& path)
+{
+    std::ifstream file_in(path, std::ios::binary);
+    if (!file_in.is_open())
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << mapped_file::name << ": Failed to open " << path;
+        throw std::runtime_error(oss.str());
+    }
+    contents.assign(std::istreambuf_iterator<char>(file_in), std::istreambuf_iterator<char>());
+    data = contents.data();
+    size = contents.size();
+}
+
+mapped_file::~mapped_file()
+{
+}
+
+#endif
+
+mesh_file::mesh_file(const std::filesystem::path& path) : mapping(path)
+{
+    auto fail = [&path](const char* reason)
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << mesh_file::name << ": " << path << " is not a valid mesh file, " << reason;
+        throw std::runtime_error(oss.str());
+    };
+
+    const uint64_t size = mapping.get_size();
+    if (size < sizeof(mesh_file_header))
+    {
+        fail("it is smaller than the header.");
+    }
+    header = reinterpret_cast<const mesh_file_header*>(mapping.get_data());
+    if (header->magic != MESH_FILE_MAGIC || header->format_version != MESH_FILE_FORMAT_VERSION)
+    {
+        fail("unknown magic or format version.");
+    }
+    if (header->file_size != size)
+    {
+        fail("it is truncated.");
+    }
+    if (header->vertex_stride == 0)
+    {
+        fail("the vertex stride is 0.");
+    }
+
+    // every section lies inside the file, counts are 32 bit so none of the products overflow.
+    const uint64_t section_offsets[] = {header->submesh_offset, header->vertex_offset, header->index_offset};
+    const uint64_t section_sizes[] = {  static_cast<uint64_t>(header->submesh_count) * sizeof(mesh_file_submesh),
+                                        static_cast<uint64_t>(header->vertex_count) * header->vertex_stride,
+                                        static_cast<uint64_t>(header->index_count) * sizeof(uint32_t)};
+    for (size_t i = 0; i < std::size(section_offsets); ++i)
+    {
+        if (section_offsets[i] % MESH_FILE_ALIGNMENT != 0 || section_offsets[i] > size || section_sizes[i] > size - section_offsets[i])
+        {
+            fail("a section is misaligned or outside the file.");
+        }
+    }
+
+    const mesh_file_submesh* submeshes = get_submeshes();
+    for (uint32_t i = 0; i < header->submesh_count; ++i)
+    {
+        if (submeshes[i].first_index > header->index_count || submeshes[i].index_count > header->index_count - submeshes[i].first_index)
+        {
+            fail("a submesh is outside the index stream.");
+        }
+
+        // every vertex a submesh draws lies inside the vertex stream, so a renderer can take the file as is.
+        if (submeshes[i].index_count == 0)
+        {
+            continue;
+        }
+        const uint32_t* submesh_indices = get_indices() + submeshes[i].first_index;
+        const auto [min_index, max_index] = std::minmax_element(submesh_indices, submesh_indices + submeshes[i].index_count);
+        if (static_cast<int64_t>(submeshes[i].vertex_offset) + *min_index < 0
+            || static_cast<int64_t>(submeshes[i].vertex_offset) + *max_index >= static_cast<int64_t>(header->vertex_count))
+        {
+            fail("a submesh indexes past the vertex stream.");
+        }
+    }
+}
+
+bool mesh_file::write(  const std::filesystem::path& path,
+                        uint32_t vertex_stride,
+                        const void* vertices,
+                        uint32_t vertex_count,
+                        const uint32_t* indices,
+                        uint32_t index_count,
+                        const std::vector<mesh_file_submesh>& submeshes)
+{
+    auto align = [](uint64_t offset) { return (offset + MESH_FILE_ALIGNMENT - 1) / MESH_FILE_ALIGNMENT * MESH_FILE_ALIGNMENT; };
+
+    mesh_file_header header = {};
+    header.magic = MESH_FILE_MAGIC;
+    header.format_version = MESH_FILE_FORMAT_VERSION;
+    header.vertex_stride = vertex_stride;
+    header.vertex_count = vertex_count;
+    header.index_count = index_count;
+    header.submesh_count = static_cast<uint32_t>(submeshes.size());
+    header.submesh_offset = align(sizeof(mesh_file_header));
+    header.vertex_offset = align(header.submesh_offset + submeshes.size() * sizeof(mesh_file_submesh));
+    header.index_offset = align(header.vertex_offset + static_cast<uint64_t>(vertex_count) * vertex_stride);
+    header.file_size = header.index_offset + static_cast<uint64_t>(index_count) * sizeof(uint32_t);
+
+    // sections are written back to back into one zeroed buffer, the gaps are the alignment padding.
+    std::vector<char> contents(header.file_size, 0);
+    std::memcpy(contents.data(), &header, sizeof(header));
+    if (!submeshes.empty())
+    {
+        std::memcpy(contents.data() + header.submesh_offset, submeshes.data(), submeshes.size() * sizeof(mesh_file_submesh));
+    }
+    if (vertex_count > 0)
+    {
+        std::memcpy(contents.data() + header.vertex_offset, vertices, static_cast<size_t>(vertex_count) * vertex_stride);
+    }
+    if (index_count > 0)
+    {
+        std::memcpy(contents.data() + header.index_offset, indices, static_cast<size_t>(index_count) * sizeof(uint32_t));
+    }
+
+    // a mesh that is being replaced stays readable, by other processes too, until the new one is complete.
+    return atomic_file_write(path, {{contents.data(), contents.size()}}, mesh_file::name);
+}
@@ -0,0 +1,476 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "include/nengine-atomic-file.h"
+#include "include/nengine-job-system.h"
+#include "include/nengine-pak-file.h"
+#include "include/nengine.h"
+
+std::string pak_file::name = "PakFile";
+
+// Blocks use the LZ4 block format: sequences of a token, literals, a 16 bit match offset and a match length.
+const size_t PAK_MIN_MATCH = 4;
+// The format ends every block with at least 5 literals, and no match starts in the last 12 bytes.
+const size_t PAK_LAST_LITERALS = 5;
+const size_t PAK_MATCH_FIND_LIMIT = 12;
+const size_t PAK_MAX_MATCH_OFFSET = 65535;
+const uint32_t PAK_HASH_BITS = 14;
+
+static size_t pak_length_bytes(size_t length)
+{
+    return length >= 15 ? (length - 15) / 255 + 1 : 0;
+}
+
+static uint8_t* pak_write_length(uint8_t* out, size_t length)
+{
+    for (length -= 15; length >= 255; length -= 255)
+    {
+        *out++ = 255;
+    }
+    *out++ = static_cast<uint8_t>(length);
+    return out;
+}
+
+// Writes one sequence, a match_length of 0 writes the literals that end the block. nullptr when it does not fit.
+static uint8_t* pak_write_sequence(uint8_t* out, const uint8_t* out_end, const uint8_t* literals, size_t literal_length, size_t match_offset, size_t match_length)
+{
+    const size_t match_code = match_length != 0 ? match_length - PAK_MIN_MATCH : 0;
+    const size_t sequence_size = 1 + pak_length_bytes(literal_length) + literal_length + (match_length != 0 ? 2 + pak_length_bytes(match_code) : 0);
+    if (sequence_size > static_cast<size_t>(out_end - out))
+    {
+        return nullptr;
+    }
+
+    *out++ = static_cast<uint8_t>((std::min<size_t>(literal_length, 15) << 4) | std::min<size_t>(match_code, 15));
+    if (literal_length >= 15)
+    {
+        out = pak_write_length(out, literal_length);
+    }
+    std::memcpy(out, literals, literal_length);
+    out += literal_length;
+    if (match_length != 0)
+    {
+        *out++ = static_cast<uint8_t>(match_offset & 0xff);
+        *out++ = static_cast<uint8_t>(match_offset >> 8);
+        if (match_code >= 15)
+        {
+            out = pak_write_length(out, match_code);
+        }
+    }
+    return out;
+}
+
+// Greedy single pass compression with a hash table of the last position of each 4 byte sequence. Returns the
+// compressed size, 0 when it would not fit in capacity.
+static size_t pak_compress_block(const uint8_t* source, size_t source_size, uint8_t* destination, size_t capacity)
+{
+    std::vector<uint32_t> last_positions(size_t(1) << PAK_HASH_BITS, UINT32_MAX);
+    uint8_t* out = destination;
+    const uint8_t* out_end = destination + capacity;
+    size_t anchor = 0;
+
+    if (source_size > PAK_MATCH_FIND_LIMIT)
+    {
+        const size_t match_start_limit = source_size - PAK_MATCH_FIND_LIMIT;
+        const size_t match_end_limit = source_size - PAK_LAST_LITERALS;
+        for (size_t position = 0; position <= match_start_limit;)
+        {
+            uint32_t sequence;
+            std::memcpy(&sequence, source + position, sizeof(sequence));
+            const uint32_t hash = (sequence * 2654435761u) >> (32 - PAK_HASH_BITS);
+            const uint32_t candidate = last_positions[hash];
+            last_positions[hash] = static_cast<uint32_t>(position);
+
+            if (candidate == UINT32_MAX || position - candidate > PAK_MAX_MATCH_OFFSET || std::memcmp(source + candidate, source + position, PAK_MIN_MATCH) != 0)
+            {
+                ++position;
+                continue;
+            }
+
+            size_t match_length = PAK_MIN_MATCH;
+            while (position + match_length < match_end_limit && source[candidate + match_length] == source[position + match_length])
+            {
+                ++match_length;
+            }
+            out = pak_write_sequence(out, out_end, source + anchor, position - anchor, position - candidate, match_length);
+            if (out == nullptr)
+            {
+                return 0;
+            }
+            position += match_length;
+            anchor = position;
+        }
+    }
+
+    out = pak_write_sequence(out, out_end, source + anchor, source_size - anchor, 0, 0);
+    return out != nullptr ? static_cast<size_t>(out - destination) : 0;
+}
+
+static bool pak_read_length(const uint8_t* source, size_t source_size, size_t& in, size_t& length)
+{
+    uint8_t byte;
+    do
+    {
+        if (in >= source_size)
+        {
+            return false;
+        }
+        byte = source[in++];
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// Fails instead of reading or writing out of bounds when the block is damaged.
+static bool pak_decompress_block(const uint8_t* source, size_t source_size, uint8_t* destination, size_t destination_size)
+{
+    size_t in = 0;
+    size_t out = 0;
+    while (in < source_size)
+    {
+        const uint8_t token = source[in++];
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !pak_read_length(source, source_size, in, literal_length))
+        {
+            return false;
+        }
+        if (literal_length > source_size - in || literal_length > destination_size - out)
+        {
+            return false;
+        }
+        std::memcpy(destination + out, source + in, literal_length);
+        in += literal_length;
+        out += literal_length;
+
+        // the last sequence has no match.
+        if (in == source_size)
+        {
+            return out == destination_size;
+        }
+
+        if (source_size - in < 2)
+        {
+            return false;
+        }
+        const size_t match_offset = static_cast<size_t>(source[in]) | static_cast<size_t>(source[in + 1]) << 8;
+        in += 2;
+        size_t match_length = token & 15;
+        if (match_length == 15 && !pak_read_length(source, source_size, in, match_length))
+        {
+            return false;
+        }
+        match_length += PAK_MIN_MATCH;
+        if (match_offset == 0 || match_offset > out || match_length > destination_size - out)
+        {
+            return false;
+        }
+
+        // a match closer than its length repeats the bytes it is copying, those go one at a time.
+        const uint8_t* match = destination + out - match_offset;
+        if (match_offset >= match_length)
+        {
+            std::memcpy(destination + out, match, match_length);
+        }
+        else
+        {
+            for (size_t i = 0; i < match_length; ++i)
+            {
+                destination[out + i] = match[i];
+            }
+        }
+        out += match_length;
+    }
+    return false;
+}
+
+// Calls function(index) for every index in [0, count), a block per job when given a job system and on the calling
+// thread otherwise. Block counts are 32 bit in the file, so count always fits.
+template<typename function_type>
+static void pak_for_each_block(uint64_t count, job_system* jobs, const function_type& function)
+{
+    if (jobs && count > 1)
+    {
+        jobs->parallel_for(static_cast<uint32_t>(count), 1, [&](uint32_t i)
+        {
+            function(i);
+        });
+    }
+    else
+    {
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            function(i);
+        }
+    }
+}
+
+pak_file::pak_file(const std::filesystem::path& path) : mapping(path)
+{
+    auto fail = [&path](const char* reason)
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << pak_file::name << ": " << path << " is not a valid pak archive, " << reason;
+        throw std::runtime_error(oss.str());
+    };
+
+    const uint64_t size = mapping.get_size();
+    if (size < sizeof(pak_file_header))
+    {
+        fail("it is smaller than the header.");
+    }
+    header = reinterpret_cast<const pak_file_header*>(mapping.get_data());
+    if (header->magic != PAK_FILE_MAGIC || header->format_version != PAK_FILE_FORMAT_VERSION)
+    {
+        fail("unknown magic or format version.");
+    }
+    if (header->file_size != size)
+    {
+        fail("it is truncated.");
+    }
+    if (header->block_count != (header->data_size + PAK_FILE_BLOCK_SIZE - 1) / PAK_FILE_BLOCK_SIZE)
+    {
+        fail("the block count does not match the data size.");
+    }
+
+    // counts are 32 bit so none of the products overflow.
+    const uint64_t section_offsets[] = {header->entry_offset, header->block_offset, header->name_offset};
+    const uint64_t section_sizes[] = {  static_cast<uint64_t>(header->entry_count) * sizeof(pak_file_entry),
+                                        static_cast<uint64_t>(header->block_count) * sizeof(pak_file_block),
+                                        header->name_size};
+    for (size_t i = 0; i < std::size(section_offsets); ++i)
+    {
+        if (section_offsets[i] % PAK_FILE_ALIGNMENT != 0 || section_offsets[i] > size || section_sizes[i] > size - section_offsets[i])
+        {
+            fail("a section is misaligned or outside the file.");
+        }
+    }
+
+    const pak_file_block* blocks = get_blocks();
+    for (uint32_t i = 0; i < header->block_count; ++i)
+    {
+        const uint64_t uncompressed_size = std::min<uint64_t>(PAK_FILE_BLOCK_SIZE, header->data_size - static_cast<uint64_t>(i) * PAK_FILE_BLOCK_SIZE);
+        if (blocks[i].uncompressed_size != uncompressed_size || blocks[i].compressed_size > blocks[i].uncompressed_size
+            || blocks[i].offset > size || blocks[i].compressed_size > size - blocks[i].offset)
+        {
+            fail("a block is outside the file.");
+        }
+    }
+
+    const pak_file_entry* entries = get_entries();
+    for (uint32_t i = 0; i < header->entry_count; ++i)
+    {
+        if (entries[i].data_offset > header->data_size || entries[i].size > header->data_size - entries[i].data_offset
+            || entries[i].name_offset > header->name_size || entries[i].name_size > header->name_size - entries[i].name_offset)
+        {
+            fail("an entry is outside the data or the names.");
+        }
+        if (i > 0 && entries[i - 1].path_hash > entries[i].path_hash)
+        {
+            fail("the entries are not sorted.");
+        }
+    }
+}
+
+bool pak_file::write(const std::filesystem::path& path, const std::vector<pak_file_input>& files)
+{
+    return write_blocks(path, files, nullptr);
+}
+
+bool pak_file::write(const std::filesystem::path& path, const std::vector<pak_file_input>& files, job_system& jobs)
+{
+    return write_blocks(path, files, &jobs);
+}
+
+bool pak_file::write_blocks(const std::filesystem::path& path, const std::vector<pak_file_input>& files, job_system* jobs)
+{
+    auto align = [](uint64_t offset) { return (offset + PAK_FILE_ALIGNMENT - 1) / PAK_FILE_ALIGNMENT * PAK_FILE_ALIGNMENT; };
+
+    // files are stored in the order given, the entry table is sorted for lookups.
+    std::vector<std::string> names(files.size());
+    std::vector<pak_file_entry> entries(files.size());
+    std::string name_section;
+    std::vector<uint8_t> data;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        names[i] = std::filesystem::path(files[i].name).lexically_normal().generic_string();
+        entries[i].path_hash = nengine_utils::hash_fnv1a_64(names[i].data(), names[i].size());
+        entries[i].data_offset = data.size();
+        entries[i].size = files[i].data.size();
+        entries[i].name_offset = static_cast<uint32_t>(name_section.size());
+        entries[i].name_size = static_cast<uint32_t>(names[i].size());
+        name_section += names[i];
+        data.insert(data.end(), files[i].data.begin(), files[i].data.end());
+    }
+
+    std::vector<size_t> order(files.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+    {
+        return entries[a].path_hash != entries[b].path_hash ? entries[a].path_hash < entries[b].path_hash : names[a] < names[b];
+    });
+    std::vector<pak_file_entry> sorted_entries;
+    sorted_entries.reserve(files.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        if (i > 0 && names[order[i]] == names[order[i - 1]])
+        {
+            std::cerr << nengine::name << " - " << pak_file::name << ": " << names[order[i]] << " is packed twice into " << path << std::endl;
+            return false;
+        }
+        sorted_entries.push_back(entries[order[i]]);
+    }
+
+    // a block is kept compressed only when that made it smaller.
+    const uint64_t block_count = (data.size() + PAK_FILE_BLOCK_SIZE - 1) / PAK_FILE_BLOCK_SIZE;
+    std::vector<std::vector<uint8_t>> block_contents(block_count);
+    pak_for_each_block(block_count, jobs, [&](uint64_t i)
+    {
+        const uint8_t* source = data.data() + i * PAK_FILE_BLOCK_SIZE;
+        const size_t source_size = static_cast<size_t>(std::min<uint64_t>(PAK_FILE_BLOCK_SIZE, data.size() - i * PAK_FILE_BLOCK_SIZE));
+        block_contents[i].resize(source_size);
+        const size_t compressed_size = pak_compress_block(source, source_size, block_contents[i].data(), source_size - 1);
+        if (compressed_size != 0)
+        {
+            block_contents[i].resize(compressed_size);
+        }
+        else
+        {
+            block_contents[i].assign(source, source + source_size);
+        }
+    });
+
+    pak_file_header header = {};
+    header.magic = PAK_FILE_MAGIC;
+    header.format_version = PAK_FILE_FORMAT_VERSION;
+    header.entry_count = static_cast<uint32_t>(sorted_entries.size());
+    header.block_count = static_cast<uint32_t>(block_count);
+    header.entry_offset = align(sizeof(pak_file_header));
+    header.block_offset = align(header.entry_offset + sorted_entries.size() * sizeof(pak_file_entry));
+    header.name_offset = align(header.block_offset + block_count * sizeof(pak_file_block));
+    header.name_size = name_section.size();
+    header.data_size = data.size();
+
+    std::vector<pak_file_block> blocks(block_count);
+    uint64_t block_offset = align(header.name_offset + header.name_size);
+    for (uint64_t i = 0; i < block_count; ++i)
+    {
+        blocks[i].offset = block_offset;
+        blocks[i].compressed_size = static_cast<uint32_t>(block_contents[i].size());
+        blocks[i].uncompressed_size = static_cast<uint32_t>(std::min<uint64_t>(PAK_FILE_BLOCK_SIZE, data.size() - i * PAK_FILE_BLOCK_SIZE));
+        block_offset += block_contents[i].size();
+    }
+    header.file_size = block_offset;
+
+    // sections are written back to back into one zeroed buffer, the gaps are the alignment padding.
+    std::vector<char> contents(header.file_size, 0);
+    std::memcpy(contents.data(), &header, sizeof(header));
+    if (!sorted_entries.empty())
+    {
+        std::memcpy(contents.data() + header.entry_offset, sorted_entries.data(), sorted_entries.size() * sizeof(pak_file_entry));
+    }
+    if (!blocks.empty())
+    {
+        std::memcpy(contents.data() + header.block_offset, blocks.data(), blocks.size() * sizeof(pak_file_block));
+    }
+    std::memcpy(contents.data() + header.name_offset, name_section.data(), name_section.size());
+    for (uint64_t i = 0; i < block_count; ++i)
+    {
+        std::memcpy(contents.data() + blocks[i].offset, block_contents[i].data(), block_contents[i].size());
+    }
+
+    // a pak that is being rebuilt stays readable, by other processes too, until the new one is complete.
+    return atomic_file_write(path, {{contents.data(), contents.size()}}, pak_file::name);
+}
+
+const pak_file_entry* pak_file::find(std::string_view file_name) const
+{
+    const uint64_t path_hash = nengine_utils::hash_fnv1a_64(file_name.data(), file_name.size());
+    const pak_file_entry* entries_end = get_entries() + header->entry_count;
+    const pak_file_entry* entry = std::lower_bound( get_entries(), entries_end, path_hash,
+                                                    [](const pak_file_entry& candidate, uint64_t hash) { return candidate.path_hash < hash; });
+    for (; entry != entries_end && entry->path_hash == path_hash; ++entry)
+    {
+        if (get_name(*entry) == file_name)
+        {
+            return entry;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<uint8_t> pak_file::read(const pak_file_entry& entry) const
+{
+    return read_blocks(entry, nullptr);
+}
+
+std::vector<uint8_t> pak_file::read(const pak_file_entry& entry, job_system& jobs) const
+{
+    return read_blocks(entry, &jobs);
+}
+
+std::vector<uint8_t> pak_file::read_blocks(const pak_file_entry& entry, job_system* jobs) const
+{
+    std::vector<uint8_t> data(entry.size);
+    if (entry.size == 0)
+    {
+        return data;
+    }
+
+    const uint64_t first_block = entry.data_offset / PAK_FILE_BLOCK_SIZE;
+    const uint64_t last_block = (entry.data_offset + entry.size - 1) / PAK_FILE_BLOCK_SIZE;
+    std::atomic<bool> damaged = false;
+    pak_for_each_block(last_block - first_block + 1, jobs, [&](uint64_t i)
+    {
+        const uint64_t block_index = first_block + i;
+        const pak_file_block& block = get_blocks()[block_index];
+        const uint8_t* source = mapping.get_data() + block.offset;
+
+        // the part of the block that belongs to the entry, files share the blocks at their ends with their neighbours.
+        const uint64_t block_start = block_index * PAK_FILE_BLOCK_SIZE;
+        const uint64_t copy_start = std::max(block_start, entry.data_offset);
+        const uint64_t copy_end = std::min(block_start + block.uncompressed_size, entry.data_offset + entry.size);
+        uint8_t* destination = data.data() + (copy_start - entry.data_offset);
+
+        if (block.compressed_size == block.uncompressed_size)
+        {
+            std::memcpy(destination, source + (copy_start - block_start), copy_end - copy_start);
+        }
+        else if (copy_start == block_start && copy_end == block_start + block.uncompressed_size)
+        {
+            if (!pak_decompress_block(source, block.compressed_size, destination, block.uncompressed_size))
+            {
+                damaged = true;
+            }
+        }
+        else
+        {
+            std::vector<uint8_t> block_data(block.uncompressed_size);
+            if (!pak_decompress_block(source, block.compressed_size, block_data.data(), block_data.size()))
+            {
+                damaged = true;
+                return;
+            }
+            std::memcpy(destination, block_data.data() + (copy_start - block_start), copy_end - copy_start);
+        }
+    });
+
+    if (damaged)
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << pak_file::name << ": A block of " << get_name(entry) << " is damaged.";
+        throw std::runtime_error(oss.str());
+    }
+    return data;
+}
+
+std::string_view pak_file::get_name(const pak_file_entry& entry) const
+{
+    const char* names = reinterpret_cast<const char*>(mapping.get_data() + header->name_offset);
+    return std::string_view(names + entry.name_offset, entry.name_size);
+}
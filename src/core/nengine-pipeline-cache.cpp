@@ -0,0 +1,100 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "include/nengine-pipeline-cache.h"
+#include "include/nengine-atomic-file.h"
+#include "include/nengine.h"
+
+std::string pipeline_cache_file::name = "PipelineCache";
+
+// On-disk layout: pipeline_cache_file_header followed by data_size bytes of driver data.
+struct pipeline_cache_file_header
+{
+    uint32_t magic;
+    uint32_t format_version;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t driver_version;
+    uint8_t pipeline_cache_uuid[PIPELINE_CACHE_UUID_SIZE];
+    uint32_t padding;
+    uint64_t data_size;
+    uint64_t checksum;
+};
+
+const uint32_t PIPELINE_CACHE_FILE_MAGIC = 0x434c504e; // "NPLC"
+const uint32_t PIPELINE_CACHE_FILE_FORMAT_VERSION = 1;
+
+pipeline_cache_file::pipeline_cache_file(const std::filesystem::path& in_path) : path(in_path)
+{
+}
+
+std::optional<std::vector<uint8_t>> pipeline_cache_file::load(const pipeline_cache_device_identity& identity) const
+{
+    std::error_code size_error;
+    const uintmax_t file_size = std::filesystem::file_size(path, size_error);
+    std::ifstream file_in(path, std::ios::binary);
+    if (size_error || !file_in.is_open())
+    {
+        return std::nullopt;
+    }
+
+    pipeline_cache_file_header header = {};
+    file_in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (file_in.fail() || header.magic != PIPELINE_CACHE_FILE_MAGIC || header.format_version != PIPELINE_CACHE_FILE_FORMAT_VERSION)
+    {
+        std::cerr << nengine::name << " - " << pipeline_cache_file::name << ": Ignoring unreadable cache " << path << std::endl;
+        return std::nullopt;
+    }
+
+    pipeline_cache_device_identity stored_identity;
+    stored_identity.vendor_id = header.vendor_id;
+    stored_identity.device_id = header.device_id;
+    stored_identity.driver_version = header.driver_version;
+    std::memcpy(stored_identity.pipeline_cache_uuid.data(), header.pipeline_cache_uuid, PIPELINE_CACHE_UUID_SIZE);
+    if (stored_identity != identity)
+    {
+        std::cout << nengine::name << " - " << pipeline_cache_file::name << ": Cache " << path
+                  << " was written by another device or driver version, starting empty." << std::endl;
+        return std::nullopt;
+    }
+
+    // the size is checked against the file before anything is allocated for it.
+    if (header.data_size != file_size - sizeof(header))
+    {
+        std::cerr << nengine::name << " - " << pipeline_cache_file::name << ": Ignoring corrupt cache " << path << std::endl;
+        return std::nullopt;
+    }
+
+    std::vector<uint8_t> data(header.data_size);
+    file_in.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    if (file_in.fail() || nengine_utils::hash_fnv1a_64(data.data(), data.size()) != header.checksum)
+    {
+        std::cerr << nengine::name << " - " << pipeline_cache_file::name << ": Ignoring corrupt cache " << path << std::endl;
+        return std::nullopt;
+    }
+
+    return data;
+}
+
+bool pipeline_cache_file::save(const pipeline_cache_device_identity& identity, const std::vector<uint8_t>& data) const
+{
+    pipeline_cache_file_header header = {};
+    header.magic = PIPELINE_CACHE_FILE_MAGIC;
+    header.format_version = PIPELINE_CACHE_FILE_FORMAT_VERSION;
+    header.vendor_id = identity.vendor_id;
+    header.device_id = identity.device_id;
+    header.driver_version = identity.driver_version;
+    std::memcpy(header.pipeline_cache_uuid, identity.pipeline_cache_uuid.data(), PIPELINE_CACHE_UUID_SIZE);
+    header.data_size = data.size();
+    header.checksum = nengine_utils::hash_fnv1a_64(data.data(), data.size());
+
+    std::error_code directory_error;
+    if (path.has_parent_path())
+    {
+        std::filesystem::create_directories(path.parent_path(), directory_error);
+    }
+
+    // several processes may exit at once, each writes its own temporary file and the last rename wins.
+    return atomic_file_write(path, {{&header, sizeof(header)}, {data.data(), data.size()}}, pipeline_cache_file::name);
+}
@@ -0,0 +1,314 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include "include/nengine-profiler.h"
+#include "include/nengine.h"
+
+std::string profiler::name = "Profiler";
+
+const std::chrono::steady_clock::time_point profiler_epoch = std::chrono::steady_clock::now();
+
+// Hands the calling thread's timeline back to the profiler when the thread exits.
+struct profiler_thread_timeline_handle
+{
+    profiler_timeline* timeline = nullptr;
+
+    ~profiler_thread_timeline_handle()
+    {
+        if (timeline != nullptr)
+        {
+            profiler::get().release_thread_timeline(timeline);
+        }
+    }
+};
+
+thread_local profiler_thread_timeline_handle profiler_current_thread_timeline;
+
+// Chrome traces are JSON, zone and thread names may contain anything.
+void profiler_write_json_string(std::ostream& out, const std::string& value)
+{
+    out << '"';
+    for (char character : value)
+    {
+        switch (character)
+        {
+        case '"': out << "\\\""; break;
+        case '\\': out << "\\\\"; break;
+        case '\n': out << "\\n"; break;
+        case '\t': out << "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(character) < 0x20)
+            {
+                out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(character) << std::dec;
+            }
+            else
+            {
+                out << character;
+            }
+        }
+    }
+    out << '"';
+}
+
+double profiler_percentile_ms(const std::vector<uint64_t>& sorted_durations_ns, double percentile)
+{
+    const size_t rank = static_cast<size_t>(std::ceil(percentile * static_cast<double>(sorted_durations_ns.size())));
+    return static_cast<double>(sorted_durations_ns[std::max<size_t>(rank, 1) - 1]) / 1e6;
+}
+
+// Keeps the last PROFILER_FRAME_HISTORY durations, overwriting the oldest.
+void profiler_append_duration(std::vector<uint64_t>& durations_ns, size_t& next_duration, uint64_t duration_ns)
+{
+    if (durations_ns.size() < PROFILER_FRAME_HISTORY)
+    {
+        durations_ns.push_back(duration_ns);
+    }
+    else
+    {
+        durations_ns[next_duration] = duration_ns;
+    }
+    next_duration = (next_duration + 1) % PROFILER_FRAME_HISTORY;
+}
+
+profiler_frame_statistics profiler_summarize_durations(std::vector<uint64_t> sorted_durations_ns)
+{
+    profiler_frame_statistics statistics;
+    if (sorted_durations_ns.empty())
+    {
+        return statistics;
+    }
+
+    std::sort(sorted_durations_ns.begin(), sorted_durations_ns.end());
+    uint64_t total_ns = 0;
+    for (uint64_t duration_ns : sorted_durations_ns)
+    {
+        total_ns += duration_ns;
+    }
+
+    statistics.frame_count = sorted_durations_ns.size();
+    statistics.average_ms = static_cast<double>(total_ns) / static_cast<double>(sorted_durations_ns.size()) / 1e6;
+    statistics.minimum_ms = static_cast<double>(sorted_durations_ns.front()) / 1e6;
+    statistics.maximum_ms = static_cast<double>(sorted_durations_ns.back()) / 1e6;
+    statistics.p50_ms = profiler_percentile_ms(sorted_durations_ns, 0.50);
+    statistics.p95_ms = profiler_percentile_ms(sorted_durations_ns, 0.95);
+    statistics.p99_ms = profiler_percentile_ms(sorted_durations_ns, 0.99);
+    return statistics;
+}
+
+profiler::profiler()
+{
+    gpu_timeline.name = "GPU";
+}
+
+profiler& profiler::get()
+{
+    static profiler instance;
+    return instance;
+}
+
+uint64_t profiler::now()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profiler_epoch).count());
+}
+
+profiler_timeline& profiler::get_thread_timeline()
+{
+    if (profiler_current_thread_timeline.timeline == nullptr)
+    {
+        std::lock_guard<std::mutex> lock(timelines_mutex);
+        auto timeline = std::make_unique<profiler_timeline>();
+        timeline->id = ++last_thread_timeline_id;
+        timeline->name = "Thread " + std::to_string(timeline->id);
+        profiler_current_thread_timeline.timeline = timeline.get();
+        thread_timelines.push_back(std::move(timeline));
+    }
+    return *profiler_current_thread_timeline.timeline;
+}
+
+// Threads come and go with job system restarts and reloads, a finished thread's zones leave the trace with it.
+void profiler::release_thread_timeline(profiler_timeline* timeline)
+{
+    std::lock_guard<std::mutex> lock(timelines_mutex);
+    std::erase_if(thread_timelines, [timeline](const std::unique_ptr<profiler_timeline>& candidate) { return candidate.get() == timeline; });
+}
+
+void profiler::set_thread_name(const std::string& thread_name)
+{
+    profiler_timeline& timeline = get_thread_timeline();
+    std::lock_guard<std::mutex> lock(timeline.mutex);
+    timeline.name = thread_name;
+}
+
+void profiler::append_zone(profiler_timeline& timeline, const profiler_zone_event& zone)
+{
+    std::lock_guard<std::mutex> lock(timeline.mutex);
+    if (timeline.zones.size() < PROFILER_ZONES_PER_THREAD)
+    {
+        timeline.zones.push_back(zone);
+    }
+    else
+    {
+        timeline.zones[timeline.next_zone] = zone;
+    }
+    timeline.next_zone = (timeline.next_zone + 1) % PROFILER_ZONES_PER_THREAD;
+}
+
+void profiler::record_zone(const char* zone_name, uint64_t start_ns, uint64_t end_ns)
+{
+    if (is_enabled())
+    {
+        append_zone(get_thread_timeline(), {zone_name, start_ns, end_ns});
+    }
+}
+
+void profiler::record_gpu_zone(const char* zone_name, uint64_t start_ns, uint64_t end_ns)
+{
+    if (is_enabled())
+    {
+        append_zone(gpu_timeline, {zone_name, start_ns, end_ns});
+    }
+}
+
+void profiler::end_frame(uint64_t end_ns)
+{
+    uint64_t start_ns = 0;
+    {
+        std::lock_guard<std::mutex> lock(frames_mutex);
+        start_ns = last_frame_end_ns;
+        last_frame_end_ns = end_ns;
+        if (!frame_open)
+        {
+            // the first call only opens a frame.
+            frame_open = true;
+            return;
+        }
+
+        profiler_append_duration(frame_durations_ns, next_frame, end_ns - start_ns);
+    }
+    record_zone("Frame", start_ns, end_ns);
+}
+
+void profiler::record_latency(uint64_t input_ns, uint64_t present_ns)
+{
+    std::lock_guard<std::mutex> lock(frames_mutex);
+    profiler_append_duration(latencies_ns, next_latency, present_ns > input_ns ? present_ns - input_ns : 0);
+}
+
+profiler_frame_statistics profiler::get_frame_statistics() const
+{
+    std::vector<uint64_t> durations_ns;
+    {
+        std::lock_guard<std::mutex> lock(frames_mutex);
+        durations_ns = frame_durations_ns;
+    }
+    return profiler_summarize_durations(std::move(durations_ns));
+}
+
+profiler_frame_statistics profiler::get_latency_statistics() const
+{
+    std::vector<uint64_t> durations_ns;
+    {
+        std::lock_guard<std::mutex> lock(frames_mutex);
+        durations_ns = latencies_ns;
+    }
+    return profiler_summarize_durations(std::move(durations_ns));
+}
+
+void profiler::write_chrome_trace(std::ostream& out) const
+{
+    // CPU threads are grouped under one process and the GPU under another, so the viewer shows them as separate tracks.
+    const int cpu_process_id = 1;
+    const int gpu_process_id = 2;
+
+    bool first_event = true;
+    auto write_separator = [&]()
+    {
+        out << (first_event ? "\n" : ",\n");
+        first_event = false;
+    };
+
+    auto write_timeline = [&](profiler_timeline& timeline, int process_id)
+    {
+        std::lock_guard<std::mutex> lock(timeline.mutex);
+        write_separator();
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << process_id << ",\"tid\":" << timeline.id << ",\"args\":{\"name\":";
+        profiler_write_json_string(out, timeline.name);
+        out << "}}";
+
+        for (const profiler_zone_event& zone : timeline.zones)
+        {
+            // trace timestamps are in microseconds, fractions keep the nanosecond resolution.
+            write_separator();
+            out << "{\"name\":";
+            profiler_write_json_string(out, zone.name);
+            out << ",\"ph\":\"X\",\"pid\":" << process_id << ",\"tid\":" << timeline.id
+                << ",\"ts\":" << static_cast<double>(zone.start_ns) / 1e3
+                << ",\"dur\":" << static_cast<double>(zone.end_ns - zone.start_ns) / 1e3 << "}";
+        }
+    };
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+    write_separator();
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << cpu_process_id << ",\"args\":{\"name\":\"CPU\"}}";
+    write_separator();
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << gpu_process_id << ",\"args\":{\"name\":\"GPU\"}}";
+
+    {
+        std::lock_guard<std::mutex> lock(timelines_mutex);
+        for (const auto& timeline : thread_timelines)
+        {
+            write_timeline(*timeline, cpu_process_id);
+        }
+    }
+    write_timeline(gpu_timeline, gpu_process_id);
+
+    out << "\n]}\n";
+}
+
+void profiler::save_chrome_trace(const std::filesystem::path& path) const
+{
+    std::ofstream out(path);
+    write_chrome_trace(out);
+    if (out.fail())
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << profiler::name << ": Failed to write trace to " << path;
+        throw std::runtime_error(oss.str());
+    }
+    std::cout << nengine::name << " - " << profiler::name << ": Wrote trace to " << path << std::endl;
+}
+
+void profiler::clear()
+{
+    {
+        std::lock_guard<std::mutex> lock(timelines_mutex);
+        for (const auto& timeline : thread_timelines)
+        {
+            std::lock_guard<std::mutex> timeline_lock(timeline->mutex);
+            timeline->zones.clear();
+            timeline->next_zone = 0;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(gpu_timeline.mutex);
+        gpu_timeline.zones.clear();
+        gpu_timeline.next_zone = 0;
+    }
+
+    std::lock_guard<std::mutex> lock(frames_mutex);
+    frame_durations_ns.clear();
+    next_frame = 0;
+    latencies_ns.clear();
+    next_latency = 0;
+    last_frame_end_ns = 0;
+    frame_open = false;
+}
@@ -0,0 +1,391 @@
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include "include/nengine-render-graph.h"
+#include "include/nengine.h"
+
+std::string render_graph::name = "RenderGraph";
+
+// Two accesses of a resource must be ordered unless both only read it the same way.
+inline bool render_graph_accesses_conflict(render_graph_access first, render_graph_access second)
+{
+    return first != second || render_graph_is_write(first) || render_graph_is_write(second);
+}
+
+render_graph_resource render_graph::create_texture(const std::string& resource_name, const render_graph_texture_description& description)
+{
+    render_graph_resource_info info;
+    info.name = resource_name;
+    info.description = description;
+    resources.push_back(info);
+    return static_cast<render_graph_resource>(resources.size() - 1);
+}
+
+render_graph_resource render_graph::import_texture( const std::string& resource_name,
+                                                    const render_graph_texture_description& description,
+                                                    render_graph_access initial_access,
+                                                    render_graph_access final_access,
+                                                    bool preserve_contents)
+{
+    render_graph_resource_info info;
+    info.name = resource_name;
+    info.description = description;
+    info.imported = true;
+    info.initial_access = initial_access;
+    info.final_access = final_access;
+    info.preserve_contents = preserve_contents;
+    resources.push_back(info);
+    return static_cast<render_graph_resource>(resources.size() - 1);
+}
+
+render_graph_pass render_graph::add_pass(const std::string& pass_name, render_graph_execute_function execute)
+{
+    pass_info info;
+    info.name = pass_name;
+    info.execute = std::move(execute);
+    passes.push_back(std::move(info));
+    return static_cast<render_graph_pass>(passes.size() - 1);
+}
+
+void render_graph::add_access(render_graph_pass pass, render_graph_resource resource, render_graph_access access, bool write)
+{
+    // a write declared as a read would get no barrier before the next reader and never keep its pass alive.
+    const bool single_access = access != RENDER_GRAPH_ACCESS_NONE && (access & (access - 1)) == 0;
+    if (!single_access || (write ? !render_graph_is_write(access) : !render_graph_is_read(access)))
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << render_graph::name << ": Pass " << passes[pass].name << " declares access " << access
+            << " to " << resources[resource].name << " as a " << (write ? "write" : "read") << ".";
+        throw std::invalid_argument(oss.str());
+    }
+
+    for (const pass_access& existing : passes[pass].accesses)
+    {
+        if (existing.resource == resource)
+        {
+            std::ostringstream oss;
+            oss << nengine::name << " - " << render_graph::name << ": Pass " << passes[pass].name << " accesses "
+                << resources[resource].name << " more than once.";
+            throw std::invalid_argument(oss.str());
+        }
+    }
+    passes[pass].accesses.push_back({resource, access});
+}
+
+void render_graph::read(render_graph_pass pass, render_graph_resource resource, render_graph_access access)
+{
+    add_access(pass, resource, access, false);
+}
+
+void render_graph::write(render_graph_pass pass, render_graph_resource resource, render_graph_access access)
+{
+    add_access(pass, resource, access, true);
+}
+
+void render_graph::set_side_effects(render_graph_pass pass)
+{
+    passes[pass].side_effects = true;
+}
+
+void render_graph::compile(const render_graph_memory_function& memory_requirements)
+{
+    for (render_graph_resource_info& resource : resources)
+    {
+        resource.live = false;
+        resource.access_mask = 0;
+        resource.last_access = RENDER_GRAPH_ACCESS_NONE;
+        resource.memory_slot = UINT32_MAX;
+    }
+
+    cull_passes();
+    assign_levels();
+    alias_memory(memory_requirements);
+    plan_barriers();
+}
+
+void render_graph::cull_passes()
+{
+    // Walking backwards, a pass is live when it has side effects, writes an imported resource, or produces
+    // something a live pass accesses. The producer of a resource for pass p is the last writer declared before p.
+    for (pass_info& pass : passes)
+    {
+        pass.live = pass.side_effects;
+        for (const pass_access& access : pass.accesses)
+        {
+            pass.live = pass.live || (resources[access.resource].imported && render_graph_is_write(access.access));
+        }
+    }
+
+    for (size_t i = passes.size(); i-- > 0;)
+    {
+        if (!passes[i].live)
+        {
+            continue;
+        }
+        for (const pass_access& access : passes[i].accesses)
+        {
+            for (size_t producer = i; producer-- > 0;)
+            {
+                auto writes_resource = [&](const pass_access& other)
+                {
+                    return other.resource == access.resource && render_graph_is_write(other.access);
+                };
+                if (std::any_of(passes[producer].accesses.begin(), passes[producer].accesses.end(), writes_resource))
+                {
+                    passes[producer].live = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void render_graph::assign_levels()
+{
+    // Per resource, the live accesses so far in declaration order, with the level of their pass.
+    struct level_access
+    {
+        render_graph_access access;
+        uint32_t level;
+    };
+    std::vector<std::vector<level_access>> resource_accesses(resources.size());
+
+    levels.clear();
+    for (size_t i = 0; i < passes.size(); ++i)
+    {
+        pass_info& pass = passes[i];
+        if (!pass.live)
+        {
+            continue;
+        }
+
+        pass.level = 0;
+        for (const pass_access& access : pass.accesses)
+        {
+            for (const level_access& previous : resource_accesses[access.resource])
+            {
+                if (render_graph_accesses_conflict(previous.access, access.access))
+                {
+                    pass.level = std::max(pass.level, previous.level + 1);
+                }
+            }
+        }
+
+        for (const pass_access& access : pass.accesses)
+        {
+            resource_accesses[access.resource].push_back({access.access, pass.level});
+
+            render_graph_resource_info& resource = resources[access.resource];
+            resource.first_level = resource.live ? std::min(resource.first_level, pass.level) : pass.level;
+            resource.last_level = resource.live ? std::max(resource.last_level, pass.level) : pass.level;
+            resource.access_mask |= access.access;
+            resource.live = true;
+        }
+
+        if (levels.size() <= pass.level)
+        {
+            levels.resize(pass.level + 1);
+        }
+        levels[pass.level].push_back(static_cast<render_graph_pass>(i));
+    }
+
+    // the state each resource is left in, which the next user of its memory starts from.
+    for (const auto& level : levels)
+    {
+        for (render_graph_pass pass : level)
+        {
+            for (const pass_access& access : passes[pass].accesses)
+            {
+                resources[access.resource].last_access = access.access;
+            }
+        }
+    }
+}
+
+void render_graph::alias_memory(const render_graph_memory_function& memory_requirements)
+{
+    memory_slots.clear();
+
+    std::vector<render_graph_resource> transients;
+    for (size_t i = 0; i < resources.size(); ++i)
+    {
+        if (resources[i].live && !resources[i].imported)
+        {
+            resources[i].memory_requirements = memory_requirements(static_cast<render_graph_resource>(i), resources[i]);
+            transients.push_back(static_cast<render_graph_resource>(i));
+        }
+    }
+
+    // Greedy interval packing: in order of first use, each resource takes the slot freed before it starts that
+    // wastes the least memory, or grows the largest one, or opens a new slot.
+    std::stable_sort(transients.begin(), transients.end(), [&](render_graph_resource a, render_graph_resource b)
+    {
+        return resources[a].first_level < resources[b].first_level;
+    });
+
+    std::vector<uint32_t> slot_last_levels;
+    for (render_graph_resource resource : transients)
+    {
+        render_graph_resource_info& info = resources[resource];
+        uint32_t best_slot = UINT32_MAX;
+        for (uint32_t slot = 0; slot < memory_slots.size(); ++slot)
+        {
+            const render_graph_memory_requirements& slot_requirements = memory_slots[slot].requirements;
+            if (slot_last_levels[slot] >= info.first_level || (slot_requirements.memory_type_bits & info.memory_requirements.memory_type_bits) == 0)
+            {
+                continue;
+            }
+
+            if (best_slot == UINT32_MAX)
+            {
+                best_slot = slot;
+                continue;
+            }
+            const uint64_t best_size = memory_slots[best_slot].requirements.size;
+            const uint64_t slot_size = slot_requirements.size;
+            const bool slot_fits = slot_size >= info.memory_requirements.size;
+            const bool best_fits = best_size >= info.memory_requirements.size;
+            if ((slot_fits && (!best_fits || slot_size < best_size)) || (!slot_fits && !best_fits && slot_size > best_size))
+            {
+                best_slot = slot;
+            }
+        }
+
+        if (best_slot == UINT32_MAX)
+        {
+            best_slot = static_cast<uint32_t>(memory_slots.size());
+            memory_slots.emplace_back();
+            memory_slots.back().requirements.size = 0;
+            slot_last_levels.push_back(0);
+        }
+
+        render_graph_memory_requirements& slot_requirements = memory_slots[best_slot].requirements;
+        slot_requirements.size = std::max(slot_requirements.size, info.memory_requirements.size);
+        slot_requirements.alignment = std::max(slot_requirements.alignment, info.memory_requirements.alignment);
+        slot_requirements.memory_type_bits &= info.memory_requirements.memory_type_bits;
+        memory_slots[best_slot].resources.push_back(resource);
+        slot_last_levels[best_slot] = info.last_level;
+        info.memory_slot = best_slot;
+    }
+}
+
+void render_graph::plan_barriers()
+{
+    std::vector<render_graph_access> current_access(resources.size(), RENDER_GRAPH_ACCESS_NONE);
+    std::vector<bool> used(resources.size(), false);
+
+    level_barriers.assign(levels.size(), {});
+    final_barriers.clear();
+
+    for (size_t level = 0; level < levels.size(); ++level)
+    {
+        for (render_graph_pass pass : levels[level])
+        {
+            for (const pass_access& access : passes[pass].accesses)
+            {
+                const render_graph_resource_info& resource = resources[access.resource];
+                render_graph_barrier barrier{access.resource, current_access[access.resource], access.access, false};
+
+                if (!used[access.resource] && resource.imported)
+                {
+                    barrier.before = resource.initial_access;
+                    barrier.discard = !resource.preserve_contents;
+                }
+                else if (!used[access.resource])
+                {
+                    // the memory was last used by the slot's previous resource, by the last one for the first
+                    // resource, as the previous frame left it.
+                    const std::vector<render_graph_resource>& slot_resources = memory_slots[resource.memory_slot].resources;
+                    const auto position = std::find(slot_resources.begin(), slot_resources.end(), access.resource);
+                    const render_graph_resource previous = position == slot_resources.begin() ? slot_resources.back() : *(position - 1);
+                    barrier.before = resources[previous].last_access;
+                    barrier.discard = true;
+                }
+
+                if (barrier.discard || render_graph_accesses_conflict(barrier.before, barrier.after))
+                {
+                    level_barriers[level].push_back(barrier);
+                }
+                current_access[access.resource] = access.access;
+                used[access.resource] = true;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < resources.size(); ++i)
+    {
+        const render_graph_resource_info& resource = resources[i];
+        if (resource.imported && used[i] && render_graph_accesses_conflict(current_access[i], resource.final_access))
+        {
+            final_barriers.push_back({static_cast<render_graph_resource>(i), current_access[i], resource.final_access, false});
+        }
+    }
+}
+
+void render_graph::execute(void* context, const render_graph_barrier_function& barriers) const
+{
+    for (size_t level = 0; level < levels.size(); ++level)
+    {
+        if (!level_barriers[level].empty())
+        {
+            barriers(context, level_barriers[level].data(), level_barriers[level].size());
+        }
+        for (render_graph_pass pass : levels[level])
+        {
+            if (passes[pass].execute)
+            {
+                passes[pass].execute(context);
+            }
+        }
+    }
+
+    if (!final_barriers.empty())
+    {
+        barriers(context, final_barriers.data(), final_barriers.size());
+    }
+}
+
+void render_graph::clear()
+{
+    resources.clear();
+    passes.clear();
+    levels.clear();
+    level_barriers.clear();
+    final_barriers.clear();
+    memory_slots.clear();
+}
+
+size_t render_graph::get_barrier_count() const
+{
+    size_t count = final_barriers.size();
+    for (const auto& barriers : level_barriers)
+    {
+        count += barriers.size();
+    }
+    return count;
+}
+
+uint64_t render_graph::get_aliased_memory_bytes() const
+{
+    uint64_t bytes = 0;
+    for (const render_graph_memory_slot& slot : memory_slots)
+    {
+        bytes += slot.requirements.size;
+    }
+    return bytes;
+}
+
+uint64_t render_graph::get_unaliased_memory_bytes() const
+{
+    uint64_t bytes = 0;
+    for (const render_graph_resource_info& resource : resources)
+    {
+        if (resource.live && !resource.imported)
+        {
+            bytes += resource.memory_requirements.size;
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,111 @@
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "include/nengine-render-queue.h"
+#include "include/nengine.h"
+
+std::string render_command_queue::name = "RenderCommandQueue";
+
+render_command_queue::render_command_queue(uint32_t in_capacity)
+{
+    if (in_capacity == 0 || in_capacity > (1u << 31))
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << render_command_queue::name << ": Invalid capacity " << in_capacity;
+        throw std::invalid_argument(oss.str());
+    }
+
+    uint32_t rounded_capacity = 1;
+    while (rounded_capacity < in_capacity)
+    {
+        rounded_capacity <<= 1;
+    }
+    mask = rounded_capacity - 1;
+    cells = std::make_unique<cell[]>(rounded_capacity);
+    for (uint32_t i = 0; i < rounded_capacity; ++i)
+    {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool render_command_queue::try_push(const render_command& command)
+{
+    // A cell is free for the producer claiming position p when its sequence is p, and holds a command for the
+    // consumer reading position p when it is p + 1. The consumer hands it back to the next lap with p + capacity.
+    uint64_t position = write_position.load(std::memory_order_relaxed);
+    cell* target = nullptr;
+    for (;;)
+    {
+        target = &cells[position & mask];
+        const uint64_t sequence = target->sequence.load(std::memory_order_acquire);
+        const int64_t difference = static_cast<int64_t>(sequence - position);
+        if (difference == 0)
+        {
+            if (write_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            // the consumer has not released this cell from the previous lap yet.
+            return false;
+        }
+        else
+        {
+            // another producer claimed the position first.
+            position = write_position.load(std::memory_order_relaxed);
+        }
+    }
+
+    target->command = command;
+    target->sequence.store(position + 1, std::memory_order_release);
+    target->sequence.notify_all();
+    return true;
+}
+
+void render_command_queue::push(const render_command& command)
+{
+    while (!try_push(command))
+    {
+        // full, sleeps until the consumer hands the cell at the write position back. A cell released in between
+        // changed its sequence already and the wait returns right away.
+        const uint64_t position = write_position.load(std::memory_order_relaxed);
+        cell& target = cells[position & mask];
+        const uint64_t sequence = target.sequence.load(std::memory_order_acquire);
+        if (static_cast<int64_t>(sequence - position) < 0)
+        {
+            target.sequence.wait(sequence, std::memory_order_acquire);
+        }
+    }
+}
+
+bool render_command_queue::try_pop(render_command& out_command)
+{
+    cell& source = cells[read_position & mask];
+    if (source.sequence.load(std::memory_order_acquire) != read_position + 1)
+    {
+        // empty, or the producer that claimed the position is still writing it.
+        return false;
+    }
+
+    out_command = source.command;
+    source.sequence.store(read_position + mask + 1, std::memory_order_release);
+    source.sequence.notify_all();
+    read_position++;
+    return true;
+}
+
+void render_command_queue::pop(render_command& out_command)
+{
+    while (!try_pop(out_command))
+    {
+        // sleeps until a producer publishes the cell at the read position.
+        cell& source = cells[read_position & mask];
+        const uint64_t sequence = source.sequence.load(std::memory_order_acquire);
+        if (sequence != read_position + 1)
+        {
+            source.sequence.wait(sequence, std::memory_order_acquire);
+        }
+    }
+}
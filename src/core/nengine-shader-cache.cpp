@@ -0,0 +1,115 @@
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "include/nengine-shader-cache.h"
+#include "include/nengine-atomic-file.h"
+#include "include/nengine.h"
+
+std::string shader_cache::name = "ShaderCache";
+
+// On-disk layout: shader_cache_entry_header followed by word_count SPIR-V words.
+struct shader_cache_entry_header
+{
+    uint32_t magic;
+    uint32_t format_version;
+    uint64_t key_hash;
+    uint64_t word_count;
+    uint64_t checksum;
+};
+
+const uint32_t SHADER_CACHE_MAGIC = 0x5650534e; // "NSPV"
+const uint32_t SHADER_CACHE_FORMAT_VERSION = 1;
+
+uint64_t shader_cache_key::hash() const
+{
+    uint64_t key_hash = nengine_utils::hash_fnv1a_64(&source_hash, sizeof(source_hash));
+    key_hash = nengine_utils::hash_fnv1a_64(&include_hash, sizeof(include_hash), key_hash);
+    key_hash = nengine_utils::hash_fnv1a_64(&shader_kind, sizeof(shader_kind), key_hash);
+
+    // length prefix strings so that adjacent fields can not alias each other.
+    uint64_t entry_point_length = entry_point.size();
+    key_hash = nengine_utils::hash_fnv1a_64(&entry_point_length, sizeof(entry_point_length), key_hash);
+    key_hash = nengine_utils::hash_fnv1a_64(entry_point.data(), entry_point.size(), key_hash);
+    uint64_t compile_options_length = compile_options.size();
+    key_hash = nengine_utils::hash_fnv1a_64(&compile_options_length, sizeof(compile_options_length), key_hash);
+    key_hash = nengine_utils::hash_fnv1a_64(compile_options.data(), compile_options.size(), key_hash);
+
+    uint64_t compiler_build_length = compiler_build.size();
+    key_hash = nengine_utils::hash_fnv1a_64(&compiler_build_length, sizeof(compiler_build_length), key_hash);
+    key_hash = nengine_utils::hash_fnv1a_64(compiler_build.data(), compiler_build.size(), key_hash);
+    return key_hash;
+}
+
+shader_cache::shader_cache(const std::filesystem::path& in_directory) : directory(in_directory)
+{
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error)
+    {
+        std::cerr   << nengine::name << " - " << shader_cache::name
+                    << ": Failed to create cache directory " << directory << ": " << error.message() << std::endl;
+    }
+}
+
+std::filesystem::path shader_cache::get_entry_path(const shader_cache_key& key) const
+{
+    std::ostringstream file_name;
+    file_name << std::hex << std::setw(16) << std::setfill('0') << key.hash() << ".spv";
+    return directory / file_name.str();
+}
+
+std::optional<spirv_module> shader_cache::load(const shader_cache_key& key)
+{
+    const uint64_t key_hash = key.hash();
+    const std::filesystem::path entry_path = get_entry_path(key);
+    std::error_code size_error;
+    const uintmax_t entry_size = std::filesystem::file_size(entry_path, size_error);
+    std::ifstream entry_in(entry_path, std::ios::binary);
+    if (size_error || !entry_in.is_open())
+    {
+        miss_count.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+
+    shader_cache_entry_header header = {};
+    entry_in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (entry_in.fail()
+        || header.magic != SHADER_CACHE_MAGIC
+        || header.format_version != SHADER_CACHE_FORMAT_VERSION
+        || header.key_hash != key_hash
+        || header.word_count != (entry_size - sizeof(header)) / sizeof(uint32_t)
+        || (entry_size - sizeof(header)) % sizeof(uint32_t) != 0)
+    {
+        // the word count is checked against the file before anything is allocated for it.
+        miss_count.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+
+    spirv_module module(header.word_count);
+    entry_in.read(reinterpret_cast<char*>(module.data()), static_cast<std::streamsize>(module.size() * sizeof(uint32_t)));
+    if (entry_in.fail() || nengine_utils::hash_fnv1a_64(module.data(), module.size() * sizeof(uint32_t)) != header.checksum)
+    {
+        // truncated or corrupt entry, it will be overwritten by the next store.
+        miss_count.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+
+    hit_count.fetch_add(1, std::memory_order_relaxed);
+    return module;
+}
+
+bool shader_cache::store(const shader_cache_key& key, const spirv_module& module)
+{
+    shader_cache_entry_header header = {};
+    header.magic = SHADER_CACHE_MAGIC;
+    header.format_version = SHADER_CACHE_FORMAT_VERSION;
+    header.key_hash = key.hash();
+    header.word_count = module.size();
+    header.checksum = nengine_utils::hash_fnv1a_64(module.data(), module.size() * sizeof(uint32_t));
+
+    const std::filesystem::path entry_path = get_entry_path(key);
+
+    return atomic_file_write(entry_path, {{&header, sizeof(header)}, {module.data(), module.size() * sizeof(uint32_t)}}, shader_cache::name);
+}
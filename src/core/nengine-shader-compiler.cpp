@@ -1,12 +1,37 @@
-
+#include <algorithm>
+#include <atomic>
+#include <exception>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include "include/nengine-shader-compiler.h"
 #include "shaderc/shaderc.hpp"
 #include "include/nengine.h"
 
+// shaderc's build generates build-version.inc, one string literal naming the shaderc, SPIRV-Tools and glslang
+// versions it was built from. Without it the time core was compiled stands in, which changes with every build of
+// core, so an upgraded compiler at least invalidates the cache once core is rebuilt against it.
+#if __has_include("build-version.inc")
+const char* const SHADER_COMPILER_BUILD =
+#include "build-version.inc"
+    ;
+#else
+#if defined(__clang__)
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdate-time"
+#endif
+const char* const SHADER_COMPILER_BUILD = "nengine " __DATE__ " " __TIME__;
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#endif
+#endif
+
 std::string shader_compiler::name = "ShaderCompiler";
+std::shared_ptr<shader_cache> shader_compiler::cache = nullptr;
+std::shared_ptr<shader_include_cache> shader_compiler::include_cache = std::make_shared<shader_include_cache>();
 
 shader_compiler::shader_compiler()
 {
@@ -16,21 +41,204 @@ shader_compiler::~shader_compiler()
 {
 }
 
+void shader_compiler::set_cache(std::shared_ptr<shader_cache> in_cache)
+{
+    cache = in_cache;
+}
+
+shaderc::CompileOptions shader_compiler::make_compile_options(const shader_compile_config& config)
+{
+    shaderc::CompileOptions options;
+    options.SetIncluder(std::make_unique<shader_includer>(include_cache, config.include_directories));
+    for (const auto& [macro, value] : config.definitions)
+    {
+        options.AddMacroDefinition(macro, value);
+    }
+    if (config.optimize)
+    {
+        options.SetOptimizationLevel(shaderc_optimization_level_performance);
+    }
+    return options;
+}
+
+std::string shader_compiler::get_compile_options_signature(const shader_compile_config& config)
+{
+    // Must describe every option make_compile_options applies, it is part of the cache key. Include directories only
+    // matter through the files they resolve to, which the key's include_hash covers.
+    std::ostringstream signature;
+    signature << (config.optimize ? "performance" : "default");
+    for (const auto& [macro, value] : config.definitions)
+    {
+        signature << ";" << macro.size() << ":" << macro << "=" << value.size() << ":" << value;
+    }
+    return signature.str();
+}
+
+shader_cache_key shader_compiler::make_cache_key(const shader_compile_config& config)
+{
+    shader_cache_key key;
+    key.source_hash = nengine_utils::hash_fnv1a_64(config.shader_code.data(), config.shader_code.size());
+    key.include_hash = include_cache->hash_includes(config.shader_code, config.input_file_name, config.include_directories);
+    key.shader_kind = static_cast<uint32_t>(config.shader_kind);
+    key.entry_point = config.entry_point;
+    key.compile_options = get_compile_options_signature(config);
+
+    key.compiler_build = SHADER_COMPILER_BUILD;
+    return key;
+}
+
 spirv_module shader_compiler::compile(shader_compile_config& config)
 {
     shaderc::Compiler compiler;
-    shaderc::CompileOptions options;
+    return compile(compiler, config);
+}
+
+std::vector<shader_compile_result> shader_compiler::compile_batch(std::vector<shader_compile_config>& configs, unsigned int thread_count)
+{
+    std::vector<shader_compile_result> results(configs.size());
+    if (configs.empty())
+    {
+        return results;
+    }
+
+    if (thread_count == 0)
+    {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    thread_count = static_cast<unsigned int>(std::min<size_t>(thread_count, configs.size()));
+
+    // Workers pull the next config index until the batch is drained, so uneven shader sizes balance out.
+    std::atomic<size_t> next_config_index = 0;
+    auto compile_worker = [&]()
+    {
+        shaderc::Compiler compiler;
+        for (size_t i = next_config_index.fetch_add(1); i < configs.size(); i = next_config_index.fetch_add(1))
+        {
+            try
+            {
+                results[i].module = compile(compiler, configs[i]);
+            }
+            catch (const std::string& error)
+            {
+                results[i].error = error;
+            }
+            catch (const std::exception& exception)
+            {
+                results[i].error = exception.what();
+            }
+        }
+    };
+
+    // the calling thread works too, instead of sleeping on the joins.
+    std::vector<std::thread> workers;
+    workers.reserve(thread_count - 1);
+    for (unsigned int i = 1; i < thread_count; ++i)
+    {
+        workers.emplace_back(compile_worker);
+    }
+    compile_worker();
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+
+    return results;
+}
+
+shader_permutation_result shader_compiler::compile_permutations( const shader_compile_config& base,
+                                                                const std::vector<std::string>& feature_macros,
+                                                                const std::vector<uint32_t>& feature_masks,
+                                                                unsigned int thread_count)
+{
+    if (feature_macros.size() > 32)
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << shader_compiler::name << ": At most 32 features fit a mask, got " << feature_macros.size();
+        throw std::invalid_argument(oss.str());
+    }
+
+    std::vector<shader_compile_config> configs(feature_masks.size(), base);
+    for (size_t i = 0; i < feature_masks.size(); ++i)
+    {
+        for (size_t feature = 0; feature < feature_macros.size(); ++feature)
+        {
+            if (feature_masks[i] & (1u << feature))
+            {
+                configs[i].definitions[feature_macros[feature]] = "1";
+            }
+        }
+    }
 
-    shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(config.shader_code, config.shader_kind, config.input_file_name.c_str(), options);
+    std::vector<shader_compile_result> results = compile_batch(configs, thread_count);
+
+    shader_permutation_result permutations;
+    permutations.module_indices.reserve(results.size());
+    // hash of a module to the indices of the unique modules with that hash.
+    std::unordered_multimap<uint64_t, uint32_t> module_hashes;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        if (!results[i].succeeded())
+        {
+            std::ostringstream error_stream;
+            error_stream << "Permutation " << feature_masks[i] << ": " << results[i].error;
+            return {{}, {}, error_stream.str()};
+        }
+
+        const spirv_module& module = results[i].module;
+        const uint64_t module_hash = nengine_utils::hash_fnv1a_64(module.data(), module.size() * sizeof(uint32_t));
+        uint32_t module_index = static_cast<uint32_t>(permutations.modules.size());
+        const auto [first, last] = module_hashes.equal_range(module_hash);
+        for (auto candidate = first; candidate != last; ++candidate)
+        {
+            if (permutations.modules[candidate->second] == module)
+            {
+                module_index = candidate->second;
+                break;
+            }
+        }
+
+        if (module_index == permutations.modules.size())
+        {
+            module_hashes.insert({module_hash, module_index});
+            permutations.modules.push_back(std::move(results[i].module));
+        }
+        permutations.module_indices.push_back(module_index);
+    }
+    return permutations;
+}
+
+spirv_module shader_compiler::compile(const shaderc::Compiler& compiler, shader_compile_config& config)
+{
+    std::shared_ptr<shader_cache> compile_cache = cache;
+    shader_cache_key cache_key;
+    if (compile_cache)
+    {
+        cache_key = make_cache_key(config);
+        if (std::optional<spirv_module> cached_module = compile_cache->load(cache_key))
+        {
+            return std::move(*cached_module);
+        }
+    }
+
+    shaderc::CompileOptions options = make_compile_options(config);
+
+    shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(config.shader_code, config.shader_kind, config.input_file_name.c_str(), config.entry_point.c_str(), options);
     if (result.GetCompilationStatus() != shaderc_compilation_status_success)
     {
         std::ostringstream error_stream;
         error_stream    << nengine::name << " - " << shader_compiler::name 
-                        << "Failed to compile shader: " << result.GetErrorMessage() << std::endl;
+                        << ": Failed to compile shader " << config.input_file_name << ": " << result.GetErrorMessage() << std::endl;
         throw(error_stream.str());
     }
 
     spirv_module module(result.cbegin(), result.cend());
+
+    if (compile_cache)
+    {
+        compile_cache->store(cache_key, module);
+    }
+
     return module;
 
 }
@@ -0,0 +1,200 @@
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <string>
+#include <system_error>
+#include <unordered_set>
+#include <utility>
+#include "include/nengine-shader-includes.h"
+#include "include/nengine.h"
+
+std::string shader_include_cache::name = "ShaderIncludeCache";
+
+std::shared_ptr<const shader_include_file> shader_include_cache::load(const std::filesystem::path& path)
+{
+    const std::filesystem::path normal_path = path.lexically_normal();
+    const std::string key = normal_path.string();
+
+    // a stat per include, the contents are only read when they may have changed.
+    std::error_code error;
+    const std::filesystem::file_time_type write_time = std::filesystem::last_write_time(normal_path, error);
+    const uintmax_t size = error ? 0 : std::filesystem::file_size(normal_path, error);
+    if (error)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.erase(key);
+        return nullptr;
+    }
+
+    // the first compile to miss reads the file, the others wait for its result.
+    std::promise<std::shared_ptr<const shader_include_file>> loaded_file;
+    std::shared_future<std::shared_ptr<const shader_include_file>> cached_file;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto entry = entries.find(key);
+        if (entry != entries.end() && entry->second.write_time == write_time && entry->second.size == size)
+        {
+            cached_file = entry->second.file;
+        }
+        else
+        {
+            entries[key] = {write_time, size, loaded_file.get_future().share()};
+        }
+    }
+    if (cached_file.valid())
+    {
+        return cached_file.get();
+    }
+
+    // read without holding the lock, compiles of other shaders keep hitting the cache meanwhile.
+    std::shared_ptr<shader_include_file> file;
+    std::ifstream file_in(normal_path, std::ios::binary);
+    if (file_in.is_open())
+    {
+        file = std::make_shared<shader_include_file>();
+        file->path = normal_path;
+        file->contents.assign(std::istreambuf_iterator<char>(file_in), std::istreambuf_iterator<char>());
+        file->contents_hash = nengine_utils::hash_fnv1a_64(file->contents.data(), file->contents.size());
+        read_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    loaded_file.set_value(file);
+    if (!file)
+    {
+        // not remembered, the next include tries again.
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto entry = entries.find(key);
+        if (entry != entries.end() && entry->second.file.wait_for(std::chrono::seconds(0)) == std::future_status::ready && !entry->second.file.get())
+        {
+            entries.erase(entry);
+        }
+    }
+    return file;
+}
+
+std::shared_ptr<const shader_include_file> shader_include_cache::resolve(   const std::string& requested_source,
+                                                                            const std::filesystem::path& requesting_source,
+                                                                            bool relative,
+                                                                            const std::vector<std::filesystem::path>& include_directories)
+{
+    if (relative)
+    {
+        if (std::shared_ptr<const shader_include_file> file = load(requesting_source.parent_path() / requested_source))
+        {
+            return file;
+        }
+    }
+
+    for (const auto& include_directory : include_directories)
+    {
+        if (std::shared_ptr<const shader_include_file> file = load(include_directory / requested_source))
+        {
+            return file;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<std::shared_ptr<const shader_include_file>> shader_include_cache::find_includes(  const std::string& source,
+                                                                                            const std::filesystem::path& source_path,
+                                                                                            const std::vector<std::filesystem::path>& include_directories)
+{
+    std::vector<std::shared_ptr<const shader_include_file>> included_files;
+    std::unordered_set<std::string> visited_files;
+    std::vector<std::pair<std::shared_ptr<const shader_include_file>, std::filesystem::path>> pending_sources;
+
+    // the source itself is not in the cache, it is scanned through a file without contents_hash.
+    auto root = std::make_shared<shader_include_file>();
+    root->contents = source;
+    pending_sources.push_back({root, source_path});
+
+    while (!pending_sources.empty())
+    {
+        const auto [including_file, including_path] = pending_sources.back();
+        pending_sources.pop_back();
+
+        const std::string& contents = including_file->contents;
+        for (size_t line_start = 0; line_start < contents.size();)
+        {
+            size_t line_end = contents.find('\n', line_start);
+            if (line_end == std::string::npos)
+            {
+                line_end = contents.size();
+            }
+
+            // # include "file" or # include <file>, with optional whitespace around the #.
+            size_t position = contents.find_first_not_of(" \t", line_start);
+            if (position < line_end && contents[position] == '#')
+            {
+                position = contents.find_first_not_of(" \t", position + 1);
+                if (position < line_end && contents.compare(position, 7, "include") == 0)
+                {
+                    position = contents.find_first_not_of(" \t", position + 7);
+                    if (position < line_end && (contents[position] == '"' || contents[position] == '<'))
+                    {
+                        const bool relative = contents[position] == '"';
+                        const size_t name_end = contents.find(relative ? '"' : '>', position + 1);
+                        if (name_end < line_end)
+                        {
+                            const std::string requested_source = contents.substr(position + 1, name_end - position - 1);
+                            std::shared_ptr<const shader_include_file> file = resolve(requested_source, including_path, relative, include_directories);
+                            if (file && visited_files.insert(file->path.string()).second)
+                            {
+                                included_files.push_back(file);
+                                pending_sources.push_back({file, file->path});
+                            }
+                        }
+                    }
+                }
+            }
+            line_start = line_end + 1;
+        }
+    }
+    return included_files;
+}
+
+uint64_t shader_include_cache::hash_includes(   const std::string& source,
+                                                const std::filesystem::path& source_path,
+                                                const std::vector<std::filesystem::path>& include_directories)
+{
+    uint64_t includes_hash = 0;
+    for (const auto& file : find_includes(source, source_path, include_directories))
+    {
+        includes_hash = nengine_utils::hash_fnv1a_64(&file->contents_hash, sizeof(file->contents_hash), includes_hash);
+    }
+    return includes_hash;
+}
+
+shader_includer::shader_includer(std::shared_ptr<shader_include_cache> in_cache, const std::vector<std::filesystem::path>& in_include_directories)
+    : cache(std::move(in_cache)), include_directories(in_include_directories)
+{
+}
+
+shaderc_include_result* shader_includer::GetInclude(const char* requested_source, shaderc_include_type type, const char* requesting_source, size_t include_depth)
+{
+    UNUSED(include_depth);
+    include_result* include = new include_result();
+    include->file = cache->resolve(requested_source, requesting_source, type == shaderc_include_type_relative, include_directories);
+    if (include->file)
+    {
+        include->source_name = include->file->path.string();
+        include->result.content = include->file->contents.data();
+        include->result.content_length = include->file->contents.size();
+    }
+    else
+    {
+        // an empty source name tells shaderc the include failed, the content is the error message.
+        include->error = std::string("Cannot find include file ") + requested_source;
+        include->result.content = include->error.data();
+        include->result.content_length = include->error.size();
+    }
+    include->result.source_name = include->source_name.data();
+    include->result.source_name_length = include->source_name.size();
+    include->result.user_data = include;
+    return &include->result;
+}
+
+void shader_includer::ReleaseInclude(shaderc_include_result* data)
+{
+    delete static_cast<include_result*>(data->user_data);
+}
@@ -0,0 +1,64 @@
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "include/nengine-staging-ring.h"
+#include "include/nengine.h"
+
+std::string staging_ring::name = "StagingRing";
+
+staging_ring::staging_ring(uint64_t in_capacity) : capacity(in_capacity)
+{
+}
+
+std::optional<uint64_t> staging_ring::allocate(uint64_t size, uint64_t alignment)
+{
+    if (size == 0 || alignment == 0 || (alignment & (alignment - 1)) != 0)
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << staging_ring::name << ": Invalid allocation of " << size << " bytes aligned to " << alignment;
+        throw std::invalid_argument(oss.str());
+    }
+
+    if (used_bytes == 0)
+    {
+        head = 0;
+    }
+
+    // Free space starts at head and runs used_bytes short of a full lap. The allocation either fits before the end
+    // of the ring or starts over at offset 0, in which case the skipped tail is consumed along with it.
+    uint64_t offset = (head + alignment - 1) & ~(alignment - 1);
+    if (offset + size > capacity)
+    {
+        offset = 0;
+    }
+
+    const uint64_t consumed = offset >= head ? offset + size - head : capacity - head + size;
+    if (used_bytes + consumed > capacity)
+    {
+        return std::nullopt;
+    }
+
+    head = (offset + size) % capacity;
+    used_bytes += consumed;
+    open_batch_bytes += consumed;
+    return offset;
+}
+
+void staging_ring::close_batch(uint64_t timeline_value)
+{
+    if (open_batch_bytes == 0)
+    {
+        return;
+    }
+    batches.push_back({timeline_value, open_batch_bytes});
+    open_batch_bytes = 0;
+}
+
+void staging_ring::retire(uint64_t completed_timeline_value)
+{
+    while (!batches.empty() && batches.front().timeline_value <= completed_timeline_value)
+    {
+        used_bytes -= batches.front().bytes;
+        batches.pop_front();
+    }
+}
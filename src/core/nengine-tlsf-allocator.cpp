@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <bit>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "include/nengine-tlsf-allocator.h"
+#include "include/nengine.h"
+
+std::string tlsf_allocator::name = "TLSFAllocator";
+
+struct tlsf_bucket
+{
+    uint32_t first_level;
+    uint32_t second_level;
+};
+
+// Bucket holding ranges of exactly this size class. Sizes below TLSF_SECOND_LEVEL_COUNT share the first level 0.
+inline tlsf_bucket tlsf_get_bucket(uint64_t size)
+{
+    if (size < TLSF_SECOND_LEVEL_COUNT)
+    {
+        return {0, static_cast<uint32_t>(size)};
+    }
+    const uint32_t size_log2 = static_cast<uint32_t>(std::bit_width(size)) - 1;
+    return {size_log2 - TLSF_SECOND_LEVEL_LOG2 + 1,
+            static_cast<uint32_t>(size >> (size_log2 - TLSF_SECOND_LEVEL_LOG2)) - TLSF_SECOND_LEVEL_COUNT};
+}
+
+// Smallest bucket whose every range is at least size bytes, so the first free range found needs no size check.
+inline tlsf_bucket tlsf_get_search_bucket(uint64_t size)
+{
+    if (size >= TLSF_SECOND_LEVEL_COUNT)
+    {
+        const uint32_t size_log2 = static_cast<uint32_t>(std::bit_width(size)) - 1;
+        size += (uint64_t(1) << (size_log2 - TLSF_SECOND_LEVEL_LOG2)) - 1;
+    }
+    return tlsf_get_bucket(size);
+}
+
+tlsf_allocator::tlsf_allocator(uint64_t in_capacity) : capacity(in_capacity)
+{
+    for (auto& first_level_heads : free_heads)
+    {
+        std::fill(std::begin(first_level_heads), std::end(first_level_heads), invalid_node);
+    }
+
+    if (capacity > 0)
+    {
+        insert_free(create_node(0, capacity));
+    }
+}
+
+uint32_t tlsf_allocator::create_node(uint64_t offset, uint64_t size)
+{
+    uint32_t node = invalid_node;
+    if (unused_nodes.empty())
+    {
+        node = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+    }
+    else
+    {
+        node = unused_nodes.back();
+        unused_nodes.pop_back();
+        nodes[node] = range_node();
+    }
+    nodes[node].offset = offset;
+    nodes[node].size = size;
+    return node;
+}
+
+void tlsf_allocator::destroy_node(uint32_t node)
+{
+    unused_nodes.push_back(node);
+}
+
+void tlsf_allocator::insert_free(uint32_t node)
+{
+    const tlsf_bucket bucket = tlsf_get_bucket(nodes[node].size);
+    uint32_t& head = free_heads[bucket.first_level][bucket.second_level];
+
+    nodes[node].free = true;
+    nodes[node].previous_free = invalid_node;
+    nodes[node].next_free = head;
+    if (head != invalid_node)
+    {
+        nodes[head].previous_free = node;
+    }
+    head = node;
+
+    first_level_bitmap |= uint64_t(1) << bucket.first_level;
+    second_level_bitmaps[bucket.first_level] |= 1u << bucket.second_level;
+}
+
+void tlsf_allocator::remove_free(uint32_t node)
+{
+    const tlsf_bucket bucket = tlsf_get_bucket(nodes[node].size);
+    range_node& range = nodes[node];
+
+    if (range.previous_free != invalid_node)
+    {
+        nodes[range.previous_free].next_free = range.next_free;
+    }
+    else
+    {
+        free_heads[bucket.first_level][bucket.second_level] = range.next_free;
+    }
+    if (range.next_free != invalid_node)
+    {
+        nodes[range.next_free].previous_free = range.previous_free;
+    }
+    range.free = false;
+
+    if (free_heads[bucket.first_level][bucket.second_level] == invalid_node)
+    {
+        second_level_bitmaps[bucket.first_level] &= ~(1u << bucket.second_level);
+        if (second_level_bitmaps[bucket.first_level] == 0)
+        {
+            first_level_bitmap &= ~(uint64_t(1) << bucket.first_level);
+        }
+    }
+}
+
+uint32_t tlsf_allocator::find_free(uint64_t size) const
+{
+    tlsf_bucket bucket = tlsf_get_search_bucket(size);
+    if (bucket.first_level >= TLSF_FIRST_LEVEL_COUNT)
+    {
+        return invalid_node;
+    }
+
+    uint32_t second_level_map = second_level_bitmaps[bucket.first_level] & (~0u << bucket.second_level);
+    if (second_level_map == 0)
+    {
+        const uint64_t first_level_map = bucket.first_level + 1 < 64 ? first_level_bitmap & (~uint64_t(0) << (bucket.first_level + 1)) : 0;
+        if (first_level_map == 0)
+        {
+            return invalid_node;
+        }
+        bucket.first_level = static_cast<uint32_t>(std::countr_zero(first_level_map));
+        second_level_map = second_level_bitmaps[bucket.first_level];
+    }
+    bucket.second_level = static_cast<uint32_t>(std::countr_zero(second_level_map));
+    return free_heads[bucket.first_level][bucket.second_level];
+}
+
+std::optional<tlsf_allocation> tlsf_allocator::allocate(uint64_t size, uint64_t alignment)
+{
+    if (size == 0 || alignment == 0 || (alignment & (alignment - 1)) != 0)
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << tlsf_allocator::name << ": Invalid allocation of " << size << " bytes aligned to " << alignment;
+        throw std::invalid_argument(oss.str());
+    }
+
+    // Any free range of size + alignment - 1 bytes has room for an aligned start, whatever its offset.
+    uint32_t node = find_free(size + alignment - 1);
+    if (node == invalid_node)
+    {
+        return std::nullopt;
+    }
+    remove_free(node);
+
+    // Padding in front of the aligned start goes back to the free lists as its own range.
+    const uint64_t aligned_offset = (nodes[node].offset + alignment - 1) & ~(alignment - 1);
+    const uint64_t padding = aligned_offset - nodes[node].offset;
+    if (padding > 0)
+    {
+        const uint32_t padding_node = create_node(nodes[node].offset, padding);
+        nodes[padding_node].previous_physical = nodes[node].previous_physical;
+        nodes[padding_node].next_physical = node;
+        if (nodes[node].previous_physical != invalid_node)
+        {
+            nodes[nodes[node].previous_physical].next_physical = padding_node;
+        }
+        nodes[node].previous_physical = padding_node;
+        nodes[node].offset = aligned_offset;
+        nodes[node].size -= padding;
+        insert_free(padding_node);
+    }
+
+    if (nodes[node].size > size)
+    {
+        const uint32_t remainder_node = create_node(aligned_offset + size, nodes[node].size - size);
+        nodes[remainder_node].previous_physical = node;
+        nodes[remainder_node].next_physical = nodes[node].next_physical;
+        if (nodes[node].next_physical != invalid_node)
+        {
+            nodes[nodes[node].next_physical].previous_physical = remainder_node;
+        }
+        nodes[node].next_physical = remainder_node;
+        nodes[node].size = size;
+        insert_free(remainder_node);
+    }
+
+    used_bytes += size;
+    allocation_count++;
+    return tlsf_allocation{aligned_offset, size, node};
+}
+
+void tlsf_allocator::release(const tlsf_allocation& allocation)
+{
+    uint32_t node = allocation.node;
+    if (node >= nodes.size() || nodes[node].free || nodes[node].offset != allocation.offset || nodes[node].size != allocation.size)
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << tlsf_allocator::name << ": Releasing unknown allocation at offset " << allocation.offset;
+        throw std::invalid_argument(oss.str());
+    }
+    used_bytes -= allocation.size;
+    allocation_count--;
+
+    const uint32_t previous = nodes[node].previous_physical;
+    if (previous != invalid_node && nodes[previous].free)
+    {
+        remove_free(previous);
+        nodes[previous].size += nodes[node].size;
+        nodes[previous].next_physical = nodes[node].next_physical;
+        if (nodes[node].next_physical != invalid_node)
+        {
+            nodes[nodes[node].next_physical].previous_physical = previous;
+        }
+        destroy_node(node);
+        node = previous;
+    }
+
+    const uint32_t next = nodes[node].next_physical;
+    if (next != invalid_node && nodes[next].free)
+    {
+        remove_free(next);
+        nodes[node].size += nodes[next].size;
+        nodes[node].next_physical = nodes[next].next_physical;
+        if (nodes[next].next_physical != invalid_node)
+        {
+            nodes[nodes[next].next_physical].previous_physical = node;
+        }
+        destroy_node(next);
+    }
+
+    insert_free(node);
+}
+
+tlsf_statistics tlsf_allocator::get_statistics() const
+{
+    tlsf_statistics statistics;
+    statistics.capacity = capacity;
+    statistics.used_bytes = used_bytes;
+    statistics.allocation_count = allocation_count;
+
+    for (const auto& first_level_heads : free_heads)
+    {
+        for (uint32_t node : first_level_heads)
+        {
+            for (; node != invalid_node; node = nodes[node].next_free)
+            {
+                statistics.free_bytes += nodes[node].size;
+                statistics.largest_free_range = std::max(statistics.largest_free_range, nodes[node].size);
+                statistics.free_range_count++;
+            }
+        }
+    }
+    return statistics;
+}
@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "include/nengine-transform-hierarchy.h"
+#include "include/nengine-job-system.h"
+#include "include/nengine.h"
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+std::string transform_hierarchy::name = "TransformHierarchy";
+
+// out = parent * local, column major like glm: column j of out is the parent's columns weighted by column j of local.
+// x64 builds use the SSE2 path. The AVX path is opt-in, none of the build configs pass -mavx, because the binaries
+// must run on any x64 CPU.
+static inline void transform_multiply(const glm::mat4& parent, const glm::mat4& local, glm::mat4& out)
+{
+    const float* p = &parent[0][0];
+    const float* l = &local[0][0];
+    float* o = &out[0][0];
+#if defined(__AVX__)
+    // two columns of the result per register, each lane half broadcasting its own column's weights.
+    auto load_twice = [](const float* column)
+    {
+        const __m128 value = _mm_loadu_ps(column);
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(value), value, 1);
+    };
+    const __m256 p0 = load_twice(p);
+    const __m256 p1 = load_twice(p + 4);
+    const __m256 p2 = load_twice(p + 8);
+    const __m256 p3 = load_twice(p + 12);
+    for (int column = 0; column < 4; column += 2)
+    {
+        const __m256 weights = _mm256_loadu_ps(l + column * 4);
+        __m256 result = _mm256_mul_ps(p0, _mm256_shuffle_ps(weights, weights, 0x00));
+        result = _mm256_add_ps(result, _mm256_mul_ps(p1, _mm256_shuffle_ps(weights, weights, 0x55)));
+        result = _mm256_add_ps(result, _mm256_mul_ps(p2, _mm256_shuffle_ps(weights, weights, 0xaa)));
+        result = _mm256_add_ps(result, _mm256_mul_ps(p3, _mm256_shuffle_ps(weights, weights, 0xff)));
+        _mm256_storeu_ps(o + column * 4, result);
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128 p0 = _mm_loadu_ps(p);
+    const __m128 p1 = _mm_loadu_ps(p + 4);
+    const __m128 p2 = _mm_loadu_ps(p + 8);
+    const __m128 p3 = _mm_loadu_ps(p + 12);
+    for (int column = 0; column < 4; ++column)
+    {
+        __m128 result = _mm_mul_ps(p0, _mm_set1_ps(l[column * 4]));
+        result = _mm_add_ps(result, _mm_mul_ps(p1, _mm_set1_ps(l[column * 4 + 1])));
+        result = _mm_add_ps(result, _mm_mul_ps(p2, _mm_set1_ps(l[column * 4 + 2])));
+        result = _mm_add_ps(result, _mm_mul_ps(p3, _mm_set1_ps(l[column * 4 + 3])));
+        _mm_storeu_ps(o + column * 4, result);
+    }
+#else
+    UNUSED(p);
+    UNUSED(l);
+    UNUSED(o);
+    out = parent * local;
+#endif
+}
+
+transform_id transform_hierarchy::create(transform_id parent, const glm::mat4& local)
+{
+    // appended after every existing transform, so after its parent too.
+    const uint32_t parent_position = parent != TRANSFORM_NONE ? get_position(parent) : UINT32_MAX;
+
+    transform_id id;
+    if (!free_ids.empty())
+    {
+        id = free_ids.back();
+        free_ids.pop_back();
+    }
+    else
+    {
+        id = static_cast<transform_id>(positions.size());
+        positions.push_back(UINT32_MAX);
+    }
+
+    positions[id] = static_cast<uint32_t>(ids.size());
+    local_matrices.push_back(local);
+    world_matrices.push_back(glm::mat4(1.0f));
+    parents.push_back(parent_position);
+    dirty.push_back(1);
+    changed.push_back(0);
+    ids.push_back(id);
+    sorted = false;
+    return id;
+}
+
+void transform_hierarchy::destroy(transform_id id)
+{
+    const uint32_t position = get_position(id);
+
+    // children come after their parent, one pass finds the whole subtree.
+    ids[position] = TRANSFORM_NONE;
+    positions[id] = UINT32_MAX;
+    free_ids.push_back(id);
+    ++removed_count;
+    for (uint32_t i = position + 1; i < ids.size(); ++i)
+    {
+        if (ids[i] != TRANSFORM_NONE && parents[i] != UINT32_MAX && ids[parents[i]] == TRANSFORM_NONE)
+        {
+            positions[ids[i]] = UINT32_MAX;
+            free_ids.push_back(ids[i]);
+            ids[i] = TRANSFORM_NONE;
+            ++removed_count;
+        }
+    }
+    sorted = false;
+}
+
+bool transform_hierarchy::is_alive(transform_id id) const
+{
+    return id < positions.size() && positions[id] != UINT32_MAX;
+}
+
+void transform_hierarchy::set_local(transform_id id, const glm::mat4& local)
+{
+    const uint32_t position = get_position(id);
+    local_matrices[position] = local;
+    dirty[position] = 1;
+}
+
+const glm::mat4& transform_hierarchy::get_local(transform_id id) const
+{
+    return local_matrices[get_position(id)];
+}
+
+const glm::mat4& transform_hierarchy::get_world(transform_id id) const
+{
+    return world_matrices[get_position(id)];
+}
+
+transform_id transform_hierarchy::get_parent(transform_id id) const
+{
+    const uint32_t parent = parents[get_position(id)];
+    return parent != UINT32_MAX ? ids[parent] : TRANSFORM_NONE;
+}
+
+void transform_hierarchy::update()
+{
+    sort_by_depth();
+    updated_count.store(update_range(0, static_cast<uint32_t>(ids.size())), std::memory_order_relaxed);
+}
+
+void transform_hierarchy::update(job_system& jobs)
+{
+    sort_by_depth();
+    updated_count.store(0, std::memory_order_relaxed);
+
+    // a level only reads the levels above it, the chunks of one level never depend on each other.
+    for (size_t level = 0; level + 1 < level_starts.size(); ++level)
+    {
+        const uint32_t level_begin = level_starts[level];
+        const uint32_t level_end = level_starts[level + 1];
+        if (level_end - level_begin < 2 * TRANSFORM_PARALLEL_CHUNK_SIZE)
+        {
+            updated_count.fetch_add(update_range(level_begin, level_end), std::memory_order_relaxed);
+            continue;
+        }
+
+        const uint32_t chunk_count = (level_end - level_begin + TRANSFORM_PARALLEL_CHUNK_SIZE - 1) / TRANSFORM_PARALLEL_CHUNK_SIZE;
+        jobs.parallel_for(chunk_count, 1, [&](uint32_t chunk)
+        {
+            const uint32_t chunk_begin = level_begin + chunk * TRANSFORM_PARALLEL_CHUNK_SIZE;
+            const uint32_t chunk_end = std::min(chunk_begin + TRANSFORM_PARALLEL_CHUNK_SIZE, level_end);
+            updated_count.fetch_add(update_range(chunk_begin, chunk_end), std::memory_order_relaxed);
+        });
+    }
+}
+
+// Counting sort by depth, stable so transforms keep their relative order within a level, dropping destroyed ones.
+void transform_hierarchy::sort_by_depth()
+{
+    if (sorted)
+    {
+        return;
+    }
+
+    const uint32_t count = static_cast<uint32_t>(ids.size());
+    std::vector<uint32_t> depths(count, 0);
+    std::vector<uint32_t> level_counts;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (ids[i] == TRANSFORM_NONE)
+        {
+            continue;
+        }
+        depths[i] = parents[i] != UINT32_MAX ? depths[parents[i]] + 1 : 0;
+        if (depths[i] >= level_counts.size())
+        {
+            level_counts.resize(depths[i] + 1, 0);
+        }
+        ++level_counts[depths[i]];
+    }
+
+    level_starts.assign(level_counts.size() + 1, 0);
+    for (size_t level = 0; level < level_counts.size(); ++level)
+    {
+        level_starts[level + 1] = level_starts[level] + level_counts[level];
+    }
+
+    std::vector<uint32_t> new_positions(count, UINT32_MAX);
+    std::vector<uint32_t> next_positions(level_starts.begin(), level_starts.end() - 1);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (ids[i] != TRANSFORM_NONE)
+        {
+            new_positions[i] = next_positions[depths[i]]++;
+        }
+    }
+
+    const uint32_t sorted_count = level_starts.back();
+    std::vector<glm::mat4> sorted_local_matrices(sorted_count);
+    std::vector<glm::mat4> sorted_world_matrices(sorted_count);
+    std::vector<uint32_t> sorted_parents(sorted_count);
+    std::vector<uint8_t> sorted_dirty(sorted_count);
+    std::vector<transform_id> sorted_ids(sorted_count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const uint32_t position = new_positions[i];
+        if (position == UINT32_MAX)
+        {
+            continue;
+        }
+        sorted_local_matrices[position] = local_matrices[i];
+        sorted_world_matrices[position] = world_matrices[i];
+        sorted_parents[position] = parents[i] != UINT32_MAX ? new_positions[parents[i]] : UINT32_MAX;
+        sorted_dirty[position] = dirty[i];
+        sorted_ids[position] = ids[i];
+        positions[ids[i]] = position;
+    }
+
+    local_matrices = std::move(sorted_local_matrices);
+    world_matrices = std::move(sorted_world_matrices);
+    parents = std::move(sorted_parents);
+    dirty = std::move(sorted_dirty);
+    ids = std::move(sorted_ids);
+    changed.assign(sorted_count, 0);
+    removed_count = 0;
+    sorted = true;
+}
+
+// Parents of the range are before it and already updated. Returns how many world matrices were recomputed.
+uint32_t transform_hierarchy::update_range(uint32_t begin, uint32_t end)
+{
+    uint32_t updated = 0;
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        const uint32_t parent = parents[i];
+        const bool recompute = dirty[i] != 0 || (parent != UINT32_MAX && changed[parent] != 0);
+        changed[i] = recompute ? 1 : 0;
+        dirty[i] = 0;
+        if (!recompute)
+        {
+            continue;
+        }
+
+        if (parent != UINT32_MAX)
+        {
+            transform_multiply(world_matrices[parent], local_matrices[i], world_matrices[i]);
+        }
+        else
+        {
+            world_matrices[i] = local_matrices[i];
+        }
+        ++updated;
+    }
+    return updated;
+}
+
+uint32_t transform_hierarchy::get_position(transform_id id) const
+{
+    if (!is_alive(id))
+    {
+        std::ostringstream oss;
+        oss << nengine::name << " - " << transform_hierarchy::name << ": Transform " << id << " does not exist.";
+        throw std::invalid_argument(oss.str());
+    }
+    return positions[id];
+}
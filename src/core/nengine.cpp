@@ -2,6 +2,8 @@
 #include "../utils/helpers.h"
 
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <memory>
 
@@ -10,20 +12,147 @@ std::string nengine::name = "NeNgine";
 
 nengine::nengine(){}
 
-nengine::nengine(nengine_config in_config) : config(in_config) {}
+nengine::nengine(nengine_config in_config) : config(in_config)
+{
+    nengine_apply_latency_mode(config);
+}
+
+void nengine_apply_latency_mode(nengine_config& config)
+{
+    switch (config.latency_mode)
+    {
+        case NENGINE_LATENCY_MODE_CUSTOM:
+            break;
+        case NENGINE_LATENCY_MODE_LOW_LATENCY:
+            config.frames_in_flight = 1;
+            config.swap_chain_image_count = 0;
+            config.present_mode = NENGINE_PRESENT_MODE_MAILBOX;
+            config.frame_wait = NENGINE_FRAME_WAIT_GPU_IDLE;
+            break;
+        case NENGINE_LATENCY_MODE_MAX_THROUGHPUT:
+            config.frames_in_flight = 3;
+            config.swap_chain_image_count = 4;
+            config.present_mode = NENGINE_PRESENT_MODE_IMMEDIATE;
+            config.frame_wait = NENGINE_FRAME_WAIT_PIPELINED;
+            break;
+    }
+}
+
+nengine::~nengine()
+{
+    shutdown();
+}
 
 void nengine::initialize()
 {
     std::cout << "NeNgine - Main()" << std::endl;
+    jobs->start(config.job_worker_count);
+    frame_memory = std::make_unique<frame_allocator>(config.frames_in_flight, config.frame_allocator_bytes);
+
+    if (config.threaded_simulation)
+    {
+        simulation_thread_running.store(true);
+        simulation_thread = std::thread(&nengine::simulation_thread_main, this);
+    }
+
     status = nengine_status::RUNNING;
 }
 
+void nengine::set_simulation_callback(std::function<void(double)> in_simulation_callback)
+{
+    simulation_callback = std::move(in_simulation_callback);
+}
+
+nengine_frame_timing nengine::update(double current_time)
+{
+    PROFILE_ZONE("Engine update");
+    const double frame_time = last_update_time < 0.0 ? 0.0 : std::max(0.0, current_time - last_update_time);
+    last_update_time = current_time;
+
+    jobs->pump_main_thread_jobs();
+
+    if (!simulation_thread_running.load())
+    {
+        return advance_simulation(frame_time);
+    }
+
+    // Collect the ticks the simulation thread ran for the previous frame, then immediately hand it this frame's
+    // time so it simulates while the caller renders.
+    nengine_frame_timing timing;
+    if (simulation_in_flight)
+    {
+        simulation_done.acquire();
+        timing = completed_frame_timing;
+    }
+    pending_frame_time = frame_time;
+    simulation_in_flight = true;
+    simulation_start.release();
+    return timing;
+}
+
+nengine_frame_timing nengine::advance_simulation(double frame_time)
+{
+    const double fixed_timestep = get_fixed_timestep();
+    simulation_accumulator += frame_time;
+
+    nengine_frame_timing timing;
+    while (simulation_accumulator >= fixed_timestep && timing.ticks_this_frame < config.max_simulation_ticks_per_frame)
+    {
+        tick();
+        simulation_accumulator -= fixed_timestep;
+        timing.ticks_this_frame++;
+    }
+
+    // Out of catch-up budget: drop the backlog, the simulation runs slower than real time rather than stalling frames.
+    if (simulation_accumulator >= fixed_timestep)
+    {
+        simulation_accumulator = std::fmod(simulation_accumulator, fixed_timestep);
+    }
+
+    timing.simulation_tick = simulation_tick_count;
+    timing.interpolation_alpha = simulation_accumulator / fixed_timestep;
+    return timing;
+}
+
+void nengine::simulation_thread_main()
+{
+    profiler::get().set_thread_name("Simulation");
+    while (true)
+    {
+        simulation_start.acquire();
+        if (!simulation_thread_running.load())
+        {
+            break;
+        }
+        completed_frame_timing = advance_simulation(pending_frame_time);
+        simulation_done.release();
+    }
+}
+
 void nengine::tick()
 {
-    std::cout << "NeNgine - Main()" << std::endl;
+    PROFILE_ZONE("Simulation tick");
+    if (simulation_callback)
+    {
+        simulation_callback(get_fixed_timestep());
+    }
+    simulation_tick_count++;
 }
 
 void nengine::shutdown()
 {
+    if (simulation_thread.joinable())
+    {
+        if (simulation_in_flight)
+        {
+            simulation_done.acquire();
+            simulation_in_flight = false;
+        }
+        simulation_thread_running.store(false);
+        simulation_start.release();
+        simulation_thread.join();
+    }
+
+    jobs->stop();
     status = nengine_status::STOPPED;
 }
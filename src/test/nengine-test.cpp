@@ -1,8 +1,59 @@
 #include "src/core/include/nengine.h"
+#include "src/core/include/nengine-async-io.h"
+#include "src/core/include/nengine-bvh.h"
+#include "src/core/include/nengine-descriptor-slots.h"
+#include "src/core/include/nengine-ecs.h"
+#include "src/core/include/nengine-file-watcher.h"
+#include "src/core/include/nengine-frame-allocator.h"
+#include "src/core/include/nengine-frame-fences.h"
+#include "src/core/include/nengine-frustum.h"
+#include "src/core/include/nengine-image-file.h"
+#include "src/core/include/nengine-job-system.h"
+#include "src/core/include/nengine-mesh-file.h"
+#include "src/core/include/nengine-pak-file.h"
+#include "src/core/include/nengine-pipeline-cache.h"
+#include "src/core/include/nengine-profiler.h"
+#include "src/core/include/nengine-render-graph.h"
+#include "src/core/include/nengine-render-queue.h"
+#include "src/core/include/nengine-shader-cache.h"
+#include "src/core/include/nengine-shader-compiler.h"
+#include "src/core/include/nengine-staging-ring.h"
+#include "src/core/include/nengine-tlsf-allocator.h"
+#include "src/core/include/nengine-transform-hierarchy.h"
 
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <sstream>
+#include <thread>
+
+// An empty directory under the system temp directory, removed again when the test leaves its scope.
+struct test_temp_directory
+{
+    test_temp_directory(const std::string& test_name) : path(std::filesystem::temp_directory_path() / ("nengine-test-" + test_name))
+    {
+        std::filesystem::remove_all(path);
+        std::filesystem::create_directories(path);
+    }
+    ~test_temp_directory()
+    {
+        std::error_code error;
+        std::filesystem::remove_all(path, error);
+    }
+
+    test_temp_directory(const test_temp_directory&) = delete;
+    test_temp_directory& operator=(const test_temp_directory&) = delete;
+
+    const std::filesystem::path path;
+};
 
 TEST(nengine_test, nengine_default_initialization)
 {
@@ -10,6 +61,1483 @@ TEST(nengine_test, nengine_default_initialization)
     ASSERT_TRUE(true);
 }
 
+TEST(nengine_test, shader_cache_round_trip)
+{
+    // the cache creates its directory.
+    const test_temp_directory temp_directory("shader-cache");
+    const std::filesystem::path cache_directory = temp_directory.path / "cache";
+    shader_cache cache(cache_directory);
+
+    shader_cache_key key;
+    key.source_hash = 0x1234;
+    key.entry_point = "main";
+    key.compile_options = "default";
+    const spirv_module module = {0x07230203, 1, 2, 3};
+
+    ASSERT_FALSE(cache.load(key).has_value());
+    ASSERT_TRUE(cache.store(key, module));
+
+    std::optional<spirv_module> loaded = cache.load(key);
+    ASSERT_TRUE(loaded.has_value());
+    ASSERT_EQ(*loaded, module);
+
+    // Any change to the key must miss.
+    shader_cache_key other_entry_point = key;
+    other_entry_point.entry_point = "other";
+    ASSERT_FALSE(cache.load(other_entry_point).has_value());
+    shader_cache_key other_compiler = key;
+    other_compiler.compiler_build = "shaderc v0";
+    ASSERT_FALSE(cache.load(other_compiler).has_value());
+
+    // Truncated entries are rejected rather than returned.
+    std::filesystem::resize_file(cache.get_entry_path(key), std::filesystem::file_size(cache.get_entry_path(key)) - 4);
+    ASSERT_FALSE(cache.load(key).has_value());
+    ASSERT_EQ(cache.get_hit_count(), 1u);
+
+    // So are entries claiming more words than the file holds, without allocating for them.
+    ASSERT_TRUE(cache.store(key, module));
+    {
+        std::fstream entry(cache.get_entry_path(key), std::ios::binary | std::ios::in | std::ios::out);
+        const uint64_t word_count = UINT64_MAX / 2;
+        entry.seekp(16);
+        entry.write(reinterpret_cast<const char*>(&word_count), sizeof(word_count));
+    }
+    ASSERT_FALSE(cache.load(key).has_value());
+    ASSERT_EQ(cache.get_hit_count(), 1u);
+}
+
+TEST(nengine_test, shader_compile_batch_reports_per_shader_errors)
+{
+    shader_compiler::set_cache(nullptr);
+
+    std::vector<shader_compile_config> configs(8);
+    for (size_t i = 0; i < configs.size(); ++i)
+    {
+        configs[i].shader_kind = shaderc_glsl_vertex_shader;
+        configs[i].shader_code = "#version 450\nvoid main() { gl_Position = vec4(" + std::to_string(i) + ".0); }\n";
+    }
+    configs[3].shader_code = "#version 450\n#error broken permutation\n";
+
+    std::vector<shader_compile_result> results = shader_compiler::compile_batch(configs, 4);
+    ASSERT_EQ(results.size(), configs.size());
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        ASSERT_EQ(results[i].succeeded(), i != 3);
+        ASSERT_EQ(results[i].module.empty(), i == 3);
+    }
+}
+
+TEST(nengine_test, job_system_parallel_for_visits_every_index_once)
+{
+    job_system jobs;
+    jobs.start(4);
+
+    std::vector<std::atomic<uint32_t>> visits(100000);
+    jobs.parallel_for(static_cast<uint32_t>(visits.size()), 64, [&](uint32_t index)
+    {
+        visits[index].fetch_add(1, std::memory_order_relaxed);
+    });
+
+    for (const auto& visit : visits)
+    {
+        ASSERT_EQ(visit.load(), 1u);
+    }
+    jobs.stop();
+}
+
+TEST(nengine_test, job_system_dependencies_and_main_thread_lane)
+{
+    job_system jobs;
+    jobs.start(3);
+
+    struct dependency_test_state
+    {
+        std::atomic<uint32_t> first_stage_done = 0;
+        std::atomic<uint32_t> second_stage_saw = 0;
+        std::thread::id main_thread_job_thread;
+        job_system* system;
+    } state;
+    state.system = &jobs;
+
+    job_counter first_stage;
+    job_counter second_stage;
+    for (int i = 0; i < 64; ++i)
+    {
+        jobs.run([](void* data) { static_cast<dependency_test_state*>(data)->first_stage_done.fetch_add(1); }, &state, &first_stage);
+    }
+    jobs.run_after(first_stage, [](void* data)
+    {
+        auto* test_state = static_cast<dependency_test_state*>(data);
+        test_state->second_stage_saw.store(test_state->first_stage_done.load());
+    }, &state, &second_stage);
+    jobs.run_on_main_thread([](void* data)
+    {
+        static_cast<dependency_test_state*>(data)->main_thread_job_thread = std::this_thread::get_id();
+    }, &state, &second_stage);
+
+    jobs.wait(second_stage);
+    ASSERT_EQ(state.second_stage_saw.load(), 64u);
+    ASSERT_EQ(state.main_thread_job_thread, std::this_thread::get_id());
+
+    // a second system started on this thread does not take the main thread lane of the first.
+    {
+        job_system other_jobs;
+        other_jobs.start(1);
+        EXPECT_TRUE(other_jobs.is_main_thread());
+        EXPECT_TRUE(jobs.is_main_thread());
+        job_counter main_thread_job;
+        std::atomic<uint32_t> main_thread_runs = 0;
+        jobs.run_on_main_thread([](void* data) { static_cast<std::atomic<uint32_t>*>(data)->fetch_add(1); }, &main_thread_runs, &main_thread_job);
+        jobs.wait(main_thread_job);
+        EXPECT_EQ(main_thread_runs.load(), 1u);
+        other_jobs.stop();
+        EXPECT_FALSE(other_jobs.is_main_thread());
+        EXPECT_TRUE(jobs.is_main_thread());
+    }
+
+    // chains that keep queuing their next link while stop() runs are run to the end, none is dropped.
+    struct chain_link
+    {
+        job_system* system;
+        job_counter* counter;
+        std::atomic<uint32_t>* link_count;
+        uint32_t remaining;
+
+        static void run(void* data)
+        {
+            chain_link& link = *static_cast<chain_link*>(data);
+            link.link_count->fetch_add(1);
+            if (link.remaining-- > 0)
+            {
+                link.system->run(&chain_link::run, data, link.counter);
+            }
+        }
+    };
+    job_counter chains;
+    std::atomic<uint32_t> link_count = 0;
+    std::vector<chain_link> links(8, chain_link{&jobs, &chains, &link_count, 200});
+    for (chain_link& link : links)
+    {
+        jobs.run(&chain_link::run, &link, &chains);
+    }
+    jobs.stop();
+    EXPECT_TRUE(chains.is_done());
+    EXPECT_EQ(link_count.load(), 8u * 201u);
+}
+
+struct ecs_test_position { float x, y, z; };
+struct ecs_test_velocity { float x, y, z; };
+
+TEST(nengine_test, ecs_entities_move_between_archetypes)
+{
+    ecs_world world;
+    std::vector<entity> entities;
+    for (uint32_t i = 0; i < 10000; ++i)
+    {
+        entity new_entity = world.create();
+        world.add(new_entity, ecs_test_position{static_cast<float>(i), 0.0f, 0.0f});
+        if (i % 2 == 0)
+        {
+            world.add(new_entity, ecs_test_velocity{1.0f, 0.0f, 0.0f});
+        }
+        entities.push_back(new_entity);
+    }
+
+    // destroying from the middle of chunks must keep every survivor reachable through its handle.
+    for (uint32_t i = 0; i < entities.size(); i += 3)
+    {
+        world.destroy(entities[i]);
+    }
+    ASSERT_FALSE(world.is_alive(entities[0]));
+    ASSERT_EQ(world.get<ecs_test_position>(entities[0]), nullptr);
+
+    entity recycled = world.create();
+    ASSERT_EQ(recycled.index, entities[entities.size() - 1 - ((entities.size() - 1) % 3)].index);
+    ASSERT_NE(recycled.generation, 0u);
+    world.destroy(recycled);
+
+    size_t moving = 0;
+    world.each<ecs_test_position, ecs_test_velocity>([&](entity, ecs_test_position& position, const ecs_test_velocity& velocity)
+    {
+        position.x += velocity.x;
+        ++moving;
+    });
+
+    size_t expected_moving = 0;
+    for (uint32_t i = 0; i < entities.size(); ++i)
+    {
+        if (i % 3 == 0)
+        {
+            continue;
+        }
+        const bool has_velocity = i % 2 == 0;
+        expected_moving += has_velocity ? 1 : 0;
+        ASSERT_EQ(world.has<ecs_test_velocity>(entities[i]), has_velocity);
+        ASSERT_EQ(world.get<ecs_test_position>(entities[i])->x, static_cast<float>(i) + (has_velocity ? 1.0f : 0.0f));
+    }
+    ASSERT_EQ(moving, expected_moving);
+
+    world.remove<ecs_test_velocity>(entities[2]);
+    ASSERT_FALSE(world.has<ecs_test_velocity>(entities[2]));
+    ASSERT_EQ(world.get<ecs_test_position>(entities[2])->x, 3.0f);
+}
+
+TEST(nengine_test, ecs_parallel_each_visits_every_chunk)
+{
+    job_system jobs;
+    jobs.start(4);
+
+    ecs_world world;
+    for (uint32_t i = 0; i < 50000; ++i)
+    {
+        entity new_entity = world.create();
+        world.add(new_entity, ecs_test_position{0.0f, 0.0f, 0.0f});
+        world.add(new_entity, ecs_test_velocity{1.0f, 2.0f, 3.0f});
+    }
+
+    world.parallel_each<ecs_test_position, const ecs_test_velocity>(jobs, [](entity, ecs_test_position& position, const ecs_test_velocity& velocity)
+    {
+        position.x += velocity.x;
+        position.y += velocity.y;
+        position.z += velocity.z;
+    });
+
+    size_t visited = 0;
+    world.each<ecs_test_position>([&](entity, const ecs_test_position& position)
+    {
+        visited += (position.x == 1.0f && position.y == 2.0f && position.z == 3.0f) ? 1 : 0;
+    });
+    ASSERT_EQ(visited, 50000u);
+    jobs.stop();
+}
+
+TEST(nengine_test, frame_allocator_recycles_slots_and_tracks_overflow)
+{
+    frame_allocator frame_memory(2, 1024 * 1024, 4096);
+    frame_memory.begin_frame(0);
+
+    frame_vector<uint32_t> draw_list{frame_stl_allocator<uint32_t>(frame_memory)};
+    for (uint32_t i = 0; i < 1000; ++i)
+    {
+        draw_list.push_back(i);
+    }
+    frame_ostringstream label(std::ios_base::out, frame_stl_allocator<char>(frame_memory));
+    label << "frame " << 0;
+    ASSERT_EQ(label.str(), "frame 0");
+
+    void* first_allocation = frame_memory.allocate(64, 64);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(first_allocation) % 64, 0u);
+    ASSERT_GT(frame_memory.get_used_bytes(), 0u);
+    ASSERT_EQ(frame_memory.get_overflow_bytes(), 0u);
+
+    // a slot reused after its frame retired hands out the same memory again.
+    frame_memory.begin_frame(1);
+    frame_memory.begin_frame(2);
+    ASSERT_EQ(frame_memory.get_current_frame(), 0u);
+    ASSERT_EQ(frame_memory.get_used_bytes(), 0u);
+
+    frame_memory.allocate(2 * 1024 * 1024);
+    ASSERT_GT(frame_memory.get_overflow_bytes(), 0u);
+
+    // a thread alternating between two allocators keeps a block in each.
+    frame_allocator other_memory(1, 1024 * 1024, 4096);
+    other_memory.begin_frame(0);
+    frame_memory.begin_frame(1);
+    std::byte* first = static_cast<std::byte*>(frame_memory.allocate(16, 16));
+    other_memory.allocate(16, 16);
+    std::byte* second = static_cast<std::byte*>(frame_memory.allocate(16, 16));
+    EXPECT_EQ(second, first + 16);
+    EXPECT_EQ(frame_memory.get_used_bytes(), 4096u);
+    EXPECT_EQ(other_memory.get_used_bytes(), 4096u);
+}
+
+TEST(nengine_test, nengine_fixed_timestep_accumulates_and_clamps)
+{
+    nengine_config config;
+    config.job_worker_count = 1;
+    config.simulation_tick_rate = 4.0;
+    config.max_simulation_ticks_per_frame = 3;
+    nengine engine(config);
+
+    uint64_t simulated_ticks = 0;
+    engine.set_simulation_callback([&](double tick_seconds)
+    {
+        EXPECT_DOUBLE_EQ(tick_seconds, 0.25);
+        simulated_ticks++;
+    });
+    engine.initialize();
+
+    nengine_frame_timing timing = engine.update(1.0);
+    EXPECT_EQ(timing.ticks_this_frame, 0u);
+
+    timing = engine.update(1.6);
+    EXPECT_EQ(timing.ticks_this_frame, 2u);
+    EXPECT_EQ(timing.simulation_tick, 2u);
+    EXPECT_NEAR(timing.interpolation_alpha, 0.4, 1e-9);
+
+    // a long stall only runs the catch-up budget and drops the rest.
+    timing = engine.update(11.6);
+    EXPECT_EQ(timing.ticks_this_frame, 3u);
+    EXPECT_EQ(timing.simulation_tick, 5u);
+    EXPECT_LT(timing.interpolation_alpha, 1.0);
+    EXPECT_EQ(simulated_ticks, 5u);
+
+    engine.shutdown();
+}
+
+TEST(nengine_test, nengine_threaded_simulation_runs_one_frame_behind)
+{
+    nengine_config config;
+    config.job_worker_count = 1;
+    config.simulation_tick_rate = 4.0;
+    config.threaded_simulation = true;
+    nengine engine(config);
+
+    std::atomic<uint64_t> simulated_ticks = 0;
+    engine.set_simulation_callback([&](double) { simulated_ticks++; });
+    engine.initialize();
+
+    engine.update(0.0);
+    EXPECT_EQ(engine.update(0.5).ticks_this_frame, 0u);
+    EXPECT_EQ(engine.update(1.0).ticks_this_frame, 2u);
+
+    engine.shutdown();
+    EXPECT_EQ(simulated_ticks.load(), 4u);
+}
+
+TEST(nengine_test, image_file_writes_headless_frames_as_ppm)
+{
+    const test_temp_directory temp_directory("image-file");
+    const std::filesystem::path path = temp_directory.path / "frame.ppm";
+
+    // two rows of two pixels, as out_texture holds them. Alpha is dropped.
+    const std::vector<uint8_t> rgba = { 255, 0, 0, 255,     0, 255, 0, 128,
+                                        0, 0, 255, 0,       10, 20, 30, 40};
+    ASSERT_TRUE(image_file::write_ppm(path, rgba.data(), 2, 2));
+
+    std::ifstream file_in(path, std::ios::binary);
+    const std::string contents((std::istreambuf_iterator<char>(file_in)), std::istreambuf_iterator<char>());
+    const std::string expected_header = "P6\n2 2\n255\n";
+    ASSERT_EQ(contents.size(), expected_header.size() + 12);
+    EXPECT_EQ(contents.substr(0, expected_header.size()), expected_header);
+    const std::vector<uint8_t> rgb(contents.begin() + static_cast<std::ptrdiff_t>(expected_header.size()), contents.end());
+    EXPECT_EQ(rgb, (std::vector<uint8_t>{255, 0, 0, 0, 255, 0, 0, 0, 255, 10, 20, 30}));
+
+    EXPECT_FALSE(image_file::write_ppm(temp_directory.path / "missing" / "frame.ppm", rgba.data(), 2, 2));
+}
+
+TEST(nengine_test, profiler_frame_percentiles_and_chrome_trace)
+{
+    profiler& instance = profiler::get();
+    instance.clear();
+
+    // frames of 1ms, 2ms ... 100ms, in shuffled order.
+    uint64_t time_ns = 1000;
+    instance.end_frame(time_ns);
+    for (uint64_t i = 0; i < 100; ++i)
+    {
+        time_ns += ((i * 37) % 100 + 1) * 1000000;
+        instance.end_frame(time_ns);
+    }
+
+    profiler_frame_statistics statistics = instance.get_frame_statistics();
+    EXPECT_EQ(statistics.frame_count, 100u);
+    EXPECT_DOUBLE_EQ(statistics.minimum_ms, 1.0);
+    EXPECT_DOUBLE_EQ(statistics.maximum_ms, 100.0);
+    EXPECT_DOUBLE_EQ(statistics.average_ms, 50.5);
+    EXPECT_DOUBLE_EQ(statistics.p50_ms, 50.0);
+    EXPECT_DOUBLE_EQ(statistics.p95_ms, 95.0);
+    EXPECT_DOUBLE_EQ(statistics.p99_ms, 99.0);
+
+    {
+        profiler_zone zone("Quoted \"zone\"");
+    }
+    instance.record_gpu_zone("Render pass", 2000, 3500);
+
+    std::ostringstream trace;
+    instance.write_chrome_trace(trace);
+    const std::string json = trace.str();
+    EXPECT_NE(json.find("\"traceEvents\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"Quoted \\\"zone\\\"\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"Render pass\",\"ph\":\"X\",\"pid\":2"), std::string::npos);
+    EXPECT_NE(json.find("\"ts\":2.000,\"dur\":1.500"), std::string::npos);
+
+    // latencies of 10ms and 30ms, a present timestamped before its input counts as no latency at all.
+    instance.record_latency(5000000, 15000000);
+    instance.record_latency(5000000, 35000000);
+    instance.record_latency(9000, 8000);
+    statistics = instance.get_latency_statistics();
+    EXPECT_EQ(statistics.frame_count, 3u);
+    EXPECT_DOUBLE_EQ(statistics.minimum_ms, 0.0);
+    EXPECT_DOUBLE_EQ(statistics.p50_ms, 10.0);
+    EXPECT_DOUBLE_EQ(statistics.maximum_ms, 30.0);
+
+    // a thread's timeline is freed when the thread exits, the running threads keep theirs.
+    std::thread([&instance]()
+    {
+        instance.set_thread_name("Finished thread");
+        profiler_zone zone("Finished zone");
+    }).join();
+    instance.set_thread_name("Test thread");
+    trace.str({});
+    instance.write_chrome_trace(trace);
+    EXPECT_EQ(trace.str().find("Finished"), std::string::npos);
+    EXPECT_NE(trace.str().find("\"Test thread\""), std::string::npos);
+
+    instance.clear();
+    EXPECT_EQ(instance.get_frame_statistics().frame_count, 0u);
+    EXPECT_EQ(instance.get_latency_statistics().frame_count, 0u);
+}
+
+TEST(nengine_test, frame_fences_complete_frames_in_submission_order)
+{
+    frame_fence_tracker fences(2);
+    EXPECT_FALSE(fences.is_complete(0));
+    // waiting on a fence nothing was submitted with completes nothing.
+    fences.fence_signaled(1);
+    EXPECT_EQ(fences.get_completed_frame_count(), 0u);
+
+    fences.submitted(0);
+    fences.submitted(1);
+    fences.submitted(2);
+    EXPECT_THROW(fences.submitted(0), std::invalid_argument);
+    EXPECT_THROW(fences.fence_signaled(2), std::invalid_argument);
+
+    // frame 1 signaling means frame 0 is done too, a swap chain replaced before frame 2 can go once frame 2 is.
+    fences.fence_signaled(1);
+    EXPECT_EQ(fences.get_completed_frame_count(), 2u);
+    EXPECT_TRUE(fences.is_complete(0));
+    EXPECT_FALSE(fences.is_complete(2));
+    fences.fence_signaled(0);
+    EXPECT_TRUE(fences.is_complete(2));
+
+    // a slot waited on again after its older frame completed never moves the count back.
+    fences.submitted(3);
+    fences.fence_signaled(0);
+    EXPECT_EQ(fences.get_completed_frame_count(), 3u);
+    fences.fence_signaled(1);
+    EXPECT_EQ(fences.get_completed_frame_count(), 4u);
+}
+
+TEST(nengine_test, pipeline_cache_file_round_trip_and_rejects_other_driver)
+{
+    // saving creates the missing cache directory.
+    const test_temp_directory temp_directory("pipeline-cache");
+    const std::filesystem::path path = temp_directory.path / "cache" / "pipeline-cache.bin";
+
+    pipeline_cache_device_identity identity;
+    identity.vendor_id = 0x10de;
+    identity.device_id = 0x2684;
+    identity.driver_version = 42;
+    identity.pipeline_cache_uuid[0] = 7;
+
+    pipeline_cache_file cache_file(path);
+    EXPECT_FALSE(cache_file.load(identity).has_value());
+
+    const std::vector<uint8_t> data = {1, 2, 3, 4, 5, 6, 7, 8};
+    ASSERT_TRUE(cache_file.save(identity, data));
+    std::optional<std::vector<uint8_t>> loaded = cache_file.load(identity);
+    ASSERT_TRUE(loaded.has_value());
+    EXPECT_EQ(*loaded, data);
+
+    pipeline_cache_device_identity updated_driver = identity;
+    updated_driver.driver_version = 43;
+    EXPECT_FALSE(cache_file.load(updated_driver).has_value());
+
+    // a flipped byte in the blob fails the checksum.
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(-1, std::ios::end);
+        file.put(static_cast<char>(0xff));
+    }
+    EXPECT_FALSE(cache_file.load(identity).has_value());
+
+    // so does a blob size the file can not hold, before anything is allocated for it.
+    ASSERT_TRUE(cache_file.save(identity, data));
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        const uint64_t data_size = UINT64_MAX / 2;
+        file.seekp(40);
+        file.write(reinterpret_cast<const char*>(&data_size), sizeof(data_size));
+    }
+    EXPECT_FALSE(cache_file.load(identity).has_value());
+}
+
+TEST(nengine_test, tlsf_allocator_aligns_and_merges_free_ranges)
+{
+    tlsf_allocator allocator(1024 * 1024);
+
+    std::optional<tlsf_allocation> a = allocator.allocate(100);
+    std::optional<tlsf_allocation> b = allocator.allocate(1000, 256);
+    std::optional<tlsf_allocation> c = allocator.allocate(64 * 1024, 4096);
+    ASSERT_TRUE(a.has_value() && b.has_value() && c.has_value());
+    EXPECT_EQ(b->offset % 256, 0u);
+    EXPECT_EQ(c->offset % 4096, 0u);
+    EXPECT_GE(b->offset, a->offset + a->size);
+    EXPECT_GE(c->offset, b->offset + b->size);
+    EXPECT_EQ(allocator.get_used_bytes(), 100u + 1000u + 64u * 1024u);
+    EXPECT_FALSE(allocator.allocate(1024 * 1024).has_value());
+
+    // releasing the middle range leaves a hole, releasing its neighbours merges everything back into one range.
+    allocator.release(*b);
+    EXPECT_GT(allocator.get_statistics().get_fragmentation(), 0.0);
+    allocator.release(*a);
+    allocator.release(*c);
+
+    tlsf_statistics statistics = allocator.get_statistics();
+    EXPECT_TRUE(allocator.is_empty());
+    EXPECT_EQ(statistics.free_range_count, 1u);
+    EXPECT_EQ(statistics.largest_free_range, 1024u * 1024u);
+    EXPECT_DOUBLE_EQ(statistics.get_fragmentation(), 0.0);
+    EXPECT_TRUE(allocator.allocate(1024 * 1024).has_value());
+}
+
+TEST(nengine_test, staging_ring_wraps_and_retires_batches)
+{
+    staging_ring ring(1024);
+
+    std::optional<uint64_t> first = ring.allocate(400);
+    std::optional<uint64_t> second = ring.allocate(300, 256);
+    ASSERT_TRUE(first.has_value() && second.has_value());
+    EXPECT_EQ(*first, 0u);
+    EXPECT_EQ(*second, 512u);
+    ring.close_batch(1);
+
+    // the 212 bytes left at the end are too few, wrapping needs the space of batch 1.
+    EXPECT_FALSE(ring.allocate(300).has_value());
+    ring.retire(0);
+    EXPECT_FALSE(ring.allocate(300).has_value());
+
+    ring.retire(1);
+    EXPECT_EQ(ring.get_used_bytes(), 0u);
+    std::optional<uint64_t> third = ring.allocate(600);
+    std::optional<uint64_t> fourth = ring.allocate(350);
+    ASSERT_TRUE(third.has_value() && fourth.has_value());
+    EXPECT_EQ(*third, 0u);
+    EXPECT_EQ(*fourth, 600u);
+    ring.close_batch(2);
+
+    // 100 bytes no longer fit before the end, wrapping around needs the space batch 2 still holds.
+    std::optional<uint64_t> fifth = ring.allocate(100);
+    EXPECT_FALSE(fifth.has_value());
+    ring.retire(2);
+    fifth = ring.allocate(100);
+    ASSERT_TRUE(fifth.has_value());
+    EXPECT_EQ(*fifth, 0u);
+    ring.close_batch(3);
+    ring.retire(3);
+    EXPECT_EQ(ring.get_used_bytes(), 0u);
+}
+
+TEST(nengine_test, job_thread_storage_gives_each_recording_thread_its_own_value)
+{
+    // what parallel command recording relies on: no two threads ever use the same value, so pools need no lock.
+    struct recording_lane
+    {
+        std::atomic<bool> in_use = false;
+        uint32_t jobs_recorded = 0;
+        std::thread::id recording_thread;
+    };
+
+    job_system jobs;
+    jobs.start(3);
+    job_thread_storage<recording_lane> lanes(jobs);
+    EXPECT_EQ(lanes.size(), jobs.get_thread_count() + 1);
+
+    std::atomic<uint32_t> shared_lanes = 0;
+    auto record = [&](uint32_t)
+    {
+        recording_lane& lane = lanes.local();
+        if (lane.in_use.exchange(true, std::memory_order_acquire)
+            || (lane.jobs_recorded > 0 && lane.recording_thread != std::this_thread::get_id()))
+        {
+            shared_lanes.fetch_add(1, std::memory_order_relaxed);
+        }
+        lane.recording_thread = std::this_thread::get_id();
+        ++lane.jobs_recorded;
+        std::this_thread::yield();
+        lane.in_use.store(false, std::memory_order_release);
+    };
+
+    // from the main thread, then from a render thread the job system does not know, which gets the external value.
+    jobs.parallel_for(2000, 1, record);
+    EXPECT_EQ(lanes.get_external().jobs_recorded, 0u);
+    std::thread render_thread([&]() { jobs.parallel_for(2000, 1, record); });
+    render_thread.join();
+    EXPECT_GT(lanes.get_external().jobs_recorded, 0u);
+    jobs.stop();
+
+    EXPECT_EQ(shared_lanes.load(), 0u);
+    uint32_t jobs_recorded = 0;
+    for (const recording_lane& lane : lanes)
+    {
+        jobs_recorded += lane.jobs_recorded;
+    }
+    EXPECT_EQ(jobs_recorded, 4000u);
+}
+
+TEST(nengine_test, render_graph_culls_orders_and_aliases_transients)
+{
+    render_graph graph;
+    const render_graph_texture_description description{256, 256, 0};
+    render_graph_resource backbuffer = graph.import_texture("Backbuffer", description, RENDER_GRAPH_ACCESS_PRESENT, RENDER_GRAPH_ACCESS_PRESENT);
+    render_graph_resource gbuffer = graph.create_texture("GBuffer", description);
+    render_graph_resource lighting = graph.create_texture("Lighting", description);
+    render_graph_resource tonemapped = graph.create_texture("Tonemapped", description);
+    render_graph_resource debug = graph.create_texture("Debug", description);
+
+    std::vector<std::string> executed;
+    auto record = [&executed](const std::string& pass_name) { return [&executed, pass_name](void*) { executed.push_back(pass_name); }; };
+
+    render_graph_pass geometry_pass = graph.add_pass("Geometry", record("Geometry"));
+    graph.write(geometry_pass, gbuffer, RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT_WRITE);
+    render_graph_pass lighting_pass = graph.add_pass("Lighting", record("Lighting"));
+    graph.read(lighting_pass, gbuffer, RENDER_GRAPH_ACCESS_SHADER_READ);
+    graph.write(lighting_pass, lighting, RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT_WRITE);
+    // nothing consumes the debug view, so the pass is culled.
+    render_graph_pass debug_pass = graph.add_pass("Debug", record("Debug"));
+    graph.read(debug_pass, gbuffer, RENDER_GRAPH_ACCESS_SHADER_READ);
+    graph.write(debug_pass, debug, RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT_WRITE);
+    render_graph_pass tonemap_pass = graph.add_pass("Tonemap", record("Tonemap"));
+    graph.read(tonemap_pass, lighting, RENDER_GRAPH_ACCESS_SHADER_READ);
+    graph.write(tonemap_pass, tonemapped, RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT_WRITE);
+    render_graph_pass composite_pass = graph.add_pass("Composite", record("Composite"));
+    graph.read(composite_pass, tonemapped, RENDER_GRAPH_ACCESS_SHADER_READ);
+    graph.write(composite_pass, backbuffer, RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT_WRITE);
+
+    graph.compile([](render_graph_resource, const render_graph_resource_info& info)
+    {
+        return render_graph_memory_requirements{uint64_t(info.description.width) * info.description.height * 4, 4096, ~0u};
+    });
+
+    EXPECT_TRUE(graph.is_pass_culled(debug_pass));
+    EXPECT_FALSE(graph.get_resource(debug).live);
+    ASSERT_EQ(graph.get_levels().size(), 4u);
+
+    // the gbuffer is dead by the time tonemapped is written, so the two share memory.
+    EXPECT_EQ(graph.get_resource(gbuffer).memory_slot, graph.get_resource(tonemapped).memory_slot);
+    EXPECT_NE(graph.get_resource(gbuffer).memory_slot, graph.get_resource(lighting).memory_slot);
+    EXPECT_EQ(graph.get_memory_slots().size(), 2u);
+    EXPECT_EQ(graph.get_unaliased_memory_bytes(), 3u * 256u * 256u * 4u);
+    EXPECT_EQ(graph.get_aliased_memory_bytes(), 2u * 256u * 256u * 4u);
+
+    std::vector<render_graph_barrier> barriers;
+    graph.execute(nullptr, [&barriers](void*, const render_graph_barrier* level_barriers, size_t count)
+    {
+        barriers.insert(barriers.end(), level_barriers, level_barriers + count);
+    });
+    EXPECT_EQ(executed, (std::vector<std::string>{"Geometry", "Lighting", "Tonemap", "Composite"}));
+    EXPECT_EQ(barriers.size(), graph.get_barrier_count());
+    ASSERT_EQ(barriers.size(), 8u);
+
+    // first use of aliased memory discards whatever the other resource left there.
+    EXPECT_EQ(barriers[0].resource, gbuffer);
+    EXPECT_TRUE(barriers[0].discard);
+    EXPECT_EQ(barriers[0].before, RENDER_GRAPH_ACCESS_SHADER_READ);
+    EXPECT_EQ(barriers.back().resource, backbuffer);
+    EXPECT_EQ(barriers.back().before, RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT_WRITE);
+    EXPECT_EQ(barriers.back().after, RENDER_GRAPH_ACCESS_PRESENT);
+}
+
+TEST(nengine_test, render_graph_skips_barriers_between_equal_reads)
+{
+    render_graph graph;
+    const render_graph_texture_description description{64, 64, 0};
+    render_graph_resource shadow_map = graph.import_texture("ShadowMap", description, RENDER_GRAPH_ACCESS_SHADER_READ, RENDER_GRAPH_ACCESS_SHADER_READ, true);
+    render_graph_resource first_target = graph.import_texture("First", description, RENDER_GRAPH_ACCESS_NONE, RENDER_GRAPH_ACCESS_SHADER_READ);
+    render_graph_resource second_target = graph.import_texture("Second", description, RENDER_GRAPH_ACCESS_NONE, RENDER_GRAPH_ACCESS_SHADER_READ);
+
+    render_graph_pass first = graph.add_pass("First", nullptr);
+    graph.read(first, shadow_map, RENDER_GRAPH_ACCESS_SHADER_READ);
+    graph.write(first, first_target, RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT_WRITE);
+    render_graph_pass second = graph.add_pass("Second", nullptr);
+    graph.read(second, shadow_map, RENDER_GRAPH_ACCESS_SHADER_READ);
+    graph.write(second, second_target, RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT_WRITE);
+    EXPECT_THROW(graph.read(second, shadow_map, RENDER_GRAPH_ACCESS_SHADER_READ), std::invalid_argument);
+    // accesses must match the call declaring them.
+    EXPECT_THROW(graph.read(first, second_target, RENDER_GRAPH_ACCESS_STORAGE_WRITE), std::invalid_argument);
+    EXPECT_THROW(graph.write(first, second_target, RENDER_GRAPH_ACCESS_SHADER_READ), std::invalid_argument);
+    EXPECT_THROW(graph.write(first, second_target, RENDER_GRAPH_ACCESS_PRESENT), std::invalid_argument);
+    EXPECT_THROW(graph.read(first, second_target, static_cast<render_graph_access>(RENDER_GRAPH_ACCESS_SHADER_READ | RENDER_GRAPH_ACCESS_TRANSFER_READ)), std::invalid_argument);
+
+    graph.compile([](render_graph_resource, const render_graph_resource_info&) { return render_graph_memory_requirements{}; });
+
+    // both passes only read the shadow map, so they run in one level and it never transitions.
+    ASSERT_EQ(graph.get_levels().size(), 1u);
+    EXPECT_EQ(graph.get_levels()[0].size(), 2u);
+    EXPECT_EQ(graph.get_barrier_count(), 4u);
+    EXPECT_TRUE(graph.get_memory_slots().empty());
+}
+
+TEST(nengine_test, view_frustum_culls_spheres_like_the_cull_pass)
+{
+    // a 90 degree, square perspective looking down -z with depth mapped to [0, 1], near 0.1 and far 100.
+    const float near_plane = 0.1f;
+    const float far_plane = 100.0f;
+    glm::mat4 view_projection(0.0f);
+    view_projection[0][0] = 1.0f;
+    view_projection[1][1] = 1.0f;
+    view_projection[2][2] = far_plane / (near_plane - far_plane);
+    view_projection[2][3] = -1.0f;
+    view_projection[3][2] = near_plane * far_plane / (near_plane - far_plane);
+    const view_frustum frustum = view_frustum_from_view_projection(view_projection);
+
+    auto at = [](float x, float y, float z)
+    {
+        glm::mat4 transform(1.0f);
+        transform[3] = glm::vec4(x, y, z, 1.0f);
+        return transform;
+    };
+    const glm::vec4 unit_sphere(0.0f, 0.0f, 0.0f, 1.0f);
+
+    // 5 units ahead the frustum is 5 units wide to each side. A sphere overlapping a plane stays.
+    EXPECT_TRUE(view_frustum_intersects_sphere(frustum, at(0.0f, 0.0f, -5.0f), unit_sphere));
+    EXPECT_TRUE(view_frustum_intersects_sphere(frustum, at(5.5f, 0.0f, -5.0f), unit_sphere));
+    EXPECT_FALSE(view_frustum_intersects_sphere(frustum, at(7.0f, 0.0f, -5.0f), unit_sphere));
+    EXPECT_FALSE(view_frustum_intersects_sphere(frustum, at(0.0f, -7.0f, -5.0f), unit_sphere));
+    EXPECT_FALSE(view_frustum_intersects_sphere(frustum, at(0.0f, 0.0f, 5.0f), unit_sphere));
+    EXPECT_FALSE(view_frustum_intersects_sphere(frustum, at(0.0f, 0.0f, -200.0f), unit_sphere));
+
+    // the bounds are in object space, and the radius grows with the largest axis scale.
+    glm::mat4 stretched = at(7.0f, 0.0f, -5.0f);
+    stretched[1][1] = 3.0f;
+    EXPECT_FALSE(view_frustum_intersects_sphere(frustum, stretched, glm::vec4(0.0f, 0.0f, 0.0f, 0.4f)));
+    EXPECT_TRUE(view_frustum_intersects_sphere(frustum, stretched, glm::vec4(0.0f, 0.0f, 0.0f, 0.5f)));
+    EXPECT_TRUE(view_frustum_intersects_sphere(frustum, at(7.0f, 0.0f, -5.0f), glm::vec4(-2.0f, 0.0f, 0.0f, 0.1f)));
+}
+
+TEST(nengine_test, render_command_queue_keeps_each_producers_order)
+{
+    render_command_queue queue(6);
+    EXPECT_EQ(queue.get_capacity(), 8u);
+
+    render_command command;
+    for (uint32_t i = 0; i < queue.get_capacity(); ++i)
+    {
+        EXPECT_TRUE(queue.try_push(command));
+    }
+    EXPECT_FALSE(queue.try_push(command));
+    for (uint32_t i = 0; i < queue.get_capacity(); ++i)
+    {
+        EXPECT_TRUE(queue.try_pop(command));
+    }
+    EXPECT_FALSE(queue.try_pop(command));
+
+    // producers keep running into a full queue, each tags its commands with its index and a running count.
+    const uint32_t producer_count = 4;
+    const uint32_t commands_per_producer = 20000;
+    std::vector<std::thread> producers;
+    for (uint32_t producer = 0; producer < producer_count; ++producer)
+    {
+        producers.emplace_back([&queue, producer]()
+        {
+            for (uint32_t i = 0; i < commands_per_producer; ++i)
+            {
+                render_command produced;
+                produced.type = RENDER_COMMAND_SET_VIEW_PROJECTION;
+                produced.matrix[0][0] = static_cast<float>(i);
+                produced.matrix[0][1] = static_cast<float>(producer);
+                queue.push(produced);
+            }
+        });
+    }
+
+    std::vector<uint32_t> next_expected(producer_count, 0);
+    for (uint32_t popped = 0; popped < producer_count * commands_per_producer;)
+    {
+        render_command consumed;
+        queue.pop(consumed);
+        const uint32_t producer = static_cast<uint32_t>(consumed.matrix[0][1]);
+        ASSERT_EQ(consumed.type, RENDER_COMMAND_SET_VIEW_PROJECTION);
+        ASSERT_LT(producer, producer_count);
+        ASSERT_EQ(static_cast<uint32_t>(consumed.matrix[0][0]), next_expected[producer]);
+        next_expected[producer]++;
+        popped++;
+    }
+
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+    EXPECT_FALSE(queue.try_pop(command));
+}
+
+TEST(nengine_test, nengine_latency_modes_override_frame_settings)
+{
+    nengine_config config;
+    config.frames_in_flight = 5;
+    EXPECT_EQ(nengine(config).get_config().frames_in_flight, 5u);
+
+    config.latency_mode = NENGINE_LATENCY_MODE_LOW_LATENCY;
+    nengine low_latency(config);
+    EXPECT_EQ(low_latency.get_config().frames_in_flight, 1u);
+    EXPECT_EQ(low_latency.get_config().present_mode, NENGINE_PRESENT_MODE_MAILBOX);
+    EXPECT_EQ(low_latency.get_config().frame_wait, NENGINE_FRAME_WAIT_GPU_IDLE);
+
+    config.latency_mode = NENGINE_LATENCY_MODE_MAX_THROUGHPUT;
+    nengine_apply_latency_mode(config);
+    EXPECT_EQ(config.frames_in_flight, 3u);
+    EXPECT_GT(config.swap_chain_image_count, config.frames_in_flight);
+    EXPECT_EQ(config.frame_wait, NENGINE_FRAME_WAIT_PIPELINED);
+}
+
+TEST(nengine_test, descriptor_slots_reuse_freed_slots_once_retired)
+{
+    descriptor_slot_allocator slots(3);
+    EXPECT_EQ(slots.allocate(), 0u);
+    EXPECT_EQ(slots.allocate(), 1u);
+    EXPECT_EQ(slots.allocate(), 2u);
+    EXPECT_FALSE(slots.allocate().has_value());
+
+    // frames up to 5 may still read slot 1, frames up to 7 slot 0.
+    slots.free(1, 5);
+    slots.free(0, 7);
+    EXPECT_THROW(slots.free(1, 8), std::invalid_argument);
+    EXPECT_EQ(slots.get_used_count(), 3u);
+
+    slots.retire(4);
+    EXPECT_FALSE(slots.allocate().has_value());
+    slots.retire(7);
+    EXPECT_EQ(slots.get_used_count(), 1u);
+    EXPECT_EQ(slots.allocate(), 0u);
+    EXPECT_EQ(slots.allocate(), 1u);
+    EXPECT_FALSE(slots.allocate().has_value());
+}
+
+TEST(nengine_test, file_watcher_reports_changed_watched_files_once)
+{
+    const test_temp_directory temp_directory("file-watcher");
+    const std::filesystem::path& directory = temp_directory.path;
+    const std::filesystem::path watched = directory / "watched.vert";
+    const std::filesystem::path unwatched = directory / "unwatched.vert";
+    std::ofstream(watched) << "original";
+    std::ofstream(unwatched) << "original";
+
+    file_watcher watcher;
+    watcher.watch(watched);
+    EXPECT_TRUE(watcher.poll().empty());
+
+    // replaced by rename, the way many editors save, and the other file written in place.
+    std::ofstream(directory / "watched.vert.tmp") << "edited";
+    std::filesystem::rename(directory / "watched.vert.tmp", watched);
+    std::ofstream(unwatched) << "edited";
+
+    // file times can be coarse where changes are polled for rather than notified.
+    std::vector<std::filesystem::path> changed;
+    for (int attempt = 0; attempt < 100 && changed.empty(); ++attempt)
+    {
+        changed = watcher.poll();
+        if (changed.empty())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    ASSERT_EQ(changed.size(), 1u);
+    EXPECT_EQ(changed[0], watched);
+    EXPECT_TRUE(watcher.poll().empty());
+}
+
+TEST(nengine_test, shader_includes_list_every_included_file_once)
+{
+    const test_temp_directory temp_directory("shader-include-list");
+    const std::filesystem::path& directory = temp_directory.path;
+    std::ofstream(directory / "lighting.glsl") << "#include \"constants.glsl\"\n";
+    std::ofstream(directory / "shadows.glsl") << "#include \"constants.glsl\"\n";
+    std::ofstream(directory / "constants.glsl") << "#define SCALE 1.0\n";
+
+    // what the shader reload thread watches, so editing any of them recompiles the shader.
+    shader_include_cache include_cache;
+    const std::string source = "#version 450\n#include \"lighting.glsl\"\n#include \"shadows.glsl\"\n#include \"missing.glsl\"\n";
+    std::vector<std::shared_ptr<const shader_include_file>> includes = include_cache.find_includes(source, directory / "shader.frag", {});
+    std::vector<std::string> names;
+    for (const auto& include : includes)
+    {
+        names.push_back(include->path.filename().string());
+    }
+    std::sort(names.begin(), names.end());
+    EXPECT_EQ(names, (std::vector<std::string>{"constants.glsl", "lighting.glsl", "shadows.glsl"}));
+    EXPECT_TRUE(include_cache.find_includes("#version 450\n", directory / "shader.frag", {}).empty());
+}
+
+TEST(nengine_test, shader_includes_are_read_once_and_keyed_by_contents)
+{
+    const test_temp_directory temp_directory("shader-includes");
+    const std::filesystem::path& directory = temp_directory.path;
+    std::filesystem::create_directories(directory / "common");
+    std::ofstream(directory / "common" / "lighting.glsl") << "#include \"constants.glsl\"\nvec3 light() { return vec3(SCALE); }\n";
+    std::ofstream(directory / "common" / "constants.glsl") << "#define SCALE 1.0\n";
+
+    shader_compiler::set_cache(nullptr);
+    std::shared_ptr<shader_include_cache> include_cache = shader_compiler::get_include_cache();
+    const uint64_t reads_before = include_cache->get_read_count();
+
+    std::vector<shader_compile_config> configs(4);
+    for (auto& config : configs)
+    {
+        config.shader_kind = shaderc_glsl_fragment_shader;
+        config.shader_code = "#version 450\n#include <lighting.glsl>\nvoid main() {}\n";
+        config.input_file_name = (directory / "shader.frag").string();
+        config.include_directories = {directory / "common"};
+    }
+    std::vector<shader_compile_result> results = shader_compiler::compile_batch(configs, 4);
+    for (const auto& result : results)
+    {
+        ASSERT_TRUE(result.succeeded()) << result.error;
+    }
+    EXPECT_EQ(include_cache->get_read_count() - reads_before, 2u);
+
+    // unchanged includes are served from memory, an edited one is read again and changes the cache key.
+    const shader_cache_key key_before = shader_compiler::make_cache_key(configs[0]);
+    EXPECT_NE(key_before.include_hash, 0u);
+    EXPECT_EQ(include_cache->get_read_count() - reads_before, 2u);
+    std::ofstream(directory / "common" / "constants.glsl") << "#define SCALE 2.0 // brighter\n";
+    EXPECT_NE(shader_compiler::make_cache_key(configs[0]).include_hash, key_before.include_hash);
+    EXPECT_EQ(include_cache->get_read_count() - reads_before, 3u);
+
+    configs[0].include_directories.clear();
+    EXPECT_FALSE(shader_compiler::compile_batch(configs, 1)[0].succeeded());
+}
+
+TEST(nengine_test, shader_permutations_share_identical_modules)
+{
+    shader_compiler::set_cache(nullptr);
+
+    shader_compile_config base;
+    base.shader_kind = shaderc_glsl_vertex_shader;
+    base.shader_code = "#version 450\nvoid main() {\n#ifdef USE_OFFSET\n gl_Position = vec4(1.0);\n#endif\n}\n";
+
+    // UNUSED_FEATURE is never referenced, masks differing only in it compile to the same module.
+    const std::vector<std::string> feature_macros = {"USE_OFFSET", "UNUSED_FEATURE"};
+    const std::vector<uint32_t> feature_masks = {0, 1, 2, 3};
+    shader_permutation_result permutations = shader_compiler::compile_permutations(base, feature_macros, feature_masks, 2);
+    ASSERT_TRUE(permutations.succeeded()) << permutations.error;
+    ASSERT_EQ(permutations.modules.size(), 2u);
+    EXPECT_EQ(permutations.module_indices, (std::vector<uint32_t>{0, 1, 0, 1}));
+    EXPECT_NE(permutations.get_module(0), permutations.get_module(1));
+
+    // each permutation is its own cache entry.
+    shader_compile_config with_feature = base;
+    with_feature.definitions["USE_OFFSET"] = "1";
+    EXPECT_NE(shader_compiler::make_cache_key(base).compile_options, shader_compiler::make_cache_key(with_feature).compile_options);
+}
+
+TEST(nengine_test, mesh_file_maps_aligned_streams_and_rejects_damaged_files)
+{
+    const test_temp_directory temp_directory("mesh-file");
+    const std::filesystem::path& directory = temp_directory.path;
+    const std::filesystem::path path = directory / "quad.nmesh";
+
+    // 20 byte vertices, an odd stride so the index stream needs padding to stay aligned.
+    const std::vector<float> vertices = {   0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+                                            1.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+                                            1.0f, 1.0f, 0.0f, 0.0f, 1.0f};
+    const std::vector<uint32_t> indices = {0, 1, 2, 2, 1, 0};
+    const std::vector<mesh_file_submesh> submeshes = {  {0, 3, 0, 0, {0.5f, 0.5f, 0.0f, 0.75f}},
+                                                        {3, 3, 0, 0, {0.5f, 0.5f, 0.0f, 0.75f}}};
+    ASSERT_TRUE(mesh_file::write(path, 20, vertices.data(), 3, indices.data(), static_cast<uint32_t>(indices.size()), submeshes));
+
+    {
+        mesh_file mesh(path);
+        EXPECT_EQ(mesh.get_header().vertex_count, 3u);
+        EXPECT_EQ(mesh.get_header().submesh_count, 2u);
+        EXPECT_EQ(mesh.get_vertex_data_size(), vertices.size() * sizeof(float));
+        EXPECT_EQ(std::memcmp(mesh.get_vertex_data(), vertices.data(), mesh.get_vertex_data_size()), 0);
+        EXPECT_EQ(std::vector<uint32_t>(mesh.get_indices(), mesh.get_indices() + indices.size()), indices);
+        EXPECT_EQ(mesh.get_submeshes()[1].first_index, 3u);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(mesh.get_indices()) % MESH_FILE_ALIGNMENT, 0u);
+
+        // rewriting the file replaces it, the open mesh keeps its own mapping.
+        ASSERT_TRUE(mesh_file::write(path, 20, vertices.data(), 3, indices.data(), 3, {submeshes[0]}));
+        EXPECT_EQ(mesh.get_header().submesh_count, 2u);
+        EXPECT_EQ(mesh_file(path).get_header().submesh_count, 1u);
+    }
+
+    // a truncated file and a submesh past the end of the index stream are both rejected.
+    const uintmax_t file_size = std::filesystem::file_size(path);
+    std::filesystem::resize_file(path, file_size - 4);
+    EXPECT_THROW(mesh_file mesh(path), std::runtime_error);
+
+    const std::vector<mesh_file_submesh> out_of_range = {{4, 3, 0, 0, {0.0f, 0.0f, 0.0f, 1.0f}}};
+    ASSERT_TRUE(mesh_file::write(path, 20, vertices.data(), 3, indices.data(), static_cast<uint32_t>(indices.size()), out_of_range));
+    EXPECT_THROW(mesh_file mesh(path), std::runtime_error);
+
+    // so are submeshes whose offset indices land before or past the vertex stream.
+    for (const int32_t vertex_offset : {1, -1})
+    {
+        const std::vector<mesh_file_submesh> offset_out_of_range = {{0, 3, vertex_offset, 0, {0.0f, 0.0f, 0.0f, 1.0f}}};
+        ASSERT_TRUE(mesh_file::write(path, 20, vertices.data(), 3, indices.data(), static_cast<uint32_t>(indices.size()), offset_out_of_range));
+        EXPECT_THROW(mesh_file mesh(path), std::runtime_error);
+    }
+    const std::vector<uint32_t> index_out_of_range = {0, 1, 3};
+    ASSERT_TRUE(mesh_file::write(path, 20, vertices.data(), 3, index_out_of_range.data(), 3, {{0, 3, 0, 0, {0.0f, 0.0f, 0.0f, 1.0f}}}));
+    EXPECT_THROW(mesh_file mesh(path), std::runtime_error);
+}
+
+TEST(nengine_test, async_io_reads_batches_ranges_and_reports_failures)
+{
+    const test_temp_directory temp_directory("async-io");
+    const std::filesystem::path& directory = temp_directory.path;
+
+    std::vector<std::filesystem::path> small_paths;
+    for (int i = 0; i < 100; ++i)
+    {
+        small_paths.push_back(directory / ("small-" + std::to_string(i) + ".bin"));
+        std::ofstream(small_paths.back(), std::ios::binary) << "file " << i;
+    }
+    // larger than a registered buffer, read straight into the result.
+    std::string large_contents(3 * ASYNC_IO_REGISTERED_BUFFER_SIZE + 17, '\0');
+    for (size_t i = 0; i < large_contents.size(); ++i)
+    {
+        large_contents[i] = static_cast<char>(i * 31 % 251);
+    }
+    const std::filesystem::path large_path = directory / "large.bin";
+    std::ofstream(large_path, std::ios::binary) << large_contents;
+
+    // the ring and the thread pool behave the same, where io_uring is missing both runs use the pool.
+    for (const bool use_io_uring : {true, false})
+    {
+        std::atomic<uint32_t> callback_count = 0;
+        std::vector<std::future<async_io_result>> small_reads;
+        std::future<async_io_result> large_read;
+        std::future<async_io_result> missing_read;
+        {
+            async_io_service service(8, use_io_uring);
+            if (!use_io_uring)
+            {
+                EXPECT_FALSE(service.is_using_io_uring());
+            }
+
+            small_reads = service.read_batch(small_paths);
+            large_read = service.read(large_path, ASYNC_IO_PRIORITY_STREAMING);
+            missing_read = service.read(directory / "missing.bin", ASYNC_IO_PRIORITY_STREAMING);
+
+            async_io_request range;
+            range.path = large_path;
+            range.offset = ASYNC_IO_REGISTERED_BUFFER_SIZE - 3;
+            range.size = 6;
+            range.on_complete = [&callback_count, &large_contents](async_io_result& result)
+            {
+                EXPECT_TRUE(result.succeeded()) << result.error;
+                EXPECT_EQ(std::string(result.data.begin(), result.data.end()), large_contents.substr(ASYNC_IO_REGISTERED_BUFFER_SIZE - 3, 6));
+                callback_count.fetch_add(1);
+            };
+            async_io_request past_end = range;
+            past_end.offset = large_contents.size() - 2;
+            past_end.on_complete = [&callback_count](async_io_result& result)
+            {
+                EXPECT_FALSE(result.succeeded());
+                callback_count.fetch_add(1);
+            };
+            service.submit({range, past_end});
+            // leaving the scope waits for every read.
+        }
+
+        EXPECT_EQ(callback_count.load(), 2u);
+        for (size_t i = 0; i < small_reads.size(); ++i)
+        {
+            async_io_result result = small_reads[i].get();
+            ASSERT_TRUE(result.succeeded()) << result.error;
+            EXPECT_EQ(result.path, small_paths[i]);
+            EXPECT_EQ(std::string(result.data.begin(), result.data.end()), "file " + std::to_string(i));
+        }
+        async_io_result large = large_read.get();
+        ASSERT_TRUE(large.succeeded()) << large.error;
+        EXPECT_TRUE(std::string(large.data.begin(), large.data.end()) == large_contents);
+        async_io_result missing = missing_read.get();
+        EXPECT_FALSE(missing.succeeded());
+        EXPECT_TRUE(missing.data.empty());
+    }
+}
+
+TEST(nengine_test, pak_file_round_trips_files_across_compressed_blocks)
+{
+    const test_temp_directory temp_directory("pak-file");
+    const std::filesystem::path& directory = temp_directory.path;
+    const std::filesystem::path path = directory / "assets.pak";
+
+    // a small file, one spanning several compressible blocks, one that does not compress and an empty one.
+    std::vector<pak_file_input> files(4);
+    files[0].name = "shaders/basic.vert";
+    const std::string source = "#version 450\nvoid main() {}\n";
+    files[0].data.assign(source.begin(), source.end());
+    files[1].name = "meshes/../meshes/large.bin";
+    for (uint32_t i = 0; i < 3 * PAK_FILE_BLOCK_SIZE + 1000; ++i)
+    {
+        files[1].data.push_back(static_cast<uint8_t>((i / 7) % 13 + i % 3));
+    }
+    files[2].name = "noise.bin";
+    uint32_t state = 1;
+    for (uint32_t i = 0; i < PAK_FILE_BLOCK_SIZE; ++i)
+    {
+        state = state * 1664525u + 1013904223u;
+        files[2].data.push_back(static_cast<uint8_t>(state >> 24));
+    }
+    files[3].name = "empty.txt";
+    job_system jobs;
+    jobs.start(3);
+    ASSERT_TRUE(pak_file::write(path, files, jobs));
+    EXPECT_LT(std::filesystem::file_size(path), files[1].data.size() / 2 + files[2].data.size());
+
+    {
+        pak_file archive(path);
+        EXPECT_EQ(archive.get_header().entry_count, 4u);
+        EXPECT_EQ(archive.find("shaders/basic.frag"), nullptr);
+
+        const pak_file_entry* small = archive.find("shaders/basic.vert");
+        ASSERT_NE(small, nullptr);
+        EXPECT_EQ(archive.get_name(*small), "shaders/basic.vert");
+        EXPECT_EQ(archive.read(*small), files[0].data);
+
+        // names are normalized on write, the large file is read back on the job system and on this thread.
+        const pak_file_entry* large = archive.find("meshes/large.bin");
+        ASSERT_NE(large, nullptr);
+        EXPECT_EQ(archive.read(*large, jobs), files[1].data);
+        EXPECT_EQ(archive.read(*large), files[1].data);
+        EXPECT_EQ(archive.read(*archive.find("noise.bin"), jobs), files[2].data);
+        EXPECT_TRUE(archive.read(*archive.find("empty.txt")).empty());
+    }
+
+    // a compressed block of the large file whose payload is overwritten fails to decompress instead of returning
+    // garbage. 0xff bytes are literal lengths that run past the end of the block.
+    uint64_t damaged_offset = 0;
+    uint32_t damaged_size = 0;
+    {
+        pak_file archive(path);
+        const pak_file_entry* large = archive.find("meshes/large.bin");
+        const pak_file_block& block = archive.get_blocks()[large->data_offset / PAK_FILE_BLOCK_SIZE + 1];
+        ASSERT_LT(block.compressed_size, block.uncompressed_size);
+        damaged_offset = block.offset;
+        damaged_size = block.compressed_size;
+    }
+    {
+        std::fstream file_out(path, std::ios::binary | std::ios::in | std::ios::out);
+        file_out.seekp(static_cast<std::streamoff>(damaged_offset));
+        const std::vector<char> damage(damaged_size, static_cast<char>(0xff));
+        file_out.write(damage.data(), static_cast<std::streamsize>(damage.size()));
+    }
+    {
+        pak_file archive(path);
+        EXPECT_THROW(archive.read(*archive.find("meshes/large.bin")), std::runtime_error);
+        EXPECT_THROW(archive.read(*archive.find("meshes/large.bin"), jobs), std::runtime_error);
+        EXPECT_EQ(archive.read(*archive.find("noise.bin")), files[2].data);
+    }
+
+    // a truncated archive is rejected, and so is a name packed twice.
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+    EXPECT_THROW(pak_file archive(path), std::runtime_error);
+    files[3].name = "./noise.bin";
+    EXPECT_FALSE(pak_file::write(path, files));
+
+    jobs.stop();
+}
+
+TEST(nengine_test, transform_hierarchy_propagates_only_changed_subtrees)
+{
+    // a level wide enough to be split into chunks, then transforms under random earlier ones, out of depth order.
+    transform_hierarchy transforms;
+    std::vector<transform_id> ids;
+    std::vector<glm::mat4> locals;
+    for (uint32_t i = 0; i < 4 * TRANSFORM_PARALLEL_CHUNK_SIZE; ++i)
+    {
+        const transform_id parent = i < 4 ? TRANSFORM_NONE : i < 3 * TRANSFORM_PARALLEL_CHUNK_SIZE ? ids[i % 4] : ids[(i * 2654435761u) % i];
+        glm::mat4 local(1.0f);
+        local[0][1] = 0.001f * static_cast<float>(i % 13);
+        local[3] = glm::vec4(static_cast<float>(i % 5), 1.0f, -2.0f, 1.0f);
+        ids.push_back(transforms.create(parent, local));
+        locals.push_back(local);
+    }
+
+    auto expected_world = [&](size_t i)
+    {
+        glm::mat4 world = locals[i];
+        for (transform_id parent = transforms.get_parent(ids[i]); parent != TRANSFORM_NONE; parent = transforms.get_parent(parent))
+        {
+            world = transforms.get_local(parent) * world;
+        }
+        return world;
+    };
+    auto expect_worlds = [&]()
+    {
+        for (size_t i = 0; i < ids.size(); i += 97)
+        {
+            const glm::mat4 expected = expected_world(i);
+            const glm::mat4& world = transforms.get_world(ids[i]);
+            for (int column = 0; column < 4; ++column)
+            {
+                for (int row = 0; row < 4; ++row)
+                {
+                    ASSERT_NEAR(world[column][row], expected[column][row], 1e-3f);
+                }
+            }
+        }
+    };
+
+    job_system jobs;
+    jobs.start(4);
+    transforms.update(jobs);
+    EXPECT_EQ(transforms.get_updated_count(), ids.size());
+    expect_worlds();
+
+    // nothing changed, nothing is recomputed.
+    transforms.update(jobs);
+    EXPECT_EQ(transforms.get_updated_count(), 0u);
+
+    // moving a leaf recomputes only the leaf, moving a root its whole subtree.
+    glm::mat4 moved(1.0f);
+    moved[3] = glm::vec4(10.0f, 0.0f, 0.0f, 1.0f);
+    transforms.set_local(ids.back(), moved);
+    locals.back() = moved;
+    transforms.update();
+    EXPECT_EQ(transforms.get_updated_count(), 1u);
+    expect_worlds();
+
+    transforms.set_local(ids[0], moved);
+    locals[0] = moved;
+    transforms.update(jobs);
+    EXPECT_GT(transforms.get_updated_count(), 1u);
+    EXPECT_LT(transforms.get_updated_count(), ids.size());
+    expect_worlds();
+
+    // destroying a transform destroys everything below it.
+    const size_t count = transforms.get_count();
+    transforms.destroy(ids[1]);
+    EXPECT_FALSE(transforms.is_alive(ids[1]));
+    EXPECT_LT(transforms.get_count(), count - 1);
+    transforms.update(jobs);
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        if (transforms.is_alive(ids[i]) && transforms.get_parent(ids[i]) != TRANSFORM_NONE)
+        {
+            EXPECT_TRUE(transforms.is_alive(transforms.get_parent(ids[i])));
+        }
+    }
+    EXPECT_THROW(transforms.get_world(ids[1]), std::invalid_argument);
+    jobs.stop();
+}
+
+TEST(nengine_test, transform_hierarchy_simd_matches_scalar_glm)
+{
+    // dense matrices with no zero or unit entries, so every lane and every weight of the multiply is exercised.
+    auto make_local = [](uint32_t seed)
+    {
+        glm::mat4 local;
+        for (int column = 0; column < 4; ++column)
+        {
+            for (int row = 0; row < 4; ++row)
+            {
+                const uint32_t hash = (seed * 16 + static_cast<uint32_t>(column * 4 + row) + 1) * 2654435761u;
+                local[column][row] = static_cast<float>(hash >> 8) / static_cast<float>(1 << 24) - 0.5f;
+            }
+        }
+        return local;
+    };
+
+    // chains of a few levels under each root, the depth at which float error is still well inside the tolerance.
+    transform_hierarchy transforms;
+    std::vector<transform_id> ids;
+    std::vector<glm::mat4> expected;
+    for (uint32_t i = 0; i < 64; ++i)
+    {
+        const bool root = i % 4 == 0;
+        const glm::mat4 local = make_local(i);
+        ids.push_back(transforms.create(root ? TRANSFORM_NONE : ids.back(), local));
+        expected.push_back(root ? local : expected.back() * local);
+    }
+    transforms.update();
+
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        const glm::mat4& world = transforms.get_world(ids[i]);
+        for (int column = 0; column < 4; ++column)
+        {
+            for (int row = 0; row < 4; ++row)
+            {
+                const float reference = expected[i][column][row];
+                ASSERT_NEAR(world[column][row], reference, 1e-5f * std::max(1.0f, std::abs(reference))) << "transform " << i;
+            }
+        }
+    }
+}
+
+TEST(nengine_test, bvh_queries_match_brute_force_through_refits_and_rebuilds)
+{
+    uint32_t state = 1;
+    auto random = [&](float range)
+    {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<float>(state >> 8) / 16777216.0f * range;
+    };
+    auto random_box = [&](float size)
+    {
+        const glm::vec3 minimum(random(1000.0f), random(1000.0f), random(1000.0f));
+        return bvh_aabb{minimum, minimum + glm::vec3(random(size), random(size), random(size))};
+    };
+
+    // enough objects for the build to split into jobs.
+    bvh tree;
+    std::vector<bvh_object_id> ids;
+    std::vector<bvh_aabb> bounds;
+    for (uint32_t i = 0; i < 3 * BVH_PARALLEL_BUILD_SIZE; ++i)
+    {
+        bounds.push_back(random_box(10.0f));
+        ids.push_back(tree.insert(bounds.back()));
+    }
+    std::vector<bool> alive(ids.size(), true);
+
+    std::vector<bvh_aabb> boxes;
+    std::vector<bvh_frustum> frustums;
+    std::vector<bvh_ray> rays;
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+        boxes.push_back(random_box(50.0f));
+        rays.push_back({glm::vec3(random(1000.0f), random(1000.0f), -1.0f), glm::vec3(random(1.0f) - 0.5f, random(1.0f) - 0.5f, 1.0f), 2000.0f});
+    }
+    // an axis aligned ray, which is parallel to two of the slabs.
+    rays.push_back({glm::vec3(-1.0f, bounds[5].minimum.y, bounds[5].minimum.z), glm::vec3(1.0f, 0.0f, 0.0f), 2000.0f});
+    for (uint32_t i = 0; i < 10; ++i)
+    {
+        const bvh_aabb box = random_box(200.0f);
+        frustums.push_back({{glm::vec4(1.0f, 0.0f, 0.0f, -box.minimum.x), glm::vec4(-1.0f, 0.0f, 0.0f, box.maximum.x),
+                             glm::vec4(0.0f, 1.0f, 0.0f, -box.minimum.y), glm::vec4(0.0f, -1.0f, 0.0f, box.maximum.y),
+                             glm::vec4(0.0f, 0.0f, 1.0f, -box.minimum.z), glm::vec4(0.0f, 0.0f, -1.0f, box.maximum.z)}});
+    }
+
+    auto overlaps = [](const bvh_aabb& a, const bvh_aabb& b)
+    {
+        return a.minimum.x <= b.maximum.x && a.maximum.x >= b.minimum.x && a.minimum.y <= b.maximum.y &&
+               a.maximum.y >= b.minimum.y && a.minimum.z <= b.maximum.z && a.maximum.z >= b.minimum.z;
+    };
+    auto ray_distance = [](const bvh_ray& ray, const bvh_aabb& box)
+    {
+        float enter = 0.0f;
+        float leave = ray.max_distance;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (ray.direction[axis] < 1e-6f && ray.direction[axis] > -1e-6f)
+            {
+                if (ray.origin[axis] < box.minimum[axis] || ray.origin[axis] > box.maximum[axis])
+                {
+                    return -1.0f;
+                }
+                continue;
+            }
+            const float a = (box.minimum[axis] - ray.origin[axis]) / ray.direction[axis];
+            const float b = (box.maximum[axis] - ray.origin[axis]) / ray.direction[axis];
+            enter = std::max(enter, std::min(a, b));
+            leave = std::min(leave, std::max(a, b));
+        }
+        return enter <= leave ? enter : -1.0f;
+    };
+    auto expect_results = [&](const bvh_query_results& results, size_t query, const std::function<bool(const bvh_aabb&)>& expected)
+    {
+        std::vector<bvh_object_id> found(results.objects.begin() + static_cast<std::ptrdiff_t>(results.offsets[query]),
+                                         results.objects.begin() + static_cast<std::ptrdiff_t>(results.offsets[query + 1]));
+        std::vector<bvh_object_id> brute_force;
+        for (size_t i = 0; i < ids.size(); ++i)
+        {
+            if (alive[i] && expected(bounds[i]))
+            {
+                brute_force.push_back(ids[i]);
+            }
+        }
+        std::sort(found.begin(), found.end());
+        std::sort(brute_force.begin(), brute_force.end());
+        EXPECT_EQ(found, brute_force);
+    };
+
+    job_system jobs;
+    jobs.start(4);
+    auto expect_queries = [&](bool parallel)
+    {
+        bvh_query_results results;
+        parallel ? tree.overlap(boxes, results, jobs) : tree.overlap(boxes, results);
+        ASSERT_EQ(results.offsets.size(), boxes.size() + 1);
+        for (size_t query = 0; query < boxes.size(); ++query)
+        {
+            expect_results(results, query, [&](const bvh_aabb& box) { return overlaps(box, boxes[query]); });
+        }
+
+        parallel ? tree.cull(frustums, results, jobs) : tree.cull(frustums, results);
+        for (size_t query = 0; query < frustums.size(); ++query)
+        {
+            const glm::vec4* planes = frustums[query].planes;
+            const bvh_aabb inside{glm::vec3(-planes[0].w, -planes[2].w, -planes[4].w), glm::vec3(planes[1].w, planes[3].w, planes[5].w)};
+            expect_results(results, query, [&](const bvh_aabb& box) { return overlaps(box, inside); });
+        }
+
+        std::vector<bvh_ray_hit> hits;
+        parallel ? tree.raycast(rays, hits, jobs) : tree.raycast(rays, hits);
+        ASSERT_EQ(hits.size(), rays.size());
+        for (size_t query = 0; query < rays.size(); ++query)
+        {
+            float nearest = -1.0f;
+            for (size_t i = 0; i < ids.size(); ++i)
+            {
+                const float distance = alive[i] ? ray_distance(rays[query], bounds[i]) : -1.0f;
+                if (distance >= 0.0f && (nearest < 0.0f || distance < nearest))
+                {
+                    nearest = distance;
+                }
+            }
+            ASSERT_EQ(hits[query].object != BVH_NONE, nearest >= 0.0f);
+            if (nearest >= 0.0f)
+            {
+                EXPECT_NEAR(hits[query].distance, nearest, 1e-3f);
+                EXPECT_NEAR(ray_distance(rays[query], tree.get_bounds(hits[query].object)), nearest, 1e-3f);
+            }
+        }
+    };
+
+    // objects inserted before any build are found too, the first update builds the tree.
+    expect_queries(false);
+    tree.update(jobs);
+    EXPECT_EQ(tree.get_build_count(), 1u);
+    EXPECT_LE(tree.get_node_count(), 2 * ids.size() - 1);
+    expect_queries(true);
+
+    // moving objects refits the tree instead of rebuilding it.
+    for (size_t i = 0; i < ids.size(); i += 50)
+    {
+        bounds[i] = random_box(10.0f);
+        tree.move(ids[i], bounds[i]);
+    }
+    tree.update(jobs);
+    EXPECT_EQ(tree.get_build_count(), 1u);
+    expect_queries(true);
+
+    // a few removals and insertions are handled without a rebuild, removed objects are gone right away.
+    for (size_t i = 1; i < ids.size(); i += 100)
+    {
+        tree.remove(ids[i]);
+        alive[i] = false;
+    }
+    EXPECT_THROW(tree.get_bounds(ids[1]), std::invalid_argument);
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+        bounds.push_back(random_box(10.0f));
+        ids.push_back(tree.insert(bounds.back()));
+        alive.push_back(true);
+    }
+    tree.update();
+    EXPECT_EQ(tree.get_build_count(), 1u);
+    EXPECT_EQ(tree.get_object_count(), static_cast<uint32_t>(std::count(alive.begin(), alive.end(), true)));
+    expect_queries(false);
+
+    // a rebuild takes them in, and later updates rebuild once the interval has passed.
+    tree.rebuild(jobs);
+    EXPECT_EQ(tree.get_build_count(), 2u);
+    expect_queries(true);
+    bvh small_tree(3);
+    const bvh_object_id object = small_tree.insert(bounds[0]);
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        small_tree.move(object, bounds[i]);
+        small_tree.update();
+    }
+    EXPECT_EQ(small_tree.get_build_count(), 2u);
+    jobs.stop();
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,67 @@
+#include "../../core/include/nengine-job-system.h"
+#include "../../core/include/nengine-pak-file.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+const std::string applicationName = "nengine-pak";
+
+// Packs files into a pak archive, named by their path relative to the root directory:
+//   nengine-pak <output.pak> <root directory> <files...>
+// Run by the build, see src/app/shaders/shaders.bff.
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << applicationName << " <output.pak> <root directory> <files...>" << std::endl;
+        return 1;
+    }
+
+    const auto start_time = std::chrono::steady_clock::now();
+    const std::filesystem::path output_path = argv[1];
+    const std::filesystem::path root_directory = std::filesystem::absolute(argv[2]);
+
+    std::vector<pak_file_input> files;
+    uint64_t input_size = 0;
+    for (int i = 3; i < argc; ++i)
+    {
+        const std::filesystem::path input_path = std::filesystem::absolute(argv[i]);
+        std::ifstream file_in(input_path, std::ios::binary);
+        if (!file_in.is_open())
+        {
+            std::cerr << applicationName << ": Failed to read " << input_path << std::endl;
+            return 1;
+        }
+
+        pak_file_input file;
+        file.name = input_path.lexically_relative(root_directory).generic_string();
+        if (file.name.empty() || file.name.rfind("..", 0) == 0)
+        {
+            std::cerr << applicationName << ": " << input_path << " is outside of " << root_directory << std::endl;
+            return 1;
+        }
+        file.data.assign(std::istreambuf_iterator<char>(file_in), std::istreambuf_iterator<char>());
+        input_size += file.data.size();
+        files.push_back(std::move(file));
+    }
+
+    // blocks are compressed on every hardware thread.
+    job_system jobs;
+    jobs.start();
+    const bool written = pak_file::write(output_path, files, jobs);
+    jobs.stop();
+    if (!written)
+    {
+        return 1;
+    }
+
+    std::cout   << applicationName << ": Packed " << files.size() << " files, " << input_size << " bytes into "
+                << std::filesystem::file_size(output_path) << " bytes in "
+                << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count() << " ms." << std::endl;
+    return 0;
+}
@@ -1,14 +1,33 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 #define UNUSED(x) (void)(x)
 
 namespace nengine_utils
 {
-    struct version 
+    struct version
     {
         unsigned int variant;
         unsigned int major;
         unsigned int minor;
         unsigned int patch;
     };
+
+    // 64-bit FNV-1a. Stable across platforms and runs, so it is safe to persist.
+    const uint64_t FNV1A_64_OFFSET_BASIS = 0xcbf29ce484222325ull;
+    const uint64_t FNV1A_64_PRIME = 0x100000001b3ull;
+
+    inline uint64_t hash_fnv1a_64(const void* data, size_t size, uint64_t seed = FNV1A_64_OFFSET_BASIS)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        uint64_t hash = seed;
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= FNV1A_64_PRIME;
+        }
+        return hash;
+    }
 }